@@ -0,0 +1,347 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2010  Nokia Corporation
+ *  Copyright (C) 2010  Marcel Holtmann <marcel@holtmann.org>
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdint.h>
+#include <string.h>
+
+#include <bluetooth/bluetooth.h>
+
+#include <glib.h>
+
+#include "lib/uuid.h"
+#include "gattrib.h"
+#include "att.h"
+#include "gatt.h"
+#include "att-database.h"
+
+/*
+ * The request handlers below encode matching attributes straight into the
+ * response PDU and stop as soon as the next entry would not fit into the
+ * MTU, so the remaining attributes are neither read nor copied.
+ */
+
+static bt_uuid_t prim_uuid = {
+			.type = BT_UUID16,
+			.value.u16 = GATT_PRIM_SVC_UUID
+};
+static bt_uuid_t snd_uuid = {
+			.type = BT_UUID16,
+			.value.u16 = GATT_SND_SVC_UUID
+};
+
+uint16_t att_db_read_by_group(GList *database, uint16_t start, uint16_t end,
+					bt_uuid_t *uuid, att_db_read_t func,
+					void *user_data, uint8_t *pdu, size_t len)
+{
+	struct attribute *a = NULL;
+	GList *dl;
+	uint8_t *ptr, *group_end = NULL;
+	uint16_t last_handle, last_size = 0;
+	gboolean full = FALSE;
+	uint8_t status;
+
+	if (start > end || start == 0x0000)
+		return enc_error_resp(ATT_OP_READ_BY_GROUP_REQ, start,
+					ATT_ECODE_INVALID_HANDLE, pdu, len);
+
+	/*
+	 * Only <<Primary Service>> and <<Secondary Service>> grouping
+	 * types may be used in the Read By Group Type Request.
+	 */
+
+	if (bt_uuid_cmp(uuid, &prim_uuid) != 0 &&
+		bt_uuid_cmp(uuid, &snd_uuid) != 0)
+		return enc_error_resp(ATT_OP_READ_BY_GROUP_REQ, 0x0000,
+					ATT_ECODE_UNSUPP_GRP_TYPE, pdu, len);
+
+	pdu[0] = ATT_OP_READ_BY_GROUP_RESP;
+	ptr = &pdu[2];
+
+	last_handle = end;
+	for (dl = database; dl; dl = dl->next) {
+
+		a = dl->data;
+
+		if (a->handle < start)
+			continue;
+
+		if (a->handle >= end)
+			break;
+
+		/* The old group ends when a new one starts */
+		if (group_end && (bt_uuid_cmp(&a->uuid, &prim_uuid) == 0 ||
+				bt_uuid_cmp(&a->uuid, &snd_uuid) == 0)) {
+			att_put_u16(last_handle, group_end);
+			group_end = NULL;
+		}
+
+		if (bt_uuid_cmp(&a->uuid, uuid) != 0) {
+			/* Still inside a service, update its last handle */
+			if (group_end)
+				last_handle = a->handle;
+			continue;
+		}
+
+		if (last_size && (last_size != a->len))
+			break;
+
+		/* Attribute handle, end group handle and value */
+		if (ptr + a->len + 4 > pdu + len) {
+			full = TRUE;
+			break;
+		}
+
+		status = func ? func(a, ATT_OP_READ_BY_GROUP_REQ, user_data) : 0;
+
+		if (status)
+			return enc_error_resp(ATT_OP_READ_BY_GROUP_REQ,
+						a->handle, status, pdu, len);
+
+		/* The callback may have changed the value */
+		if (last_size && last_size != a->len)
+			break;
+
+		if (ptr + a->len + 4 > pdu + len) {
+			full = TRUE;
+			break;
+		}
+
+		/* Attribute Grouping Type found */
+		att_put_u16(a->handle, ptr);
+		group_end = &ptr[2];
+		memcpy(&ptr[4], a->data, a->len);
+		ptr += a->len + 4;
+
+		last_size = a->len;
+		last_handle = a->handle;
+	}
+
+	if (ptr == &pdu[2]) {
+		/* Not even a single group fits into the MTU */
+		if (full)
+			return 0;
+
+		return enc_error_resp(ATT_OP_READ_BY_GROUP_REQ, start,
+					ATT_ECODE_ATTR_NOT_FOUND, pdu, len);
+	}
+
+	if (group_end)
+		att_put_u16(dl == NULL ? a->handle : last_handle, group_end);
+
+	pdu[1] = last_size + 4;
+
+	return ptr - pdu;
+}
+
+uint16_t att_db_read_by_type(GList *database, uint16_t start, uint16_t end,
+					bt_uuid_t *uuid, att_db_read_t func,
+					void *user_data, uint8_t *pdu, size_t len)
+{
+	GList *dl;
+	struct attribute *a;
+	uint16_t num, length;
+	uint8_t *ptr;
+	size_t elen = 0;
+	uint8_t status;
+
+	if (start > end || start == 0x0000)
+		return enc_error_resp(ATT_OP_READ_BY_TYPE_REQ, start,
+					ATT_ECODE_INVALID_HANDLE, pdu, len);
+
+	pdu[0] = ATT_OP_READ_BY_TYPE_RESP;
+	ptr = &pdu[2];
+
+	for (dl = database, length = 0, num = 0; dl; dl = dl->next) {
+
+		a = dl->data;
+
+		if (a->handle < start)
+			continue;
+
+		if (a->handle > end)
+			break;
+
+		if (bt_uuid_cmp(&a->uuid, uuid)  != 0)
+			continue;
+
+		if (num > 0 && ptr + elen > pdu + len)
+			break;
+
+		status = func ? func(a, ATT_OP_READ_BY_TYPE_REQ, user_data) : 0;
+
+		if (status)
+			return enc_error_resp(ATT_OP_READ_BY_TYPE_REQ,
+						a->handle, status, pdu, len);
+
+		/* All elements must have the same length */
+		if (length == 0) {
+			length = a->len;
+
+			/*
+			 * Handle length plus attribute value length, the value
+			 * is truncated to what fits into the MTU and the one
+			 * octet length field.
+			 */
+			elen = MIN(len - 2, (size_t) length + 2);
+			elen = MIN(elen, (size_t) UINT8_MAX);
+			pdu[1] = elen;
+		} else if (a->len != length)
+			break;
+
+		att_put_u16(a->handle, ptr);
+
+		/* Attribute Value */
+		memcpy(&ptr[2], a->data, elen - 2);
+		ptr += elen;
+		num++;
+	}
+
+	if (num == 0)
+		return enc_error_resp(ATT_OP_READ_BY_TYPE_REQ, start,
+					ATT_ECODE_ATTR_NOT_FOUND, pdu, len);
+
+	return ptr - pdu;
+}
+
+uint16_t att_db_find_info(GList *database, uint16_t start, uint16_t end,
+						uint8_t *pdu, size_t len)
+{
+	struct attribute *a;
+	GList *dl;
+	uint8_t *ptr;
+	uint8_t last_type = BT_UUID_UNSPEC;
+	uint16_t length = 0;
+
+	if (start > end || start == 0x0000)
+		return enc_error_resp(ATT_OP_FIND_INFO_REQ, start,
+					ATT_ECODE_INVALID_HANDLE, pdu, len);
+
+	pdu[0] = ATT_OP_FIND_INFO_RESP;
+	ptr = &pdu[2];
+
+	for (dl = database; dl; dl = dl->next) {
+		a = dl->data;
+
+		if (a->handle < start)
+			continue;
+
+		if (a->handle > end)
+			break;
+
+		if (last_type == BT_UUID_UNSPEC) {
+			last_type = a->uuid.type;
+
+			if (last_type == BT_UUID16) {
+				length = 2;
+				pdu[1] = 0x01;
+			} else if (last_type == BT_UUID128) {
+				length = 16;
+				pdu[1] = 0x02;
+			} else
+				return 0;
+		}
+
+		if (a->uuid.type != last_type)
+			break;
+
+		if (ptr + length + 2 > pdu + len)
+			break;
+
+		att_put_u16(a->handle, ptr);
+
+		/* Attribute Value */
+		att_put_uuid(a->uuid, &ptr[2]);
+		ptr += length + 2;
+	}
+
+	if (last_type == BT_UUID_UNSPEC)
+		return enc_error_resp(ATT_OP_FIND_INFO_REQ, start,
+					ATT_ECODE_ATTR_NOT_FOUND, pdu, len);
+
+	if (ptr == &pdu[2])
+		return 0;
+
+	return ptr - pdu;
+}
+
+uint16_t att_db_find_by_type(GList *database, uint16_t start, uint16_t end,
+				bt_uuid_t *uuid, const uint8_t *value,
+				size_t vlen, uint8_t *opdu, size_t mtu)
+{
+	struct attribute *a;
+	GList *dl;
+	uint8_t *ptr, *range_end = NULL;
+
+	if (start > end || start == 0x0000)
+		return enc_error_resp(ATT_OP_FIND_BY_TYPE_REQ, start,
+					ATT_ECODE_INVALID_HANDLE, opdu, mtu);
+
+	opdu[0] = ATT_OP_FIND_BY_TYPE_RESP;
+	ptr = &opdu[1];
+
+	/* Searching first requested handle number */
+	for (dl = database; dl; dl = dl->next) {
+		a = dl->data;
+
+		if (a->handle < start)
+			continue;
+
+		if (a->handle > end)
+			break;
+
+		/* Primary service? Attribute value matches? */
+		if ((bt_uuid_cmp(&a->uuid, uuid) == 0) && (a->len == vlen) &&
+					(memcmp(a->data, value, vlen) == 0)) {
+
+			if (ptr + 4 > opdu + mtu)
+				break;
+
+			/* It is allowed to have end group handle the same as
+			 * start handle, for groups with only one attribute. */
+			att_put_u16(a->handle, ptr);
+			att_put_u16(a->handle, &ptr[2]);
+			range_end = &ptr[2];
+			ptr += 4;
+		} else if (range_end) {
+			/* Update the last found handle or reset the pointer
+			 * to track that a new group started: Primary or
+			 * Secondary service. */
+			if (bt_uuid_cmp(&a->uuid, &prim_uuid) == 0 ||
+					bt_uuid_cmp(&a->uuid, &snd_uuid) == 0)
+				range_end = NULL;
+			else
+				att_put_u16(a->handle, range_end);
+		}
+	}
+
+	if (ptr == &opdu[1])
+		return enc_error_resp(ATT_OP_FIND_BY_TYPE_REQ, start,
+				ATT_ECODE_ATTR_NOT_FOUND, opdu, mtu);
+
+	return ptr - opdu;
+}
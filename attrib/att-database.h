@@ -20,6 +20,8 @@
  *
  */
 
+struct btd_device;
+
 /* Requirements for read/write operations */
 enum {
 	ATT_NONE,		/* No restrictions */
@@ -41,3 +43,18 @@ struct attribute {
 	size_t len;
 	uint8_t *data;
 };
+
+typedef uint8_t (*att_db_read_t) (struct attribute *a, uint8_t opcode,
+							void *user_data);
+
+uint16_t att_db_read_by_group(GList *database, uint16_t start, uint16_t end,
+					bt_uuid_t *uuid, att_db_read_t func,
+					void *user_data, uint8_t *pdu, size_t len);
+uint16_t att_db_read_by_type(GList *database, uint16_t start, uint16_t end,
+					bt_uuid_t *uuid, att_db_read_t func,
+					void *user_data, uint8_t *pdu, size_t len);
+uint16_t att_db_find_info(GList *database, uint16_t start, uint16_t end,
+						uint8_t *pdu, size_t len);
+uint16_t att_db_find_by_type(GList *database, uint16_t start, uint16_t end,
+				bt_uuid_t *uuid, const uint8_t *value,
+				size_t vlen, uint8_t *opdu, size_t mtu);
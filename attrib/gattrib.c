@@ -43,6 +43,16 @@
 
 #define GATT_TIMEOUT 30
 
+/*
+ * Registrations are indexed by opcode and handle. Opcode wide and
+ * wildcard registrations use GATTRIB_ALL_HANDLES as handle.
+ */
+#define EVENT_KEY(opcode, handle) \
+			GUINT_TO_POINTER(((guint) (opcode) << 16) | (handle))
+
+#define MAX_EVENT_BUCKETS 4
+#define EVENT_STACK_SIZE 16
+
 struct _GAttrib {
 	GIOChannel *io;
 	int refs;
@@ -53,7 +63,8 @@ struct _GAttrib {
 	guint timeout_watch;
 	GQueue *requests;
 	GQueue *responses;
-	GSList *events;
+	GHashTable *events;
+	GHashTable *event_index;
 	guint next_cmd_id;
 	GDestroyNotify destroy;
 	gpointer destroy_user_data;
@@ -177,9 +188,20 @@ static void event_destroy(struct event *evt)
 	g_free(evt);
 }
 
+static gboolean steal_event(gpointer key, gpointer value, gpointer user_data)
+{
+	event_destroy(value);
+
+	return TRUE;
+}
+
+static void event_list_free(gpointer data)
+{
+	g_slist_free(data);
+}
+
 static void attrib_destroy(GAttrib *attrib)
 {
-	GSList *l;
 	struct command *c;
 
 	while ((c = g_queue_pop_head(attrib->requests)))
@@ -194,10 +216,11 @@ static void attrib_destroy(GAttrib *attrib)
 	g_queue_free(attrib->responses);
 	attrib->responses = NULL;
 
-	for (l = attrib->events; l; l = l->next)
-		event_destroy(l->data);
+	g_hash_table_destroy(attrib->event_index);
+	attrib->event_index = NULL;
 
-	g_slist_free(attrib->events);
+	g_hash_table_foreach_steal(attrib->events, steal_event, NULL);
+	g_hash_table_destroy(attrib->events);
 	attrib->events = NULL;
 
 	if (attrib->timeout_watch > 0)
@@ -365,35 +388,140 @@ static void wake_up_sender(struct _GAttrib *attrib)
 				can_write_data, attrib, destroy_sender);
 }
 
-static bool match_event(struct event *evt, const uint8_t *pdu, gsize len)
+static gpointer event_key(struct event *evt)
 {
-	guint16 handle;
+	/* Wildcard registrations match regardless of the handle */
+	if (evt->expected == GATTRIB_ALL_EVENTS ||
+					evt->expected == GATTRIB_ALL_REQS)
+		return EVENT_KEY(evt->expected, GATTRIB_ALL_HANDLES);
 
-	if (evt->expected == GATTRIB_ALL_EVENTS)
-		return true;
+	return EVENT_KEY(evt->expected, evt->handle);
+}
 
-	if (!is_response(pdu[0]) && evt->expected == GATTRIB_ALL_REQS)
-		return true;
+static void index_event(GAttrib *attrib, struct event *evt)
+{
+	gpointer key = event_key(evt);
+	GSList *list;
 
-	if (evt->expected == pdu[0] && evt->handle == GATTRIB_ALL_HANDLES)
-		return true;
+	/* Ids are increasing so appending keeps registration order */
+	list = g_hash_table_lookup(attrib->event_index, key);
+	list = g_slist_append(list, evt);
 
-	if (len < 3)
-		return false;
+	g_hash_table_steal(attrib->event_index, key);
+	g_hash_table_insert(attrib->event_index, key, list);
+}
 
-	handle = att_get_u16(&pdu[1]);
+static void unindex_event(GAttrib *attrib, struct event *evt)
+{
+	gpointer key = event_key(evt);
+	GSList *list;
 
-	if (evt->expected == pdu[0] && evt->handle == handle)
-		return true;
+	list = g_hash_table_lookup(attrib->event_index, key);
+	list = g_slist_remove(list, evt);
 
-	return false;
+	g_hash_table_steal(attrib->event_index, key);
+
+	if (list)
+		g_hash_table_insert(attrib->event_index, key, list);
+}
+
+static unsigned int lookup_events(GAttrib *attrib, const uint8_t *pdu,
+						gsize len, GSList **buckets)
+{
+	unsigned int count = 0;
+	GSList *list;
+
+	list = g_hash_table_lookup(attrib->event_index,
+			EVENT_KEY(GATTRIB_ALL_EVENTS, GATTRIB_ALL_HANDLES));
+	if (list)
+		buckets[count++] = list;
+
+	if (!is_response(pdu[0])) {
+		list = g_hash_table_lookup(attrib->event_index,
+			EVENT_KEY(GATTRIB_ALL_REQS, GATTRIB_ALL_HANDLES));
+		if (list)
+			buckets[count++] = list;
+	}
+
+	if (pdu[0] != GATTRIB_ALL_EVENTS && pdu[0] != GATTRIB_ALL_REQS) {
+		list = g_hash_table_lookup(attrib->event_index,
+				EVENT_KEY(pdu[0], GATTRIB_ALL_HANDLES));
+		if (list)
+			buckets[count++] = list;
+
+		if (len >= 3 && att_get_u16(&pdu[1]) != GATTRIB_ALL_HANDLES) {
+			list = g_hash_table_lookup(attrib->event_index,
+				EVENT_KEY(pdu[0], att_get_u16(&pdu[1])));
+			if (list)
+				buckets[count++] = list;
+		}
+	}
+
+	return count;
+}
+
+static void dispatch_events(GAttrib *attrib, const uint8_t *pdu, gsize len)
+{
+	GSList *buckets[MAX_EVENT_BUCKETS];
+	guint stack_ids[EVENT_STACK_SIZE];
+	guint *ids = stack_ids;
+	unsigned int num_buckets, num_ids = 0, i;
+
+	num_buckets = lookup_events(attrib, pdu, len, buckets);
+	if (num_buckets == 0)
+		return;
+
+	for (i = 0; i < num_buckets; i++)
+		num_ids += g_slist_length(buckets[i]);
+
+	if (num_ids > EVENT_STACK_SIZE)
+		ids = g_new(guint, num_ids);
+
+	/*
+	 * Merge the matching buckets by id so callbacks are called in
+	 * registration order. Only ids are collected since callbacks are
+	 * allowed to unregister events.
+	 */
+	for (num_ids = 0;; num_ids++) {
+		GSList **next = NULL;
+
+		for (i = 0; i < num_buckets; i++) {
+			struct event *evt;
+
+			if (buckets[i] == NULL)
+				continue;
+
+			evt = buckets[i]->data;
+
+			if (next == NULL || evt->id <
+					((struct event *) (*next)->data)->id)
+				next = &buckets[i];
+		}
+
+		if (next == NULL)
+			break;
+
+		ids[num_ids] = ((struct event *) (*next)->data)->id;
+		*next = (*next)->next;
+	}
+
+	for (i = 0; i < num_ids; i++) {
+		struct event *evt;
+
+		evt = g_hash_table_lookup(attrib->events,
+						GUINT_TO_POINTER(ids[i]));
+		if (evt)
+			evt->func(pdu, len, evt->user_data);
+	}
+
+	if (ids != stack_ids)
+		g_free(ids);
 }
 
 static gboolean received_data(GIOChannel *io, GIOCondition cond, gpointer data)
 {
 	struct _GAttrib *attrib = data;
 	struct command *cmd = NULL;
-	GSList *l;
 	uint8_t buf[512], status;
 	gsize len;
 	GIOStatus iostat;
@@ -415,12 +543,7 @@ static gboolean received_data(GIOChannel *io, GIOCondition cond, gpointer data)
 		goto done;
 	}
 
-	for (l = attrib->events; l; l = l->next) {
-		struct event *evt = l->data;
-
-		if (match_event(evt, buf, len))
-			evt->func(buf, len, evt->user_data);
-	}
+	dispatch_events(attrib, buf, len);
 
 	if (!is_response(buf[0]))
 		return TRUE;
@@ -433,7 +556,7 @@ static gboolean received_data(GIOChannel *io, GIOCondition cond, gpointer data)
 	cmd = g_queue_pop_head(attrib->requests);
 	if (cmd == NULL) {
 		/* Keep the watch if we have events to report */
-		return attrib->events != NULL;
+		return g_hash_table_size(attrib->events) > 0;
 	}
 
 	if (buf[0] == ATT_OP_ERROR) {
@@ -494,6 +617,9 @@ GAttrib *g_attrib_new(GIOChannel *io)
 	attrib->io = g_io_channel_ref(io);
 	attrib->requests = g_queue_new();
 	attrib->responses = g_queue_new();
+	attrib->events = g_hash_table_new(NULL, NULL);
+	attrib->event_index = g_hash_table_new_full(NULL, NULL, NULL,
+							event_list_free);
 
 	attrib->read_watch = g_io_add_watch(attrib->io,
 			G_IO_IN | G_IO_HUP | G_IO_ERR | G_IO_NVAL,
@@ -687,19 +813,13 @@ guint g_attrib_register(GAttrib *attrib, guint8 opcode, guint16 handle,
 	event->notify = notify;
 	event->id = ++next_evt_id;
 
-	attrib->events = g_slist_append(attrib->events, event);
+	g_hash_table_insert(attrib->events, GUINT_TO_POINTER(event->id),
+								event);
+	index_event(attrib, event);
 
 	return event->id;
 }
 
-static int event_cmp_by_id(gconstpointer a, gconstpointer b)
-{
-	const struct event *evt = a;
-	guint id = GPOINTER_TO_UINT(b);
-
-	return evt->id - id;
-}
-
 gboolean g_attrib_is_encrypted(GAttrib *attrib)
 {
 	BtIOSecLevel sec_level;
@@ -715,21 +835,18 @@ gboolean g_attrib_is_encrypted(GAttrib *attrib)
 gboolean g_attrib_unregister(GAttrib *attrib, guint id)
 {
 	struct event *evt;
-	GSList *l;
 
 	if (id == 0) {
 		warn("%s: invalid id", __FUNCTION__);
 		return FALSE;
 	}
 
-	l = g_slist_find_custom(attrib->events, GUINT_TO_POINTER(id),
-							event_cmp_by_id);
-	if (l == NULL)
+	evt = g_hash_table_lookup(attrib->events, GUINT_TO_POINTER(id));
+	if (evt == NULL)
 		return FALSE;
 
-	evt = l->data;
-
-	attrib->events = g_slist_remove(attrib->events, evt);
+	g_hash_table_remove(attrib->events, GUINT_TO_POINTER(id));
+	unindex_event(attrib, evt);
 
 	if (evt->notify)
 		evt->notify(evt->user_data);
@@ -741,22 +858,11 @@ gboolean g_attrib_unregister(GAttrib *attrib, guint id)
 
 gboolean g_attrib_unregister_all(GAttrib *attrib)
 {
-	GSList *l;
-
-	if (attrib->events == NULL)
+	if (g_hash_table_size(attrib->events) == 0)
 		return FALSE;
 
-	for (l = attrib->events; l; l = l->next) {
-		struct event *evt = l->data;
-
-		if (evt->notify)
-			evt->notify(evt->user_data);
-
-		g_free(evt);
-	}
-
-	g_slist_free(attrib->events);
-	attrib->events = NULL;
+	g_hash_table_remove_all(attrib->event_index);
+	g_hash_table_foreach_steal(attrib->events, steal_event, NULL);
 
 	return TRUE;
 }
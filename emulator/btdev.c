@@ -30,6 +30,7 @@
 #include <ctype.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include "monitor/bt.h"
 #include "btdev.h"
@@ -42,10 +43,52 @@
 #define has_bredr(btdev)	(!((btdev)->features[4] & 0x20))
 #define has_le(btdev)		(!!((btdev)->features[4] & 0x40))
 
+#define MAX_BTDEV_CONN		16
+#define MAX_ACL_HANDLE		0x0eff
+
+#define acl_handle(h)		((h) & 0x0fff)
+#define acl_flags(h)		((h) >> 12)
+#define acl_handle_pack(h, f)	((uint16_t) (((h) & 0x0fff) | ((f) << 12)))
+
+/* Maximum time completed packets are held back when batching them */
+#define NCP_BATCH_TIMEOUT	10
+
+struct btdev_pkt {
+	struct btdev_pkt *next;
+	uint64_t due;
+	uint16_t len;
+	uint8_t data[0];
+};
+
+struct btdev_conn {
+	uint16_t handle;
+	uint8_t link_type;
+	struct btdev *remote;
+	uint16_t remote_handle;
+	uint16_t completed;
+	uint64_t busy_until;
+	struct btdev_pkt *tx_head;
+	struct btdev_pkt *tx_tail;
+	int tx_timeout;
+};
+
 struct btdev {
 	enum btdev_type type;
 
-	struct btdev *conn;
+	struct btdev_conn conns[MAX_BTDEV_CONN];
+	uint16_t next_handle;
+
+	uint16_t acl_pending;
+	uint16_t acl_completed;
+	uint16_t ncp_batch;
+	int ncp_timeout;
+
+	uint32_t link_bandwidth;
+	uint32_t link_latency;
+
+	btdev_add_timeout_func add_timeout;
+	btdev_remove_timeout_func remove_timeout;
+	void *timeout_data;
 
 	btdev_command_func command_handler;
 	void *command_data;
@@ -425,6 +468,8 @@ struct btdev *btdev_create(enum btdev_type type, uint16_t id)
 
 	btdev->acl_mtu = 192;
 	btdev->acl_max_pkt = 1;
+	btdev->ncp_batch = 1;
+	btdev->next_handle = 0x0001;
 
 	btdev->country_code = 0x00;
 
@@ -439,11 +484,36 @@ struct btdev *btdev_create(enum btdev_type type, uint16_t id)
 	return btdev;
 }
 
+static void conn_release(struct btdev *btdev, struct btdev_conn *conn);
+
 void btdev_destroy(struct btdev *btdev)
 {
+	int i;
+
 	if (!btdev)
 		return;
 
+	for (i = 0; i < MAX_BTDEV_CONN; i++) {
+		struct btdev_conn *conn = &btdev->conns[i];
+		struct btdev *remote = conn->remote;
+		uint16_t remote_handle = conn->remote_handle;
+		int j;
+
+		if (!conn->handle)
+			continue;
+
+		conn_release(btdev, conn);
+
+		for (j = 0; j < MAX_BTDEV_CONN; j++) {
+			if (remote->conns[j].handle == remote_handle &&
+					remote->conns[j].remote == btdev)
+				conn_release(remote, &remote->conns[j]);
+		}
+	}
+
+	if (btdev->ncp_timeout > 0 && btdev->remove_timeout)
+		btdev->remove_timeout(btdev->ncp_timeout, btdev->timeout_data);
+
 	del_btdev(btdev);
 
 	free(btdev);
@@ -474,6 +544,55 @@ void btdev_set_send_handler(struct btdev *btdev, btdev_send_func handler,
 	btdev->send_data = user_data;
 }
 
+void btdev_set_timeout_handler(struct btdev *btdev,
+					btdev_add_timeout_func add,
+					btdev_remove_timeout_func remove,
+					void *user_data)
+{
+	if (!btdev)
+		return;
+
+	btdev->add_timeout = add;
+	btdev->remove_timeout = remove;
+	btdev->timeout_data = user_data;
+}
+
+void btdev_set_acl_buffer(struct btdev *btdev, uint16_t mtu, uint16_t max_pkt)
+{
+	if (!btdev || !mtu || !max_pkt)
+		return;
+
+	btdev->acl_mtu = mtu;
+	btdev->acl_max_pkt = max_pkt;
+}
+
+void btdev_set_completion_batch(struct btdev *btdev, uint16_t count)
+{
+	if (!btdev || !count)
+		return;
+
+	btdev->ncp_batch = count;
+}
+
+void btdev_set_link_params(struct btdev *btdev, uint32_t bandwidth,
+							uint32_t latency)
+{
+	if (!btdev)
+		return;
+
+	btdev->link_bandwidth = bandwidth;
+	btdev->link_latency = latency;
+}
+
+static uint64_t get_time_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
 static void send_packet(struct btdev *btdev, const void *data, uint16_t len)
 {
 	if (!btdev->send_handler)
@@ -554,16 +673,303 @@ static void cmd_status(struct btdev *btdev, uint8_t status, uint16_t opcode)
 
 static void num_completed_packets(struct btdev *btdev)
 {
-	if (btdev->conn) {
-		struct bt_hci_evt_num_completed_packets ncp;
+	uint8_t buf[1 + MAX_BTDEV_CONN * 4];
+	uint8_t num_handles = 0;
+	int i;
+
+	if (btdev->ncp_timeout > 0) {
+		if (btdev->remove_timeout)
+			btdev->remove_timeout(btdev->ncp_timeout,
+							btdev->timeout_data);
+		btdev->ncp_timeout = 0;
+	}
+
+	for (i = 0; i < MAX_BTDEV_CONN; i++) {
+		struct btdev_conn *conn = &btdev->conns[i];
+		uint16_t handle, count;
+
+		if (!conn->handle || !conn->completed)
+			continue;
+
+		handle = cpu_to_le16(conn->handle);
+		count = cpu_to_le16(conn->completed);
+
+		memcpy(buf + 1 + num_handles * 4, &handle, 2);
+		memcpy(buf + 3 + num_handles * 4, &count, 2);
+		num_handles++;
+
+		btdev->acl_pending -= conn->completed;
+		btdev->acl_completed -= conn->completed;
+		conn->completed = 0;
+	}
+
+	if (!num_handles)
+		return;
+
+	buf[0] = num_handles;
+
+	send_event(btdev, BT_HCI_EVT_NUM_COMPLETED_PACKETS, buf,
+							1 + num_handles * 4);
+}
+
+static void ncp_timeout_callback(void *user_data)
+{
+	struct btdev *btdev = user_data;
+
+	btdev->ncp_timeout = 0;
+
+	num_completed_packets(btdev);
+}
+
+static void packet_completed(struct btdev *btdev, struct btdev_conn *conn)
+{
+	conn->completed++;
+	btdev->acl_completed++;
+
+	/*
+	 * Completions are reported right away unless batching is enabled.
+	 * A batch is flushed once it is full, once the host has run out of
+	 * buffer credits or after a short timeout.
+	 */
+	if (btdev->ncp_batch <= 1 || !btdev->add_timeout ||
+			btdev->acl_completed >= btdev->ncp_batch ||
+			btdev->acl_pending >= btdev->acl_max_pkt) {
+		num_completed_packets(btdev);
+		return;
+	}
+
+	if (btdev->ncp_timeout > 0)
+		return;
+
+	btdev->ncp_timeout = btdev->add_timeout(NCP_BATCH_TIMEOUT,
+						ncp_timeout_callback, btdev,
+						btdev->timeout_data);
+}
+
+static struct btdev_conn *find_conn(struct btdev *btdev, uint16_t handle)
+{
+	int i;
+
+	if (!handle)
+		return NULL;
+
+	for (i = 0; i < MAX_BTDEV_CONN; i++) {
+		if (btdev->conns[i].handle == handle)
+			return &btdev->conns[i];
+	}
+
+	return NULL;
+}
+
+static struct btdev_conn *add_conn(struct btdev *btdev, struct btdev *remote,
+							uint8_t link_type)
+{
+	struct btdev_conn *conn = NULL;
+	int i;
+
+	for (i = 0; i < MAX_BTDEV_CONN; i++) {
+		if (!btdev->conns[i].handle) {
+			conn = &btdev->conns[i];
+			break;
+		}
+	}
+
+	if (!conn)
+		return NULL;
+
+	memset(conn, 0, sizeof(*conn));
+
+	while (find_conn(btdev, btdev->next_handle) ||
+					btdev->next_handle > MAX_ACL_HANDLE) {
+		if (btdev->next_handle >= MAX_ACL_HANDLE)
+			btdev->next_handle = 0x0001;
+		else
+			btdev->next_handle++;
+	}
+
+	conn->handle = btdev->next_handle++;
+	conn->link_type = link_type;
+	conn->remote = remote;
+
+	return conn;
+}
+
+static void conn_release(struct btdev *btdev, struct btdev_conn *conn)
+{
+	struct btdev_pkt *pkt;
+
+	if (conn->tx_timeout > 0 && btdev->remove_timeout)
+		btdev->remove_timeout(conn->tx_timeout, btdev->timeout_data);
+
+	/*
+	 * Packets still queued on the link are flushed, the host reclaims
+	 * their buffers with the disconnection so they are not reported.
+	 */
+	while ((pkt = conn->tx_head)) {
+		conn->tx_head = pkt->next;
+		btdev->acl_pending--;
+		free(pkt);
+	}
+
+	btdev->acl_pending -= conn->completed;
+	btdev->acl_completed -= conn->completed;
+
+	memset(conn, 0, sizeof(*conn));
+}
+
+static struct btdev_conn *find_remote_conn(struct btdev_conn *conn)
+{
+	if (!conn->remote)
+		return NULL;
+
+	return find_conn(conn->remote, conn->remote_handle);
+}
+
+static void deliver_packet(struct btdev *btdev, struct btdev_conn *conn,
+						const void *data, uint16_t len)
+{
+	struct btdev_conn *remote_conn = find_remote_conn(conn);
+
+	if (remote_conn) {
+		uint8_t pkt_data[len];
+		struct bt_hci_acl_hdr *hdr = (void *) (pkt_data + 1);
+		uint16_t handle;
+
+		memcpy(pkt_data, data, len);
+
+		handle = le16_to_cpu(hdr->handle);
+		hdr->handle = cpu_to_le16(acl_handle_pack(conn->remote_handle,
+							acl_flags(handle)));
+
+		send_packet(conn->remote, pkt_data, len);
+	}
+
+	packet_completed(btdev, conn);
+}
+
+static void link_schedule(struct btdev *btdev, struct btdev_conn *conn);
+
+static void link_timeout_callback(void *user_data)
+{
+	struct btdev_conn *conn = user_data;
+	struct btdev *btdev = NULL;
+	uint64_t now;
+	int i;
+
+	for (i = 0; i < MAX_BTDEV_ENTRIES && !btdev; i++) {
+		struct btdev *dev = btdev_list[i];
+
+		if (dev && conn >= dev->conns &&
+					conn < dev->conns + MAX_BTDEV_CONN)
+			btdev = dev;
+	}
+
+	conn->tx_timeout = 0;
+
+	if (!btdev)
+		return;
+
+	now = get_time_us();
+
+	while (conn->tx_head && conn->tx_head->due <= now) {
+		struct btdev_pkt *pkt = conn->tx_head;
+
+		conn->tx_head = pkt->next;
+		if (!conn->tx_head)
+			conn->tx_tail = NULL;
+
+		deliver_packet(btdev, conn, pkt->data, pkt->len);
+		free(pkt);
+
+		/* The link might have been torn down by the remote side */
+		if (!conn->handle)
+			return;
+	}
+
+	link_schedule(btdev, conn);
+}
+
+static void link_schedule(struct btdev *btdev, struct btdev_conn *conn)
+{
+	uint64_t now, delay;
+
+	if (!conn->tx_head || conn->tx_timeout > 0)
+		return;
+
+	now = get_time_us();
+	delay = conn->tx_head->due > now ? conn->tx_head->due - now : 0;
+
+	conn->tx_timeout = btdev->add_timeout((delay + 999) / 1000,
+						link_timeout_callback, conn,
+						btdev->timeout_data);
+}
+
+static void send_acl(struct btdev *btdev, const void *data, uint16_t len)
+{
+	const struct bt_hci_acl_hdr *hdr = data + 1;
+	struct btdev_conn *conn;
+	struct btdev_pkt *pkt;
+	uint64_t start;
+
+	if (len < 1 + sizeof(*hdr))
+		return;
+
+	conn = find_conn(btdev, acl_handle(le16_to_cpu(hdr->handle)));
+	if (!conn) {
+		printf("ACL data for unknown handle 0x%4.4x\n",
+					acl_handle(le16_to_cpu(hdr->handle)));
+		return;
+	}
+
+	if (le16_to_cpu(hdr->dlen) > btdev->acl_mtu) {
+		printf("ACL packet exceeds buffer size (%u > %u)\n",
+				le16_to_cpu(hdr->dlen), btdev->acl_mtu);
+		return;
+	}
+
+	if (btdev->acl_pending >= btdev->acl_max_pkt) {
+		printf("ACL buffer overflow (%u packets)\n",
+						btdev->acl_max_pkt);
+		return;
+	}
 
-		ncp.num_handles = 1;
-		ncp.handle = cpu_to_le16(42);
-		ncp.count = cpu_to_le16(1);
+	btdev->acl_pending++;
 
-		send_event(btdev, BT_HCI_EVT_NUM_COMPLETED_PACKETS,
-							&ncp, sizeof(ncp));
+	if ((!btdev->link_bandwidth && !btdev->link_latency) ||
+						!btdev->add_timeout) {
+		deliver_packet(btdev, conn, data, len);
+		return;
+	}
+
+	pkt = malloc(sizeof(*pkt) + len);
+	if (!pkt) {
+		btdev->acl_pending--;
+		return;
 	}
+
+	memcpy(pkt->data, data, len);
+	pkt->len = len;
+	pkt->next = NULL;
+
+	/* Packets are serialized on the link at the configured bandwidth */
+	start = get_time_us();
+	if (conn->busy_until > start)
+		start = conn->busy_until;
+
+	if (btdev->link_bandwidth)
+		start += (uint64_t) le16_to_cpu(hdr->dlen) * 1000000 /
+							btdev->link_bandwidth;
+
+	conn->busy_until = start;
+	pkt->due = start + (uint64_t) btdev->link_latency * 1000;
+
+	if (conn->tx_tail)
+		conn->tx_tail->next = pkt;
+	else
+		conn->tx_head = pkt;
+	conn->tx_tail = pkt;
+
+	link_schedule(btdev, conn);
 }
 
 static void inquiry_complete(struct btdev *btdev, uint8_t status)
@@ -634,23 +1040,42 @@ static void conn_complete(struct btdev *btdev,
 					const uint8_t *bdaddr, uint8_t status)
 {
 	struct bt_hci_evt_conn_complete cc;
+	struct btdev *remote = NULL;
+	struct btdev_conn *conn, *remote_conn;
 
 	if (!status) {
-		struct btdev *remote = find_btdev_by_bdaddr(bdaddr);
+		remote = find_btdev_by_bdaddr(bdaddr);
+		if (!remote)
+			status = BT_HCI_ERR_UNKNOWN_CONN_ID;
+	}
+
+	if (!status) {
+		conn = add_conn(btdev, remote, 0x01);
+		remote_conn = add_conn(remote, btdev, 0x01);
+
+		if (!conn || !remote_conn) {
+			if (conn)
+				conn_release(btdev, conn);
+			if (remote_conn)
+				conn_release(remote, remote_conn);
+			status = BT_HCI_ERR_MEM_CAPACITY_EXCEEDED;
+		}
+	}
 
-		btdev->conn = remote;
-		remote->conn = btdev;
+	if (!status) {
+		conn->remote_handle = remote_conn->handle;
+		remote_conn->remote_handle = conn->handle;
 
 		cc.status = status;
 		memcpy(cc.bdaddr, btdev->bdaddr, 6);
 		cc.encr_mode = 0x00;
 
-		cc.handle = cpu_to_le16(42);
+		cc.handle = cpu_to_le16(remote_conn->handle);
 		cc.link_type = 0x01;
 
 		send_event(remote, BT_HCI_EVT_CONN_COMPLETE, &cc, sizeof(cc));
 
-		cc.handle = cpu_to_le16(42);
+		cc.handle = cpu_to_le16(conn->handle);
 		cc.link_type = 0x01;
 	} else {
 		cc.handle = cpu_to_le16(0x0000);
@@ -688,9 +1113,11 @@ static void disconnect_complete(struct btdev *btdev, uint16_t handle,
 							uint8_t reason)
 {
 	struct bt_hci_evt_disconnect_complete dc;
+	struct btdev_conn *conn, *remote_conn;
 	struct btdev *remote;
 
-	if (!btdev) {
+	conn = find_conn(btdev, handle);
+	if (!conn) {
 		dc.status = BT_HCI_ERR_UNKNOWN_CONN_ID;
 		dc.handle = cpu_to_le16(handle);
 		dc.reason = 0x00;
@@ -704,12 +1131,20 @@ static void disconnect_complete(struct btdev *btdev, uint16_t handle,
 	dc.handle = cpu_to_le16(handle);
 	dc.reason = reason;
 
-	remote = btdev->conn;
+	remote = conn->remote;
+	remote_conn = find_remote_conn(conn);
 
-	btdev->conn = NULL;
-	remote->conn = NULL;
+	conn_release(btdev, conn);
 
 	send_event(btdev, BT_HCI_EVT_DISCONNECT_COMPLETE, &dc, sizeof(dc));
+
+	if (!remote_conn)
+		return;
+
+	dc.handle = cpu_to_le16(remote_conn->handle);
+
+	conn_release(remote, remote_conn);
+
 	send_event(remote, BT_HCI_EVT_DISCONNECT_COMPLETE, &dc, sizeof(dc));
 }
 
@@ -738,11 +1173,12 @@ static void name_request_complete(struct btdev *btdev,
 static void remote_features_complete(struct btdev *btdev, uint16_t handle)
 {
 	struct bt_hci_evt_remote_features_complete rfc;
+	struct btdev_conn *conn = find_conn(btdev, handle);
 
-	if (btdev->conn) {
+	if (conn) {
 		rfc.status = BT_HCI_ERR_SUCCESS;
 		rfc.handle = cpu_to_le16(handle);
-		memcpy(rfc.features, btdev->conn->features, 8);
+		memcpy(rfc.features, conn->remote->features, 8);
 	} else {
 		rfc.status = BT_HCI_ERR_UNKNOWN_CONN_ID;
 		rfc.handle = cpu_to_le16(handle);
@@ -757,8 +1193,9 @@ static void remote_ext_features_complete(struct btdev *btdev, uint16_t handle,
 								uint8_t page)
 {
 	struct bt_hci_evt_remote_ext_features_complete refc;
+	struct btdev_conn *conn = find_conn(btdev, handle);
 
-	if (btdev->conn && page < 0x02) {
+	if (conn && page < 0x02) {
 		refc.handle = cpu_to_le16(handle);
 		refc.page = page;
 		refc.max_page = 0x01;
@@ -766,7 +1203,7 @@ static void remote_ext_features_complete(struct btdev *btdev, uint16_t handle,
 		switch (page) {
 		case 0x00:
 			refc.status = BT_HCI_ERR_SUCCESS;
-			memcpy(refc.features, btdev->conn->features, 8);
+			memcpy(refc.features, conn->remote->features, 8);
 			break;
 		case 0x01:
 			refc.status = BT_HCI_ERR_SUCCESS;
@@ -792,13 +1229,14 @@ static void remote_ext_features_complete(struct btdev *btdev, uint16_t handle,
 static void remote_version_complete(struct btdev *btdev, uint16_t handle)
 {
 	struct bt_hci_evt_remote_version_complete rvc;
+	struct btdev_conn *conn = find_conn(btdev, handle);
 
-	if (btdev->conn) {
+	if (conn) {
 		rvc.status = BT_HCI_ERR_SUCCESS;
 		rvc.handle = cpu_to_le16(handle);
-		rvc.lmp_ver = btdev->conn->version;
-		rvc.manufacturer = cpu_to_le16(btdev->conn->manufacturer);
-		rvc.lmp_subver = cpu_to_le16(btdev->conn->revision);
+		rvc.lmp_ver = conn->remote->version;
+		rvc.manufacturer = cpu_to_le16(conn->remote->manufacturer);
+		rvc.lmp_subver = cpu_to_le16(conn->remote->revision);
 	} else {
 		rvc.status = BT_HCI_ERR_UNKNOWN_CONN_ID;
 		rvc.handle = cpu_to_le16(handle);
@@ -1680,9 +2118,7 @@ void btdev_receive_h4(struct btdev *btdev, const void *data, uint16_t len)
 		process_cmd(btdev, data + 1, len - 1);
 		break;
 	case BT_H4_ACL_PKT:
-		if (btdev->conn)
-			send_packet(btdev->conn, data, len);
-		num_completed_packets(btdev);
+		send_acl(btdev, data, len);
 		break;
 	default:
 		printf("Unsupported packet 0x%2.2x\n", pkt_type);
@@ -53,6 +53,14 @@ typedef void (*btdev_command_func) (uint16_t opcode,
 typedef void (*btdev_send_func) (const void *data, uint16_t len,
 							void *user_data);
 
+typedef void (*btdev_timeout_func) (void *user_data);
+
+typedef int (*btdev_add_timeout_func) (unsigned int msec,
+					btdev_timeout_func func,
+					void *func_data, void *user_data);
+
+typedef void (*btdev_remove_timeout_func) (int id, void *user_data);
+
 enum btdev_type {
 	BTDEV_TYPE_BREDRLE,
 	BTDEV_TYPE_BREDR,
@@ -73,4 +81,14 @@ void btdev_set_command_handler(struct btdev *btdev, btdev_command_func handler,
 void btdev_set_send_handler(struct btdev *btdev, btdev_send_func handler,
 							void *user_data);
 
+void btdev_set_timeout_handler(struct btdev *btdev,
+					btdev_add_timeout_func add,
+					btdev_remove_timeout_func remove,
+					void *user_data);
+
+void btdev_set_acl_buffer(struct btdev *btdev, uint16_t mtu, uint16_t max_pkt);
+void btdev_set_completion_batch(struct btdev *btdev, uint16_t count);
+void btdev_set_link_params(struct btdev *btdev, uint32_t bandwidth,
+							uint32_t latency);
+
 void btdev_receive_h4(struct btdev *btdev, const void *data, uint16_t len);
@@ -41,6 +41,29 @@
 #define cpu_to_le16(val) (val)
 #define cpu_to_le32(val) (val)
 
+#define acl_handle(h)		((h) & 0x0fff)
+#define acl_flags(h)		((h) >> 12)
+#define acl_handle_pack(h, f)	((uint16_t) (((h) & 0x0fff) | ((f) << 12)))
+
+#define L2CAP_FEAT_ERTM		0x00000008
+#define L2CAP_FEAT_STREAMING	0x00000010
+
+#define L2CAP_CONF_RFC		0x04
+
+static void put_le16(uint16_t val, void *ptr)
+{
+	uint8_t *buf = ptr;
+
+	buf[0] = val;
+	buf[1] = val >> 8;
+}
+
+static void put_le32(uint32_t val, void *ptr)
+{
+	put_le16(val, ptr);
+	put_le16(val >> 16, ptr + 2);
+}
+
 struct cmd {
 	struct cmd *next;
 	struct cmd *prev;
@@ -53,13 +76,32 @@ struct cmd_queue {
 	struct cmd *tail;
 };
 
+struct cid_hook {
+	uint16_t cid;
+	bthost_cid_hook_func_t func;
+	void *user_data;
+	struct cid_hook *next;
+};
+
 struct btconn {
 	uint16_t handle;
 	uint16_t next_cid;
+	uint16_t acl_sent;
 	struct l2conn *l2conns;
+	struct cid_hook *cid_hooks;
+	uint8_t *recv_data;
+	uint16_t recv_len;
+	uint16_t data_len;
 	struct btconn *next;
 };
 
+struct acl_pkt {
+	struct acl_pkt *next;
+	uint16_t handle;
+	uint16_t len;
+	uint8_t data[0];
+};
+
 struct l2conn {
 	uint16_t scid;
 	uint16_t dcid;
@@ -85,7 +127,14 @@ struct bthost {
 	bthost_new_conn_cb new_conn_cb;
 	void *new_conn_data;
 	uint16_t server_psm;
+	uint8_t server_mode;
+	bthost_l2cap_connect_cb l2cap_connect_cb;
+	void *l2cap_connect_data;
 	struct l2cap_pending_req *l2reqs;
+	uint16_t acl_mtu;
+	uint16_t acl_credits;
+	struct acl_pkt *acl_head;
+	struct acl_pkt *acl_tail;
 };
 
 struct bthost *bthost_create(void)
@@ -115,6 +164,14 @@ static void btconn_free(struct btconn *conn)
 		l2conn_free(l2conn);
 	}
 
+	while (conn->cid_hooks) {
+		struct cid_hook *hook = conn->cid_hooks;
+
+		conn->cid_hooks = hook->next;
+		free(hook);
+	}
+
+	free(conn->recv_data);
 	free(conn);
 }
 
@@ -189,6 +246,13 @@ void bthost_destroy(struct bthost *bthost)
 		btconn_free(conn);
 	}
 
+	while (bthost->acl_head) {
+		struct acl_pkt *pkt = bthost->acl_head;
+
+		bthost->acl_head = pkt->next;
+		free(pkt);
+	}
+
 	while (bthost->l2reqs) {
 		struct l2cap_pending_req *req = bthost->l2reqs;
 
@@ -240,35 +304,102 @@ static void send_packet(struct bthost *bthost, const void *data, uint16_t len)
 	bthost->send_handler(data, len, bthost->send_data);
 }
 
+static void send_acl_pkt(struct bthost *bthost, struct acl_pkt *pkt)
+{
+	struct btconn *conn;
+
+	conn = bthost_find_conn(bthost, pkt->handle);
+	if (conn)
+		conn->acl_sent++;
+
+	if (bthost->acl_credits)
+		bthost->acl_credits--;
+
+	send_packet(bthost, pkt->data, pkt->len);
+}
+
+static void flush_acl(struct bthost *bthost)
+{
+	while (bthost->acl_head && bthost->acl_credits) {
+		struct acl_pkt *pkt = bthost->acl_head;
+
+		bthost->acl_head = pkt->next;
+		if (!bthost->acl_head)
+			bthost->acl_tail = NULL;
+
+		send_acl_pkt(bthost, pkt);
+		free(pkt);
+	}
+}
+
+static void queue_acl(struct bthost *bthost, uint16_t handle, uint8_t flags,
+					const void *data, uint16_t len)
+{
+	struct bt_hci_acl_hdr *acl_hdr;
+	struct acl_pkt *pkt;
+
+	pkt = malloc(sizeof(*pkt) + 1 + sizeof(*acl_hdr) + len);
+	if (!pkt)
+		return;
+
+	pkt->next = NULL;
+	pkt->handle = handle;
+	pkt->len = 1 + sizeof(*acl_hdr) + len;
+
+	pkt->data[0] = BT_H4_ACL_PKT;
+
+	acl_hdr = (void *) (pkt->data + 1);
+	acl_hdr->handle = cpu_to_le16(acl_handle_pack(handle, flags));
+	acl_hdr->dlen = cpu_to_le16(len);
+
+	memcpy(pkt->data + 1 + sizeof(*acl_hdr), data, len);
+
+	/*
+	 * Until the buffer size of the controller is known packets are
+	 * sent right away, otherwise they wait for available credits.
+	 */
+	if (!bthost->acl_mtu || (bthost->acl_credits && !bthost->acl_head)) {
+		send_acl_pkt(bthost, pkt);
+		free(pkt);
+		return;
+	}
+
+	if (bthost->acl_tail)
+		bthost->acl_tail->next = pkt;
+	else
+		bthost->acl_head = pkt;
+	bthost->acl_tail = pkt;
+}
+
 static void send_acl(struct bthost *bthost, uint16_t handle, uint16_t cid,
 						const void *data, uint16_t len)
 {
-	struct bt_hci_acl_hdr *acl_hdr;
 	struct bt_l2cap_hdr *l2_hdr;
-	uint16_t pkt_len;
-	void *pkt_data;
+	uint16_t pkt_len, offset, frag_len;
+	uint8_t *pkt_data;
 
-	pkt_len = 1 + sizeof(*acl_hdr) + sizeof(*l2_hdr) + len;
+	pkt_len = sizeof(*l2_hdr) + len;
 
 	pkt_data = malloc(pkt_len);
 	if (!pkt_data)
 		return;
 
-	((uint8_t *) pkt_data)[0] = BT_H4_ACL_PKT;
-
-	acl_hdr = pkt_data + 1;
-	acl_hdr->handle = cpu_to_le16(handle);
-	acl_hdr->dlen = cpu_to_le16(len + sizeof(*l2_hdr));
-
-	l2_hdr = pkt_data + 1 + sizeof(*acl_hdr);
+	l2_hdr = (void *) pkt_data;
 	l2_hdr->cid = cpu_to_le16(cid);
 	l2_hdr->len = cpu_to_le16(len);
 
 	if (len > 0)
-		memcpy(pkt_data + 1 + sizeof(*acl_hdr) + sizeof(*l2_hdr),
-								data, len);
+		memcpy(pkt_data + sizeof(*l2_hdr), data, len);
+
+	/* Fragment the L2CAP frame into ACL packets of at most acl_mtu */
+	for (offset = 0; offset < pkt_len; offset += frag_len) {
+		frag_len = pkt_len - offset;
+		if (bthost->acl_mtu && frag_len > bthost->acl_mtu)
+			frag_len = bthost->acl_mtu;
 
-	send_packet(bthost, pkt_data, pkt_len);
+		queue_acl(bthost, handle, offset ? 0x01 : 0x00,
+						pkt_data + offset, frag_len);
+	}
 
 	free(pkt_data);
 }
@@ -395,6 +526,21 @@ static void next_cmd(struct bthost *bthost)
 	free(cmd);
 }
 
+static void read_buffer_size_complete(struct bthost *bthost,
+						const void *data, uint8_t len)
+{
+	const struct bt_hci_rsp_read_buffer_size *ev = data;
+
+	if (len < sizeof(*ev))
+		return;
+
+	if (ev->status)
+		return;
+
+	bthost->acl_mtu = le16_to_cpu(ev->acl_mtu);
+	bthost->acl_credits = le16_to_cpu(ev->acl_max_pkt);
+}
+
 static void read_bd_addr_complete(struct bthost *bthost, const void *data,
 								uint8_t len)
 {
@@ -428,6 +574,9 @@ static void evt_cmd_complete(struct bthost *bthost, const void *data,
 	switch (opcode) {
 	case BT_HCI_CMD_RESET:
 		break;
+	case BT_HCI_CMD_READ_BUFFER_SIZE:
+		read_buffer_size_complete(bthost, param, len - sizeof(*ev));
+		break;
 	case BT_HCI_CMD_READ_BD_ADDR:
 		read_bd_addr_complete(bthost, param, len - sizeof(*ev));
 		break;
@@ -528,6 +677,7 @@ static void evt_disconn_complete(struct bthost *bthost, const void *data,
 
 		if (conn->handle == handle) {
 			*curr = conn->next;
+			bthost->acl_credits += conn->acl_sent;
 			btconn_free(conn);
 		} else {
 			curr = &conn->next;
@@ -539,9 +689,31 @@ static void evt_num_completed_packets(struct bthost *bthost, const void *data,
 								uint8_t len)
 {
 	const struct bt_hci_evt_num_completed_packets *ev = data;
+	const uint8_t *entry = data + 1;
+	uint8_t i;
 
 	if (len < sizeof(*ev))
 		return;
+
+	if (len < 1 + ev->num_handles * 4)
+		return;
+
+	for (i = 0; i < ev->num_handles; i++, entry += 4) {
+		uint16_t handle, count;
+		struct btconn *conn;
+
+		handle = acl_handle(entry[0] | (entry[1] << 8));
+		count = entry[2] | (entry[3] << 8);
+
+		conn = bthost_find_conn(bthost, handle);
+		if (conn)
+			conn->acl_sent -= count < conn->acl_sent ?
+						count : conn->acl_sent;
+
+		bthost->acl_credits += count;
+	}
+
+	flush_acl(bthost);
 }
 
 static void process_evt(struct bthost *bthost, const void *data, uint16_t len)
@@ -599,6 +771,41 @@ static bool l2cap_cmd_rej(struct bthost *bthost, uint16_t handle,
 	return true;
 }
 
+static void send_config_req(struct bthost *bthost, uint16_t handle,
+								uint16_t dcid)
+{
+	struct bt_l2cap_pdu_config_req *req;
+	uint8_t buf[sizeof(*req) + 11];
+	uint16_t len = sizeof(*req);
+
+	memset(buf, 0, sizeof(buf));
+
+	req = (void *) buf;
+	req->dcid = cpu_to_le16(dcid);
+
+	if (bthost->server_mode) {
+		uint8_t *opt = buf + sizeof(*req);
+
+		opt[0] = L2CAP_CONF_RFC;
+		opt[1] = 9;
+		opt[2] = bthost->server_mode;
+
+		/* Streaming mode leaves window size and timeouts zero */
+		if (bthost->server_mode == 0x03) {
+			opt[3] = 63;			/* TxWindow */
+			opt[4] = 3;			/* MaxTransmit */
+			put_le16(2000, opt + 5);	/* Retransmission */
+			put_le16(12000, opt + 7);	/* Monitor */
+		}
+
+		put_le16(1010, opt + 9);		/* MPS */
+
+		len += 11;
+	}
+
+	l2cap_sig_send(bthost, handle, BT_L2CAP_PDU_CONFIG_REQ, 0, buf, len);
+}
+
 static bool l2cap_conn_req(struct bthost *bthost, uint16_t handle,
 				uint8_t ident, const void *data, uint16_t len)
 {
@@ -628,16 +835,14 @@ static bool l2cap_conn_req(struct bthost *bthost, uint16_t handle,
 								sizeof(rsp));
 
 	if (!rsp.result) {
-		struct bt_l2cap_pdu_config_req conf_req;
-
 		bthost_add_l2cap_conn(bthost, handle, le16_to_cpu(rsp.dcid),
 							le16_to_cpu(rsp.scid));
 
-		memset(&conf_req, 0, sizeof(conf_req));
-		conf_req.dcid = rsp.dcid;
+		send_config_req(bthost, handle, le16_to_cpu(rsp.scid));
 
-		l2cap_sig_send(bthost, handle, BT_L2CAP_PDU_CONFIG_REQ, 0,
-						&conf_req, sizeof(conf_req));
+		if (bthost->l2cap_connect_cb)
+			bthost->l2cap_connect_cb(handle, le16_to_cpu(rsp.dcid),
+						bthost->l2cap_connect_data);
 	}
 
 	return true;
@@ -654,15 +859,8 @@ static bool l2cap_conn_rsp(struct bthost *bthost, uint16_t handle,
 	bthost_add_l2cap_conn(bthost, handle, le16_to_cpu(rsp->scid),
 						le16_to_cpu(rsp->dcid));
 
-	if (le16_to_cpu(rsp->result) == 0x0001) {
-		struct bt_l2cap_pdu_config_req req;
-
-		memset(&req, 0, sizeof(req));
-		req.dcid = rsp->dcid;
-
-		l2cap_sig_send(bthost, handle, BT_L2CAP_PDU_CONFIG_REQ, 0,
-							&req, sizeof(req));
-	}
+	if (le16_to_cpu(rsp->result) == 0x0001)
+		send_config_req(bthost, handle, le16_to_cpu(rsp->dcid));
 
 	return true;
 }
@@ -671,9 +869,10 @@ static bool l2cap_config_req(struct bthost *bthost, uint16_t handle,
 				uint8_t ident, const void *data, uint16_t len)
 {
 	const struct bt_l2cap_pdu_config_req *req = data;
-	struct bt_l2cap_pdu_config_rsp rsp;
+	struct bt_l2cap_pdu_config_rsp *rsp;
 	struct l2conn *l2conn;
-	uint16_t dcid;
+	uint16_t dcid, opt_len;
+	uint8_t *buf;
 
 	if (len < sizeof(*req))
 		return false;
@@ -684,12 +883,25 @@ static bool l2cap_config_req(struct bthost *bthost, uint16_t handle,
 	if (!l2conn)
 		return false;
 
-	memset(&rsp, 0, sizeof(rsp));
-	rsp.scid  = cpu_to_le16(l2conn->dcid);
-	rsp.flags = req->flags;
+	opt_len = len - sizeof(*req);
 
-	l2cap_sig_send(bthost, handle, BT_L2CAP_PDU_CONFIG_RSP, ident, &rsp,
-								sizeof(rsp));
+	buf = malloc(sizeof(*rsp) + opt_len);
+	if (!buf)
+		return false;
+
+	rsp = (void *) buf;
+	memset(rsp, 0, sizeof(*rsp));
+	rsp->scid  = cpu_to_le16(l2conn->dcid);
+	rsp->flags = req->flags;
+
+	/* All options, including the requested mode, are accepted as is */
+	if (opt_len > 0)
+		memcpy(buf + sizeof(*rsp), data + sizeof(*req), opt_len);
+
+	l2cap_sig_send(bthost, handle, BT_L2CAP_PDU_CONFIG_RSP, ident, buf,
+						sizeof(*rsp) + opt_len);
+
+	free(buf);
 
 	return true;
 }
@@ -728,16 +940,28 @@ static bool l2cap_info_req(struct bthost *bthost, uint16_t handle,
 				uint8_t ident, const void *data, uint16_t len)
 {
 	const struct bt_l2cap_pdu_info_req *req = data;
-	struct bt_l2cap_pdu_info_rsp rsp;
+	struct bt_l2cap_pdu_info_rsp *rsp;
+	uint8_t buf[sizeof(*rsp) + 4];
+	uint16_t rsp_len = sizeof(*rsp);
 
 	if (len < sizeof(*req))
 		return false;
 
-	rsp.type = req->type;
-	rsp.result = cpu_to_le16(0x0001); /* Not Supported */
+	rsp = (void *) buf;
+	rsp->type = req->type;
 
-	l2cap_sig_send(bthost, handle, BT_L2CAP_PDU_INFO_RSP, ident, &rsp,
-								sizeof(rsp));
+	if (le16_to_cpu(req->type) == 0x0002) {
+		/* Extended features mask */
+		rsp->result = cpu_to_le16(0x0000);
+		put_le32(L2CAP_FEAT_ERTM | L2CAP_FEAT_STREAMING,
+							buf + sizeof(*rsp));
+		rsp_len += 4;
+	} else {
+		rsp->result = cpu_to_le16(0x0001); /* Not Supported */
+	}
+
+	l2cap_sig_send(bthost, handle, BT_L2CAP_PDU_INFO_RSP, ident, buf,
+								rsp_len);
 
 	return true;
 }
@@ -831,36 +1055,110 @@ reject:
 							&rej, sizeof(rej));
 }
 
+static void process_l2cap(struct bthost *bthost, struct btconn *conn,
+					const void *data, uint16_t len)
+{
+	const struct bt_l2cap_hdr *l2_hdr = data;
+	struct cid_hook *hook;
+	uint16_t cid, l2_len;
+	const void *l2_data;
+
+	if (len < sizeof(*l2_hdr))
+		return;
+
+	l2_len = le16_to_cpu(l2_hdr->len);
+	if (len != sizeof(*l2_hdr) + l2_len)
+		return;
+
+	l2_data = data + sizeof(*l2_hdr);
+
+	cid = le16_to_cpu(l2_hdr->cid);
+
+	if (cid == 0x0001) {
+		l2cap_sig(bthost, conn->handle, l2_data, l2_len);
+		return;
+	}
+
+	for (hook = conn->cid_hooks; hook; hook = hook->next) {
+		if (hook->cid == cid) {
+			hook->func(l2_data, l2_len, hook->user_data);
+			return;
+		}
+	}
+
+	printf("Packet for unknown CID 0x%04x (%u)\n", cid, cid);
+}
+
 static void process_acl(struct bthost *bthost, const void *data, uint16_t len)
 {
 	const struct bt_hci_acl_hdr *acl_hdr = data;
 	const struct bt_l2cap_hdr *l2_hdr = data + sizeof(*acl_hdr);
-	uint16_t handle, cid, acl_len, l2_len;
-	const void *l2_data;
+	uint16_t handle, acl_len, l2_len;
+	struct btconn *conn;
+	const void *acl_data;
+	uint8_t flags;
 
-	if (len < sizeof(*acl_hdr) + sizeof(*l2_hdr))
+	if (len < sizeof(*acl_hdr))
 		return;
 
 	acl_len = le16_to_cpu(acl_hdr->dlen);
 	if (len != sizeof(*acl_hdr) + acl_len)
 		return;
 
-	handle = le16_to_cpu(acl_hdr->handle);
+	handle = acl_handle(le16_to_cpu(acl_hdr->handle));
+	flags = acl_flags(le16_to_cpu(acl_hdr->handle)) & 0x03;
 
-	l2_len = le16_to_cpu(l2_hdr->len);
-	if (len - sizeof(*acl_hdr) != sizeof(*l2_hdr) + l2_len)
+	conn = bthost_find_conn(bthost, handle);
+	if (!conn)
 		return;
 
-	l2_data = data + sizeof(*acl_hdr) + sizeof(*l2_hdr);
+	acl_data = data + sizeof(*acl_hdr);
 
-	cid = le16_to_cpu(l2_hdr->cid);
+	switch (flags) {
+	case 0x00:	/* start of a non-flushable packet */
+	case 0x02:	/* start of an automatically flushable packet */
+		free(conn->recv_data);
+		conn->recv_data = NULL;
 
-	switch (cid) {
-	case 0x0001:
-		l2cap_sig(bthost, handle, l2_data, l2_len);
+		if (acl_len < sizeof(*l2_hdr))
+			return;
+
+		l2_len = le16_to_cpu(l2_hdr->len) + sizeof(*l2_hdr);
+
+		if (acl_len >= l2_len) {
+			process_l2cap(bthost, conn, acl_data, acl_len);
+			return;
+		}
+
+		conn->recv_data = malloc(l2_len);
+		if (!conn->recv_data)
+			return;
+
+		memcpy(conn->recv_data, acl_data, acl_len);
+		conn->recv_len = acl_len;
+		conn->data_len = l2_len;
 		break;
-	default:
-		printf("Packet for unknown CID 0x%04x (%u)\n", cid, cid);
+
+	case 0x01:	/* continuing fragment */
+		if (!conn->recv_data)
+			return;
+
+		if (conn->recv_len + acl_len > conn->data_len) {
+			free(conn->recv_data);
+			conn->recv_data = NULL;
+			return;
+		}
+
+		memcpy(conn->recv_data + conn->recv_len, acl_data, acl_len);
+		conn->recv_len += acl_len;
+
+		if (conn->recv_len < conn->data_len)
+			return;
+
+		process_l2cap(bthost, conn, conn->recv_data, conn->recv_len);
+
+		free(conn->recv_data);
+		conn->recv_data = NULL;
 		break;
 	}
 }
@@ -924,6 +1222,56 @@ void bthost_set_server_psm(struct bthost *bthost, uint16_t psm)
 	bthost->server_psm = psm;
 }
 
+void bthost_set_server_mode(struct bthost *bthost, uint8_t mode)
+{
+	bthost->server_mode = mode;
+}
+
+void bthost_set_l2cap_connect_cb(struct bthost *bthost,
+					bthost_l2cap_connect_cb cb,
+					void *user_data)
+{
+	bthost->l2cap_connect_cb = cb;
+	bthost->l2cap_connect_data = user_data;
+}
+
+void bthost_add_cid_hook(struct bthost *bthost, uint16_t handle, uint16_t cid,
+				bthost_cid_hook_func_t func, void *user_data)
+{
+	struct cid_hook *hook;
+	struct btconn *conn;
+
+	conn = bthost_find_conn(bthost, handle);
+	if (!conn)
+		return;
+
+	hook = malloc(sizeof(*hook));
+	if (!hook)
+		return;
+
+	memset(hook, 0, sizeof(*hook));
+
+	hook->cid = cid;
+	hook->func = func;
+	hook->user_data = user_data;
+
+	hook->next = conn->cid_hooks;
+	conn->cid_hooks = hook;
+}
+
+void bthost_send_cid(struct bthost *bthost, uint16_t handle, uint16_t cid,
+					const void *data, uint16_t len)
+{
+	struct l2conn *l2conn;
+
+	/* Dynamic channels are addressed by their local identifier */
+	l2conn = bthost_find_l2cap_conn_by_scid(bthost, handle, cid);
+	if (l2conn)
+		cid = l2conn->dcid;
+
+	send_acl(bthost, handle, cid, data, len);
+}
+
 void bthost_start(struct bthost *bthost)
 {
 	if (!bthost)
@@ -933,6 +1281,8 @@ void bthost_start(struct bthost *bthost)
 
 	send_command(bthost, BT_HCI_CMD_RESET, NULL, 0);
 
+	send_command(bthost, BT_HCI_CMD_READ_BUFFER_SIZE, NULL, 0);
+
 	send_command(bthost, BT_HCI_CMD_READ_BD_ADDR, NULL, 0);
 }
 
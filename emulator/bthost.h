@@ -61,6 +61,23 @@ bool bthost_l2cap_req(struct bthost *bthost, uint16_t handle, uint8_t req,
 void bthost_write_scan_enable(struct bthost *bthost, uint8_t scan);
 
 void bthost_set_server_psm(struct bthost *bthost, uint16_t psm);
+void bthost_set_server_mode(struct bthost *bthost, uint8_t mode);
+
+typedef void (*bthost_l2cap_connect_cb) (uint16_t handle, uint16_t cid,
+							void *user_data);
+
+void bthost_set_l2cap_connect_cb(struct bthost *bthost,
+					bthost_l2cap_connect_cb cb,
+					void *user_data);
+
+typedef void (*bthost_cid_hook_func_t) (const void *data, uint16_t len,
+							void *user_data);
+
+void bthost_add_cid_hook(struct bthost *bthost, uint16_t handle, uint16_t cid,
+				bthost_cid_hook_func_t func, void *user_data);
+
+void bthost_send_cid(struct bthost *bthost, uint16_t handle, uint16_t cid,
+					const void *data, uint16_t len);
 
 void bthost_start(struct bthost *bthost);
 void bthost_stop(struct bthost *bthost);
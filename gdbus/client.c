@@ -32,6 +32,9 @@
 
 #define METHOD_CALL_TIMEOUT (300 * 1000)
 
+/* Number of objects parsed per mainloop iteration from GetManagedObjects */
+#define MANAGED_OBJECTS_BATCH 32
+
 struct GDBusClient {
 	int ref_count;
 	DBusConnection *dbus_conn;
@@ -52,6 +55,21 @@ struct GDBusClient {
 	GDBusPropertyFunction property_changed;
 	void *user_data;
 	GList *proxy_list;
+	GHashTable *proxy_index;
+	DBusMessage *objects_reply;
+	DBusMessageIter objects_iter;
+	guint objects_id;
+	GSList *objects_pending;
+};
+
+struct proxy_key {
+	const char *path;
+	const char *interface;
+};
+
+struct proxy_entry {
+	struct proxy_key key;
+	GList *link;
 };
 
 struct GDBusProxy {
@@ -272,11 +290,57 @@ static void update_properties(GDBusProxy *proxy, DBusMessageIter *iter,
 	}
 }
 
+static guint proxy_key_hash(gconstpointer data)
+{
+	const struct proxy_key *key = data;
+
+	return g_str_hash(key->path) * 33 + g_str_hash(key->interface);
+}
+
+static gboolean proxy_key_equal(gconstpointer a, gconstpointer b)
+{
+	const struct proxy_key *ka = a, *kb = b;
+
+	return g_str_equal(ka->path, kb->path) &&
+				g_str_equal(ka->interface, kb->interface);
+}
+
+static struct proxy_entry *proxy_entry_lookup(GDBusClient *client,
+						const char *path,
+						const char *interface)
+{
+	struct proxy_key key;
+
+	key.path = path;
+	key.interface = interface;
+
+	return g_hash_table_lookup(client->proxy_index, &key);
+}
+
+static void proxy_list_add(GDBusClient *client, GDBusProxy *proxy)
+{
+	struct proxy_entry *entry;
+
+	/*
+	 * The list is kept in reverse order so adding doesn't have to walk
+	 * it, the index keeps the link for constant time removal.
+	 */
+	client->proxy_list = g_list_prepend(client->proxy_list, proxy);
+
+	entry = g_new0(struct proxy_entry, 1);
+	entry->key.path = proxy->obj_path;
+	entry->key.interface = proxy->interface;
+	entry->link = client->proxy_list;
+
+	g_hash_table_replace(client->proxy_index, &entry->key, entry);
+}
+
 static void get_all_properties_reply(DBusPendingCall *call, void *user_data)
 {
 	GDBusProxy *proxy = user_data;
 	GDBusClient *client = proxy->client;
 	DBusMessage *reply = dbus_pending_call_steal_reply(call);
+	struct proxy_entry *entry;
 	DBusMessageIter iter;
 	DBusError error;
 
@@ -292,11 +356,12 @@ static void get_all_properties_reply(DBusPendingCall *call, void *user_data)
 	update_properties(proxy, &iter, FALSE);
 
 done:
-	if (g_list_find(client->proxy_list, proxy) == NULL) {
+	entry = proxy_entry_lookup(client, proxy->obj_path, proxy->interface);
+	if (entry == NULL || entry->link->data != proxy) {
 		if (client->proxy_added)
 			client->proxy_added(proxy, client->user_data);
 
-		client->proxy_list = g_list_append(client->proxy_list, proxy);
+		proxy_list_add(client, proxy);
 	}
 
 	dbus_message_unref(reply);
@@ -337,18 +402,13 @@ static void get_all_properties(GDBusProxy *proxy)
 static GDBusProxy *proxy_lookup(GDBusClient *client, const char *path,
 						const char *interface)
 {
-	GList *list;
-
-	for (list = g_list_first(client->proxy_list); list;
-						list = g_list_next(list)) {
-		GDBusProxy *proxy = list->data;
+	struct proxy_entry *entry;
 
-		if (g_str_equal(proxy->interface, interface) == TRUE &&
-				g_str_equal(proxy->obj_path, path) == TRUE)
-			return proxy;
-        }
+	entry = proxy_entry_lookup(client, path, interface);
+	if (entry == NULL)
+		return NULL;
 
-	return NULL;
+	return entry->link->data;
 }
 
 static GDBusProxy *proxy_new(GDBusClient *client, const char *path,
@@ -405,23 +465,32 @@ static void proxy_free(gpointer data)
 	g_dbus_proxy_unref(proxy);
 }
 
+static void proxy_list_free(GDBusClient *client)
+{
+	g_hash_table_remove_all(client->proxy_index);
+
+	client->proxy_list = g_list_reverse(client->proxy_list);
+	g_list_free_full(client->proxy_list, proxy_free);
+	client->proxy_list = NULL;
+}
+
 static void proxy_remove(GDBusClient *client, const char *path,
 						const char *interface)
 {
-	GList *list;
+	struct proxy_entry *entry;
+	GDBusProxy *proxy;
 
-	for (list = g_list_first(client->proxy_list); list;
-						list = g_list_next(list)) {
-		GDBusProxy *proxy = list->data;
+	entry = proxy_entry_lookup(client, path, interface);
+	if (entry == NULL)
+		return;
 
-		if (g_str_equal(proxy->interface, interface) == TRUE &&
-				g_str_equal(proxy->obj_path, path) == TRUE) {
-			client->proxy_list =
-				g_list_delete_link(client->proxy_list, list);
-			proxy_free(proxy);
-			break;
-		}
-	}
+	proxy = entry->link->data;
+
+	client->proxy_list = g_list_delete_link(client->proxy_list,
+								entry->link);
+	g_hash_table_remove(client->proxy_index, &entry->key);
+
+	proxy_free(proxy);
 }
 
 GDBusProxy *g_dbus_proxy_new(GDBusClient *client, const char *path,
@@ -796,10 +865,9 @@ static void refresh_properties(GDBusClient *client)
 static void properties_changed(GDBusClient *client, const char *path,
 							DBusMessage *msg)
 {
-	GDBusProxy *proxy = NULL;
+	GDBusProxy *proxy;
 	DBusMessageIter iter, entry;
 	const char *interface;
-	GList *list;
 
 	if (dbus_message_iter_init(msg, &iter) == FALSE)
 		return;
@@ -810,17 +878,7 @@ static void properties_changed(GDBusClient *client, const char *path,
 	dbus_message_iter_get_basic(&iter, &interface);
 	dbus_message_iter_next(&iter);
 
-	for (list = g_list_first(client->proxy_list); list;
-						list = g_list_next(list)) {
-		GDBusProxy *data = list->data;
-
-		if (g_str_equal(data->interface, interface) == TRUE &&
-				g_str_equal(data->obj_path, path) == TRUE) {
-			proxy = data;
-			break;
-		}
-	}
-
+	proxy = proxy_lookup(client, path, interface);
 	if (proxy == NULL)
 		return;
 
@@ -877,7 +935,7 @@ static void parse_properties(GDBusClient *client, const char *path,
 	if (client->proxy_added)
 		client->proxy_added(proxy, client->user_data);
 
-	client->proxy_list = g_list_append(client->proxy_list, proxy);
+	proxy_list_add(client, proxy);
 }
 
 static void parse_interfaces(GDBusClient *client, const char *path,
@@ -961,41 +1019,107 @@ static void interfaces_removed(GDBusClient *client, DBusMessage *msg)
 	g_dbus_client_unref(client);
 }
 
-static void parse_managed_objects(GDBusClient *client, DBusMessage *msg)
+static void parse_object(GDBusClient *client, DBusMessageIter *dict)
 {
-	DBusMessageIter iter, dict;
+	DBusMessageIter entry;
+	const char *path;
 
-	if (dbus_message_iter_init(msg, &iter) == FALSE)
-		return;
+	dbus_message_iter_recurse(dict, &entry);
 
-	if (dbus_message_iter_get_arg_type(&iter) != DBUS_TYPE_ARRAY)
+	if (dbus_message_iter_get_arg_type(&entry) != DBUS_TYPE_OBJECT_PATH)
 		return;
 
-	dbus_message_iter_recurse(&iter, &dict);
+	dbus_message_iter_get_basic(&entry, &path);
+	dbus_message_iter_next(&entry);
 
-	while (dbus_message_iter_get_arg_type(&dict) == DBUS_TYPE_DICT_ENTRY) {
-		DBusMessageIter entry;
-		const char *path;
+	parse_interfaces(client, path, &entry);
+}
 
-		dbus_message_iter_recurse(&dict, &entry);
+static void process_object_signal(GDBusClient *client, DBusMessage *msg)
+{
+	const char *interface = dbus_message_get_interface(msg);
+	const char *member = dbus_message_get_member(msg);
 
-		if (dbus_message_iter_get_arg_type(&entry) !=
-							DBUS_TYPE_OBJECT_PATH)
-			break;
+	if (g_str_equal(interface, DBUS_INTERFACE_PROPERTIES) == TRUE)
+		properties_changed(client, dbus_message_get_path(msg), msg);
+	else if (g_str_equal(member, "InterfacesAdded") == TRUE)
+		interfaces_added(client, msg);
+	else if (g_str_equal(member, "InterfacesRemoved") == TRUE)
+		interfaces_removed(client, msg);
+}
 
-		dbus_message_iter_get_basic(&entry, &path);
-		dbus_message_iter_next(&entry);
+static void managed_objects_reset(GDBusClient *client)
+{
+	if (client->objects_id > 0) {
+		g_source_remove(client->objects_id);
+		client->objects_id = 0;
+	}
 
-		parse_interfaces(client, path, &entry);
+	if (client->objects_reply != NULL) {
+		dbus_message_unref(client->objects_reply);
+		client->objects_reply = NULL;
+	}
 
-		dbus_message_iter_next(&dict);
+	g_slist_free_full(client->objects_pending,
+				(GDestroyNotify) dbus_message_unref);
+	client->objects_pending = NULL;
+}
+
+static void managed_objects_complete(GDBusClient *client)
+{
+	GSList *pending, *l;
+
+	pending = g_slist_reverse(client->objects_pending);
+	client->objects_pending = NULL;
+
+	dbus_message_unref(client->objects_reply);
+	client->objects_reply = NULL;
+	client->objects_id = 0;
+
+	/* Replay signals received while the objects were being parsed */
+	for (l = pending; l != NULL; l = l->next) {
+		DBusMessage *msg = l->data;
+
+		process_object_signal(client, msg);
+
+		dbus_message_unref(msg);
 	}
+
+	g_slist_free(pending);
+}
+
+static gboolean parse_managed_objects(gpointer user_data)
+{
+	GDBusClient *client = user_data;
+	DBusMessageIter *dict = &client->objects_iter;
+	unsigned int count;
+	gboolean ret = TRUE;
+
+	g_dbus_client_ref(client);
+
+	for (count = 0; count < MANAGED_OBJECTS_BATCH; count++) {
+		if (dbus_message_iter_get_arg_type(dict) !=
+							DBUS_TYPE_DICT_ENTRY) {
+			managed_objects_complete(client);
+			ret = FALSE;
+			break;
+		}
+
+		parse_object(client, dict);
+
+		dbus_message_iter_next(dict);
+	}
+
+	g_dbus_client_unref(client);
+
+	return ret;
 }
 
 static void get_managed_objects_reply(DBusPendingCall *call, void *user_data)
 {
 	GDBusClient *client = user_data;
 	DBusMessage *reply = dbus_pending_call_steal_reply(call);
+	DBusMessageIter iter;
 	DBusError error;
 
 	g_dbus_client_ref(client);
@@ -1007,7 +1131,19 @@ static void get_managed_objects_reply(DBusPendingCall *call, void *user_data)
 		goto done;
 	}
 
-	parse_managed_objects(client, reply);
+	if (dbus_message_iter_init(reply, &iter) == FALSE)
+		goto done;
+
+	if (dbus_message_iter_get_arg_type(&iter) != DBUS_TYPE_ARRAY)
+		goto done;
+
+	/*
+	 * Services may expose thousands of objects so the reply is parsed
+	 * in batches from the mainloop to keep the client responsive.
+	 */
+	client->objects_reply = dbus_message_ref(reply);
+	dbus_message_iter_recurse(&iter, &client->objects_iter);
+	client->objects_id = g_idle_add(parse_managed_objects, client);
 
 done:
 	dbus_message_unref(reply);
@@ -1027,7 +1163,7 @@ static void get_managed_objects(GDBusClient *client)
 		return;
 	}
 
-	if (client->get_objects_call != NULL)
+	if (client->get_objects_call != NULL || client->objects_reply != NULL)
 		return;
 
 	msg = dbus_message_new_method_call(client->service_name, "/",
@@ -1154,8 +1290,8 @@ static DBusHandlerResult message_filter(DBusConnection *connection,
 		if (*new == '\0' && client->unique_name != NULL &&
 				g_str_equal(old, client->unique_name) == TRUE) {
 
-			g_list_free_full(client->proxy_list, proxy_free);
-			client->proxy_list = NULL;
+			managed_objects_reset(client);
+			proxy_list_free(client);
 
 			if (client->disconn_func)
 				client->disconn_func(client->dbus_conn,
@@ -1191,6 +1327,13 @@ static DBusHandlerResult message_filter(DBusConnection *connection,
 						".ObjectManager") == FALSE)
 				return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
 
+			if (client->objects_reply != NULL) {
+				client->objects_pending = g_slist_prepend(
+						client->objects_pending,
+						dbus_message_ref(message));
+				return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+			}
+
 			if (g_str_equal(member, "InterfacesAdded") == TRUE) {
 				interfaces_added(client, message);
 				return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
@@ -1208,7 +1351,14 @@ static DBusHandlerResult message_filter(DBusConnection *connection,
 			return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
 
 		if (g_str_equal(interface, DBUS_INTERFACE_PROPERTIES) == TRUE) {
-			if (g_str_equal(member, "PropertiesChanged") == TRUE)
+			if (g_str_equal(member, "PropertiesChanged") == FALSE)
+				return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+			if (client->objects_reply != NULL)
+				client->objects_pending = g_slist_prepend(
+						client->objects_pending,
+						dbus_message_ref(message));
+			else
 				properties_changed(client, path, message);
 
 			return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
@@ -1244,6 +1394,8 @@ GDBusClient *g_dbus_client_new(DBusConnection *connection,
 	client->dbus_conn = dbus_connection_ref(connection);
 	client->service_name = g_strdup(service);
 	client->base_path = g_strdup(path);
+	client->proxy_index = g_hash_table_new_full(proxy_key_hash,
+						proxy_key_equal, NULL, g_free);
 
 	get_name_owner(client, client->service_name);
 
@@ -1317,7 +1469,10 @@ void g_dbus_client_unref(GDBusClient *client)
 	dbus_connection_remove_filter(client->dbus_conn,
 						message_filter, client);
 
-	g_list_free_full(client->proxy_list, proxy_free);
+	managed_objects_reset(client);
+
+	proxy_list_free(client);
+	g_hash_table_destroy(client->proxy_index);
 
 	if (client->disconn_func)
 		client->disconn_func(client->dbus_conn, client->disconn_data);
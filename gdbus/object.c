@@ -85,6 +85,7 @@ struct property_data {
 };
 
 static int global_flags = 0;
+static unsigned long signal_count = 0;
 static struct generic_data *root;
 
 static gboolean process_changes(gpointer user_data);
@@ -1508,6 +1509,8 @@ gboolean g_dbus_send_message(DBusConnection *connection, DBusMessage *message)
 
 		if (!check_signal(connection, path, interface, name, &args))
 			goto out;
+
+		signal_count++;
 	}
 
 	result = dbus_connection_send(connection, message, NULL);
@@ -1782,3 +1785,8 @@ void g_dbus_set_flags(int flags)
 {
 	global_flags = flags;
 }
+
+unsigned long g_dbus_get_signal_count(void)
+{
+	return signal_count;
+}
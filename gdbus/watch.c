@@ -42,6 +42,35 @@ static DBusHandlerResult message_filter(DBusConnection *connection,
 
 static guint listener_id = 0;
 static GSList *listeners = NULL;
+static GSList *removed_listeners = NULL;
+static unsigned int dispatch_depth = 0;
+
+/*
+ * Listeners are also indexed by (interface, member, path) so incoming
+ * signals only need to look at the watches that can possibly match them.
+ * Interface and member names are interned as quarks, a zero quark or a
+ * NULL path is used for listeners that don't filter on that field.
+ */
+#define KEY_INTERFACE	0x01
+#define KEY_MEMBER	0x02
+#define KEY_PATH	0x04
+#define KEY_MASKS	0x08
+
+struct filter_key {
+	GQuark interface;
+	GQuark member;
+	const char *path;
+};
+
+struct filter_bucket {
+	struct filter_key key;
+	char *path;
+	GSList *listeners;
+};
+
+static GHashTable *filter_index = NULL;
+static guint key_masks[KEY_MASKS];
+static guint listener_seq = 0;
 
 struct service_data {
 	DBusConnection *conn;
@@ -76,8 +105,178 @@ struct filter_data {
 	guint name_watch;
 	gboolean lock;
 	gboolean registered;
+	gboolean removed;
+	struct filter_key key;
+	guint seq;
 };
 
+static guint filter_key_hash(gconstpointer key)
+{
+	const struct filter_key *k = key;
+	guint hash;
+
+	hash = k->interface * 31 + k->member;
+
+	if (k->path)
+		hash ^= g_str_hash(k->path);
+
+	return hash;
+}
+
+static gboolean filter_key_equal(gconstpointer a, gconstpointer b)
+{
+	const struct filter_key *ka = a, *kb = b;
+
+	if (ka->interface != kb->interface || ka->member != kb->member)
+		return FALSE;
+
+	return g_strcmp0(ka->path, kb->path) == 0;
+}
+
+static guint filter_key_mask(const struct filter_key *key)
+{
+	guint mask = 0;
+
+	if (key->interface)
+		mask |= KEY_INTERFACE;
+	if (key->member)
+		mask |= KEY_MEMBER;
+	if (key->path)
+		mask |= KEY_PATH;
+
+	return mask;
+}
+
+static void filter_bucket_free(gpointer user_data)
+{
+	struct filter_bucket *bucket = user_data;
+
+	g_slist_free(bucket->listeners);
+	g_free(bucket->path);
+	g_free(bucket);
+}
+
+static struct filter_bucket *filter_bucket_lookup(const struct filter_key *key)
+{
+	if (filter_index == NULL)
+		return NULL;
+
+	return g_hash_table_lookup(filter_index, key);
+}
+
+static void listener_add(struct filter_data *data)
+{
+	struct filter_bucket *bucket;
+
+	if (filter_index == NULL)
+		filter_index = g_hash_table_new_full(filter_key_hash,
+						filter_key_equal, NULL,
+						filter_bucket_free);
+
+	data->key.interface = data->interface ?
+				g_quark_from_string(data->interface) : 0;
+	data->key.member = data->member ?
+				g_quark_from_string(data->member) : 0;
+	data->key.path = data->path;
+	data->seq = ++listener_seq;
+
+	bucket = filter_bucket_lookup(&data->key);
+	if (bucket == NULL) {
+		bucket = g_new0(struct filter_bucket, 1);
+		bucket->path = g_strdup(data->path);
+		bucket->key = data->key;
+		bucket->key.path = bucket->path;
+		g_hash_table_insert(filter_index, &bucket->key, bucket);
+		key_masks[filter_key_mask(&bucket->key)]++;
+	}
+
+	bucket->listeners = g_slist_append(bucket->listeners, data);
+	listeners = g_slist_append(listeners, data);
+}
+
+static void listener_remove(struct filter_data *data)
+{
+	struct filter_bucket *bucket;
+
+	listeners = g_slist_remove(listeners, data);
+
+	bucket = filter_bucket_lookup(&data->key);
+	if (bucket == NULL)
+		return;
+
+	bucket->listeners = g_slist_remove(bucket->listeners, data);
+	if (bucket->listeners != NULL)
+		return;
+
+	key_masks[filter_key_mask(&bucket->key)]--;
+	g_hash_table_remove(filter_index, &bucket->key);
+
+	if (g_hash_table_size(filter_index) > 0)
+		return;
+
+	g_hash_table_destroy(filter_index);
+	filter_index = NULL;
+}
+
+static gint listener_seq_cmp(gconstpointer a, gconstpointer b)
+{
+	const struct filter_data *da = a, *db = b;
+
+	if (da->seq < db->seq)
+		return -1;
+
+	return da->seq > db->seq ? 1 : 0;
+}
+
+static GSList *listener_lookup(const char *path, const char *interface,
+							const char *member)
+{
+	struct filter_key key;
+	struct filter_bucket *bucket;
+	GQuark iface_quark = 0, member_quark = 0;
+	GSList *matches = NULL;
+	guint mask, found = 0;
+
+	/*
+	 * A name that was never interned can't be used by any listener so
+	 * only the wildcard entries need to be considered for it.
+	 */
+	if (interface)
+		iface_quark = g_quark_try_string(interface);
+	if (member)
+		member_quark = g_quark_try_string(member);
+
+	for (mask = 0; mask < KEY_MASKS; mask++) {
+		if (key_masks[mask] == 0)
+			continue;
+
+		if ((mask & KEY_INTERFACE) && iface_quark == 0)
+			continue;
+		if ((mask & KEY_MEMBER) && member_quark == 0)
+			continue;
+		if ((mask & KEY_PATH) && path == NULL)
+			continue;
+
+		key.interface = (mask & KEY_INTERFACE) ? iface_quark : 0;
+		key.member = (mask & KEY_MEMBER) ? member_quark : 0;
+		key.path = (mask & KEY_PATH) ? path : NULL;
+
+		bucket = filter_bucket_lookup(&key);
+		if (bucket == NULL)
+			continue;
+
+		matches = g_slist_concat(matches,
+					g_slist_copy(bucket->listeners));
+		found++;
+	}
+
+	/* Keep dispatching in registration order */
+	if (found > 1)
+		matches = g_slist_sort(matches, listener_seq_cmp);
+
+	return matches;
+}
+
 static struct filter_data *filter_data_find_match(DBusConnection *connection,
 							const char *name,
 							const char *owner,
@@ -86,9 +285,22 @@ static struct filter_data *filter_data_find_match(DBusConnection *connection,
 							const char *member,
 							const char *argument)
 {
+	struct filter_bucket *bucket;
+	struct filter_key key;
 	GSList *current;
 
-	for (current = listeners;
+	key.interface = interface ? g_quark_try_string(interface) : 0;
+	key.member = member ? g_quark_try_string(member) : 0;
+	key.path = path;
+
+	if ((interface && key.interface == 0) || (member && key.member == 0))
+		return NULL;
+
+	bucket = filter_bucket_lookup(&key);
+	if (bucket == NULL)
+		return NULL;
+
+	for (current = bucket->listeners;
 			current != NULL; current = current->next) {
 		struct filter_data *data = current->data;
 
@@ -101,15 +313,6 @@ static struct filter_data *filter_data_find_match(DBusConnection *connection,
 		if (g_strcmp0(owner, data->owner) != 0)
 			continue;
 
-		if (g_strcmp0(path, data->path) != 0)
-			continue;
-
-		if (g_strcmp0(interface, data->interface) != 0)
-			continue;
-
-		if (g_strcmp0(member, data->member) != 0)
-			continue;
-
 		if (g_strcmp0(argument, data->argument) != 0)
 			continue;
 
@@ -252,7 +455,7 @@ proceed:
 		return NULL;
 	}
 
-	listeners = g_slist_append(listeners, data);
+	listener_add(data);
 
 	return data;
 }
@@ -281,6 +484,14 @@ static void filter_data_free(struct filter_data *data)
 {
 	GSList *l;
 
+	/* Listeners removed by a callback while a signal is dispatched are
+	 * still referenced by the list of matches, free them afterwards */
+	if (dispatch_depth > 0) {
+		data->removed = TRUE;
+		removed_listeners = g_slist_prepend(removed_listeners, data);
+		return;
+	}
+
 	for (l = data->callbacks; l != NULL; l = l->next)
 		g_free(l->data);
 
@@ -386,7 +597,7 @@ static gboolean filter_data_remove_callback(struct filter_data *data,
 		return FALSE;
 
 	connection = dbus_connection_ref(data->connection);
-	listeners = g_slist_remove(listeners, data);
+	listener_remove(data);
 
 	/* Remove filter if there are no listeners left for the connection */
 	if (filter_data_find(connection) == NULL)
@@ -511,7 +722,7 @@ static DBusHandlerResult message_filter(DBusConnection *connection,
 {
 	struct filter_data *data;
 	const char *sender, *path, *iface, *member, *arg = NULL;
-	GSList *current, *delete_listener = NULL;
+	GSList *current, *matches, *delete_listener = NULL;
 
 	/* Only filter signals */
 	if (dbus_message_get_type(message) != DBUS_MESSAGE_TYPE_SIGNAL)
@@ -525,23 +736,21 @@ static DBusHandlerResult message_filter(DBusConnection *connection,
 
 	/* Sender is always the owner */
 
-	for (current = listeners; current != NULL; current = current->next) {
-		data = current->data;
+	matches = listener_lookup(path, iface, member);
 
-		if (connection != data->connection)
-			continue;
+	dispatch_depth++;
 
-		if (data->owner && g_str_equal(sender, data->owner) == FALSE)
-			continue;
+	for (current = matches; current != NULL; current = current->next) {
+		data = current->data;
 
-		if (data->path && g_str_equal(path, data->path) == FALSE)
+		/* Check if the listener was removed by a previous callback */
+		if (data->removed)
 			continue;
 
-		if (data->interface && g_str_equal(iface,
-						data->interface) == FALSE)
+		if (connection != data->connection)
 			continue;
 
-		if (data->member && g_str_equal(member, data->member) == FALSE)
+		if (data->owner && g_str_equal(sender, data->owner) == FALSE)
 			continue;
 
 		if (data->argument && g_str_equal(arg,
@@ -560,27 +769,37 @@ static DBusHandlerResult message_filter(DBusConnection *connection,
 
 		if (!data->callbacks)
 			delete_listener = g_slist_prepend(delete_listener,
-								current);
+								data);
 	}
 
+	g_slist_free(matches);
+
 	for (current = delete_listener; current != NULL;
-					current = delete_listener->next) {
-		GSList *l = current->data;
+					current = current->next) {
+		data = current->data;
 
-		data = l->data;
+		if (data->removed)
+			continue;
 
 		/* Has any other callback added callbacks back to this data? */
 		if (data->callbacks != NULL)
 			continue;
 
 		remove_match(data);
-		listeners = g_slist_delete_link(listeners, l);
+		listener_remove(data);
 
 		filter_data_free(data);
 	}
 
 	g_slist_free(delete_listener);
 
+	if (--dispatch_depth == 0) {
+		GSList *removed = removed_listeners;
+
+		removed_listeners = NULL;
+		g_slist_free_full(removed, (GDestroyNotify) filter_data_free);
+	}
+
 	/* Remove filter if there are no listeners left for the connection */
 	if (filter_data_find(connection) == NULL)
 		dbus_connection_remove_filter(connection, message_filter,
@@ -807,7 +1026,7 @@ void g_dbus_remove_all_watches(DBusConnection *connection)
 	struct filter_data *data;
 
 	while ((data = filter_data_find(connection))) {
-		listeners = g_slist_remove(listeners, data);
+		listener_remove(data);
 		filter_data_call_and_free(data);
 	}
 
@@ -45,6 +45,7 @@
 #include "obexd.h"
 #include "plugin.h"
 #include "log.h"
+#include "obex.h"
 #include "mimetype.h"
 #include "filesystem.h"
 
@@ -162,6 +163,112 @@ static char *file_stat_line(char *filename, struct stat *fstat,
 	return ret;
 }
 
+#define LISTING_BATCH_SIZE 64
+#define LISTING_CACHE_MAX 16
+#define LISTING_CACHE_LIFETIME (5 * G_USEC_PER_SEC)
+
+struct listing_cache {
+	dev_t dev;
+	ino_t ino;
+	struct timespec mtime;
+	struct timespec ctime;
+	gint64 expires;
+	GString *body;
+};
+
+struct listing_object {
+	GString *buffer;
+	GString *body;
+	char *name;
+	DIR *dp;
+	struct stat dstat;
+	gboolean root;
+	gboolean finished;
+	guint idle_id;
+	unsigned int generation;
+};
+
+static GHashTable *listing_cache = NULL;
+static unsigned int listing_generation = 0;
+
+static void listing_cache_free(gpointer data)
+{
+	struct listing_cache *cache = data;
+
+	g_string_free(cache->body, TRUE);
+	g_free(cache);
+}
+
+static void listing_cache_invalidate(void)
+{
+	/* Listings still being generated must not be cached afterwards */
+	listing_generation++;
+
+	if (listing_cache == NULL || g_hash_table_size(listing_cache) == 0)
+		return;
+
+	DBG("");
+
+	g_hash_table_remove_all(listing_cache);
+}
+
+static gboolean timespec_equal(const struct timespec *a,
+						const struct timespec *b)
+{
+	return a->tv_sec == b->tv_sec && a->tv_nsec == b->tv_nsec;
+}
+
+static struct listing_cache *listing_cache_lookup(const char *name,
+							struct stat *dstat)
+{
+	struct listing_cache *cache;
+
+	if (listing_cache == NULL)
+		return NULL;
+
+	cache = g_hash_table_lookup(listing_cache, name);
+	if (cache == NULL)
+		return NULL;
+
+	/*
+	 * The folder times only change when entries are added, removed or
+	 * renamed, changes to the files themselves are only caught by
+	 * expiring the listing.
+	 */
+	if (cache->dev == dstat->st_dev && cache->ino == dstat->st_ino &&
+			timespec_equal(&cache->mtime, &dstat->st_mtim) &&
+			timespec_equal(&cache->ctime, &dstat->st_ctim) &&
+			g_get_monotonic_time() < cache->expires)
+		return cache;
+
+	g_hash_table_remove(listing_cache, name);
+
+	return NULL;
+}
+
+static void listing_cache_store(const char *name, struct stat *dstat,
+								GString *body)
+{
+	struct listing_cache *cache;
+
+	if (listing_cache == NULL)
+		return;
+
+	/* Keep the cache bounded, a full flush is cheap to rebuild */
+	if (g_hash_table_size(listing_cache) >= LISTING_CACHE_MAX)
+		g_hash_table_remove_all(listing_cache);
+
+	cache = g_new0(struct listing_cache, 1);
+	cache->dev = dstat->st_dev;
+	cache->ino = dstat->st_ino;
+	cache->mtime = dstat->st_mtim;
+	cache->ctime = dstat->st_ctim;
+	cache->expires = g_get_monotonic_time() + LISTING_CACHE_LIFETIME;
+	cache->body = body;
+
+	g_hash_table_replace(listing_cache, g_strdup(name), cache);
+}
+
 static void *filesystem_open(const char *name, int oflag, mode_t mode,
 					void *context, size_t *size, int *err)
 {
@@ -196,6 +303,8 @@ static void *filesystem_open(const char *name, int oflag, mode_t mode,
 		goto done;
 	}
 
+	listing_cache_invalidate();
+
 	if (fstatvfs(fd, &buf) < 0) {
 		if (err)
 			*err = -errno;
@@ -250,6 +359,8 @@ static ssize_t filesystem_write(void *object, const void *buf, size_t count)
 	if (ret < 0)
 		return -errno;
 
+	listing_cache_invalidate();
+
 	return ret;
 }
 
@@ -257,6 +368,8 @@ static int filesystem_rename(const char *name, const char *destname)
 {
 	int ret;
 
+	listing_cache_invalidate();
+
 	ret = rename(name, destname);
 	if (ret < 0) {
 		error("rename(%s, %s): %s (%d)", name, destname,
@@ -346,6 +459,13 @@ done:
 	return ret;
 }
 
+static int filesystem_remove(const char *name)
+{
+	listing_cache_invalidate();
+
+	return remove(name);
+}
+
 struct capability_object {
 	int pid;
 	int output;
@@ -469,94 +589,189 @@ static GString *append_folder_preamble(GString *object)
 	return g_string_append(object, FL_TYPE);
 }
 
-static GString *append_listing(GString *object, const char *name,
-				gboolean pcsuite, size_t *size, int *err)
+static void listing_free(struct listing_object *obj)
 {
-	struct stat fstat, dstat;
+	if (obj->idle_id > 0)
+		g_source_remove(obj->idle_id);
+
+	if (obj->dp != NULL)
+		closedir(obj->dp);
+
+	if (obj->body != NULL)
+		g_string_free(obj->body, TRUE);
+
+	g_string_free(obj->buffer, TRUE);
+	g_free(obj->name);
+	g_free(obj);
+}
+
+static void listing_finish(struct listing_object *obj)
+{
+	closedir(obj->dp);
+	obj->dp = NULL;
+
+	obj->buffer = g_string_append(obj->buffer, FL_BODY_END);
+	obj->finished = TRUE;
+
+	if (obj->generation != listing_generation)
+		return;
+
+	listing_cache_store(obj->name, &obj->dstat, obj->body);
+	obj->body = NULL;
+}
+
+static gboolean listing_fill_batch(struct listing_object *obj)
+{
+	struct stat fstat;
 	struct dirent *ep;
-	DIR *dp;
+	int fd, count;
+
+	fd = dirfd(obj->dp);
+
+	for (count = 0; count < LISTING_BATCH_SIZE; count++) {
+		char *filename;
+		char *line;
+
+		ep = readdir(obj->dp);
+		if (ep == NULL)
+			break;
+
+		if (ep->d_name[0] == '.')
+			continue;
+
+		filename = g_filename_to_utf8(ep->d_name, -1, NULL, NULL, NULL);
+		if (filename == NULL) {
+			error("g_filename_to_utf8: invalid filename");
+			continue;
+		}
+
+		if (fstatat(fd, ep->d_name, &fstat, 0) < 0) {
+			DBG("stat: %s(%d)", strerror(errno), errno);
+			g_free(filename);
+			continue;
+		}
+
+		line = file_stat_line(filename, &fstat, &obj->dstat, obj->root,
+									FALSE);
+		g_free(filename);
+
+		if (line == NULL)
+			continue;
+
+		obj->body = g_string_append(obj->body, line);
+		obj->buffer = g_string_append(obj->buffer, line);
+		g_free(line);
+	}
+
+	if (ep == NULL)
+		listing_finish(obj);
+
+	return obj->finished;
+}
+
+static gboolean listing_fill(gpointer user_data)
+{
+	struct listing_object *obj = user_data;
+	gboolean finished;
+
+	finished = listing_fill_batch(obj);
+	if (finished)
+		obj->idle_id = 0;
+
+	/* The object may be closed from within the io callback */
+	if (obj->buffer->len > 0 || finished)
+		obex_object_set_io_flags(obj, G_IO_IN, 0);
+
+	return finished ? FALSE : TRUE;
+}
+
+static void *append_listing(GString *object, const char *name,
+				gboolean pcsuite, size_t *size, int *err)
+{
+	struct listing_object *obj;
+	struct listing_cache *cache;
 	gboolean root;
 	int ret;
 
+	obj = g_new0(struct listing_object, 1);
+	obj->buffer = object;
+	obj->name = g_strdup(name);
+
 	root = g_str_equal(name, obex_option_root_folder());
 
-	dp = opendir(name);
-	if (dp == NULL) {
+	obj->dp = opendir(name);
+	if (obj->dp == NULL) {
 		if (err)
 			*err = -ENOENT;
 		goto failed;
 	}
 
 	if (!root)
-		object = g_string_append(object, FL_PARENT_FOLDER_ELEMENT);
+		obj->buffer = g_string_append(obj->buffer,
+						FL_PARENT_FOLDER_ELEMENT);
 
 	ret = verify_path(name);
 	if (ret < 0) {
-		*err = ret;
+		if (err)
+			*err = ret;
 		goto failed;
 	}
 
-	ret = stat(name, &dstat);
-	if (ret < 0) {
+	if (fstat(dirfd(obj->dp), &obj->dstat) < 0) {
 		if (err)
 			*err = -errno;
 		goto failed;
 	}
 
-	while ((ep = readdir(dp))) {
-		char *filename;
-		char *fullname;
-		char *line;
+	obj->root = root;
 
-		if (ep->d_name[0] == '.')
-			continue;
+	cache = listing_cache_lookup(name, &obj->dstat);
+	if (cache != NULL) {
+		DBG("%s: cached listing", name);
 
-		filename = g_filename_to_utf8(ep->d_name, -1, NULL, NULL, NULL);
-		if (filename == NULL) {
-			error("g_filename_to_utf8: invalid filename");
-			continue;
-		}
+		closedir(obj->dp);
+		obj->dp = NULL;
 
-		fullname = g_build_filename(name, ep->d_name, NULL);
+		obj->buffer = g_string_append_len(obj->buffer, cache->body->str,
+							cache->body->len);
+		obj->buffer = g_string_append(obj->buffer, FL_BODY_END);
+		obj->finished = TRUE;
 
-		ret = stat(fullname, &fstat);
-		if (ret < 0) {
-			DBG("stat: %s(%d)", strerror(errno), errno);
-			g_free(filename);
-			g_free(fullname);
-			continue;
-		}
+		if (size)
+			*size = obj->buffer->len;
 
-		g_free(fullname);
+		goto done;
+	}
 
-		line = file_stat_line(filename, &fstat, &dstat, root, FALSE);
-		if (line == NULL) {
-			g_free(filename);
-			continue;
-		}
+	obj->body = g_string_new(NULL);
+	obj->generation = listing_generation;
 
-		g_free(filename);
+	/* Folders fitting in a single batch are listed right away */
+	if (listing_fill_batch(obj)) {
+		if (size)
+			*size = obj->buffer->len;
 
-		object = g_string_append(object, line);
-		g_free(line);
+		goto done;
 	}
 
-	closedir(dp);
-
-	object = g_string_append(object, FL_BODY_END);
+	/*
+	 * Build the rest of the listing in batches from the mainloop so big
+	 * folders don't stall other sessions, the content is streamed as it
+	 * is generated and its final size is not known upfront.
+	 */
 	if (size)
-		*size = object->len;
+		*size = OBJECT_SIZE_UNKNOWN;
+
+	obj->idle_id = g_idle_add(listing_fill, obj);
 
+done:
 	if (err)
 		*err = 0;
 
-	return object;
+	return obj;
 
 failed:
-	if (dp)
-		closedir(dp);
-
-	g_string_free(object, TRUE);
+	listing_free(obj);
 	return NULL;
 }
 
@@ -584,15 +799,6 @@ static void *pcsuite_open(const char *name, int oflag, mode_t mode,
 	return append_listing(object, name, TRUE, size, err);
 }
 
-static int string_free(void *object)
-{
-	GString *string = object;
-
-	g_string_free(string, TRUE);
-
-	return 0;
-}
-
 ssize_t string_read(void *object, void *buf, size_t count)
 {
 	GString *string = object;
@@ -608,9 +814,24 @@ ssize_t string_read(void *object, void *buf, size_t count)
 	return len;
 }
 
+static int folder_close(void *object)
+{
+	listing_free(object);
+
+	return 0;
+}
+
 static ssize_t folder_read(void *object, void *buf, size_t count)
 {
-	return string_read(object, buf, count);
+	struct listing_object *obj = object;
+	ssize_t len;
+
+	len = string_read(obj->buffer, buf, count);
+
+	if (len == 0 && !obj->finished)
+		return -EAGAIN;
+
+	return len;
 }
 
 static ssize_t capability_read(void *object, void *buf, size_t count)
@@ -659,7 +880,7 @@ static struct obex_mime_type_driver file = {
 	.close = filesystem_close,
 	.read = filesystem_read,
 	.write = filesystem_write,
-	.remove = remove,
+	.remove = filesystem_remove,
 	.move = filesystem_rename,
 	.copy = filesystem_copy,
 };
@@ -678,7 +899,7 @@ static struct obex_mime_type_driver folder = {
 	.target_size = FTP_TARGET_SIZE,
 	.mimetype = "x-obex/folder-listing",
 	.open = folder_open,
-	.close = string_free,
+	.close = folder_close,
 	.read = folder_read,
 };
 
@@ -689,7 +910,7 @@ static struct obex_mime_type_driver pcsuite = {
 	.who_size = PCSUITE_WHO_SIZE,
 	.mimetype = "x-obex/folder-listing",
 	.open = pcsuite_open,
-	.close = string_free,
+	.close = folder_close,
 	.read = folder_read,
 };
 
@@ -697,6 +918,9 @@ static int filesystem_init(void)
 {
 	int err;
 
+	listing_cache = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+							listing_cache_free);
+
 	err = obex_mime_type_driver_register(&folder);
 	if (err < 0)
 		return err;
@@ -717,6 +941,9 @@ static void filesystem_exit(void)
 	obex_mime_type_driver_unregister(&folder);
 	obex_mime_type_driver_unregister(&capability);
 	obex_mime_type_driver_unregister(&file);
+
+	g_hash_table_destroy(listing_cache);
+	listing_cache = NULL;
 }
 
 OBEX_PLUGIN_DEFINE(filesystem, filesystem_init, filesystem_exit)
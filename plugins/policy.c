@@ -26,6 +26,7 @@
 #endif
 
 #include <stdio.h>
+#include <stdbool.h>
 #include <errno.h>
 #include <unistd.h>
 
@@ -38,23 +39,23 @@
 #include "src/device.h"
 #include "src/service.h"
 #include "src/profile.h"
+#include "src/reconnect.h"
 
 #define CONTROL_CONNECT_TIMEOUT 2
-#define SOURCE_RETRY_TIMEOUT 2
-#define SINK_RETRY_TIMEOUT SOURCE_RETRY_TIMEOUT
-#define SOURCE_RETRIES 1
-#define SINK_RETRIES SOURCE_RETRIES
 
 static unsigned int service_id = 0;
 static GSList *devices = NULL;
 
+/*
+ * Retries of A2DP connections are shared by all devices so that only a
+ * limited number of page attempts per adapter is outstanding at a time.
+ */
+static struct reconnect_queue *reconnect = NULL;
+static guint reconnect_timer = 0;
+
 struct policy_data {
 	struct btd_device *dev;
 
-	guint source_timer;
-	uint8_t source_retries;
-	guint sink_timer;
-	uint8_t sink_retries;
 	guint ct_timer;
 	guint tg_timer;
 };
@@ -120,12 +121,6 @@ static void policy_remove(void *user_data)
 {
 	struct policy_data *data = user_data;
 
-	if (data->source_timer > 0)
-		g_source_remove(data->source_timer);
-
-	if (data->sink_timer > 0)
-		g_source_remove(data->sink_timer);
-
 	if (data->ct_timer > 0)
 		g_source_remove(data->ct_timer);
 
@@ -151,29 +146,71 @@ static struct policy_data *policy_get_data(struct btd_device *dev)
 	return data;
 }
 
-static gboolean policy_connect_sink(gpointer user_data)
+static uint64_t get_time_ms(void)
 {
-	struct policy_data *data = user_data;
-	struct btd_service *service;
+	return g_get_monotonic_time() / 1000;
+}
 
-	data->source_timer = 0;
-	data->sink_retries++;
+static int policy_reconnect(void *key, void *user_data)
+{
+	struct btd_service *service = key;
+	struct btd_device *dev = btd_service_get_device(service);
+	struct btd_profile *profile = btd_service_get_profile(service);
 
-	service = btd_device_get_service(data->dev, A2DP_SINK_UUID);
-	if (service != NULL)
-		policy_connect(data, service);
+	DBG("%s profile %s", device_get_path(dev), profile->name);
+
+	return btd_service_connect(service);
+}
+
+static void policy_schedule(void);
+
+static gboolean reconnect_timeout(gpointer user_data)
+{
+	reconnect_timer = 0;
+
+	policy_schedule();
 
 	return FALSE;
 }
 
-static void policy_set_sink_timer(struct policy_data *data)
+static void policy_schedule(void)
 {
-	if (data->sink_timer > 0)
-		g_source_remove(data->sink_timer);
+	int delay;
 
-	data->sink_timer = g_timeout_add_seconds(SINK_RETRY_TIMEOUT,
-							policy_connect_sink,
-							data);
+	if (reconnect_timer > 0) {
+		g_source_remove(reconnect_timer);
+		reconnect_timer = 0;
+	}
+
+	delay = reconnect_queue_run(reconnect, get_time_ms());
+	if (delay < 0)
+		return;
+
+	reconnect_timer = g_timeout_add(delay, reconnect_timeout, NULL);
+}
+
+/*
+ * Report the outcome of a connection attempt. Collisions (-EAGAIN) are
+ * queued for retry and attempts started by the queue are retried with
+ * backoff. Returns true if another attempt is scheduled.
+ */
+static bool policy_retry(struct btd_service *service, int err)
+{
+	struct btd_device *dev = btd_service_get_device(service);
+	bool retry = false;
+
+	if (reconnect_queue_contains(reconnect, service))
+		retry = reconnect_queue_complete(reconnect, service, err,
+								get_time_ms());
+	else if (err == -EAGAIN)
+		retry = reconnect_queue_add(reconnect, service,
+						device_get_adapter(dev),
+						device_get_rssi(dev),
+						get_time_ms());
+
+	policy_schedule();
+
+	return retry;
 }
 
 static void sink_cb(struct btd_service *service, btd_service_state_t old_state,
@@ -192,20 +229,10 @@ static void sink_cb(struct btd_service *service, btd_service_state_t old_state,
 	switch (new_state) {
 	case BTD_SERVICE_STATE_UNAVAILABLE:
 	case BTD_SERVICE_STATE_DISCONNECTED:
-		if (old_state == BTD_SERVICE_STATE_CONNECTING) {
-			int err = btd_service_get_error(service);
-
-			if (err == -EAGAIN) {
-				if (data->sink_retries < SINK_RETRIES)
-					policy_set_sink_timer(data);
-				else
-					data->sink_retries = 0;
-				break;
-			} else if (data->sink_timer > 0) {
-				g_source_remove(data->sink_timer);
-				data->sink_timer = 0;
-			}
-		}
+		if (old_state == BTD_SERVICE_STATE_CONNECTING &&
+				policy_retry(service,
+					btd_service_get_error(service)))
+			break;
 
 		if (data->ct_timer > 0) {
 			g_source_remove(data->ct_timer);
@@ -217,10 +244,8 @@ static void sink_cb(struct btd_service *service, btd_service_state_t old_state,
 	case BTD_SERVICE_STATE_CONNECTING:
 		break;
 	case BTD_SERVICE_STATE_CONNECTED:
-		if (data->sink_timer > 0) {
-			g_source_remove(data->sink_timer);
-			data->sink_timer = 0;
-		}
+		if (old_state == BTD_SERVICE_STATE_CONNECTING)
+			policy_retry(service, 0);
 
 		/* Check if service initiate the connection then proceed
 		 * immediatelly otherwise set timer
@@ -260,31 +285,6 @@ static void policy_set_tg_timer(struct policy_data *data)
 							data);
 }
 
-static gboolean policy_connect_source(gpointer user_data)
-{
-	struct policy_data *data = user_data;
-	struct btd_service *service;
-
-	data->source_timer = 0;
-	data->source_retries++;
-
-	service = btd_device_get_service(data->dev, A2DP_SOURCE_UUID);
-	if (service != NULL)
-		policy_connect(data, service);
-
-	return FALSE;
-}
-
-static void policy_set_source_timer(struct policy_data *data)
-{
-	if (data->source_timer > 0)
-		g_source_remove(data->source_timer);
-
-	data->source_timer = g_timeout_add_seconds(SOURCE_RETRY_TIMEOUT,
-							policy_connect_source,
-							data);
-}
-
 static void source_cb(struct btd_service *service,
 						btd_service_state_t old_state,
 						btd_service_state_t new_state)
@@ -302,20 +302,10 @@ static void source_cb(struct btd_service *service,
 	switch (new_state) {
 	case BTD_SERVICE_STATE_UNAVAILABLE:
 	case BTD_SERVICE_STATE_DISCONNECTED:
-		if (old_state == BTD_SERVICE_STATE_CONNECTING) {
-			int err = btd_service_get_error(service);
-
-			if (err == -EAGAIN) {
-				if (data->source_retries < SOURCE_RETRIES)
-					policy_set_source_timer(data);
-				else
-					data->source_retries = 0;
-				break;
-			} else if (data->source_timer > 0) {
-				g_source_remove(data->source_timer);
-				data->source_timer = 0;
-			}
-		}
+		if (old_state == BTD_SERVICE_STATE_CONNECTING &&
+				policy_retry(service,
+					btd_service_get_error(service)))
+			break;
 
 		if (data->tg_timer > 0) {
 			g_source_remove(data->tg_timer);
@@ -327,10 +317,8 @@ static void source_cb(struct btd_service *service,
 	case BTD_SERVICE_STATE_CONNECTING:
 		break;
 	case BTD_SERVICE_STATE_CONNECTED:
-		if (data->source_timer > 0) {
-			g_source_remove(data->source_timer);
-			data->source_timer = 0;
-		}
+		if (old_state == BTD_SERVICE_STATE_CONNECTING)
+			policy_retry(service, 0);
 
 		/* Check if service initiate the connection then proceed
 		 * immediatelly otherwise set timer
@@ -409,6 +397,14 @@ static void service_cb(struct btd_service *service,
 {
 	struct btd_profile *profile = btd_service_get_profile(service);
 
+	if (new_state == BTD_SERVICE_STATE_UNAVAILABLE) {
+		bool queued = reconnect_queue_contains(reconnect, service);
+
+		reconnect_queue_remove(reconnect, service);
+		if (queued)
+			policy_schedule();
+	}
+
 	if (g_str_equal(profile->remote_uuid, A2DP_SINK_UUID))
 		sink_cb(service, old_state, new_state);
 	else if (g_str_equal(profile->remote_uuid, A2DP_SOURCE_UUID))
@@ -421,6 +417,9 @@ static void service_cb(struct btd_service *service,
 
 static int policy_init(void)
 {
+	reconnect = reconnect_queue_new(RECONNECT_MAX_ACTIVE,
+						policy_reconnect, NULL);
+
 	service_id = btd_service_add_state_cb(service_cb, NULL);
 
 	return 0;
@@ -431,6 +430,11 @@ static void policy_exit(void)
 	g_slist_free_full(devices, policy_remove);
 
 	btd_service_remove_state_cb(service_id);
+
+	if (reconnect_timer > 0)
+		g_source_remove(reconnect_timer);
+
+	reconnect_queue_free(reconnect);
 }
 
 BLUETOOTH_PLUGIN_DEFINE(policy, VERSION, BLUETOOTH_PLUGIN_PRIORITY_DEFAULT,
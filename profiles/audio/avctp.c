@@ -29,11 +29,13 @@
 
 #include <stdlib.h>
 #include <stdint.h>
+#include <inttypes.h>
 #include <stdbool.h>
 #include <errno.h>
 #include <unistd.h>
 #include <assert.h>
 #include <signal.h>
+#include <time.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
@@ -64,6 +66,9 @@
 
 #define QUIRK_NO_RELEASE 1 << 0
 
+/* Key press latency buckets, bucket n counts latencies below 2^(n+1) us */
+#define LATENCY_BUCKETS		16
+
 /* Message types */
 #define AVCTP_COMMAND		0
 #define AVCTP_RESPONSE		1
@@ -182,6 +187,14 @@ struct key_pressed {
 	guint timer;
 };
 
+struct key_latency {
+	struct timespec received;
+	unsigned int count;
+	uint64_t total;
+	uint64_t max;
+	unsigned int buckets[LATENCY_BUCKETS];
+};
+
 struct avctp {
 	struct avctp_server *server;
 	struct btd_device *device;
@@ -202,6 +215,7 @@ struct avctp {
 
 	uint8_t key_quirks[256];
 	struct key_pressed key;
+	struct key_latency latency;
 	bool initiator;
 };
 
@@ -269,25 +283,94 @@ static gboolean avctp_passthrough_rsp(struct avctp *session, uint8_t code,
 					uint8_t subunit, uint8_t *operands,
 					size_t operand_count, void *user_data);
 
-static int send_event(int fd, uint16_t type, uint16_t code, int32_t value)
+static void set_event(struct uinput_event *event, uint16_t type,
+					uint16_t code, int32_t value)
 {
-	struct uinput_event event;
-
-	memset(&event, 0, sizeof(event));
-	event.type	= type;
-	event.code	= code;
-	event.value	= value;
+	memset(event, 0, sizeof(*event));
+	event->type	= type;
+	event->code	= code;
+	event->value	= value;
+}
 
-	return write(fd, &event, sizeof(event));
+static int send_events(int fd, struct uinput_event *events, size_t count)
+{
+	/* uinput accepts several events per write, so the key and its
+	 * SYN_REPORT reach the input layer together */
+	return write(fd, events, count * sizeof(*events));
 }
 
 static void send_key(int fd, uint16_t key, int pressed)
 {
+	struct uinput_event events[2];
+
 	if (fd < 0)
 		return;
 
-	send_event(fd, EV_KEY, key, pressed);
-	send_event(fd, EV_SYN, SYN_REPORT, 0);
+	set_event(&events[0], EV_KEY, key, pressed);
+	set_event(&events[1], EV_SYN, SYN_REPORT, 0);
+
+	send_events(fd, events, 2);
+}
+
+static void send_key_click(int fd, uint16_t key)
+{
+	struct uinput_event events[4];
+
+	if (fd < 0)
+		return;
+
+	set_event(&events[0], EV_KEY, key, 1);
+	set_event(&events[1], EV_SYN, SYN_REPORT, 0);
+	set_event(&events[2], EV_KEY, key, 0);
+	set_event(&events[3], EV_SYN, SYN_REPORT, 0);
+
+	send_events(fd, events, 4);
+}
+
+static void latency_record(struct key_latency *latency)
+{
+	struct timespec now;
+	uint64_t usec;
+	unsigned int bucket = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	usec = (now.tv_sec - latency->received.tv_sec) * 1000000ULL +
+		(now.tv_nsec - latency->received.tv_nsec) / 1000;
+
+	while (bucket < LATENCY_BUCKETS - 1 && usec >= (2ULL << bucket))
+		bucket++;
+
+	latency->buckets[bucket]++;
+	latency->count++;
+	latency->total += usec;
+
+	if (usec > latency->max)
+		latency->max = usec;
+}
+
+static void latency_print(struct key_latency *latency)
+{
+	unsigned int i;
+
+	if (latency->count == 0)
+		return;
+
+	DBG("AVCTP: %u key presses, average %" PRIu64 " us, max %"
+				PRIu64 " us", latency->count,
+				latency->total / latency->count, latency->max);
+
+	for (i = 0; i < LATENCY_BUCKETS; i++) {
+		if (latency->buckets[i] == 0)
+			continue;
+
+		if (i == LATENCY_BUCKETS - 1)
+			DBG("AVCTP:   >= %u us: %u", 1 << i,
+							latency->buckets[i]);
+		else
+			DBG("AVCTP:   < %u us: %u", 2 << i,
+							latency->buckets[i]);
+	}
 }
 
 static gboolean auto_release(gpointer user_data)
@@ -351,8 +434,8 @@ static size_t handle_panel_passthrough(struct avctp *session,
 			}
 
 			DBG("AV/C: treating key press as press + release");
-			send_key(session->uinput, key_map[i].uinput, 1);
-			send_key(session->uinput, key_map[i].uinput, 0);
+			send_key_click(session->uinput, key_map[i].uinput);
+			latency_record(&session->latency);
 			break;
 		}
 
@@ -373,6 +456,10 @@ static size_t handle_panel_passthrough(struct avctp *session,
 		}
 
 		send_key(session->uinput, key_map[i].uinput, pressed);
+
+		if (pressed)
+			latency_record(&session->latency);
+
 		break;
 	}
 
@@ -516,6 +603,8 @@ static void avctp_disconnected(struct avctp *session)
 		ba2str(device_get_address(session->device), address);
 		DBG("AVCTP: closing uinput for %s", address);
 
+		latency_print(&session->latency);
+
 		ioctl(session->uinput, UI_DEV_DESTROY);
 		close(session->uinput);
 		session->uinput = -1;
@@ -546,19 +635,24 @@ static void avctp_set_state(struct avctp *session, avctp_state_t new_state)
 	switch (new_state) {
 	case AVCTP_STATE_DISCONNECTED:
 		DBG("AVCTP Disconnected");
+		device_trace(session->device, "avctp", "disconnected");
 		avctp_disconnected(session);
 		break;
 	case AVCTP_STATE_CONNECTING:
 		DBG("AVCTP Connecting");
+		device_trace(session->device, "avctp", "connecting");
 		break;
 	case AVCTP_STATE_CONNECTED:
 		DBG("AVCTP Connected");
+		device_trace(session->device, "avctp", "connected");
 		break;
 	case AVCTP_STATE_BROWSING_CONNECTING:
 		DBG("AVCTP Browsing Connecting");
+		device_trace(session->device, "avctp", "browsing connecting");
 		break;
 	case AVCTP_STATE_BROWSING_CONNECTED:
 		DBG("AVCTP Browsing Connected");
+		device_trace(session->device, "avctp", "browsing connected");
 		break;
 	default:
 		error("Invalid AVCTP state %d", new_state);
@@ -768,7 +862,8 @@ static void control_response(struct avctp_channel *control,
 
 		control->p = NULL;
 
-		if (control->process_id == 0)
+		if (control->process_id == 0 &&
+					!g_queue_is_empty(control->queue))
 			control->process_id = g_idle_add(process_queue,
 								control);
 	}
@@ -925,6 +1020,8 @@ static gboolean session_cb(GIOChannel *chan, GIOCondition cond,
 	if (ret <= 0)
 		goto failed;
 
+	clock_gettime(CLOCK_MONOTONIC, &session->latency.received);
+
 	if ((unsigned int) ret < sizeof(struct avctp_header)) {
 		error("Too small AVCTP packet");
 		goto failed;
@@ -1512,6 +1609,15 @@ static int avctp_send_req(struct avctp *session, uint8_t code,
 
 	g_queue_push_tail(control->queue, p);
 
+	/* Send passthrough right away when nothing is outstanding instead
+	 * of waiting for the main loop to become idle */
+	if (opcode == AVC_OP_PASSTHROUGH && control->p == NULL &&
+					control->process_id == 0 &&
+					g_queue_get_length(control->queue) == 1) {
+		process_queue(control);
+		return 0;
+	}
+
 	if (control->process_id == 0)
 		control->process_id = g_idle_add(process_queue, control);
 
@@ -718,6 +718,18 @@ static void avdtp_set_state(struct avdtp *session,
 
 	session->state = new_state;
 
+	switch (new_state) {
+	case AVDTP_SESSION_STATE_DISCONNECTED:
+		device_trace(session->device, "avdtp", "disconnected");
+		break;
+	case AVDTP_SESSION_STATE_CONNECTING:
+		device_trace(session->device, "avdtp", "connecting");
+		break;
+	case AVDTP_SESSION_STATE_CONNECTED:
+		device_trace(session->device, "avdtp", "connected");
+		break;
+	}
+
 	for (l = avdtp_callbacks; l != NULL; l = l->next) {
 		struct avdtp_state_callback *cb = l->data;
 
@@ -997,6 +1009,8 @@ static void avdtp_sep_set_state(struct avdtp *session,
 	old_state = sep->state;
 	sep->state = state;
 
+	device_trace(session->device, "avdtp-stream", avdtp_statestr(state));
+
 	switch (state) {
 	case AVDTP_STATE_CONFIGURED:
 		if (sep->info.type == AVDTP_SEP_TYPE_SINK)
@@ -186,6 +186,8 @@ struct pending_pdu {
 
 struct pending_list_items {
 	GSList *items;
+	GHashTable *seen;
+	uint32_t received;
 	uint32_t start;
 	uint32_t end;
 };
@@ -2169,7 +2171,7 @@ static gboolean avrcp_list_items_rsp(struct avctp *conn, uint8_t *operands,
 	struct avrcp_player *player = session->player;
 	struct pending_list_items *p = player->p;
 	uint16_t count;
-	uint32_t items, total;
+	uint32_t total;
 	size_t i;
 	int err = 0;
 
@@ -2195,6 +2197,8 @@ static gboolean avrcp_list_items_rsp(struct avctp *conn, uint8_t *operands,
 	if (count == 0)
 		goto done;
 
+	p->received += count;
+
 	for (i = 8; count && i + 3 < operand_count; count--) {
 		struct media_item *item;
 		uint8_t type;
@@ -2220,25 +2224,31 @@ static gboolean avrcp_list_items_rsp(struct avctp *conn, uint8_t *operands,
 			item = parse_media_folder(session, &operands[i], len);
 
 		if (item) {
-			if (g_slist_find(p->items, item))
+			/* Stop if the TG starts repeating items */
+			if (g_hash_table_lookup(p->seen, item))
 				goto done;
-			p->items = g_slist_append(p->items, item);
+
+			g_hash_table_insert(p->seen, item, item);
+			p->items = g_slist_prepend(p->items, item);
 		}
 
 		i += len;
 	}
 
-	items = g_slist_length(p->items);
-	total = p->end - p->start;
-	if (items < total) {
-		avrcp_list_items(session, p->start + items + 1, p->end);
+	/* Start and end are inclusive, request what the TG left out */
+	total = p->end - p->start + 1;
+	if (p->received < total) {
+		avrcp_list_items(session, p->start + p->received, p->end);
 		return FALSE;
 	}
 
 done:
-	media_player_list_complete(player->user_data, p->items, err);
+	p->items = g_slist_reverse(p->items);
+	media_player_list_complete(player->user_data, p->items, p->received,
+									err);
 
 	g_slist_free(p->items);
+	g_hash_table_destroy(p->seen);
 	g_free(p);
 	player->p = NULL;
 
@@ -2597,6 +2607,7 @@ static int ct_list_items(struct media_player *mp, const char *name,
 	avrcp_list_items(session, start, end);
 
 	p = g_new0(struct pending_list_items, 1);
+	p->seen = g_hash_table_new(NULL, NULL);
 	p->start = start;
 	p->end = end;
 	player->p = p;
@@ -3111,6 +3122,9 @@ static void avrcp_uids_changed(struct avrcp *session, struct avrcp_header *pdu)
 	struct avrcp_player *player = session->player;
 
 	player->uid_counter = bt_get_be16(&pdu->params[1]);
+
+	/* Listed items are only valid for the previous UID counter */
+	media_player_invalidate_items(player->user_data);
 }
 
 static gboolean avrcp_handle_event(struct avctp *conn,
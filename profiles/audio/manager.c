@@ -307,6 +307,9 @@ static struct btd_profile avrcp_target_profile = {
 	.connect	= avrcp_control_connect,
 	.disconnect	= avrcp_control_disconnect,
 
+	.after_services	= BTD_PROFILE_UUID(A2DP_SOURCE_UUID,
+							A2DP_SINK_UUID),
+
 	.adapter_probe	= avrcp_target_server_probe,
 	.adapter_remove = avrcp_target_server_remove,
 };
@@ -321,6 +324,9 @@ static struct btd_profile avrcp_remote_profile = {
 	.connect	= avrcp_control_connect,
 	.disconnect	= avrcp_control_disconnect,
 
+	.after_services	= BTD_PROFILE_UUID(A2DP_SOURCE_UUID,
+							A2DP_SINK_UUID),
+
 	.adapter_probe	= avrcp_remote_server_probe,
 	.adapter_remove = avrcp_remote_server_remove,
 };
@@ -47,6 +47,9 @@
 #define MEDIA_FOLDER_INTERFACE "org.bluez.MediaFolder1"
 #define MEDIA_ITEM_INTERFACE "org.bluez.MediaItem1"
 
+#define FOLDER_WINDOW_SIZE 64
+#define MAX_CACHED_ITEMS 1024
+
 struct player_callback {
 	const struct media_player_callback *cbs;
 	void *user_data;
@@ -58,8 +61,16 @@ struct pending_req {
 	const char *value;
 };
 
+struct media_window {
+	struct media_folder	*folder;
+	uint32_t		start;		/* Offset of the first item */
+	GPtrArray		*items;		/* Items in listing order */
+	GList			*link;		/* Player LRU queue link */
+};
+
 struct media_item {
 	struct media_player	*player;
+	struct media_window	*window;	/* Window listing the item */
 	char			*path;		/* Item object path */
 	char			*name;		/* Item name */
 	player_item_type_t	type;		/* Item type */
@@ -74,7 +85,13 @@ struct media_folder {
 	struct media_item	*item;		/* Folder item */
 	uint32_t		number_of_items;/* Number of items */
 	GSList			*subfolders;
-	GSList			*items;
+	GHashTable		*items;		/* Items by object path */
+	GHashTable		*uids;		/* Items by uid */
+	GHashTable		*windows;	/* Listed windows by offset */
+	uint32_t		items_end;	/* Known end of the listing */
+	uint32_t		list_start;	/* Pending ListItems range */
+	uint32_t		list_end;
+	uint32_t		list_window;	/* Window being listed */
 	DBusMessage		*msg;
 };
 
@@ -99,6 +116,8 @@ struct media_player {
 	struct player_callback	*cb;
 	GSList			*pending;
 	GSList			*folders;
+	GQueue			*windows;	/* Listed windows, LRU first */
+	unsigned int		cached_items;	/* Items in listed windows */
 };
 
 static void append_track(void *key, void *value, void *user_data)
@@ -616,21 +635,148 @@ done:
 	folder->msg = NULL;
 }
 
-void media_player_list_complete(struct media_player *mp, GSList *items,
-								int err)
+static void media_window_free(struct media_window *window)
 {
-	struct media_folder *folder = mp->scope;
-	DBusMessage *reply;
-	DBusMessageIter iter, array;
+	g_ptr_array_free(window->items, TRUE);
+	g_free(window);
+}
 
-	if (folder == NULL || folder->msg == NULL)
-		return;
+static void media_window_evict(struct media_player *mp,
+						struct media_window *window)
+{
+	struct media_folder *folder = window->folder;
+	guint i;
 
-	if (err < 0) {
-		reply = btd_error_failed(folder->msg, strerror(-err));
-		goto done;
+	DBG("%s start %u items %u", folder->item->name, window->start,
+							window->items->len);
+
+	for (i = 0; i < window->items->len; i++) {
+		struct media_item *item = g_ptr_array_index(window->items, i);
+
+		/* Folders are owned by their media_folder */
+		if (item->type == PLAYER_ITEM_TYPE_FOLDER ||
+						item->window != window)
+			continue;
+
+		if (item->uid > 0)
+			g_hash_table_remove(folder->uids, &item->uid);
+
+		g_hash_table_remove(folder->items, item->path);
 	}
 
+	mp->cached_items -= window->items->len;
+	g_queue_delete_link(mp->windows, window->link);
+	g_hash_table_remove(folder->windows, GUINT_TO_POINTER(window->start));
+
+	/* The end of the listing has to be found again */
+	folder->items_end = UINT32_MAX;
+
+	media_window_free(window);
+}
+
+static void media_window_touch(struct media_player *mp,
+						struct media_window *window)
+{
+	g_queue_unlink(mp->windows, window->link);
+	g_queue_push_head_link(mp->windows, window->link);
+}
+
+/*
+ * Evict least recently listed windows, and with them the item objects,
+ * until the cache fits again. The first keep windows are the ones just
+ * returned by ListItems so they are never evicted.
+ */
+static void media_player_trim_cache(struct media_player *mp,
+							unsigned int keep)
+{
+	while (mp->cached_items > MAX_CACHED_ITEMS &&
+				g_queue_get_length(mp->windows) > keep)
+		media_window_evict(mp, g_queue_peek_tail(mp->windows));
+}
+
+static void media_folder_clear(struct media_player *mp,
+						struct media_folder *folder)
+{
+	GList *l, *next;
+
+	for (l = mp->windows->head; l; l = next) {
+		struct media_window *window = l->data;
+
+		next = l->next;
+
+		if (window->folder == folder)
+			media_window_evict(mp, window);
+	}
+
+	g_hash_table_remove_all(folder->uids);
+	g_hash_table_remove_all(folder->items);
+	folder->items_end = UINT32_MAX;
+}
+
+static struct media_window *media_folder_add_window(struct media_player *mp,
+						struct media_folder *folder,
+						uint32_t start, GSList *items,
+						uint32_t count)
+{
+	struct media_window *window, *old;
+	GSList *stale = NULL, *l;
+
+	window = g_new0(struct media_window, 1);
+	window->folder = folder;
+	window->start = start;
+	window->items = g_ptr_array_sized_new(FOLDER_WINDOW_SIZE);
+
+	for (l = items; l; l = l->next) {
+		struct media_item *item = l->data;
+
+		g_ptr_array_add(window->items, item);
+
+		if (item->type == PLAYER_ITEM_TYPE_FOLDER)
+			continue;
+
+		/* An item listed at another offset means the listing has
+		 * changed, so the window it was listed in is stale. */
+		if (item->window != NULL && item->window != window &&
+				!g_slist_find(stale, item->window))
+			stale = g_slist_prepend(stale, item->window);
+
+		item->window = window;
+	}
+
+	for (l = stale; l; l = l->next)
+		media_window_evict(mp, l->data);
+
+	g_slist_free(stale);
+
+	old = g_hash_table_lookup(folder->windows, GUINT_TO_POINTER(start));
+	if (old != NULL)
+		media_window_evict(mp, old);
+
+	g_hash_table_insert(folder->windows, GUINT_TO_POINTER(start), window);
+	window->link = g_list_alloc();
+	window->link->data = window;
+	g_queue_push_head_link(mp->windows, window->link);
+	mp->cached_items += window->items->len;
+
+	/* Items that failed to parse or register don't shorten the listing,
+	 * only the number of items returned by the TG does. */
+	if (count < FOLDER_WINDOW_SIZE && start + count < folder->items_end)
+		folder->items_end = start + count;
+
+	DBG("%s start %u items %u cached %u", folder->item->name, start,
+					window->items->len, mp->cached_items);
+
+	return window;
+}
+
+static void media_folder_list_reply(struct media_player *mp,
+						struct media_folder *folder)
+{
+	DBusMessage *reply;
+	DBusMessageIter iter, array;
+	unsigned int touched = 0;
+	uint32_t start;
+
 	reply = dbus_message_new_method_return(folder->msg);
 
 	dbus_message_iter_init_append(reply, &iter);
@@ -646,15 +792,117 @@ void media_player_list_complete(struct media_player *mp, GSList *items,
 					DBUS_DICT_ENTRY_END_CHAR_AS_STRING,
 					&array);
 
-	g_slist_foreach(items, parse_folder_list, &array);
+	start = folder->list_start - folder->list_start % FOLDER_WINDOW_SIZE;
+
+	for (; start <= folder->list_end && start < folder->items_end;
+					start += FOLDER_WINDOW_SIZE) {
+		struct media_window *window;
+		guint i;
+
+		window = g_hash_table_lookup(folder->windows,
+						GUINT_TO_POINTER(start));
+		if (window == NULL)
+			break;
+
+		media_window_touch(mp, window);
+		touched++;
+
+		for (i = 0; i < window->items->len; i++) {
+			uint32_t offset = start + i;
+
+			if (offset < folder->list_start)
+				continue;
+
+			if (offset > folder->list_end)
+				break;
+
+			parse_folder_list(g_ptr_array_index(window->items, i),
+									&array);
+		}
+
+		if (start > UINT32_MAX - FOLDER_WINDOW_SIZE)
+			break;
+	}
+
 	dbus_message_iter_close_container(&iter, &array);
 
-done:
+	g_dbus_send_message(btd_get_dbus_connection(), reply);
+	dbus_message_unref(folder->msg);
+	folder->msg = NULL;
+
+	media_player_trim_cache(mp, touched);
+}
+
+/*
+ * Request the first window of the pending range which is not cached yet,
+ * or reply right away if the whole range is available.
+ */
+static int media_folder_list_next(struct media_player *mp,
+						struct media_folder *folder)
+{
+	struct player_callback *cb = mp->cb;
+	uint32_t start, end;
+
+	start = folder->list_start - folder->list_start % FOLDER_WINDOW_SIZE;
+
+	for (; start <= folder->list_end && start < folder->items_end;
+					start += FOLDER_WINDOW_SIZE) {
+		if (g_hash_table_lookup(folder->windows,
+						GUINT_TO_POINTER(start))) {
+			if (start > UINT32_MAX - FOLDER_WINDOW_SIZE)
+				break;
+			continue;
+		}
+
+		end = start + FOLDER_WINDOW_SIZE - 1;
+		if (folder->number_of_items > 0 &&
+					end >= folder->number_of_items)
+			end = folder->number_of_items - 1;
+
+		folder->list_window = start;
+
+		return cb->cbs->list_items(mp, folder->item->name, start, end,
+							cb->user_data);
+	}
+
+	media_folder_list_reply(mp, folder);
+
+	return 0;
+}
+
+void media_player_list_complete(struct media_player *mp, GSList *items,
+						uint32_t count, int err)
+{
+	struct media_folder *folder = mp->scope;
+	DBusMessage *reply;
+
+	if (folder == NULL || folder->msg == NULL)
+		return;
+
+	if (err < 0)
+		goto failed;
+
+	media_folder_add_window(mp, folder, folder->list_window, items, count);
+
+	err = media_folder_list_next(mp, folder);
+	if (err == 0)
+		return;
+
+failed:
+	reply = btd_error_failed(folder->msg, strerror(-err));
 	g_dbus_send_message(btd_get_dbus_connection(), reply);
 	dbus_message_unref(folder->msg);
 	folder->msg = NULL;
 }
 
+void media_player_invalidate_items(struct media_player *mp)
+{
+	DBG("%s", mp->path);
+
+	while (!g_queue_is_empty(mp->windows))
+		media_window_evict(mp, g_queue_peek_tail(mp->windows));
+}
+
 static struct media_item *
 media_player_create_subfolder(struct media_player *mp, const char *name,
 								uint64_t uid)
@@ -674,6 +922,8 @@ media_player_create_subfolder(struct media_player *mp, const char *name,
 	return item;
 }
 
+static struct media_folder *media_folder_new(struct media_item *item);
+
 void media_player_search_complete(struct media_player *mp, int ret)
 {
 	struct media_folder *folder = mp->scope;
@@ -689,8 +939,8 @@ void media_player_search_complete(struct media_player *mp, int ret)
 	}
 
 	if (search == NULL) {
-		search = g_new0(struct media_folder, 1);
-		search->item = media_player_create_subfolder(mp, "search", 0);
+		search = media_folder_new(
+			media_player_create_subfolder(mp, "search", 0));
 		mp->search = search;
 		mp->folders = g_slist_prepend(mp->folders, search);
 	}
@@ -857,7 +1107,7 @@ static DBusMessage *media_folder_list_items(DBusConnection *conn,
 
 	dbus_message_iter_init(msg, &iter);
 
-	if (parse_filters(mp, &iter, &start, &end) < 0)
+	if (parse_filters(mp, &iter, &start, &end) < 0 || end < start)
 		return btd_error_invalid_args(msg);
 
 	if (cb->cbs->list_items == NULL)
@@ -866,13 +1116,21 @@ static DBusMessage *media_folder_list_items(DBusConnection *conn,
 	if (folder->msg != NULL)
 		return btd_error_failed(msg, strerror(EBUSY));
 
-	err = cb->cbs->list_items(mp, folder->item->name, start, end,
-							cb->user_data);
-	if (err < 0)
-		return btd_error_failed(msg, strerror(-err));
+	/* Large folders have to be listed in pages */
+	if (end - start >= MAX_CACHED_ITEMS)
+		end = start + MAX_CACHED_ITEMS - 1;
 
+	folder->list_start = start;
+	folder->list_end = end;
 	folder->msg = dbus_message_ref(msg);
 
+	err = media_folder_list_next(mp, folder);
+	if (err < 0) {
+		dbus_message_unref(folder->msg);
+		folder->msg = NULL;
+		return btd_error_failed(msg, strerror(-err));
+	}
+
 	return NULL;
 }
 
@@ -898,12 +1156,32 @@ static void media_item_destroy(void *data)
 	media_item_free(item);
 }
 
+static struct media_folder *media_folder_new(struct media_item *item)
+{
+	struct media_folder *folder;
+
+	folder = g_new0(struct media_folder, 1);
+	folder->item = item;
+	folder->items = g_hash_table_new_full(g_str_hash, g_str_equal, NULL,
+							media_item_destroy);
+	folder->uids = g_hash_table_new(g_int64_hash, g_int64_equal);
+	folder->windows = g_hash_table_new(NULL, NULL);
+	folder->items_end = UINT32_MAX;
+
+	return folder;
+}
+
 static void media_folder_destroy(void *data)
 {
 	struct media_folder *folder = data;
 
+	/* The windows list the subfolder items, so drop them first */
+	media_folder_clear(folder->item->player, folder);
+
 	g_slist_free_full(folder->subfolders, media_folder_destroy);
-	g_slist_free_full(folder->items, media_item_destroy);
+	g_hash_table_destroy(folder->windows);
+	g_hash_table_destroy(folder->uids);
+	g_hash_table_destroy(folder->items);
 
 	if (folder->msg != NULL)
 		dbus_message_unref(folder->msg);
@@ -931,8 +1209,7 @@ static void media_player_change_scope(struct media_player *mp,
 		goto done;
 
 cleanup:
-	g_slist_free_full(mp->scope->items, media_item_destroy);
-	mp->scope->items = NULL;
+	media_folder_clear(mp, mp->scope);
 
 	/* Destroy search folder if it exists and is not being set as scope */
 	if (mp->search != NULL && folder != mp->search) {
@@ -1138,7 +1415,11 @@ void media_player_destroy(struct media_player *mp)
 						MEDIA_FOLDER_INTERFACE);
 
 	g_slist_free_full(mp->pending, g_free);
+
+	/* Windows of one folder can list the subfolders of another */
+	media_player_invalidate_items(mp);
 	g_slist_free_full(mp->folders, media_folder_destroy);
+	g_queue_free(mp->windows);
 
 	g_timer_destroy(mp->progress);
 	g_free(mp->cb);
@@ -1164,6 +1445,7 @@ struct media_player *media_player_controller_create(const char *path,
 	mp->track = g_hash_table_new_full(g_str_hash, g_str_equal,
 							g_free, g_free);
 	mp->progress = g_timer_new();
+	mp->windows = g_queue_new();
 
 	if (!g_dbus_register_interface(btd_get_dbus_connection(),
 					mp->path, MEDIA_PLAYER_INTERFACE,
@@ -1441,19 +1723,10 @@ void media_player_set_playlist(struct media_player *mp, const char *name)
 static struct media_item *media_folder_find_item(struct media_folder *folder,
 								uint64_t uid)
 {
-	GSList *l;
-
 	if (uid == 0)
 		return NULL;
 
-	for (l = folder->items; l; l = l->next) {
-		struct media_item *item = l->data;
-
-		if (item->uid == uid)
-			return item;
-	}
-
-	return NULL;
+	return g_hash_table_lookup(folder->uids, &uid);
 }
 
 static DBusMessage *media_item_play(DBusConnection *conn, DBusMessage *msg,
@@ -1755,7 +2028,9 @@ static struct media_item *media_folder_create_item(struct media_player *mp,
 	}
 
 	if (type != PLAYER_ITEM_TYPE_FOLDER) {
-		folder->items = g_slist_prepend(folder->items, item);
+		g_hash_table_insert(folder->items, item->path, item);
+		if (uid > 0)
+			g_hash_table_insert(folder->uids, &item->uid, item);
 		item->metadata = g_hash_table_new_full(g_str_hash, g_str_equal,
 							g_free, g_free);
 	}
@@ -1814,8 +2089,7 @@ struct media_item *media_player_create_folder(struct media_player *mp,
 	if (item == NULL)
 		return NULL;
 
-	folder = g_new0(struct media_folder, 1);
-	folder->item = item;
+	folder = media_folder_new(item);
 
 	item->folder_type = type;
 
@@ -100,7 +100,8 @@ struct media_item *media_player_create_item(struct media_player *mp,
 
 void media_item_set_playable(struct media_item *item, bool value);
 void media_player_list_complete(struct media_player *mp, GSList *items,
-								int err);
+						uint32_t count, int err);
+void media_player_invalidate_items(struct media_player *mp);
 void media_player_change_folder_complete(struct media_player *player,
 						const char *path, int ret);
 void media_player_search_complete(struct media_player *mp, int ret);
@@ -46,7 +46,6 @@
 #include "../src/device.h"
 #include "../src/profile.h"
 #include "../src/service.h"
-#include "../src/storage.h"
 #include "../src/dbus-common.h"
 
 #include "device.h"
@@ -374,10 +373,7 @@ static int hidp_add_connection(struct input_device *idev)
 {
 	struct hidp_connadd_req *req;
 	sdp_record_t *rec;
-	char src_addr[18], dst_addr[18];
-	char filename[PATH_MAX + 1];
-	GKeyFile *key_file;
-	char handle[11], *str;
+	char dst_addr[18];
 	GError *gerr = NULL;
 	int err;
 
@@ -387,28 +383,15 @@ static int hidp_add_connection(struct input_device *idev)
 	req->flags     = 0;
 	req->idle_to   = idle_timeout;
 
-	ba2str(&idev->src, src_addr);
 	ba2str(&idev->dst, dst_addr);
 
-	snprintf(filename, PATH_MAX, STORAGEDIR "/%s/cache/%s", src_addr,
-								dst_addr);
-	filename[PATH_MAX] = '\0';
-	sprintf(handle, "0x%8.8X", idev->handle);
-
-	key_file = g_key_file_new();
-	g_key_file_load_from_file(key_file, filename, 0, NULL);
-	str = g_key_file_get_string(key_file, "ServiceRecords", handle, NULL);
-	g_key_file_free(key_file);
-
-	if (!str) {
+	rec = btd_device_read_record(idev->device, idev->handle);
+	if (!rec) {
 		error("Rejected connection from unknown device %s", dst_addr);
 		err = -EPERM;
 		goto cleanup;
 	}
 
-	rec = record_from_string(str);
-	g_free(str);
-
 	err = extract_hid_record(rec, req);
 	sdp_record_free(rec);
 	if (err < 0) {
@@ -545,6 +528,8 @@ static int input_device_connected(struct input_device *idev)
 	if (err < 0)
 		return err;
 
+	device_trace(idev->device, "hidp", "connected");
+
 	idev->dc_id = device_add_disconnect_watch(idev->device, disconnect_cb,
 							idev, NULL);
 
@@ -604,6 +589,8 @@ static void control_connect_cb(GIOChannel *chan, GError *conn_err,
 		goto failed;
 	}
 
+	device_trace(idev->device, "hidp", "control connected");
+
 	/* Connect to the HID interrupt channel */
 	io = bt_io_connect(interrupt_connect_cb, idev,
 				NULL, &err,
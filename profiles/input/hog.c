@@ -34,6 +34,7 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <limits.h>
 #include "uhid_copy.h"
 
 #include <bluetooth/bluetooth.h>
@@ -43,6 +44,7 @@
 #include "log.h"
 
 #include "lib/uuid.h"
+#include "src/textfile.h"
 #include "src/adapter.h"
 #include "src/device.h"
 #include "src/profile.h"
@@ -75,6 +77,8 @@
 #define HOG_REPORT_MAP_MAX_SIZE        512
 #define HID_INFO_SIZE			4
 
+#define HOG_CACHE_FILE		"hog"
+
 struct hog_device {
 	uint16_t		id;
 	struct btd_device	*device;
@@ -90,17 +94,26 @@ struct hog_device {
 	uint16_t		proto_mode_handle;
 	uint16_t		ctrlpt_handle;
 	uint8_t			flags;
+	uint8_t			*report_map;
+	uint16_t		report_map_len;
+	char			*signature;
+	gboolean		uhid_created;
+	gboolean		cached;
+	unsigned int		disc_pending;	/* Discovery reads in flight */
+	gboolean		disc_failed;
 };
 
 struct report {
 	uint8_t			id;
 	uint8_t			type;
+	uint16_t		ccc_handle;
 	guint			notifyid;
 	struct gatt_char	*decl;
 	struct hog_device	*hogdev;
 };
 
 struct disc_desc_cb_data {
+	struct hog_device *hogdev;
 	uint16_t end;
 	gpointer data;
 };
@@ -108,6 +121,273 @@ struct disc_desc_cb_data {
 static gboolean suspend_supported = FALSE;
 static GSList *devices = NULL;
 
+static void char_discovered_cb(GSList *chars, guint8 status,
+							gpointer user_data);
+static void report_free(void *data);
+
+static char *cache_filename(struct hog_device *hogdev)
+{
+	struct btd_adapter *adapter = device_get_adapter(hogdev->device);
+	char src_addr[18], dst_addr[18];
+
+	ba2str(adapter_get_address(adapter), src_addr);
+	ba2str(device_get_address(hogdev->device), dst_addr);
+
+	return g_strdup_printf(STORAGEDIR "/%s/%s/" HOG_CACHE_FILE, src_addr,
+								dst_addr);
+}
+
+static char *chars_signature(GSList *chars)
+{
+	GString *signature = g_string_new(NULL);
+	GSList *l;
+
+	for (l = chars; l; l = g_slist_next(l)) {
+		struct gatt_char *chr = l->data;
+
+		g_string_append_printf(signature, "%04x:%04x:%02x:%s;",
+					chr->handle, chr->value_handle,
+					chr->properties, chr->uuid);
+	}
+
+	return g_string_free(signature, FALSE);
+}
+
+static void cache_store(struct hog_device *hogdev)
+{
+	GKeyFile *key_file;
+	char *filename, *data, *map;
+	char group[6], info[9];
+	const char **list;
+	gsize length = 0;
+	GSList *l;
+	int i;
+
+	if (!device_is_bonded(hogdev->device))
+		return;
+
+	if (hogdev->report_map == NULL || hogdev->signature == NULL)
+		return;
+
+	filename = cache_filename(hogdev);
+
+	key_file = g_key_file_new();
+	g_key_file_load_from_file(key_file, filename, 0, NULL);
+
+	sprintf(group, "%hu", hogdev->hog_primary->range.start);
+
+	g_key_file_remove_group(key_file, group, NULL);
+
+	g_key_file_set_integer(key_file, group, "EndGroupHandle",
+					hogdev->hog_primary->range.end);
+	g_key_file_set_string(key_file, group, "Signature",
+							hogdev->signature);
+
+	map = g_malloc0(hogdev->report_map_len * 2 + 1);
+	for (i = 0; i < hogdev->report_map_len; i++)
+		sprintf(map + (i * 2), "%2.2X", hogdev->report_map[i]);
+
+	g_key_file_set_string(key_file, group, "ReportMap", map);
+	g_free(map);
+
+	sprintf(info, "%4.4X%2.2X%2.2X", hogdev->bcdhid,
+					hogdev->bcountrycode, hogdev->flags);
+	g_key_file_set_string(key_file, group, "Information", info);
+
+	g_key_file_set_integer(key_file, group, "ProtocolModeHandle",
+						hogdev->proto_mode_handle);
+	g_key_file_set_integer(key_file, group, "ControlPointHandle",
+						hogdev->ctrlpt_handle);
+
+	list = g_new0(const char *, g_slist_length(hogdev->reports) + 1);
+
+	for (l = hogdev->reports, i = 0; l; l = l->next, i++) {
+		struct report *r = l->data;
+
+		list[i] = g_strdup_printf("%04x:%04x:%02x:%02x:%02x:%04x:%s",
+					r->decl->handle, r->decl->value_handle,
+					r->decl->properties, r->id, r->type,
+					r->ccc_handle, r->decl->uuid);
+	}
+
+	g_key_file_set_string_list(key_file, group, "Reports", list, i);
+	g_strfreev((char **) list);
+
+	data = g_key_file_to_data(key_file, &length, NULL);
+	if (length > 0) {
+		create_file(filename, S_IRUSR | S_IWUSR);
+		g_file_set_contents(filename, data, length, NULL);
+	}
+
+	g_free(data);
+	g_free(filename);
+	g_key_file_free(key_file);
+}
+
+/*
+ * Discovery results arrive through many independent ATT transactions.
+ * Each one is counted, and the cache is only written once all of them
+ * have succeeded, so an interrupted discovery is never cached.
+ */
+static void discovery_start(struct hog_device *hogdev)
+{
+	hogdev->disc_pending++;
+}
+
+static void discovery_done(struct hog_device *hogdev, gboolean success)
+{
+	if (!success)
+		hogdev->disc_failed = TRUE;
+
+	if (--hogdev->disc_pending > 0)
+		return;
+
+	if (hogdev->disc_failed) {
+		DBG("HoG discovery of device 0x%04X incomplete", hogdev->id);
+		return;
+	}
+
+	cache_store(hogdev);
+}
+
+static void cache_remove(struct hog_device *hogdev)
+{
+	GKeyFile *key_file;
+	char *filename, *data;
+	char group[6];
+	gsize length = 0;
+
+	filename = cache_filename(hogdev);
+
+	key_file = g_key_file_new();
+
+	if (!g_key_file_load_from_file(key_file, filename, 0, NULL))
+		goto done;
+
+	sprintf(group, "%hu", hogdev->hog_primary->range.start);
+
+	if (!g_key_file_remove_group(key_file, group, NULL))
+		goto done;
+
+	data = g_key_file_to_data(key_file, &length, NULL);
+	if (length > 0)
+		g_file_set_contents(filename, data, length, NULL);
+	else
+		unlink(filename);
+
+	g_free(data);
+
+done:
+	g_free(filename);
+	g_key_file_free(key_file);
+}
+
+static struct report *cache_parse_report(struct hog_device *hogdev,
+							const char *str)
+{
+	struct report *report;
+	unsigned int handle, value_handle, properties, id, type, ccc;
+	char uuid[MAX_LEN_UUID_STR + 1];
+
+	if (sscanf(str, "%04x:%04x:%02x:%02x:%02x:%04x:%36s", &handle,
+					&value_handle, &properties, &id,
+					&type, &ccc, uuid) != 7)
+		return NULL;
+
+	report = g_new0(struct report, 1);
+	report->hogdev = hogdev;
+	report->id = id;
+	report->type = type;
+	report->ccc_handle = ccc;
+
+	report->decl = g_new0(struct gatt_char, 1);
+	report->decl->handle = handle;
+	report->decl->value_handle = value_handle;
+	report->decl->properties = properties;
+	strcpy(report->decl->uuid, uuid);
+
+	return report;
+}
+
+static gboolean cache_load(struct hog_device *hogdev)
+{
+	GKeyFile *key_file;
+	char *filename, *str = NULL, *info = NULL;
+	char **list = NULL;
+	char group[6];
+	gsize len, i;
+	GSList *reports = NULL;
+	gboolean ret = FALSE;
+
+	filename = cache_filename(hogdev);
+
+	key_file = g_key_file_new();
+
+	if (!g_key_file_load_from_file(key_file, filename, 0, NULL))
+		goto done;
+
+	sprintf(group, "%hu", hogdev->hog_primary->range.start);
+
+	if (g_key_file_get_integer(key_file, group, "EndGroupHandle",
+				NULL) != hogdev->hog_primary->range.end)
+		goto done;
+
+	str = g_key_file_get_string(key_file, group, "ReportMap", NULL);
+	if (!str || strlen(str) % 2 ||
+			strlen(str) / 2 > HOG_REPORT_MAP_MAX_SIZE)
+		goto done;
+
+	info = g_key_file_get_string(key_file, group, "Information", NULL);
+	if (!info || strlen(info) != HID_INFO_SIZE * 2)
+		goto done;
+
+	list = g_key_file_get_string_list(key_file, group, "Reports", &len,
+									NULL);
+	if (!list)
+		goto done;
+
+	for (i = 0; i < len; i++) {
+		struct report *report = cache_parse_report(hogdev, list[i]);
+
+		if (!report) {
+			g_slist_free_full(reports, report_free);
+			goto done;
+		}
+
+		reports = g_slist_append(reports, report);
+	}
+
+	hogdev->signature = g_key_file_get_string(key_file, group,
+							"Signature", NULL);
+
+	hogdev->report_map_len = strlen(str) / 2;
+	hogdev->report_map = g_malloc0(hogdev->report_map_len);
+	for (i = 0; i < hogdev->report_map_len; i++)
+		sscanf(str + (i * 2), "%02hhX", &hogdev->report_map[i]);
+
+	sscanf(info, "%04hX%02hhX%02hhX", &hogdev->bcdhid,
+				&hogdev->bcountrycode, &hogdev->flags);
+
+	hogdev->proto_mode_handle = g_key_file_get_integer(key_file, group,
+						"ProtocolModeHandle", NULL);
+	hogdev->ctrlpt_handle = g_key_file_get_integer(key_file, group,
+						"ControlPointHandle", NULL);
+
+	hogdev->reports = reports;
+	hogdev->cached = TRUE;
+
+	ret = TRUE;
+
+done:
+	g_strfreev(list);
+	g_free(info);
+	g_free(str);
+	g_free(filename);
+	g_key_file_free(key_file);
+
+	return ret;
+}
+
 static void report_value_cb(const uint8_t *pdu, uint16_t len,
 							gpointer user_data)
 {
@@ -176,21 +456,26 @@ static void report_reference_cb(guint8 status, const guint8 *pdu,
 					guint16 plen, gpointer user_data)
 {
 	struct report *report = user_data;
+	struct hog_device *hogdev = report->hogdev;
 
 	if (status != 0) {
 		error("Read Report Reference descriptor failed: %s",
 							att_ecode2str(status));
+		discovery_done(hogdev, FALSE);
 		return;
 	}
 
 	if (plen != 3) {
 		error("Malformed ATT read response");
+		discovery_done(hogdev, FALSE);
 		return;
 	}
 
 	report->id = pdu[1];
 	report->type = pdu[2];
 	DBG("Report ID: 0x%02x Report type: 0x%02x", pdu[1], pdu[2]);
+
+	discovery_done(hogdev, TRUE);
 }
 
 static void external_report_reference_cb(guint8 status, const guint8 *pdu,
@@ -202,9 +487,10 @@ static void discover_descriptor_cb(guint8 status, const guint8 *pdu,
 {
 	struct disc_desc_cb_data *ddcb_data = user_data;
 	struct report *report;
-	struct hog_device *hogdev;
+	struct hog_device *hogdev = ddcb_data->hogdev;
 	struct att_data_list *list = NULL;
-	GAttrib *attrib = NULL;
+	GAttrib *attrib = hogdev->attrib;
+	gboolean success = TRUE;
 	uint8_t format;
 	uint16_t handle = 0xffff;
 	uint16_t end = ddcb_data->end;
@@ -218,12 +504,15 @@ static void discover_descriptor_cb(guint8 status, const guint8 *pdu,
 	if (status != 0) {
 		error("Discover all characteristic descriptors failed: %s",
 							att_ecode2str(status));
+		success = FALSE;
 		goto done;
 	}
 
 	list = dec_find_info_resp(pdu, len, &format);
-	if (list == NULL)
-		return;
+	if (list == NULL) {
+		success = FALSE;
+		goto done;
+	}
 
 	if (format != ATT_FIND_INFO_RESP_FMT_16BIT)
 		goto done;
@@ -239,18 +528,17 @@ static void discover_descriptor_cb(guint8 status, const guint8 *pdu,
 		switch (uuid16) {
 		case GATT_CLIENT_CHARAC_CFG_UUID:
 			report = ddcb_data->data;
-			attrib = report->hogdev->attrib;
+			report->ccc_handle = handle;
 			write_ccc(handle, report);
 			break;
 		case GATT_REPORT_REFERENCE:
 			report = ddcb_data->data;
-			attrib = report->hogdev->attrib;
+			discovery_start(hogdev);
 			gatt_read_char(attrib, handle,
 						report_reference_cb, report);
 			break;
 		case GATT_EXTERNAL_REPORT_REFERENCE:
-			hogdev = ddcb_data->data;
-			attrib = hogdev->attrib;
+			discovery_start(hogdev);
 			gatt_read_char(attrib, handle,
 					external_report_reference_cb, hogdev);
 			break;
@@ -260,15 +548,19 @@ static void discover_descriptor_cb(guint8 status, const guint8 *pdu,
 done:
 	att_data_list_free(list);
 
-	if (handle != 0xffff && handle < end)
+	if (success && handle != 0xffff && handle < end) {
 		gatt_find_info(attrib, handle + 1, end, discover_descriptor_cb,
 								ddcb_data);
-	else
-		g_free(ddcb_data);
+		return;
+	}
+
+	g_free(ddcb_data);
+
+	discovery_done(hogdev, success);
 }
 
-static void discover_descriptor(GAttrib *attrib, uint16_t start, uint16_t end,
-							gpointer user_data)
+static void discover_descriptor(struct hog_device *hogdev, uint16_t start,
+					uint16_t end, gpointer user_data)
 {
 	struct disc_desc_cb_data *ddcb_data;
 
@@ -276,10 +568,13 @@ static void discover_descriptor(GAttrib *attrib, uint16_t start, uint16_t end,
 		return;
 
 	ddcb_data = g_new0(struct disc_desc_cb_data, 1);
+	ddcb_data->hogdev = hogdev;
 	ddcb_data->end = end;
 	ddcb_data->data = user_data;
 
-	gatt_find_info(attrib, start, end, discover_descriptor_cb, ddcb_data);
+	discovery_start(hogdev);
+	gatt_find_info(hogdev->attrib, start, end, discover_descriptor_cb,
+								ddcb_data);
 }
 
 static void external_service_char_cb(GSList *chars, guint8 status,
@@ -293,6 +588,7 @@ static void external_service_char_cb(GSList *chars, guint8 status,
 	if (status != 0) {
 		const char *str = att_ecode2str(status);
 		DBG("Discover external service characteristic failed: %s", str);
+		discovery_done(hogdev, FALSE);
 		return;
 	}
 
@@ -312,8 +608,10 @@ static void external_service_char_cb(GSList *chars, guint8 status,
 		hogdev->reports = g_slist_append(hogdev->reports, report);
 		start = chr->value_handle + 1;
 		end = (next ? next->handle - 1 : prim->range.end);
-		discover_descriptor(hogdev->attrib, start, end, report);
+		discover_descriptor(hogdev, start, end, report);
 	}
+
+	discovery_done(hogdev, TRUE);
 }
 
 static void external_report_reference_cb(guint8 status, const guint8 *pdu,
@@ -326,11 +624,13 @@ static void external_report_reference_cb(guint8 status, const guint8 *pdu,
 	if (status != 0) {
 		error("Read External Report Reference descriptor failed: %s",
 							att_ecode2str(status));
+		discovery_done(hogdev, FALSE);
 		return;
 	}
 
 	if (plen != 3) {
 		error("Malformed ATT read response");
+		discovery_done(hogdev, FALSE);
 		return;
 	}
 
@@ -338,34 +638,22 @@ static void external_report_reference_cb(guint8 status, const guint8 *pdu,
 	DBG("External report reference read, external report characteristic "
 						"UUID: 0x%04x", uuid16);
 	bt_uuid16_create(&uuid, uuid16);
+	discovery_start(hogdev);
 	gatt_discover_char(hogdev->attrib, 0x00, 0xff, &uuid,
 					external_service_char_cb, hogdev);
+
+	discovery_done(hogdev, TRUE);
 }
 
-static void report_map_read_cb(guint8 status, const guint8 *pdu, guint16 plen,
-							gpointer user_data)
+static void create_uhid(struct hog_device *hogdev)
 {
-	struct hog_device *hogdev = user_data;
-	uint8_t value[HOG_REPORT_MAP_MAX_SIZE];
 	struct uhid_event ev;
 	uint16_t vendor_src, vendor, product, version;
-	ssize_t vlen;
 	int i;
 
-	if (status != 0) {
-		error("Report Map read failed: %s", att_ecode2str(status));
-		return;
-	}
-
-	vlen = dec_read_resp(pdu, plen, value, sizeof(value));
-	if (vlen < 0) {
-		error("ATT protocol error");
-		return;
-	}
-
 	DBG("Report MAP:");
-	for (i = 0; i < vlen; i++) {
-		switch (value[i]) {
+	for (i = 0; i < hogdev->report_map_len; i++) {
+		switch (hogdev->report_map[i]) {
 		case 0x85:
 		case 0x86:
 		case 0x87:
@@ -373,10 +661,11 @@ static void report_map_read_cb(guint8 status, const guint8 *pdu, guint16 plen,
 		}
 
 		if (i % 2 == 0) {
-			if (i + 1 == vlen)
-				DBG("\t %02x", value[i]);
+			if (i + 1 == hogdev->report_map_len)
+				DBG("\t %02x", hogdev->report_map[i]);
 			else
-				DBG("\t %02x %02x", value[i], value[i + 1]);
+				DBG("\t %02x %02x", hogdev->report_map[i],
+						hogdev->report_map[i + 1]);
 		}
 	}
 
@@ -396,11 +685,59 @@ static void report_map_read_cb(guint8 status, const guint8 *pdu, guint16 plen,
 	ev.u.create.version = version;
 	ev.u.create.country = hogdev->bcountrycode;
 	ev.u.create.bus = BUS_BLUETOOTH;
-	ev.u.create.rd_data = value;
-	ev.u.create.rd_size = vlen;
+	ev.u.create.rd_data = hogdev->report_map;
+	ev.u.create.rd_size = hogdev->report_map_len;
 
-	if (write(hogdev->uhid_fd, &ev, sizeof(ev)) < 0)
+	if (write(hogdev->uhid_fd, &ev, sizeof(ev)) < 0) {
 		error("Failed to create uHID device: %s", strerror(errno));
+		return;
+	}
+
+	hogdev->uhid_created = TRUE;
+}
+
+static void destroy_uhid(struct hog_device *hogdev)
+{
+	struct uhid_event ev;
+
+	if (!hogdev->uhid_created)
+		return;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.type = UHID_DESTROY;
+	if (write(hogdev->uhid_fd, &ev, sizeof(ev)) < 0)
+		error("Failed to destroy uHID device: %s", strerror(errno));
+
+	hogdev->uhid_created = FALSE;
+}
+
+static void report_map_read_cb(guint8 status, const guint8 *pdu, guint16 plen,
+							gpointer user_data)
+{
+	struct hog_device *hogdev = user_data;
+	uint8_t value[HOG_REPORT_MAP_MAX_SIZE];
+	ssize_t vlen;
+
+	if (status != 0) {
+		error("Report Map read failed: %s", att_ecode2str(status));
+		discovery_done(hogdev, FALSE);
+		return;
+	}
+
+	vlen = dec_read_resp(pdu, plen, value, sizeof(value));
+	if (vlen < 0) {
+		error("ATT protocol error");
+		discovery_done(hogdev, FALSE);
+		return;
+	}
+
+	g_free(hogdev->report_map);
+	hogdev->report_map = g_memdup(value, vlen);
+	hogdev->report_map_len = vlen;
+
+	create_uhid(hogdev);
+
+	discovery_done(hogdev, TRUE);
 }
 
 static void info_read_cb(guint8 status, const guint8 *pdu, guint16 plen,
@@ -413,12 +750,14 @@ static void info_read_cb(guint8 status, const guint8 *pdu, guint16 plen,
 	if (status != 0) {
 		error("HID Information read failed: %s",
 						att_ecode2str(status));
+		discovery_done(hogdev, FALSE);
 		return;
 	}
 
 	vlen = dec_read_resp(pdu, plen, value, sizeof(value));
 	if (vlen != 4) {
 		error("ATT protocol error");
+		discovery_done(hogdev, FALSE);
 		return;
 	}
 
@@ -428,6 +767,8 @@ static void info_read_cb(guint8 status, const guint8 *pdu, guint16 plen,
 
 	DBG("bcdHID: 0x%04X bCountryCode: 0x%02X Flags: 0x%02X",
 			hogdev->bcdhid, hogdev->bcountrycode, hogdev->flags);
+
+	discovery_done(hogdev, TRUE);
 }
 
 static void proto_mode_read_cb(guint8 status, const guint8 *pdu, guint16 plen,
@@ -475,9 +816,13 @@ static void char_discovered_cb(GSList *chars, guint8 status, gpointer user_data)
 	if (status != 0) {
 		const char *str = att_ecode2str(status);
 		DBG("Discover all characteristics failed: %s", str);
+		discovery_done(hogdev, FALSE);
 		return;
 	}
 
+	g_free(hogdev->signature);
+	hogdev->signature = chars_signature(chars);
+
 	bt_uuid16_create(&report_uuid, HOG_REPORT_UUID);
 	bt_uuid16_create(&report_map_uuid, HOG_REPORT_MAP_UUID);
 	bt_uuid16_create(&info_uuid, HOG_INFO_UUID);
@@ -506,11 +851,12 @@ static void char_discovered_cb(GSList *chars, guint8 status, gpointer user_data)
 			report->decl = g_memdup(chr, sizeof(*chr));
 			hogdev->reports = g_slist_append(hogdev->reports,
 								report);
-			discover_descriptor(hogdev->attrib, start, end, report);
+			discover_descriptor(hogdev, start, end, report);
 		} else if (bt_uuid_cmp(&uuid, &report_map_uuid) == 0) {
+			discovery_start(hogdev);
 			gatt_read_char(hogdev->attrib, chr->value_handle,
 						report_map_read_cb, hogdev);
-			discover_descriptor(hogdev->attrib, start, end, hogdev);
+			discover_descriptor(hogdev, start, end, hogdev);
 		} else if (bt_uuid_cmp(&uuid, &info_uuid) == 0)
 			info_handle = chr->value_handle;
 		else if (bt_uuid_cmp(&uuid, &proto_mode_uuid) == 0)
@@ -525,9 +871,141 @@ static void char_discovered_cb(GSList *chars, guint8 status, gpointer user_data)
 						proto_mode_read_cb, hogdev);
 	}
 
-	if (info_handle)
+	if (info_handle) {
+		discovery_start(hogdev);
 		gatt_read_char(hogdev->attrib, info_handle, info_read_cb,
 									hogdev);
+	}
+
+	discovery_done(hogdev, TRUE);
+}
+
+static void discover_reports(struct hog_device *hogdev)
+{
+	struct gatt_primary *prim = hogdev->hog_primary;
+
+	hogdev->disc_pending = 0;
+	hogdev->disc_failed = FALSE;
+
+	discovery_start(hogdev);
+	gatt_discover_char(hogdev->attrib, prim->range.start, prim->range.end,
+					NULL, char_discovered_cb, hogdev);
+}
+
+static void discovery_reset(struct hog_device *hogdev)
+{
+	destroy_uhid(hogdev);
+
+	g_slist_free_full(hogdev->reports, report_free);
+	hogdev->reports = NULL;
+	hogdev->has_report_id = FALSE;
+	hogdev->proto_mode_handle = 0;
+	hogdev->ctrlpt_handle = 0;
+
+	g_free(hogdev->report_map);
+	hogdev->report_map = NULL;
+	hogdev->report_map_len = 0;
+
+	g_free(hogdev->signature);
+	hogdev->signature = NULL;
+}
+
+static void cache_invalidate(struct hog_device *hogdev)
+{
+	DBG("HoG cache of device 0x%04X is stale, rediscovering", hogdev->id);
+
+	hogdev->cached = FALSE;
+
+	discovery_reset(hogdev);
+	cache_remove(hogdev);
+
+	if (hogdev->attrib)
+		discover_reports(hogdev);
+}
+
+static void revalidate_report_map_cb(guint8 status, const guint8 *pdu,
+					guint16 plen, gpointer user_data)
+{
+	struct hog_device *hogdev = user_data;
+	uint8_t value[HOG_REPORT_MAP_MAX_SIZE];
+	ssize_t vlen;
+
+	if (status != 0) {
+		error("Report Map read failed: %s", att_ecode2str(status));
+		return;
+	}
+
+	vlen = dec_read_resp(pdu, plen, value, sizeof(value));
+	if (vlen < 0) {
+		error("ATT protocol error");
+		return;
+	}
+
+	if (vlen != hogdev->report_map_len ||
+			memcmp(value, hogdev->report_map, vlen) != 0) {
+		cache_invalidate(hogdev);
+		return;
+	}
+
+	DBG("HoG cache of device 0x%04X is valid", hogdev->id);
+}
+
+static void revalidate_char_cb(GSList *chars, guint8 status,
+							gpointer user_data)
+{
+	struct hog_device *hogdev = user_data;
+	bt_uuid_t report_map_uuid;
+	char *signature;
+	GSList *l;
+
+	if (status != 0) {
+		DBG("Revalidating characteristics failed: %s",
+						att_ecode2str(status));
+		return;
+	}
+
+	signature = chars_signature(chars);
+
+	if (g_strcmp0(signature, hogdev->signature) != 0) {
+		g_free(signature);
+		cache_invalidate(hogdev);
+		return;
+	}
+
+	g_free(signature);
+
+	bt_uuid16_create(&report_map_uuid, HOG_REPORT_MAP_UUID);
+
+	for (l = chars; l; l = g_slist_next(l)) {
+		struct gatt_char *chr = l->data;
+		bt_uuid_t uuid;
+
+		bt_string_to_uuid(&uuid, chr->uuid);
+
+		if (bt_uuid_cmp(&uuid, &report_map_uuid) == 0) {
+			gatt_read_char(hogdev->attrib, chr->value_handle,
+					revalidate_report_map_cb, hogdev);
+			break;
+		}
+	}
+
+	/* Make sure notifications are still enabled on the device */
+	for (l = hogdev->reports; l; l = l->next) {
+		struct report *r = l->data;
+		uint8_t value[] = { 0x01, 0x00 };
+
+		if (r->ccc_handle)
+			gatt_write_char(hogdev->attrib, r->ccc_handle, value,
+						sizeof(value), NULL, NULL);
+	}
+}
+
+static void revalidate_cache(struct hog_device *hogdev)
+{
+	struct gatt_primary *prim = hogdev->hog_primary;
+
+	gatt_discover_char(hogdev->attrib, prim->range.start, prim->range.end,
+					NULL, revalidate_char_cb, hogdev);
 }
 
 static void output_written_cb(guint8 status, const guint8 *pdu,
@@ -644,20 +1122,31 @@ failed:
 static void attio_connected_cb(GAttrib *attrib, gpointer user_data)
 {
 	struct hog_device *hogdev = user_data;
-	struct gatt_primary *prim = hogdev->hog_primary;
 	GSList *l;
 
 	DBG("HoG connected");
 
 	hogdev->attrib = g_attrib_ref(attrib);
 
+	/* A discovery interrupted by the disconnection starts over */
+	if (hogdev->disc_pending > 0) {
+		DBG("HoG discovery of device 0x%04X restarted", hogdev->id);
+		discovery_reset(hogdev);
+	}
+
 	if (hogdev->reports == NULL) {
-		gatt_discover_char(hogdev->attrib, prim->range.start,
-						prim->range.end, NULL,
-						char_discovered_cb, hogdev);
+		discover_reports(hogdev);
 		return;
 	}
 
+	/*
+	 * With a cached report map the uHID device can be created before
+	 * anything is read from the remote, the cache is then revalidated
+	 * while reports are already being delivered.
+	 */
+	if (!hogdev->uhid_created && hogdev->report_map)
+		create_uhid(hogdev);
+
 	for (l = hogdev->reports; l; l = l->next) {
 		struct report *r = l->data;
 
@@ -666,6 +1155,17 @@ static void attio_connected_cb(GAttrib *attrib, gpointer user_data)
 					r->decl->value_handle,
 					report_value_cb, r, NULL);
 	}
+
+	if (!hogdev->cached)
+		return;
+
+	hogdev->cached = FALSE;
+
+	if (hogdev->proto_mode_handle)
+		gatt_read_char(hogdev->attrib, hogdev->proto_mode_handle,
+						proto_mode_read_cb, hogdev);
+
+	revalidate_cache(hogdev);
 }
 
 static void attio_disconnected_cb(gpointer user_data)
@@ -714,6 +1214,8 @@ static void report_free(void *data)
 
 static void hog_free_device(struct hog_device *hogdev)
 {
+	g_free(hogdev->report_map);
+	g_free(hogdev->signature);
 	btd_device_unref(hogdev->device);
 	g_slist_free_full(hogdev->reports, report_free);
 	g_attrib_unref(hogdev->attrib);
@@ -748,6 +1250,9 @@ static struct hog_device *hog_register_device(struct btd_device *device,
 
 	hogdev->hog_primary = g_memdup(prim, sizeof(*prim));
 
+	if (cache_load(hogdev))
+		DBG("HoG device 0x%04X loaded from cache", hogdev->id);
+
 	hogdev->attioid = btd_device_add_attio_callback(device,
 							attio_connected_cb,
 							attio_disconnected_cb,
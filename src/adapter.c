@@ -27,6 +27,8 @@
 #endif
 
 #include <stdio.h>
+#include <stddef.h>
+#include <inttypes.h>
 #include <errno.h>
 #include <unistd.h>
 #include <stdlib.h>
@@ -51,6 +53,7 @@
 #include "lib/uuid.h"
 #include "lib/mgmt.h"
 #include "src/shared/mgmt.h"
+#include "src/shared/metrics.h"
 
 #include "hcid.h"
 #include "sdpd.h"
@@ -89,16 +92,36 @@
 #define TEMP_DEV_TIMEOUT (3 * 60)
 #define BONDING_TIMEOUT (2 * 60)
 
+/* Bump when the adapter storage needs to be fixed up again on startup */
+#define STORAGE_VERSION 1
+
 static DBusConnection *dbus_conn = NULL;
 
 static GList *adapter_list = NULL;
 static unsigned int adapter_remaining = 0;
 static bool powering_down = false;
 
+/*
+ * Adapters are registered while the plugins are still being initialized
+ * from the main loop. They are only made connectable, powered on and
+ * reported as started once every builtin plugin has registered its
+ * drivers and profiles.
+ */
+static bool plugins_loaded = false;
+
 static GSList *adapters = NULL;
 
 static struct mgmt *mgmt_master = NULL;
 
+static struct metrics_gauge *devices_gauge = NULL;
+static struct metrics_counter *device_found_total = NULL;
+static struct metrics_counter *discovery_results_total = NULL;
+static struct metrics_counter *storage_writes_total = NULL;
+static struct metrics_counter *mgmt_commands_total = NULL;
+static struct metrics_counter *mgmt_events_total = NULL;
+static struct metrics_gauge *mgmt_pending_requests = NULL;
+static struct metrics_histogram *mgmt_command_latency = NULL;
+
 #define MGMT_VERSION(v, r) ((v << 16) + (r))
 static uint8_t mgmt_version = 0;
 static uint8_t mgmt_revision = 0;
@@ -148,6 +171,7 @@ struct btd_adapter {
 	bool stored_discoverable;	/* stored discoverable mode */
 	uint32_t discoverable_timeout;	/* discoverable time(sec) */
 	uint32_t pairable_timeout;	/* pairable time(sec) */
+	int storage_version;		/* stored storage layout version */
 
 	char *current_alias;		/* current adapter name alias */
 	char *stored_alias;		/* stored adapter name alias */
@@ -173,6 +197,8 @@ struct btd_adapter {
 	sdp_list_t *services;		/* Services associated to adapter */
 
 	gboolean initialized;
+	bool power_held;		/* rfkill power on held for plugins */
+	GSList *powered_requests;	/* Powered sets held for plugins */
 
 	GSList *pin_callbacks;
 
@@ -181,8 +207,8 @@ struct btd_adapter {
 
 	struct oob_handler *oob_handler;
 
-	unsigned int load_ltks_id;
-	guint load_ltks_timeout;
+	struct key_load *load_keys;
+	struct key_load *load_ltks;
 
 	unsigned int confirm_name_id;
 	guint confirm_name_timeout;
@@ -390,6 +416,10 @@ static void store_adapter_info(struct btd_adapter *adapter)
 		g_key_file_set_string(key_file, "General", "Alias",
 							adapter->stored_alias);
 
+	if (adapter->storage_version > 0)
+		g_key_file_set_integer(key_file, "Storage", "Version",
+						adapter->storage_version);
+
 	ba2str(&adapter->bdaddr, address);
 	snprintf(filename, PATH_MAX, STORAGEDIR "/%s/settings", address);
 	filename[PATH_MAX] = '\0';
@@ -400,6 +430,8 @@ static void store_adapter_info(struct btd_adapter *adapter)
 	g_file_set_contents(filename, str, length, NULL);
 	g_free(str);
 
+	metrics_counter_add(storage_writes_total, 1);
+
 	g_key_file_free(key_file);
 }
 
@@ -422,7 +454,8 @@ static void settings_changed(struct btd_adapter *adapter, uint32_t settings)
 					ADAPTER_INTERFACE, "Powered");
 
 		if (adapter->current_settings & MGMT_SETTING_POWERED) {
-			adapter_start(adapter);
+			if (plugins_loaded)
+				adapter_start(adapter);
 		} else {
 			adapter_stop(adapter);
 
@@ -997,6 +1030,7 @@ static struct btd_device *adapter_create_device(struct btd_adapter *adapter,
 	device_set_temporary(device, TRUE);
 
 	adapter->devices = g_slist_append(adapter->devices, device);
+	metrics_gauge_inc(devices_gauge);
 
 	return device;
 }
@@ -1026,6 +1060,7 @@ static void adapter_remove_device(struct btd_adapter *adapter,
 	adapter->connect_list = g_slist_remove(adapter->connect_list, dev);
 
 	adapter->devices = g_slist_remove(adapter->devices, dev);
+	metrics_gauge_dec(devices_gauge);
 
 	adapter->discovery_found = g_slist_remove(adapter->discovery_found,
 									dev);
@@ -1940,6 +1975,7 @@ static void property_set_powered(const GDBusPropertyTable *property,
 				GDBusPendingPropertySet id, void *user_data)
 {
 	struct btd_adapter *adapter = user_data;
+	dbus_bool_t enable;
 
 	if (powering_down) {
 		g_dbus_pending_property_error(id, ERROR_INTERFACE ".Failed",
@@ -1947,9 +1983,56 @@ static void property_set_powered(const GDBusPropertyTable *property,
 		return;
 	}
 
+	dbus_message_iter_get_basic(iter, &enable);
+
+	if (enable && !plugins_loaded) {
+		DBG("power on of %s waits for plugins", adapter->path);
+
+		adapter->powered_requests = g_slist_append(
+						adapter->powered_requests,
+						GUINT_TO_POINTER(id));
+		return;
+	}
+
 	property_set_mode(adapter, MGMT_SETTING_POWERED, iter, id);
 }
 
+static void set_powered_request(gpointer data, gpointer user_data)
+{
+	GDBusPendingPropertySet id = GPOINTER_TO_UINT(data);
+	struct btd_adapter *adapter = user_data;
+	struct property_set_data *set_data;
+	uint8_t mode = 0x01;
+
+	set_data = g_try_new0(struct property_set_data, 1);
+	if (!set_data)
+		goto failed;
+
+	set_data->adapter = adapter;
+	set_data->id = id;
+
+	if (mgmt_send(adapter->mgmt, MGMT_OP_SET_POWERED, adapter->dev_id,
+				sizeof(mode), &mode,
+				property_set_mode_complete, set_data,
+				g_free) > 0)
+		return;
+
+	g_free(set_data);
+
+failed:
+	error("Failed to set mode for index %u", adapter->dev_id);
+
+	g_dbus_pending_property_error(id, ERROR_INTERFACE ".Failed", NULL);
+}
+
+static void fail_powered_request(gpointer data, gpointer user_data)
+{
+	GDBusPendingPropertySet id = GPOINTER_TO_UINT(data);
+
+	g_dbus_pending_property_error(id, ERROR_INTERFACE ".Failed",
+							"Adapter removed");
+}
+
 static gboolean property_get_discoverable(const GDBusPropertyTable *property,
 					DBusMessageIter *iter, void *user_data)
 {
@@ -2177,11 +2260,200 @@ static const GDBusPropertyTable adapter_properties[] = {
 	{ }
 };
 
-struct adapter_keys {
+/*
+ * The kernel replaces its whole list of keys with every load command, so
+ * all keys of one kind have to go into a single command. They are parsed
+ * straight into the mgmt wire format and the command is sent from that
+ * buffer once the storage has been read.
+ */
+struct key_load {
 	struct btd_adapter *adapter;
-	GSList *keys;
+	uint16_t opcode;
+	const char *name;
+	size_t hdr_size;
+	size_t key_size;
+	size_t count_offset;
+	GByteArray *buf;		/* Command header followed by keys */
+	uint16_t count;			/* Keys in the command being sent */
+	unsigned int id;
+	unsigned int timeout_secs;
+	guint timeout;
+	gint64 start;
 };
 
+static struct key_load *key_load_new(struct btd_adapter *adapter,
+					uint16_t opcode, const char *name,
+					size_t hdr_size, size_t count_offset,
+					size_t key_size)
+{
+	struct key_load *load;
+
+	load = g_new0(struct key_load, 1);
+	load->adapter = adapter;
+	load->opcode = opcode;
+	load->name = name;
+	load->hdr_size = hdr_size;
+	load->count_offset = count_offset;
+	load->key_size = key_size;
+	load->start = g_get_monotonic_time();
+
+	load->buf = g_byte_array_sized_new(hdr_size);
+	g_byte_array_set_size(load->buf, hdr_size);
+	memset(load->buf->data, 0, hdr_size);
+
+	return load;
+}
+
+static void key_load_free(struct key_load *load)
+{
+	if (load->timeout > 0)
+		g_source_remove(load->timeout);
+
+	if (load->id > 0)
+		mgmt_cancel(load->adapter->mgmt, load->id);
+
+	g_byte_array_free(load->buf, TRUE);
+	g_free(load);
+}
+
+static void key_load_finish(struct key_load *load)
+{
+	struct btd_adapter *adapter = load->adapter;
+
+	if (adapter->load_keys == load)
+		adapter->load_keys = NULL;
+	else if (adapter->load_ltks == load)
+		adapter->load_ltks = NULL;
+
+	key_load_free(load);
+}
+
+static void *key_load_append(struct key_load *load)
+{
+	guint len = load->buf->len;
+
+	g_byte_array_set_size(load->buf, len + load->key_size);
+	memset(load->buf->data + len, 0, load->key_size);
+
+	return load->buf->data + len;
+}
+
+static size_t key_load_count(struct key_load *load)
+{
+	return (load->buf->len - load->hdr_size) / load->key_size;
+}
+
+/* The parameter length of a mgmt command is limited to 16 bits */
+static uint16_t key_load_max(struct key_load *load)
+{
+	return (UINT16_MAX - load->hdr_size) / load->key_size;
+}
+
+static gboolean key_load_timeout(gpointer user_data)
+{
+	struct key_load *load = user_data;
+
+	error("Loading %s timed out for hci%u", load->name,
+						load->adapter->dev_id);
+
+	load->timeout = 0;
+
+	key_load_finish(load);
+
+	return FALSE;
+}
+
+static void key_load_complete(uint8_t status, uint16_t length,
+					const void *param, void *user_data);
+
+static bool key_load_send(struct key_load *load, uint16_t count)
+{
+	struct btd_adapter *adapter = load->adapter;
+	uint16_t key_count = htobs(count);
+
+	memcpy(load->buf->data + load->count_offset, &key_count,
+							sizeof(key_count));
+	load->count = count;
+
+	load->id = mgmt_send(adapter->mgmt, load->opcode, adapter->dev_id,
+				load->hdr_size + count * load->key_size,
+				load->buf->data, key_load_complete, load, NULL);
+	if (load->id == 0) {
+		error("Failed to load %s for hci%u", load->name,
+							adapter->dev_id);
+		return false;
+	}
+
+	if (load->timeout_secs == 0)
+		return true;
+
+	if (load->timeout > 0)
+		g_source_remove(load->timeout);
+
+	load->timeout = g_timeout_add_seconds(load->timeout_secs,
+						key_load_timeout, load);
+
+	return true;
+}
+
+static void key_load_complete(uint8_t status, uint16_t length,
+					const void *param, void *user_data)
+{
+	struct key_load *load = user_data;
+	struct btd_adapter *adapter = load->adapter;
+
+	load->id = 0;
+
+	/*
+	 * A kernel that cannot take that many keys rejects the command as
+	 * a whole. Rather than leaving it with stale keys from a previous
+	 * daemon, retry with half of the keys and finally an empty list.
+	 */
+	if ((status == MGMT_STATUS_INVALID_PARAMS ||
+				status == MGMT_STATUS_NO_RESOURCES) &&
+							load->count > 0) {
+		uint16_t count = load->count / 2;
+
+		warn("Loading %u %s rejected for hci%u: %s, retrying with %u",
+					load->count, load->name,
+					adapter->dev_id, mgmt_errstr(status),
+					count);
+
+		if (key_load_send(load, count))
+			return;
+	}
+
+	if (status != MGMT_STATUS_SUCCESS)
+		error("Failed to load %s for hci%u: %s (0x%02x)", load->name,
+				adapter->dev_id, mgmt_errstr(status), status);
+	else
+		DBG("%u %s loaded for hci%u in %" PRId64 " ms", load->count,
+				load->name, adapter->dev_id,
+				(g_get_monotonic_time() - load->start) / 1000);
+
+	key_load_finish(load);
+}
+
+static void key_load_start(struct key_load *load)
+{
+	struct btd_adapter *adapter = load->adapter;
+	size_t count = key_load_count(load);
+
+	DBG("hci%u %zu %s parsed in %" PRId64 " ms", adapter->dev_id, count,
+				load->name,
+				(g_get_monotonic_time() - load->start) / 1000);
+
+	if (count > key_load_max(load)) {
+		error("Too many %s for hci%u, loading %u of %zu", load->name,
+					adapter->dev_id, key_load_max(load),
+					count);
+		count = key_load_max(load);
+	}
+
+	if (!key_load_send(load, count))
+		key_load_finish(load);
+}
+
 static int str2buf(const char *str, uint8_t *buf, size_t blen)
 {
 	int i, dlen;
@@ -2199,37 +2471,40 @@ static int str2buf(const char *str, uint8_t *buf, size_t blen)
 	return 0;
 }
 
-static struct link_key_info *get_key_info(GKeyFile *key_file, const char *peer)
+static bool get_key_info(GKeyFile *key_file, const char *peer,
+					struct mgmt_link_key_info *key)
 {
-	struct link_key_info *info = NULL;
 	char *str;
+	bool found = false;
 
 	str = g_key_file_get_string(key_file, "LinkKey", "Key", NULL);
 	if (!str || strlen(str) != 34)
 		goto failed;
 
-	info = g_new0(struct link_key_info, 1);
+	str2ba(peer, &key->addr.bdaddr);
+	key->addr.type = BDADDR_BREDR;
+	str2buf(&str[2], key->val, sizeof(key->val));
 
-	str2ba(peer, &info->bdaddr);
-	str2buf(&str[2], info->key, sizeof(info->key));
-
-	info->type = g_key_file_get_integer(key_file, "LinkKey", "Type", NULL);
-	info->pin_len = g_key_file_get_integer(key_file, "LinkKey", "PINLength",
+	key->type = g_key_file_get_integer(key_file, "LinkKey", "Type", NULL);
+	key->pin_len = g_key_file_get_integer(key_file, "LinkKey", "PINLength",
 						NULL);
+	found = true;
 
 failed:
 	g_free(str);
 
-	return info;
+	return found;
 }
 
-static struct smp_ltk_info *get_ltk_info(GKeyFile *key_file, const char *peer)
+static bool get_ltk_info(GKeyFile *key_file, const char *peer,
+						struct mgmt_ltk_info *ltk)
 {
-	struct smp_ltk_info *ltk = NULL;
 	char *key;
 	char *rand = NULL;
 	char *type = NULL;
 	uint8_t bdaddr_type;
+	uint16_t ediv;
+	bool found = false;
 
 	key = g_key_file_get_string(key_file, "LongTermKey", "Key", NULL);
 	if (!key || strlen(key) != 34)
@@ -2250,10 +2525,8 @@ static struct smp_ltk_info *get_ltk_info(GKeyFile *key_file, const char *peer)
 	else
 		goto failed;
 
-	ltk = g_new0(struct smp_ltk_info, 1);
-
-	str2ba(peer, &ltk->bdaddr);
-	ltk->bdaddr_type = bdaddr_type;
+	str2ba(peer, &ltk->addr.bdaddr);
+	ltk->addr.type = bdaddr_type;
 	str2buf(&key[2], ltk->val, sizeof(ltk->val));
 	str2buf(&rand[2], ltk->rand, sizeof(ltk->rand));
 
@@ -2263,205 +2536,82 @@ static struct smp_ltk_info *get_ltk_info(GKeyFile *key_file, const char *peer)
 						NULL);
 	ltk->enc_size = g_key_file_get_integer(key_file, "LongTermKey",
 						"EncSize", NULL);
-	ltk->ediv = g_key_file_get_integer(key_file, "LongTermKey", "EDiv",
-						NULL);
+	ediv = htobs(g_key_file_get_integer(key_file, "LongTermKey", "EDiv",
+						NULL));
+	memcpy(&ltk->ediv, &ediv, sizeof(ediv));
+	found = true;
 
 failed:
 	g_free(key);
 	g_free(rand);
 	g_free(type);
 
-	return ltk;
-}
-
-static void load_link_keys_complete(uint8_t status, uint16_t length,
-					const void *param, void *user_data)
-{
-	struct btd_adapter *adapter = user_data;
-
-	if (status != MGMT_STATUS_SUCCESS) {
-		error("Failed to load link keys for hci%u: %s (0x%02x)",
-				adapter->dev_id, mgmt_errstr(status), status);
-		return;
-	}
-
-	DBG("link keys loaded for hci%u", adapter->dev_id);
+	return found;
 }
 
-static void load_link_keys(struct btd_adapter *adapter, GSList *keys,
+/*
+ * If the controller does not support BR/EDR operation, there is no point
+ * in trying to load the link keys into the kernel. This is an
+ * optimization for Low Energy only controllers.
+ *
+ * Even if the list of stored keys is empty, it is important to load an
+ * empty list into the kernel. That way it is ensured that no old keys
+ * from a previous daemon are present. In addition it is also the only
+ * way to toggle the different behavior for debug keys.
+ */
+static struct key_load *load_link_keys_new(struct btd_adapter *adapter,
 							bool debug_keys)
 {
+	struct key_load *load;
 	struct mgmt_cp_load_link_keys *cp;
-	struct mgmt_link_key_info *key;
-	size_t key_count, cp_size;
-	unsigned int id;
-	GSList *l;
 
-	/*
-	 * If the controller does not support BR/EDR operation,
-	 * there is no point in trying to load the link keys into
-	 * the kernel.
-	 *
-	 * This is an optimization for Low Energy only controllers.
-	 */
 	if (!(adapter->supported_settings & MGMT_SETTING_BREDR))
-		return;
-
-	key_count = g_slist_length(keys);
-
-	DBG("hci%u keys %zu debug_keys %d", adapter->dev_id, key_count,
-								debug_keys);
+		return NULL;
 
-	cp_size = sizeof(*cp) + (key_count * sizeof(*key));
+	DBG("hci%u debug_keys %d", adapter->dev_id, debug_keys);
 
-	cp = g_try_malloc0(cp_size);
-	if (cp == NULL) {
-		error("No memory for link keys for hci%u", adapter->dev_id);
-		return;
-	}
+	load = key_load_new(adapter, MGMT_OP_LOAD_LINK_KEYS, "link keys",
+			sizeof(*cp),
+			offsetof(struct mgmt_cp_load_link_keys, key_count),
+			sizeof(struct mgmt_link_key_info));
 
-	/*
-	 * Even if the list of stored keys is empty, it is important to
-	 * load an empty list into the kernel. That way it is ensured
-	 * that no old keys from a previous daemon are present.
-	 *
-	 * In addition it is also the only way to toggle the different
-	 * behavior for debug keys.
-	 */
+	cp = (void *) load->buf->data;
 	cp->debug_keys = debug_keys;
-	cp->key_count = htobs(key_count);
-
-	for (l = keys, key = cp->keys; l != NULL; l = g_slist_next(l), key++) {
-		struct link_key_info *info = l->data;
-
-		bacpy(&key->addr.bdaddr, &info->bdaddr);
-		key->addr.type = BDADDR_BREDR;
-		key->type = info->type;
-		memcpy(key->val, info->key, 16);
-		key->pin_len = info->pin_len;
-	}
-
-	id = mgmt_send(adapter->mgmt, MGMT_OP_LOAD_LINK_KEYS,
-				adapter->dev_id, cp_size, cp,
-				load_link_keys_complete, adapter, NULL);
-
-	g_free(cp);
-
-	if (id == 0)
-		error("Failed to load link keys for hci%u", adapter->dev_id);
-}
-
-static gboolean load_ltks_timeout(gpointer user_data)
-{
-	struct btd_adapter *adapter = user_data;
-
-	error("Loading LTKs timed out for hci%u", adapter->dev_id);
-
-	adapter->load_ltks_timeout = 0;
-
-	mgmt_cancel(adapter->mgmt, adapter->load_ltks_id);
-	adapter->load_ltks_id = 0;
 
-	return FALSE;
+	return load;
 }
 
-static void load_ltks_complete(uint8_t status, uint16_t length,
-					const void *param, void *user_data)
-{
-	struct btd_adapter *adapter = user_data;
-
-	if (status != MGMT_STATUS_SUCCESS) {
-		error("Failed to load LTKs for hci%u: %s (0x%02x)",
-				adapter->dev_id, mgmt_errstr(status), status);
-	}
-
-	adapter->load_ltks_id = 0;
-
-	g_source_remove(adapter->load_ltks_timeout);
-	adapter->load_ltks_timeout = 0;
-
-	DBG("LTKs loaded for hci%u", adapter->dev_id);
-}
-
-static void load_ltks(struct btd_adapter *adapter, GSList *keys)
+/*
+ * If the controller does not support Low Energy operation, there is no
+ * point in trying to load the long term keys into the kernel.
+ *
+ * While there is no harm in loading keys into the kernel, this is an
+ * optimization to avoid a confusing warning message when the loading of
+ * the keys timed out due to a kernel bug: it forgets to send a command
+ * complete response, however in case of failures it does send a command
+ * status. Hence the timeout.
+ */
+static struct key_load *load_ltks_new(struct btd_adapter *adapter)
 {
-	struct mgmt_cp_load_long_term_keys *cp;
-	struct mgmt_ltk_info *key;
-	size_t key_count, cp_size;
-	GSList *l;
+	struct key_load *load;
 
-	/*
-	 * If the controller does not support Low Energy operation,
-	 * there is no point in trying to load the long term keys
-	 * into the kernel.
-	 *
-	 * While there is no harm in loading keys into the kernel,
-	 * this is an optimization to avoid a confusing warning
-	 * message when the loading of the keys timed out due to
-	 * a kernel bug (see comment below).
-	 */
 	if (!(adapter->supported_settings & MGMT_SETTING_LE))
-		return;
-
-	key_count = g_slist_length(keys);
-
-	DBG("hci%u keys %zu", adapter->dev_id, key_count);
-
-	cp_size = sizeof(*cp) + (key_count * sizeof(*key));
-
-	cp = g_try_malloc0(cp_size);
-	if (cp == NULL) {
-		error("No memory for LTKs for hci%u", adapter->dev_id);
-		return;
-	}
-
-	/*
-	 * Even if the list of stored keys is empty, it is important to
-	 * load an empty list into the kernel. That way it is ensured
-	 * that no old keys from a previous daemon are present.
-	 */
-	cp->key_count = htobs(key_count);
-
-	for (l = keys, key = cp->keys; l != NULL; l = g_slist_next(l), key++) {
-		struct smp_ltk_info *info = l->data;
-
-		bacpy(&key->addr.bdaddr, &info->bdaddr);
-		key->addr.type = info->bdaddr_type;
-		memcpy(key->val, info->val, sizeof(info->val));
-		memcpy(key->rand, info->rand, sizeof(info->rand));
-		memcpy(&key->ediv, &info->ediv, sizeof(key->ediv));
-		key->authenticated = info->authenticated;
-		key->master = info->master;
-		key->enc_size = info->enc_size;
-	}
-
-	adapter->load_ltks_id = mgmt_send(adapter->mgmt,
-					MGMT_OP_LOAD_LONG_TERM_KEYS,
-					adapter->dev_id, cp_size, cp,
-					load_ltks_complete, adapter, NULL);
-
-	g_free(cp);
+		return NULL;
 
-	if (adapter->load_ltks_id == 0) {
-		error("Failed to load LTKs for hci%u", adapter->dev_id);
-		return;
-	}
+	load = key_load_new(adapter, MGMT_OP_LOAD_LONG_TERM_KEYS, "LTKs",
+			sizeof(struct mgmt_cp_load_long_term_keys),
+			offsetof(struct mgmt_cp_load_long_term_keys, key_count),
+			sizeof(struct mgmt_ltk_info));
+	load->timeout_secs = 2;
 
-	/*
-	 * This timeout handling is needed since the kernel is stupid
-	 * and forgets to send a command complete response. However in
-	 * case of failures it does send a command status.
-	 */
-	adapter->load_ltks_timeout = g_timeout_add_seconds(2,
-						load_ltks_timeout, adapter);
+	return load;
 }
 
 static void load_devices(struct btd_adapter *adapter)
 {
 	char filename[PATH_MAX + 1];
 	char srcaddr[18];
-	struct adapter_keys keys = { adapter, NULL };
-	struct adapter_keys ltks = { adapter, NULL };
+	struct key_load *keys, *ltks;
 	DIR *dir;
 	struct dirent *entry;
 
@@ -2476,12 +2626,22 @@ static void load_devices(struct btd_adapter *adapter)
 		return;
 	}
 
+	if (adapter->load_keys)
+		key_load_finish(adapter->load_keys);
+
+	if (adapter->load_ltks)
+		key_load_finish(adapter->load_ltks);
+
+	keys = load_link_keys_new(adapter, main_opts.debug_keys);
+	ltks = load_ltks_new(adapter);
+
 	while ((entry = readdir(dir)) != NULL) {
 		struct btd_device *device;
 		char filename[PATH_MAX + 1];
 		GKeyFile *key_file;
-		struct link_key_info *key_info;
-		struct smp_ltk_info *ltk_info;
+		struct mgmt_link_key_info key_info;
+		struct mgmt_ltk_info ltk_info;
+		bool has_key, has_ltk;
 		GSList *list;
 
 		if (entry->d_type != DT_DIR || bachk(entry->d_name) < 0)
@@ -2493,13 +2653,17 @@ static void load_devices(struct btd_adapter *adapter)
 		key_file = g_key_file_new();
 		g_key_file_load_from_file(key_file, filename, 0, NULL);
 
-		key_info = get_key_info(key_file, entry->d_name);
-		if (key_info)
-			keys.keys = g_slist_append(keys.keys, key_info);
+		memset(&key_info, 0, sizeof(key_info));
+		has_key = get_key_info(key_file, entry->d_name, &key_info);
+		if (has_key && keys)
+			memcpy(key_load_append(keys), &key_info,
+							sizeof(key_info));
 
-		ltk_info = get_ltk_info(key_file, entry->d_name);
-		if (ltk_info)
-			ltks.keys = g_slist_append(ltks.keys, ltk_info);
+		memset(&ltk_info, 0, sizeof(ltk_info));
+		has_ltk = get_ltk_info(key_file, entry->d_name, &ltk_info);
+		if (has_ltk && ltks)
+			memcpy(key_load_append(ltks), &ltk_info,
+							sizeof(ltk_info));
 
 		list = g_slist_find_custom(adapter->devices, entry->d_name,
 							device_address_cmp);
@@ -2515,6 +2679,7 @@ static void load_devices(struct btd_adapter *adapter)
 
 		device_set_temporary(device, FALSE);
 		adapter->devices = g_slist_append(adapter->devices, device);
+		metrics_gauge_inc(devices_gauge);
 
 		/* TODO: register services from pre-loaded list of primaries */
 
@@ -2523,7 +2688,7 @@ static void load_devices(struct btd_adapter *adapter)
 			device_probe_profiles(device, list);
 
 device_exist:
-		if (key_info || ltk_info) {
+		if (has_key || has_ltk) {
 			device_set_paired(device, TRUE);
 			device_set_bonded(device, TRUE);
 		}
@@ -2534,11 +2699,15 @@ free:
 
 	closedir(dir);
 
-	load_link_keys(adapter, keys.keys, main_opts.debug_keys);
-	g_slist_free_full(keys.keys, g_free);
+	if (keys) {
+		adapter->load_keys = keys;
+		key_load_start(keys);
+	}
 
-	load_ltks(adapter, ltks.keys);
-	g_slist_free_full(ltks.keys, g_free);
+	if (ltks) {
+		adapter->load_ltks = ltks;
+		key_load_start(ltks);
+	}
 }
 
 int btd_adapter_block_address(struct btd_adapter *adapter,
@@ -2832,8 +3001,19 @@ void adapter_connect_list_remove(struct btd_adapter *adapter,
 	trigger_passive_scanning(adapter);
 }
 
+static void startup_mark(struct btd_adapter *adapter, const char *stage)
+{
+	char name[10];
+
+	snprintf(name, sizeof(name), "hci%u", adapter->dev_id);
+
+	btd_startup_mark(stage, name);
+}
+
 static void adapter_start(struct btd_adapter *adapter)
 {
+	startup_mark(adapter, "powered");
+
 	g_dbus_emit_property_changed(dbus_conn, adapter->path,
 						ADAPTER_INTERFACE, "Powered");
 
@@ -2901,8 +3081,11 @@ static void adapter_free(gpointer user_data)
 
 	DBG("%p", adapter);
 
-	if (adapter->load_ltks_timeout > 0)
-		g_source_remove(adapter->load_ltks_timeout);
+	if (adapter->load_keys)
+		key_load_free(adapter->load_keys);
+
+	if (adapter->load_ltks)
+		key_load_free(adapter->load_ltks);
 
 	if (adapter->confirm_name_timeout > 0)
 		g_source_remove(adapter->confirm_name_timeout);
@@ -2972,38 +3155,120 @@ void btd_adapter_unref(struct btd_adapter *adapter)
 						ADAPTER_INTERFACE);
 }
 
-static void convert_names_entry(char *key, char *value, void *user_data)
+/*
+ * The legacy files are converted as a batch: every key file touched by
+ * the conversion is loaded once, updated in memory by all converters and
+ * written once when the batch is flushed.
+ */
+struct storage_batch {
+	char *address;			/* Adapter address */
+	GHashTable *files;		/* Filename to GKeyFile */
+};
+
+static GKeyFile *batch_get(struct storage_batch *batch, const char *peer,
+							const char *file)
 {
-	char *address = user_data;
-	char *str = key;
 	char filename[PATH_MAX + 1];
 	GKeyFile *key_file;
-	char *data;
+
+	snprintf(filename, PATH_MAX, STORAGEDIR "/%s/%s/%s", batch->address,
+								peer, file);
+	filename[PATH_MAX] = '\0';
+
+	key_file = g_hash_table_lookup(batch->files, filename);
+	if (key_file)
+		return key_file;
+
+	key_file = g_key_file_new();
+	g_key_file_load_from_file(key_file, filename, 0, NULL);
+
+	g_hash_table_insert(batch->files, g_strdup(filename), key_file);
+
+	return key_file;
+}
+
+static gboolean key_file_is_empty(GKeyFile *key_file)
+{
 	gsize length = 0;
+	char **groups;
 
-	if (strchr(key, '#'))
-		str[17] = '\0';
+	groups = g_key_file_get_groups(key_file, &length);
+	g_strfreev(groups);
 
-	if (bachk(str) != 0)
-		return;
+	return length == 0;
+}
 
-	snprintf(filename, PATH_MAX, STORAGEDIR "/%s/cache/%s", address, str);
+static gboolean batch_has_pending(struct storage_batch *batch,
+					const char *peer, const char *file)
+{
+	char filename[PATH_MAX + 1];
+	GKeyFile *key_file;
+
+	snprintf(filename, PATH_MAX, STORAGEDIR "/%s/%s/%s", batch->address,
+								peer, file);
 	filename[PATH_MAX] = '\0';
-	create_file(filename, S_IRUSR | S_IWUSR);
 
-	key_file = g_key_file_new();
-	g_key_file_load_from_file(key_file, filename, 0, NULL);
-	g_key_file_set_string(key_file, "General", "Name", value);
+	key_file = g_hash_table_lookup(batch->files, filename);
+	if (key_file == NULL)
+		return FALSE;
+
+	return !key_file_is_empty(key_file);
+}
+
+/* Check if the device directory exists or will be created by the batch */
+static gboolean batch_has_device(struct storage_batch *batch,
+							const char *peer)
+{
+	char filename[PATH_MAX + 1];
+	struct stat st;
+
+	if (batch_has_pending(batch, peer, "info") ||
+			batch_has_pending(batch, peer, "attributes"))
+		return TRUE;
+
+	snprintf(filename, PATH_MAX, STORAGEDIR "/%s/%s", batch->address, peer);
+	filename[PATH_MAX] = '\0';
+
+	if (stat(filename, &st) < 0 || !S_ISDIR(st.st_mode))
+		return FALSE;
+
+	return TRUE;
+}
+
+static void flush_file(gpointer key, gpointer value, gpointer user_data)
+{
+	const char *filename = key;
+	GKeyFile *key_file = value;
+	char *data;
+	gsize length = 0;
 
 	data = g_key_file_to_data(key_file, &length, NULL);
-	g_file_set_contents(filename, data, length, NULL);
+	if (length > 0) {
+		create_file(filename, S_IRUSR | S_IWUSR);
+		g_file_set_contents(filename, data, length, NULL);
+	}
+
 	g_free(data);
+}
 
-	g_key_file_free(key_file);
+static void convert_names_entry(char *key, char *value, void *user_data)
+{
+	struct storage_batch *batch = user_data;
+	char *str = key;
+	GKeyFile *key_file;
+
+	if (strchr(key, '#'))
+		str[17] = '\0';
+
+	if (bachk(str) != 0)
+		return;
+
+	key_file = batch_get(batch, "cache", str);
+	g_key_file_set_string(key_file, "General", "Name", value);
 }
 
 struct device_converter {
-	char *address;
+	struct storage_batch *batch;
 	void (*cb)(GKeyFile *key_file, void *value);
 	gboolean force;
 };
@@ -3188,10 +3453,7 @@ static void convert_entry(char *key, char *value, void *user_data)
 {
 	struct device_converter *converter = user_data;
 	char type = BDADDR_BREDR;
-	char filename[PATH_MAX + 1];
 	GKeyFile *key_file;
-	char *data;
-	gsize length = 0;
 
 	if (strchr(key, '#')) {
 		key[17] = '\0';
@@ -3199,54 +3461,31 @@ static void convert_entry(char *key, char *value, void *user_data)
 	}
 
 	if (bachk(key) != 0)
-		return;
-
-	if (converter->force == FALSE) {
-		struct stat st;
-		int err;
-
-		snprintf(filename, PATH_MAX, STORAGEDIR "/%s/%s",
-				converter->address, key);
-		filename[PATH_MAX] = '\0';
-
-		err = stat(filename, &st);
-		if (err || !S_ISDIR(st.st_mode))
-			return;
-	}
-
-	snprintf(filename, PATH_MAX, STORAGEDIR "/%s/%s/info",
-			converter->address, key);
-	filename[PATH_MAX] = '\0';
-
-	key_file = g_key_file_new();
-	g_key_file_load_from_file(key_file, filename, 0, NULL);
-
-	set_device_type(key_file, type);
-
-	converter->cb(key_file, value);
-
-	data = g_key_file_to_data(key_file, &length, NULL);
-	if (length > 0) {
-		create_file(filename, S_IRUSR | S_IWUSR);
-		g_file_set_contents(filename, data, length, NULL);
-	}
+		return;
 
-	g_free(data);
+	if (converter->force == FALSE &&
+			!batch_has_device(converter->batch, key))
+		return;
 
-	g_key_file_free(key_file);
+	key_file = batch_get(converter->batch, key, "info");
+
+	set_device_type(key_file, type);
+
+	converter->cb(key_file, value);
 }
 
-static void convert_file(char *file, char *address,
+static void convert_file(char *file, struct storage_batch *batch,
 				void (*cb)(GKeyFile *key_file, void *value),
 				gboolean force)
 {
 	char filename[PATH_MAX + 1];
 	struct device_converter converter;
 
-	snprintf(filename, PATH_MAX, STORAGEDIR "/%s/%s", address, file);
+	snprintf(filename, PATH_MAX, STORAGEDIR "/%s/%s", batch->address,
+									file);
 	filename[PATH_MAX] = '\0';
 
-	converter.address = address;
+	converter.batch = batch;
 	converter.cb = cb;
 	converter.force = force;
 
@@ -3306,50 +3545,29 @@ static void store_attribute_uuid(GKeyFile *key_file, uint16_t start,
 	g_key_file_set_integer(key_file, handle, "EndGroupHandle", end);
 }
 
-static void store_sdp_record(char *local, char *peer, int handle, char *value)
+static void store_sdp_record(struct storage_batch *batch, char *peer,
+						int handle, char *value)
 {
-	char filename[PATH_MAX + 1];
 	GKeyFile *key_file;
 	char handle_str[11];
-	char *data;
-	gsize length = 0;
-
-	snprintf(filename, PATH_MAX, STORAGEDIR "/%s/cache/%s", local, peer);
-	filename[PATH_MAX] = '\0';
 
-	key_file = g_key_file_new();
-	g_key_file_load_from_file(key_file, filename, 0, NULL);
+	key_file = batch_get(batch, "cache", peer);
 
 	sprintf(handle_str, "0x%8.8X", handle);
 	g_key_file_set_string(key_file, "ServiceRecords", handle_str, value);
-
-	data = g_key_file_to_data(key_file, &length, NULL);
-	if (length > 0) {
-		create_file(filename, S_IRUSR | S_IWUSR);
-		g_file_set_contents(filename, data, length, NULL);
-	}
-
-	g_free(data);
-
-	g_key_file_free(key_file);
 }
 
 static void convert_sdp_entry(char *key, char *value, void *user_data)
 {
-	char *src_addr = user_data;
+	struct storage_batch *batch = user_data;
 	char dst_addr[18];
 	char type = BDADDR_BREDR;
 	int handle, ret;
-	char filename[PATH_MAX + 1];
 	GKeyFile *key_file;
-	struct stat st;
 	sdp_record_t *rec;
 	uuid_t uuid;
 	char *att_uuid, *prim_uuid;
 	uint16_t start = 0, end = 0, psm = 0;
-	int err;
-	char *data;
-	gsize length = 0;
 
 	ret = sscanf(key, "%17s#%hhu#%08X", dst_addr, &type, &handle);
 	if (ret < 3) {
@@ -3363,15 +3581,11 @@ static void convert_sdp_entry(char *key, char *value, void *user_data)
 
 	/* Check if the device directory has been created as records should
 	 * only be converted for known devices */
-	snprintf(filename, PATH_MAX, STORAGEDIR "/%s/%s", src_addr, dst_addr);
-	filename[PATH_MAX] = '\0';
-
-	err = stat(filename, &st);
-	if (err || !S_ISDIR(st.st_mode))
+	if (!batch_has_device(batch, dst_addr))
 		return;
 
 	/* store device records in cache */
-	store_sdp_record(src_addr, dst_addr, handle, value);
+	store_sdp_record(batch, dst_addr, handle, value);
 
 	/* Retrieve device record and check if there is an
 	 * attribute entry in it */
@@ -3389,24 +3603,10 @@ static void convert_sdp_entry(char *key, char *value, void *user_data)
 	if (!gatt_parse_record(rec, &uuid, &psm, &start, &end))
 		goto failed;
 
-	snprintf(filename, PATH_MAX, STORAGEDIR "/%s/%s/attributes", src_addr,
-								dst_addr);
-	filename[PATH_MAX] = '\0';
-
-	key_file = g_key_file_new();
-	g_key_file_load_from_file(key_file, filename, 0, NULL);
+	key_file = batch_get(batch, dst_addr, "attributes");
 
 	store_attribute_uuid(key_file, start, end, prim_uuid, uuid);
 
-	data = g_key_file_to_data(key_file, &length, NULL);
-	if (length > 0) {
-		create_file(filename, S_IRUSR | S_IWUSR);
-		g_file_set_contents(filename, data, length, NULL);
-	}
-
-	g_free(data);
-	g_key_file_free(key_file);
-
 failed:
 	sdp_record_free(rec);
 	g_free(prim_uuid);
@@ -3415,17 +3615,14 @@ failed:
 
 static void convert_primaries_entry(char *key, char *value, void *user_data)
 {
-	char *address = user_data;
+	struct storage_batch *batch = user_data;
 	int device_type = -1;
 	uuid_t uuid;
 	char **services, **service, *prim_uuid;
-	char filename[PATH_MAX + 1];
 	GKeyFile *key_file;
 	int ret;
 	uint16_t start, end;
 	char uuid_str[MAX_LEN_UUID_STR + 1];
-	char *data;
-	gsize length = 0;
 
 	if (strchr(key, '#')) {
 		key[17] = '\0';
@@ -3442,12 +3639,7 @@ static void convert_primaries_entry(char *key, char *value, void *user_data)
 	sdp_uuid16_create(&uuid, GATT_PRIM_SVC_UUID);
 	prim_uuid = bt_uuid2string(&uuid);
 
-	snprintf(filename, PATH_MAX, STORAGEDIR "/%s/%s/attributes", address,
-									key);
-	filename[PATH_MAX] = '\0';
-
-	key_file = g_key_file_new();
-	g_key_file_load_from_file(key_file, filename, 0, NULL);
+	key_file = batch_get(batch, key, "attributes");
 
 	for (service = services; *service; service++) {
 		ret = sscanf(*service, "%04hX#%04hX#%s", &start, &end,
@@ -3462,52 +3654,23 @@ static void convert_primaries_entry(char *key, char *value, void *user_data)
 	}
 
 	g_strfreev(services);
+	g_free(prim_uuid);
 
-	data = g_key_file_to_data(key_file, &length, NULL);
-	if (length == 0)
-		goto end;
-
-	create_file(filename, S_IRUSR | S_IWUSR);
-	g_file_set_contents(filename, data, length, NULL);
-
-	if (device_type < 0)
-		goto end;
-
-	g_free(data);
-	g_key_file_free(key_file);
-
-	snprintf(filename, PATH_MAX, STORAGEDIR "/%s/%s/info", address, key);
-	filename[PATH_MAX] = '\0';
+	if (device_type < 0 || key_file_is_empty(key_file))
+		return;
 
-	key_file = g_key_file_new();
-	g_key_file_load_from_file(key_file, filename, 0, NULL);
+	key_file = batch_get(batch, key, "info");
 	set_device_type(key_file, device_type);
-
-	data = g_key_file_to_data(key_file, &length, NULL);
-	if (length > 0) {
-		create_file(filename, S_IRUSR | S_IWUSR);
-		g_file_set_contents(filename, data, length, NULL);
-	}
-
-end:
-	g_free(data);
-	g_free(prim_uuid);
-	g_key_file_free(key_file);
 }
 
 static void convert_ccc_entry(char *key, char *value, void *user_data)
 {
-	char *src_addr = user_data;
+	struct storage_batch *batch = user_data;
 	char dst_addr[18];
 	char type = BDADDR_BREDR;
 	int handle, ret;
-	char filename[PATH_MAX + 1];
 	GKeyFile *key_file;
-	struct stat st;
-	int err;
 	char group[6];
-	char *data;
-	gsize length = 0;
 
 	ret = sscanf(key, "%17s#%hhu#%04X", dst_addr, &type, &handle);
 	if (ret < 3)
@@ -3518,46 +3681,23 @@ static void convert_ccc_entry(char *key, char *value, void *user_data)
 
 	/* Check if the device directory has been created as records should
 	 * only be converted for known devices */
-	snprintf(filename, PATH_MAX, STORAGEDIR "/%s/%s", src_addr, dst_addr);
-	filename[PATH_MAX] = '\0';
-
-	err = stat(filename, &st);
-	if (err || !S_ISDIR(st.st_mode))
+	if (!batch_has_device(batch, dst_addr))
 		return;
 
-	snprintf(filename, PATH_MAX, STORAGEDIR "/%s/%s/ccc", src_addr,
-								dst_addr);
-	filename[PATH_MAX] = '\0';
-
-	key_file = g_key_file_new();
-	g_key_file_load_from_file(key_file, filename, 0, NULL);
+	key_file = batch_get(batch, dst_addr, "ccc");
 
 	sprintf(group, "%hu", handle);
 	g_key_file_set_string(key_file, group, "Value", value);
-
-	data = g_key_file_to_data(key_file, &length, NULL);
-	if (length > 0) {
-		create_file(filename, S_IRUSR | S_IWUSR);
-		g_file_set_contents(filename, data, length, NULL);
-	}
-
-	g_free(data);
-	g_key_file_free(key_file);
 }
 
 static void convert_gatt_entry(char *key, char *value, void *user_data)
 {
-	char *src_addr = user_data;
+	struct storage_batch *batch = user_data;
 	char dst_addr[18];
 	char type = BDADDR_BREDR;
 	int handle, ret;
-	char filename[PATH_MAX + 1];
 	GKeyFile *key_file;
-	struct stat st;
-	int err;
 	char group[6];
-	char *data;
-	gsize length = 0;
 
 	ret = sscanf(key, "%17s#%hhu#%04X", dst_addr, &type, &handle);
 	if (ret < 3)
@@ -3568,43 +3708,20 @@ static void convert_gatt_entry(char *key, char *value, void *user_data)
 
 	/* Check if the device directory has been created as records should
 	 * only be converted for known devices */
-	snprintf(filename, PATH_MAX, STORAGEDIR "/%s/%s", src_addr, dst_addr);
-	filename[PATH_MAX] = '\0';
-
-	err = stat(filename, &st);
-	if (err || !S_ISDIR(st.st_mode))
+	if (!batch_has_device(batch, dst_addr))
 		return;
 
-	snprintf(filename, PATH_MAX, STORAGEDIR "/%s/%s/gatt", src_addr,
-								dst_addr);
-	filename[PATH_MAX] = '\0';
-
-	key_file = g_key_file_new();
-	g_key_file_load_from_file(key_file, filename, 0, NULL);
+	key_file = batch_get(batch, dst_addr, "gatt");
 
 	sprintf(group, "%hu", handle);
 	g_key_file_set_string(key_file, group, "Value", value);
-
-	data = g_key_file_to_data(key_file, &length, NULL);
-	if (length > 0) {
-		create_file(filename, S_IRUSR | S_IWUSR);
-		g_file_set_contents(filename, data, length, NULL);
-	}
-
-	g_free(data);
-	g_key_file_free(key_file);
 }
 
 static void convert_proximity_entry(char *key, char *value, void *user_data)
 {
-	char *src_addr = user_data;
+	struct storage_batch *batch = user_data;
 	char *alert;
-	char filename[PATH_MAX + 1];
 	GKeyFile *key_file;
-	struct stat st;
-	int err;
-	char *data;
-	gsize length = 0;
 
 	if (!strchr(key, '#'))
 		return;
@@ -3617,95 +3734,87 @@ static void convert_proximity_entry(char *key, char *value, void *user_data)
 
 	/* Check if the device directory has been created as records should
 	 * only be converted for known devices */
-	snprintf(filename, PATH_MAX, STORAGEDIR "/%s/%s", src_addr, key);
-	filename[PATH_MAX] = '\0';
-
-	err = stat(filename, &st);
-	if (err || !S_ISDIR(st.st_mode))
+	if (!batch_has_device(batch, key))
 		return;
 
-	snprintf(filename, PATH_MAX, STORAGEDIR "/%s/%s/proximity", src_addr,
-									key);
-	filename[PATH_MAX] = '\0';
-
-	key_file = g_key_file_new();
-	g_key_file_load_from_file(key_file, filename, 0, NULL);
+	key_file = batch_get(batch, key, "proximity");
 
 	g_key_file_set_string(key_file, alert, "Level", value);
-
-	data = g_key_file_to_data(key_file, &length, NULL);
-	if (length > 0) {
-		create_file(filename, S_IRUSR | S_IWUSR);
-		g_file_set_contents(filename, data, length, NULL);
-	}
-
-	g_free(data);
-	g_key_file_free(key_file);
 }
 
 static void convert_device_storage(struct btd_adapter *adapter)
 {
 	char filename[PATH_MAX + 1];
 	char address[18];
+	struct storage_batch batch;
 
 	ba2str(&adapter->bdaddr, address);
 
+	batch.address = address;
+	batch.files = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+					(GDestroyNotify) g_key_file_free);
+
 	/* Convert device's name cache */
 	snprintf(filename, PATH_MAX, STORAGEDIR "/%s/names", address);
 	filename[PATH_MAX] = '\0';
-	textfile_foreach(filename, convert_names_entry, address);
+	textfile_foreach(filename, convert_names_entry, &batch);
 
 	/* Convert aliases */
-	convert_file("aliases", address, convert_aliases_entry, TRUE);
+	convert_file("aliases", &batch, convert_aliases_entry, TRUE);
 
 	/* Convert trusts */
-	convert_file("trusts", address, convert_trusts_entry, TRUE);
+	convert_file("trusts", &batch, convert_trusts_entry, TRUE);
 
 	/* Convert blocked */
-	convert_file("blocked", address, convert_blocked_entry, TRUE);
+	convert_file("blocked", &batch, convert_blocked_entry, TRUE);
 
 	/* Convert profiles */
-	convert_file("profiles", address, convert_profiles_entry, TRUE);
+	convert_file("profiles", &batch, convert_profiles_entry, TRUE);
 
 	/* Convert primaries */
 	snprintf(filename, PATH_MAX, STORAGEDIR "/%s/primaries", address);
 	filename[PATH_MAX] = '\0';
-	textfile_foreach(filename, convert_primaries_entry, address);
+	textfile_foreach(filename, convert_primaries_entry, &batch);
 
 	/* Convert linkkeys */
-	convert_file("linkkeys", address, convert_linkkey_entry, TRUE);
+	convert_file("linkkeys", &batch, convert_linkkey_entry, TRUE);
 
 	/* Convert longtermkeys */
-	convert_file("longtermkeys", address, convert_ltk_entry, TRUE);
+	convert_file("longtermkeys", &batch, convert_ltk_entry, TRUE);
 
 	/* Convert classes */
-	convert_file("classes", address, convert_classes_entry, FALSE);
+	convert_file("classes", &batch, convert_classes_entry, FALSE);
 
 	/* Convert device ids */
-	convert_file("did", address, convert_did_entry, FALSE);
+	convert_file("did", &batch, convert_did_entry, FALSE);
 
 	/* Convert sdp */
 	snprintf(filename, PATH_MAX, STORAGEDIR "/%s/sdp", address);
 	filename[PATH_MAX] = '\0';
-	textfile_foreach(filename, convert_sdp_entry, address);
+	textfile_foreach(filename, convert_sdp_entry, &batch);
 
 	/* Convert ccc */
 	snprintf(filename, PATH_MAX, STORAGEDIR "/%s/ccc", address);
 	filename[PATH_MAX] = '\0';
-	textfile_foreach(filename, convert_ccc_entry, address);
+	textfile_foreach(filename, convert_ccc_entry, &batch);
 
 	/* Convert appearances */
-	convert_file("appearances", address, convert_appearances_entry, FALSE);
+	convert_file("appearances", &batch, convert_appearances_entry, FALSE);
 
 	/* Convert gatt */
 	snprintf(filename, PATH_MAX, STORAGEDIR "/%s/gatt", address);
 	filename[PATH_MAX] = '\0';
-	textfile_foreach(filename, convert_gatt_entry, address);
+	textfile_foreach(filename, convert_gatt_entry, &batch);
 
 	/* Convert proximity */
 	snprintf(filename, PATH_MAX, STORAGEDIR "/%s/proximity", address);
 	filename[PATH_MAX] = '\0';
-	textfile_foreach(filename, convert_proximity_entry, address);
+	textfile_foreach(filename, convert_proximity_entry, &batch);
+
+	DBG("Writing %u converted files", g_hash_table_size(batch.files));
+
+	g_hash_table_foreach(batch.files, flush_file, NULL);
+	g_hash_table_destroy(batch.files);
 }
 
 static void convert_config(struct btd_adapter *adapter, const char *filename,
@@ -3747,83 +3856,83 @@ static void convert_config(struct btd_adapter *adapter, const char *filename,
 	g_free(data);
 }
 
-static void fix_storage(struct btd_adapter *adapter)
+static const char *legacy_files[] = {
+	"names",
+	"aliases",
+	"trusts",
+	"blocked",
+	"profiles",
+	"primaries",
+	"linkkeys",
+	"longtermkeys",
+	"classes",
+	"did",
+	"sdp",
+	"ccc",
+	"appearances",
+	"gatt",
+	"proximity",
+	NULL
+};
+
+static void store_storage_version(struct btd_adapter *adapter)
 {
+	GKeyFile *key_file;
 	char filename[PATH_MAX + 1];
 	char address[18];
-	char *converted;
+	char *data;
+	gsize length = 0;
 
 	ba2str(&adapter->bdaddr, address);
-
-	snprintf(filename, PATH_MAX, STORAGEDIR "/%s/config", address);
-	filename[PATH_MAX] = '\0';
-	converted = textfile_get(filename, "converted");
-	if (!converted)
-		return;
-
-	free(converted);
-
-	textfile_del(filename, "converted");
-
-	snprintf(filename, PATH_MAX, STORAGEDIR "/%s/names", address);
-	filename[PATH_MAX] = '\0';
-	textfile_del(filename, "converted");
-
-	snprintf(filename, PATH_MAX, STORAGEDIR "/%s/aliases", address);
-	filename[PATH_MAX] = '\0';
-	textfile_del(filename, "converted");
-
-	snprintf(filename, PATH_MAX, STORAGEDIR "/%s/trusts", address);
+	snprintf(filename, PATH_MAX, STORAGEDIR "/%s/settings", address);
 	filename[PATH_MAX] = '\0';
-	textfile_del(filename, "converted");
 
-	snprintf(filename, PATH_MAX, STORAGEDIR "/%s/blocked", address);
-	filename[PATH_MAX] = '\0';
-	textfile_del(filename, "converted");
+	key_file = g_key_file_new();
+	g_key_file_load_from_file(key_file, filename, 0, NULL);
 
-	snprintf(filename, PATH_MAX, STORAGEDIR "/%s/profiles", address);
-	filename[PATH_MAX] = '\0';
-	textfile_del(filename, "converted");
+	g_key_file_set_integer(key_file, "Storage", "Version",
+						adapter->storage_version);
 
-	snprintf(filename, PATH_MAX, STORAGEDIR "/%s/primaries", address);
-	filename[PATH_MAX] = '\0';
-	textfile_del(filename, "converted");
+	create_file(filename, S_IRUSR | S_IWUSR);
 
-	snprintf(filename, PATH_MAX, STORAGEDIR "/%s/linkkeys", address);
-	filename[PATH_MAX] = '\0';
-	textfile_del(filename, "converted");
+	data = g_key_file_to_data(key_file, &length, NULL);
+	g_file_set_contents(filename, data, length, NULL);
+	g_free(data);
 
-	snprintf(filename, PATH_MAX, STORAGEDIR "/%s/longtermkeys", address);
-	filename[PATH_MAX] = '\0';
-	textfile_del(filename, "converted");
+	g_key_file_free(key_file);
+}
 
-	snprintf(filename, PATH_MAX, STORAGEDIR "/%s/classes", address);
-	filename[PATH_MAX] = '\0';
-	textfile_del(filename, "converted");
+static void fix_storage(struct btd_adapter *adapter)
+{
+	char filename[PATH_MAX + 1];
+	char address[18];
+	char *converted;
+	int i;
 
-	snprintf(filename, PATH_MAX, STORAGEDIR "/%s/did", address);
-	filename[PATH_MAX] = '\0';
-	textfile_del(filename, "converted");
+	/* The legacy files only need to be looked at once */
+	if (adapter->storage_version >= STORAGE_VERSION)
+		return;
 
-	snprintf(filename, PATH_MAX, STORAGEDIR "/%s/sdp", address);
-	filename[PATH_MAX] = '\0';
-	textfile_del(filename, "converted");
+	ba2str(&adapter->bdaddr, address);
 
-	snprintf(filename, PATH_MAX, STORAGEDIR "/%s/ccc", address);
+	snprintf(filename, PATH_MAX, STORAGEDIR "/%s/config", address);
 	filename[PATH_MAX] = '\0';
-	textfile_del(filename, "converted");
+	converted = textfile_get(filename, "converted");
+	if (converted) {
+		free(converted);
 
-	snprintf(filename, PATH_MAX, STORAGEDIR "/%s/appearances", address);
-	filename[PATH_MAX] = '\0';
-	textfile_del(filename, "converted");
+		textfile_del(filename, "converted");
 
-	snprintf(filename, PATH_MAX, STORAGEDIR "/%s/gatt", address);
-	filename[PATH_MAX] = '\0';
-	textfile_del(filename, "converted");
+		for (i = 0; legacy_files[i]; i++) {
+			snprintf(filename, PATH_MAX, STORAGEDIR "/%s/%s",
+						address, legacy_files[i]);
+			filename[PATH_MAX] = '\0';
+			textfile_del(filename, "converted");
+		}
+	}
 
-	snprintf(filename, PATH_MAX, STORAGEDIR "/%s/proximity", address);
-	filename[PATH_MAX] = '\0';
-	textfile_del(filename, "converted");
+	adapter->storage_version = STORAGE_VERSION;
+	store_storage_version(adapter);
 }
 
 static void load_config(struct btd_adapter *adapter)
@@ -3884,6 +3993,10 @@ static void load_config(struct btd_adapter *adapter)
 		gerr = NULL;
 	}
 
+	/* Get storage layout version, files without one predate it */
+	adapter->storage_version = g_key_file_get_integer(key_file,
+					"Storage", "Version", NULL);
+
 	g_key_file_free(key_file);
 }
 
@@ -3947,11 +4060,18 @@ static void adapter_remove(struct btd_adapter *adapter)
 
 	discovery_cleanup(adapter);
 
+	g_slist_foreach(adapter->powered_requests, fail_powered_request,
+									NULL);
+	g_slist_free(adapter->powered_requests);
+	adapter->powered_requests = NULL;
+
 	g_slist_free(adapter->connect_list);
 	adapter->connect_list = NULL;
 
-	for (l = adapter->devices; l; l = l->next)
+	for (l = adapter->devices; l; l = l->next) {
 		device_remove(l->data, FALSE);
+		metrics_gauge_dec(devices_gauge);
+	}
 
 	g_slist_free(adapter->devices);
 	adapter->devices = NULL;
@@ -4086,8 +4206,6 @@ static void update_found_devices(struct btd_adapter *adapter,
 		return;
 	}
 
-	ba2str(bdaddr, addr);
-
 	list = g_slist_find_custom(adapter->devices, bdaddr, device_bdaddr_cmp);
 	if (!list) {
 		/*
@@ -4104,6 +4222,7 @@ static void update_found_devices(struct btd_adapter *adapter,
 		dev = list->data;
 
 	if (!dev) {
+		ba2str(bdaddr, addr);
 		error("Unable to create object for found device %s", addr);
 		eir_data_free(&eir_data);
 		return;
@@ -4158,6 +4277,7 @@ static void update_found_devices(struct btd_adapter *adapter,
 
 	adapter->discovery_found = g_slist_prepend(adapter->discovery_found,
 									dev);
+	metrics_counter_add(discovery_results_total, 1);
 
 	return;
 
@@ -4192,7 +4312,6 @@ static void device_found_callback(uint16_t index, uint16_t length,
 	uint32_t flags;
 	bool confirm_name;
 	bool legacy;
-	char addr[18];
 
 	if (length < sizeof(*ev)) {
 		error("Too short device found event (%u bytes)", length);
@@ -4213,9 +4332,15 @@ static void device_found_callback(uint16_t index, uint16_t length,
 
 	flags = btohl(ev->flags);
 
-	ba2str(&ev->addr.bdaddr, addr);
-	DBG("hci%u addr %s, rssi %d flags 0x%04x eir_len %u",
-			index, addr, ev->rssi, flags, eir_len);
+	metrics_counter_add(device_found_total, 1);
+
+	/* Called for every advertising report, so avoid ba2str() here */
+	DBG("hci%u addr %2.2X:%2.2X:%2.2X:%2.2X:%2.2X:%2.2X, rssi %d "
+			"flags 0x%04x eir_len %u", index,
+			ev->addr.bdaddr.b[5], ev->addr.bdaddr.b[4],
+			ev->addr.bdaddr.b[3], ev->addr.bdaddr.b[2],
+			ev->addr.bdaddr.b[1], ev->addr.bdaddr.b[0],
+			ev->rssi, flags, eir_len);
 
 	confirm_name = (flags & MGMT_DEV_FOUND_CONFIRM_NAME);
 	legacy = (flags & MGMT_DEV_FOUND_LEGACY_PAIRING);
@@ -4508,6 +4633,11 @@ int btd_adapter_restore_powered(struct btd_adapter *adapter)
 	if (adapter->current_settings & MGMT_SETTING_POWERED)
 		return 0;
 
+	if (!plugins_loaded) {
+		adapter->power_held = true;
+		return 0;
+	}
+
 	set_mode(adapter, MGMT_OP_SET_POWERED, 0x01);
 
 	return 0;
@@ -5608,11 +5738,18 @@ static int adapter_register(struct btd_adapter *adapter)
 	btd_adapter_gatt_server_start(adapter);
 
 	load_config(adapter);
+	startup_mark(adapter, "load-config");
+
 	fix_storage(adapter);
+	startup_mark(adapter, "fix-storage");
+
 	load_drivers(adapter);
 	btd_profile_foreach(probe_profile, adapter);
+	startup_mark(adapter, "load-drivers");
+
 	clear_blocked(adapter);
 	load_devices(adapter);
+	startup_mark(adapter, "load-devices");
 
 	/* retrieve the active connections: address the scenario where
 	 * the are active connections before the daemon've started */
@@ -5627,6 +5764,8 @@ static int adapter_register(struct btd_adapter *adapter)
 
 	DBG("Adapter %s registered", adapter->path);
 
+	startup_mark(adapter, "registered");
+
 	return 0;
 }
 
@@ -5712,6 +5851,8 @@ static void connected_callback(uint16_t index, uint16_t length,
 	if (eir_data.class != 0)
 		device_set_class(device, eir_data.class);
 
+	device_trace(device, "connected", NULL);
+
 	adapter_add_connection(adapter, device);
 
 	if (eir_data.name != NULL) {
@@ -5841,6 +5982,26 @@ static void unpaired_callback(uint16_t index, uint16_t length,
 		adapter_remove_device(adapter, device);
 }
 
+static void adapter_enable(struct btd_adapter *adapter)
+{
+	set_mode(adapter, MGMT_OP_SET_CONNECTABLE, 0x01);
+
+	if (adapter->stored_discoverable && !adapter->discoverable_timeout)
+		set_discoverable(adapter, 0x01, 0);
+
+	if (adapter->current_settings & MGMT_SETTING_POWERED)
+		adapter_start(adapter);
+	else if (adapter->power_held && !adapter->powered_requests)
+		set_mode(adapter, MGMT_OP_SET_POWERED, 0x01);
+
+	adapter->power_held = false;
+
+	g_slist_foreach(adapter->powered_requests, set_powered_request,
+								adapter);
+	g_slist_free(adapter->powered_requests);
+	adapter->powered_requests = NULL;
+}
+
 static void read_info_complete(uint8_t status, uint16_t length,
 					const void *param, void *user_data)
 {
@@ -5861,6 +6022,8 @@ static void read_info_complete(uint8_t status, uint16_t length,
 		goto failed;
 	}
 
+	startup_mark(adapter, "read-info");
+
 	if (bacmp(&rp->bdaddr, BDADDR_ANY) == 0) {
 		error("No Bluetooth address for index %u", adapter->dev_id);
 		goto failed;
@@ -5997,13 +6160,9 @@ static void read_info_complete(uint8_t status, uint16_t length,
 		set_mode(adapter, MGMT_OP_SET_LE, 0x01);
 
 	set_mode(adapter, MGMT_OP_SET_PAIRABLE, 0x01);
-	set_mode(adapter, MGMT_OP_SET_CONNECTABLE, 0x01);
-
-	if (adapter->stored_discoverable && !adapter->discoverable_timeout)
-		set_discoverable(adapter, 0x01, 0);
 
-	if (adapter->current_settings & MGMT_SETTING_POWERED)
-		adapter_start(adapter);
+	if (plugins_loaded)
+		adapter_enable(adapter);
 
 	return;
 
@@ -6101,6 +6260,8 @@ static void read_index_list_complete(uint8_t status, uint16_t length,
 		return;
 	}
 
+	btd_startup_mark("index-list", NULL);
+
 	num = btohs(rp->num_controllers);
 
 	DBG("Number of controllers: %d", num);
@@ -6170,6 +6331,8 @@ static void read_version_complete(uint8_t status, uint16_t length,
 	mgmt_version = rp->version;
 	mgmt_revision = btohs(rp->revision);
 
+	btd_startup_mark("mgmt-version", NULL);
+
 	info("Bluetooth management interface %u.%u initialized",
 						mgmt_version, mgmt_revision);
 
@@ -6210,16 +6373,74 @@ static void mgmt_debug(const char *str, void *user_data)
 	info("%s%s", prefix, str);
 }
 
+static void mgmt_stats(enum mgmt_stats_type type, uint32_t latency,
+							void *user_data)
+{
+	switch (type) {
+	case MGMT_STATS_REQUEST_QUEUED:
+		metrics_gauge_inc(mgmt_pending_requests);
+		break;
+	case MGMT_STATS_REQUEST_SENT:
+		metrics_counter_add(mgmt_commands_total, 1);
+		break;
+	case MGMT_STATS_REQUEST_COMPLETE:
+		metrics_histogram_observe(mgmt_command_latency, latency);
+		break;
+	case MGMT_STATS_REQUEST_FREED:
+		metrics_gauge_dec(mgmt_pending_requests);
+		break;
+	case MGMT_STATS_EVENT:
+		metrics_counter_add(mgmt_events_total, 1);
+		break;
+	}
+}
+
+void adapter_plugins_ready(void)
+{
+	GSList *l;
+
+	plugins_loaded = true;
+
+	if (powering_down)
+		return;
+
+	for (l = adapters; l; l = l->next)
+		adapter_enable(l->data);
+}
+
 int adapter_init(void)
 {
 	dbus_conn = btd_get_dbus_connection();
 
+	devices_gauge = metrics_gauge_new("bluez_adapter_devices",
+					"Device objects of all adapters");
+	device_found_total = metrics_counter_new(
+					"bluez_adapter_device_found_total",
+					"Device found events received");
+	discovery_results_total = metrics_counter_new(
+					"bluez_adapter_discovery_results_total",
+					"Devices reported by discovery sessions");
+	storage_writes_total = metrics_counter_new("bluez_storage_writes_total",
+					"Settings and device info files written");
+	mgmt_commands_total = metrics_counter_new("bluez_mgmt_commands_total",
+					"Management commands sent");
+	mgmt_events_total = metrics_counter_new("bluez_mgmt_events_total",
+					"Management events received");
+	mgmt_pending_requests = metrics_gauge_new(
+					"bluez_mgmt_pending_requests",
+					"Management commands without a reply");
+	mgmt_command_latency = metrics_histogram_new(
+					"bluez_mgmt_command_latency_us",
+					"Management command round trip time");
+
 	mgmt_master = mgmt_new_default();
 	if (!mgmt_master) {
 		error("Failed to access management interface");
 		return -EIO;
 	}
 
+	mgmt_set_stats(mgmt_master, mgmt_stats, NULL, NULL);
+
 	if (getenv("MGMT_DEBUG"))
 		mgmt_set_debug(mgmt_master, mgmt_debug, "mgmt: ", NULL);
 
@@ -58,25 +58,8 @@ struct oob_handler {
 	void *user_data;
 };
 
-struct link_key_info {
-	bdaddr_t bdaddr;
-	unsigned char key[16];
-	uint8_t type;
-	uint8_t pin_len;
-};
-
-struct smp_ltk_info {
-	bdaddr_t bdaddr;
-	uint8_t bdaddr_type;
-	uint8_t authenticated;
-	uint8_t master;
-	uint8_t enc_size;
-	uint16_t ediv;
-	uint8_t rand[8];
-	uint8_t val[16];
-};
-
 int adapter_init(void);
+void adapter_plugins_ready(void);
 void adapter_cleanup(void);
 void adapter_shutdown(void);
 
@@ -51,11 +51,16 @@
 #include "attrib/gatt.h"
 #include "attrib/att-database.h"
 #include "storage.h"
+#include "attio.h"
+#include "src/shared/metrics.h"
 
 #include "attrib-server.h"
 
 static GSList *servers = NULL;
 
+/* Received PDUs per opcode, created on first use */
+static struct metrics_counter *pdu_counters[256];
+
 struct gatt_server {
 	struct btd_adapter *adapter;
 	GIOChannel *l2cap_io;
@@ -66,6 +71,9 @@ struct gatt_server {
 	GSList *clients;
 	uint16_t name_handle;
 	uint16_t appearance_handle;
+	GSList *subscribers;		/* struct gatt_client */
+	GHashTable *ccc_index;		/* CCC handle -> subscribed clients */
+	gboolean subscribers_loaded;
 };
 
 struct gatt_channel {
@@ -81,11 +89,21 @@ struct gatt_channel {
 	struct btd_device *device;
 };
 
-struct group_elem {
+/* Client Characteristic Configuration state of a remote client */
+struct gatt_client {
+	struct gatt_server *server;
+	bdaddr_t bdaddr;
+	uint8_t bdaddr_type;
+	GHashTable *ccc;		/* CCC handle -> configuration */
+	GQueue *queue;			/* Values waiting to be sent */
+	struct btd_device *device;	/* Set while waiting for a connection */
+	guint attio_id;
+};
+
+struct pending_value {
 	uint16_t handle;
-	uint16_t end;
 	uint8_t *data;
-	uint16_t len;
+	size_t len;
 };
 
 static bt_uuid_t prim_uuid = {
@@ -122,10 +140,40 @@ static void channel_free(struct gatt_channel *channel)
 	g_free(channel);
 }
 
+static void pending_value_free(void *data)
+{
+	struct pending_value *pv = data;
+
+	g_free(pv->data);
+	g_free(pv);
+}
+
+static void client_free(void *data)
+{
+	struct gatt_client *client = data;
+
+	if (client->attio_id > 0)
+		btd_device_remove_attio_callback(client->device,
+							client->attio_id);
+
+	if (client->device)
+		btd_device_unref(client->device);
+
+	g_queue_foreach(client->queue, (GFunc) pending_value_free, NULL);
+	g_queue_free(client->queue);
+	g_hash_table_destroy(client->ccc);
+	g_free(client);
+}
+
 static void gatt_server_free(struct gatt_server *server)
 {
 	g_list_free_full(server->database, attrib_free);
 
+	g_slist_free_full(server->subscribers, client_free);
+
+	if (server->ccc_index != NULL)
+		g_hash_table_destroy(server->ccc_index);
+
 	if (server->l2cap_io != NULL) {
 		g_io_channel_shutdown(server->l2cap_io, FALSE, NULL);
 		g_io_channel_unref(server->l2cap_io);
@@ -396,388 +444,338 @@ static uint8_t att_check_reqs(struct gatt_channel *channel, uint8_t opcode,
 	return 0;
 }
 
-static uint16_t read_by_group(struct gatt_channel *channel, uint16_t start,
-						uint16_t end, bt_uuid_t *uuid,
-						uint8_t *pdu, size_t len)
+static uint8_t check_read(struct attribute *a, uint8_t opcode,
+							void *user_data)
 {
-	struct att_data_list *adl;
-	struct attribute *a;
-	struct group_elem *cur, *old = NULL;
-	GSList *l, *groups;
-	GList *dl, *database;
-	uint16_t length, last_handle, last_size = 0;
+	struct gatt_channel *channel = user_data;
 	uint8_t status;
-	int i;
-
-	if (start > end || start == 0x0000)
-		return enc_error_resp(ATT_OP_READ_BY_GROUP_REQ, start,
-					ATT_ECODE_INVALID_HANDLE, pdu, len);
 
-	/*
-	 * Only <<Primary Service>> and <<Secondary Service>> grouping
-	 * types may be used in the Read By Group Type Request.
-	 */
+	status = att_check_reqs(channel, opcode, a->read_req);
 
-	if (bt_uuid_cmp(uuid, &prim_uuid) != 0 &&
-		bt_uuid_cmp(uuid, &snd_uuid) != 0)
-		return enc_error_resp(ATT_OP_READ_BY_GROUP_REQ, 0x0000,
-					ATT_ECODE_UNSUPP_GRP_TYPE, pdu, len);
-
-	last_handle = end;
-	database = channel->server->database;
-	for (dl = database, groups = NULL, cur = NULL; dl; dl = dl->next) {
-
-		a = dl->data;
-
-		if (a->handle < start)
-			continue;
-
-		if (a->handle >= end)
-			break;
-
-		/* The old group ends when a new one starts */
-		if (old && (bt_uuid_cmp(&a->uuid, &prim_uuid) == 0 ||
-				bt_uuid_cmp(&a->uuid, &snd_uuid) == 0)) {
-			old->end = last_handle;
-			old = NULL;
-		}
-
-		if (bt_uuid_cmp(&a->uuid, uuid) != 0) {
-			/* Still inside a service, update its last handle */
-			if (old)
-				last_handle = a->handle;
-			continue;
-		}
-
-		if (last_size && (last_size != a->len))
-			break;
-
-		status = att_check_reqs(channel, ATT_OP_READ_BY_GROUP_REQ,
-								a->read_req);
-
-		if (status == 0x00 && a->read_cb)
-			status = a->read_cb(a, channel->device,
-							a->cb_user_data);
+	if (status == 0x00 && a->read_cb)
+		status = a->read_cb(a, channel->device, a->cb_user_data);
 
-		if (status) {
-			g_slist_free_full(groups, g_free);
-			return enc_error_resp(ATT_OP_READ_BY_GROUP_REQ,
-						a->handle, status, pdu, len);
-		}
+	return status;
+}
 
-		cur = g_new0(struct group_elem, 1);
-		cur->handle = a->handle;
-		cur->data = a->data;
-		cur->len = a->len;
+static struct gatt_client *find_client(struct gatt_server *server,
+				const bdaddr_t *bdaddr, uint8_t bdaddr_type)
+{
+	GSList *l;
 
-		/* Attribute Grouping Type found */
-		groups = g_slist_append(groups, cur);
+	for (l = server->subscribers; l; l = l->next) {
+		struct gatt_client *client = l->data;
 
-		last_size = a->len;
-		old = cur;
-		last_handle = cur->handle;
+		if (bacmp(&client->bdaddr, bdaddr) == 0 &&
+					client->bdaddr_type == bdaddr_type)
+			return client;
 	}
 
-	if (groups == NULL)
-		return enc_error_resp(ATT_OP_READ_BY_GROUP_REQ, start,
-					ATT_ECODE_ATTR_NOT_FOUND, pdu, len);
+	return NULL;
+}
 
-	if (dl == NULL)
-		cur->end = a->handle;
-	else
-		cur->end = last_handle;
+static struct gatt_client *find_device_client(struct gatt_server *server,
+						struct btd_device *device)
+{
+	return find_client(server, device_get_address(device),
+					btd_device_get_bdaddr_type(device));
+}
 
-	length = g_slist_length(groups);
+static struct gatt_channel *find_channel(struct gatt_server *server,
+				const bdaddr_t *bdaddr, uint8_t bdaddr_type)
+{
+	GSList *l;
 
-	adl = att_data_list_alloc(length, last_size + 4);
-	if (adl == NULL) {
-		g_slist_free_full(groups, g_free);
-		return enc_error_resp(ATT_OP_READ_BY_GROUP_REQ, start,
-					ATT_ECODE_UNLIKELY, pdu, len);
-	}
+	for (l = server->clients; l; l = l->next) {
+		struct gatt_channel *channel = l->data;
 
-	for (i = 0, l = groups; l; l = l->next, i++) {
-		uint8_t *value;
+		if (bacmp(&channel->dst, bdaddr) == 0 &&
+			btd_device_get_bdaddr_type(channel->device) ==
+								bdaddr_type)
+			return channel;
+	}
 
-		cur = l->data;
+	return NULL;
+}
 
-		value = (void *) adl->data[i];
+static void client_set_ccc(struct gatt_client *client, uint16_t handle,
+								uint16_t value)
+{
+	GHashTable *index = client->server->ccc_index;
+	gpointer key = GUINT_TO_POINTER(handle);
+	GSList *list;
+
+	list = g_hash_table_lookup(index, key);
+	list = g_slist_remove(list, client);
+
+	if (value) {
+		g_hash_table_insert(client->ccc, key, GUINT_TO_POINTER(value));
+		list = g_slist_prepend(list, client);
+	} else
+		g_hash_table_remove(client->ccc, key);
+
+	g_hash_table_steal(index, key);
+	if (list)
+		g_hash_table_insert(index, key, list);
+}
 
-		att_put_u16(cur->handle, value);
-		att_put_u16(cur->end, &value[2]);
-		/* Attribute Value */
-		memcpy(&value[4], cur->data, cur->len);
-	}
+static void client_clear_ccc(struct gatt_client *client)
+{
+	GHashTableIter iter;
+	gpointer key;
+	GSList *handles = NULL, *l;
 
-	length = enc_read_by_grp_resp(adl, pdu, len);
+	g_hash_table_iter_init(&iter, client->ccc);
+	while (g_hash_table_iter_next(&iter, &key, NULL))
+		handles = g_slist_prepend(handles, key);
 
-	att_data_list_free(adl);
-	g_slist_free_full(groups, g_free);
+	for (l = handles; l; l = l->next)
+		client_set_ccc(client, GPOINTER_TO_UINT(l->data), 0);
 
-	return length;
+	g_slist_free(handles);
 }
 
-static uint16_t read_by_type(struct gatt_channel *channel, uint16_t start,
-						uint16_t end, bt_uuid_t *uuid,
-						uint8_t *pdu, size_t len)
+/*
+ * The configuration is read from storage once per device, afterwards the
+ * registry is kept up to date by the CCC writes of the client.
+ */
+static struct gatt_client *get_client(struct gatt_server *server,
+						struct btd_device *device)
 {
-	struct att_data_list *adl;
-	GSList *l, *types;
-	GList *dl, *database;
-	struct attribute *a;
-	uint16_t num, length;
-	uint8_t status;
+	struct gatt_client *client;
+	char *filename;
+	GKeyFile *key_file;
+	char **groups;
 	int i;
 
-	if (start > end || start == 0x0000)
-		return enc_error_resp(ATT_OP_READ_BY_TYPE_REQ, start,
-					ATT_ECODE_INVALID_HANDLE, pdu, len);
-
-	database = channel->server->database;
-	for (dl = database, length = 0, types = NULL; dl; dl = dl->next) {
+	client = find_device_client(server, device);
+	if (client)
+		return client;
 
-		a = dl->data;
+	client = g_new0(struct gatt_client, 1);
+	client->server = server;
+	bacpy(&client->bdaddr, device_get_address(device));
+	client->bdaddr_type = btd_device_get_bdaddr_type(device);
+	client->ccc = g_hash_table_new(NULL, NULL);
+	client->queue = g_queue_new();
 
-		if (a->handle < start)
-			continue;
+	server->subscribers = g_slist_prepend(server->subscribers, client);
 
-		if (a->handle > end)
-			break;
+	filename = btd_device_get_storage_path(device, "ccc");
+	if (!filename) {
+		warn("Unable to get ccc storage path for device");
+		return client;
+	}
 
-		if (bt_uuid_cmp(&a->uuid, uuid)  != 0)
-			continue;
+	key_file = g_key_file_new();
+	g_key_file_load_from_file(key_file, filename, 0, NULL);
 
-		status = att_check_reqs(channel, ATT_OP_READ_BY_TYPE_REQ,
-								a->read_req);
+	groups = g_key_file_get_groups(key_file, NULL);
 
-		if (status == 0x00 && a->read_cb)
-			status = a->read_cb(a, channel->device,
-							a->cb_user_data);
+	for (i = 0; groups && groups[i]; i++) {
+		unsigned int handle, config;
+		char *str;
 
-		if (status) {
-			g_slist_free(types);
-			return enc_error_resp(ATT_OP_READ_BY_TYPE_REQ,
-						a->handle, status, pdu, len);
-		}
+		if (sscanf(groups[i], "%u", &handle) != 1)
+			continue;
 
-		/* All elements must have the same length */
-		if (length == 0)
-			length = a->len;
-		else if (a->len != length)
-			break;
+		str = g_key_file_get_string(key_file, groups[i], "Value", NULL);
+		if (str && sscanf(str, "%04X", &config) == 1)
+			client_set_ccc(client, handle, config);
 
-		types = g_slist_append(types, a);
+		g_free(str);
 	}
 
-	if (types == NULL)
-		return enc_error_resp(ATT_OP_READ_BY_TYPE_REQ, start,
-					ATT_ECODE_ATTR_NOT_FOUND, pdu, len);
-
-	num = g_slist_length(types);
-
-	/* Handle length plus attribute value length */
-	length += 2;
+	g_strfreev(groups);
+	g_free(filename);
+	g_key_file_free(key_file);
 
-	adl = att_data_list_alloc(num, length);
-	if (adl == NULL) {
-		g_slist_free(types);
-		return enc_error_resp(ATT_OP_READ_BY_TYPE_REQ, start,
-					ATT_ECODE_UNLIKELY, pdu, len);
-	}
+	return client;
+}
 
-	for (i = 0, l = types; l; i++, l = l->next) {
-		uint8_t *value;
+static int read_device_ccc(struct gatt_server *server,
+				struct btd_device *device, uint16_t handle,
+				uint16_t *value)
+{
+	struct gatt_client *client = get_client(server, device);
+	gpointer config;
 
-		a = l->data;
+	if (!g_hash_table_lookup_extended(client->ccc, GUINT_TO_POINTER(handle),
+							NULL, &config))
+		return -ENOENT;
 
-		value = (void *) adl->data[i];
+	*value = GPOINTER_TO_UINT(config);
 
-		att_put_u16(a->handle, value);
+	return 0;
+}
 
-		/* Attribute Value */
-		memcpy(&value[2], a->data, a->len);
-	}
+/* Values go out in the order they were queued */
+static void client_flush(struct gatt_client *client, GAttrib *attrib)
+{
+	struct pending_value *pv;
 
-	length = enc_read_by_type_resp(adl, pdu, len);
+	while ((pv = g_queue_pop_head(client->queue)) != NULL) {
+		size_t len;
+		uint8_t *pdu = g_attrib_get_buffer(attrib, &len);
 
-	att_data_list_free(adl);
-	g_slist_free(types);
+		len = enc_notification(pv->handle, pv->data, pv->len, pdu, len);
+		g_attrib_send(attrib, 0, pdu, len, NULL, NULL, NULL);
 
-	return length;
+		pending_value_free(pv);
+	}
 }
 
-static uint16_t find_info(struct gatt_channel *channel, uint16_t start,
-				uint16_t end, uint8_t *pdu, size_t len)
+static void client_attio_connected(GAttrib *attrib, gpointer user_data)
 {
-	struct attribute *a;
-	struct att_data_list *adl;
-	GSList *l, *info;
-	GList *dl, *database;
-	uint8_t format, last_type = BT_UUID_UNSPEC;
-	uint16_t length, num;
-	int i;
+	struct gatt_client *client = user_data;
 
-	if (start > end || start == 0x0000)
-		return enc_error_resp(ATT_OP_FIND_INFO_REQ, start,
-					ATT_ECODE_INVALID_HANDLE, pdu, len);
-
-	database = channel->server->database;
-	for (dl = database, info = NULL, num = 0; dl; dl = dl->next) {
-		a = dl->data;
-
-		if (a->handle < start)
-			continue;
-
-		if (a->handle > end)
-			break;
+	btd_device_remove_attio_callback(client->device, client->attio_id);
+	client->attio_id = 0;
 
-		if (last_type == BT_UUID_UNSPEC)
-			last_type = a->uuid.type;
+	btd_device_unref(client->device);
+	client->device = NULL;
 
-		if (a->uuid.type != last_type)
-			break;
+	client_flush(client, attrib);
+}
 
-		info = g_slist_append(info, a);
-		num++;
+static void client_send(struct gatt_client *client)
+{
+	struct gatt_server *server = client->server;
+	struct gatt_channel *channel;
+	struct btd_device *device;
 
-		last_type = a->uuid.type;
+	channel = find_channel(server, &client->bdaddr, client->bdaddr_type);
+	if (channel) {
+		client_flush(client, channel->attrib);
+		return;
 	}
 
-	if (info == NULL)
-		return enc_error_resp(ATT_OP_FIND_INFO_REQ, start,
-					ATT_ECODE_ATTR_NOT_FOUND, pdu, len);
-
-	if (last_type == BT_UUID16) {
-		length = 2;
-		format = 0x01;
-	} else if (last_type == BT_UUID128) {
-		length = 16;
-		format = 0x02;
-	} else {
-		g_slist_free(info);
-		return 0;
-	}
+	if (client->attio_id > 0)
+		return;
 
-	adl = att_data_list_alloc(num, length + 2);
-	if (adl == NULL) {
-		g_slist_free(info);
-		return enc_error_resp(ATT_OP_FIND_INFO_REQ, start,
-					ATT_ECODE_UNLIKELY, pdu, len);
+	device = adapter_find_device(server->adapter, &client->bdaddr);
+	if (device == NULL ||
+		btd_device_get_bdaddr_type(device) != client->bdaddr_type) {
+		g_queue_foreach(client->queue, (GFunc) pending_value_free,
+									NULL);
+		g_queue_clear(client->queue);
+		return;
 	}
 
-	for (i = 0, l = info; l; i++, l = l->next) {
-		uint8_t *value;
+	client->device = btd_device_ref(device);
+	client->attio_id = btd_device_add_attio_callback(device,
+						client_attio_connected, NULL,
+						client);
+}
 
-		a = l->data;
+static void client_queue(struct gatt_client *client, uint16_t handle,
+					const uint8_t *value, size_t len)
+{
+	struct pending_value *pv;
+	GList *l;
 
-		value = (void *) adl->data[i];
+	/* A value not sent yet is superseded by the new one */
+	for (l = g_queue_peek_head_link(client->queue); l; l = l->next) {
+		pv = l->data;
 
-		att_put_u16(a->handle, value);
+		if (pv->handle != handle)
+			continue;
 
-		/* Attribute Value */
-		att_put_uuid(a->uuid, &value[2]);
+		g_free(pv->data);
+		pv->data = g_memdup(value, len);
+		pv->len = len;
+		return;
 	}
 
-	length = enc_find_info_resp(format, adl, pdu, len);
+	pv = g_new0(struct pending_value, 1);
+	pv->handle = handle;
+	pv->data = g_memdup(value, len);
+	pv->len = len;
 
-	att_data_list_free(adl);
-	g_slist_free(info);
+	g_queue_push_tail(client->queue, pv);
+}
 
-	return length;
+static void load_subscriptions(struct btd_device *device, void *user_data)
+{
+	get_client(user_data, device);
 }
 
-static uint16_t find_by_type(struct gatt_channel *channel, uint16_t start,
-				uint16_t end, bt_uuid_t *uuid,
-				const uint8_t *value, size_t vlen,
-				uint8_t *opdu, size_t mtu)
+/* Values are only sent to the clients that enabled notifications */
+int attrib_server_notify(struct btd_adapter *adapter, uint16_t ccc_handle,
+				uint16_t handle, const uint8_t *value,
+				size_t len)
 {
-	struct attribute *a;
-	struct att_range *range;
-	GSList *matches;
-	GList *dl, *database;
-	uint16_t len;
+	struct gatt_server *server;
+	GSList *l, *next;
+	int count = 0;
 
-	if (start > end || start == 0x0000)
-		return enc_error_resp(ATT_OP_FIND_BY_TYPE_REQ, start,
-					ATT_ECODE_INVALID_HANDLE, opdu, mtu);
+	l = g_slist_find_custom(servers, adapter, adapter_cmp);
+	if (l == NULL)
+		return -ENOENT;
 
-	/* Searching first requested handle number */
-	database = channel->server->database;
-	for (dl = database, matches = NULL, range = NULL; dl; dl = dl->next) {
-		a = dl->data;
+	server = l->data;
 
-		if (a->handle < start)
-			continue;
+	if (!server->subscribers_loaded) {
+		btd_adapter_for_each_device(adapter, load_subscriptions,
+									server);
+		server->subscribers_loaded = TRUE;
+	}
 
-		if (a->handle > end)
-			break;
+	l = g_hash_table_lookup(server->ccc_index, GUINT_TO_POINTER(ccc_handle));
 
-		/* Primary service? Attribute value matches? */
-		if ((bt_uuid_cmp(&a->uuid, uuid) == 0) && (a->len == vlen) &&
-					(memcmp(a->data, value, vlen) == 0)) {
-
-			range = g_new0(struct att_range, 1);
-			range->start = a->handle;
-			/* It is allowed to have end group handle the same as
-			 * start handle, for groups with only one attribute. */
-			range->end = a->handle;
-
-			matches = g_slist_append(matches, range);
-		} else if (range) {
-			/* Update the last found handle or reset the pointer
-			 * to track that a new group started: Primary or
-			 * Secondary service. */
-			if (bt_uuid_cmp(&a->uuid, &prim_uuid) == 0 ||
-					bt_uuid_cmp(&a->uuid, &snd_uuid) == 0)
-				range = NULL;
-			else
-				range->end = a->handle;
-		}
-	}
+	for (; l; l = next) {
+		struct gatt_client *client = l->data;
+		uint16_t config;
 
-	if (matches == NULL)
-		return enc_error_resp(ATT_OP_FIND_BY_TYPE_REQ, start,
-				ATT_ECODE_ATTR_NOT_FOUND, opdu, mtu);
+		next = l->next;
 
-	len = enc_find_by_type_resp(matches, opdu, mtu);
+		config = GPOINTER_TO_UINT(g_hash_table_lookup(client->ccc,
+						GUINT_TO_POINTER(ccc_handle)));
+		if (!(config & GATT_CLIENT_CHARAC_CFG_NOTIF_BIT))
+			continue;
 
-	g_slist_free_full(matches, g_free);
+		client_queue(client, handle, value, len);
+		client_send(client);
+		count++;
+	}
+
+	DBG("handle 0x%04x ccc 0x%04x: %d clients", handle, ccc_handle,
+									count);
 
-	return len;
+	return count;
 }
 
-static int read_device_ccc(struct btd_device *device, uint16_t handle,
-				uint16_t *value)
+static void client_remove(struct gatt_client *client)
 {
-	char *filename;
-	GKeyFile *key_file;
-	char group[6];
-	char *str;
-	unsigned int config;
-	int err = 0;
+	struct gatt_server *server = client->server;
 
-	filename = btd_device_get_storage_path(device, "ccc");
-	if (!filename) {
-		warn("Unable to get ccc storage path for device");
-		return -ENOENT;
-	}
+	client_clear_ccc(client);
 
-	key_file = g_key_file_new();
-	g_key_file_load_from_file(key_file, filename, 0, NULL);
+	server->subscribers = g_slist_remove(server->subscribers, client);
+	client_free(client);
+}
 
-	sprintf(group, "%hu", handle);
+/*
+ * Called when a device object goes away. Its configuration is read from
+ * storage again if the device comes back, so nothing stale is inherited
+ * by a device later created at the same address.
+ */
+void attrib_server_remove_device(struct btd_device *device)
+{
+	struct gatt_server *server;
+	struct gatt_client *client;
+	GSList *l;
 
-	str = g_key_file_get_string(key_file, group, "Value", NULL);
-	if (!str || sscanf(str, "%04X", &config) != 1)
-		err = -ENOENT;
-	else
-		*value = config;
+	l = g_slist_find_custom(servers, device_get_adapter(device),
+								adapter_cmp);
+	if (l == NULL)
+		return;
 
-	g_free(str);
-	g_free(filename);
-	g_key_file_free(key_file);
+	server = l->data;
 
-	return err;
+	client = find_device_client(server, device);
+	if (client)
+		client_remove(client);
 }
 
 static uint16_t read_value(struct gatt_channel *channel, uint16_t handle,
@@ -798,7 +796,8 @@ static uint16_t read_value(struct gatt_channel *channel, uint16_t handle,
 	a = l->data;
 
 	if (bt_uuid_cmp(&ccc_uuid, &a->uuid) == 0 &&
-		read_device_ccc(channel->device, handle, &cccval) == 0) {
+		read_device_ccc(channel->server, channel->device, handle,
+							&cccval) == 0) {
 		uint8_t config[2];
 
 		att_put_u16(cccval, config);
@@ -839,7 +838,8 @@ static uint16_t read_blob(struct gatt_channel *channel, uint16_t handle,
 					ATT_ECODE_INVALID_OFFSET, pdu, len);
 
 	if (bt_uuid_cmp(&ccc_uuid, &a->uuid) == 0 &&
-		read_device_ccc(channel->device, handle, &cccval) == 0) {
+		read_device_ccc(channel->server, channel->device, handle,
+							&cccval) == 0) {
 		uint8_t config[2];
 
 		att_put_u16(cccval, config);
@@ -925,6 +925,9 @@ static uint16_t write_value(struct gatt_channel *channel, uint16_t handle,
 		g_free(data);
 		g_free(filename);
 		g_key_file_free(key_file);
+
+		client_set_ccc(get_client(channel->server, channel->device),
+							handle, cccval);
 	}
 
 	return enc_write_resp(pdu, len);
@@ -959,6 +962,7 @@ static void channel_remove(struct gatt_channel *channel)
 {
 	channel->server->clients = g_slist_remove(channel->server->clients,
 								channel);
+
 	channel_free(channel);
 }
 
@@ -970,6 +974,20 @@ static gboolean channel_watch_cb(GIOChannel *io, GIOCondition cond,
 	return FALSE;
 }
 
+static void count_pdu(uint8_t opcode)
+{
+	if (!pdu_counters[opcode]) {
+		char name[64];
+
+		snprintf(name, sizeof(name),
+				"bluez_att_pdus_total{opcode=\"0x%02x\"}", opcode);
+		pdu_counters[opcode] = metrics_counter_new(name,
+						"ATT PDUs received by opcode");
+	}
+
+	metrics_counter_add(pdu_counters[opcode], 1);
+}
+
 static void channel_handler(const uint8_t *ipdu, uint16_t len,
 							gpointer user_data)
 {
@@ -983,6 +1001,8 @@ static void channel_handler(const uint8_t *ipdu, uint16_t len,
 
 	DBG("op 0x%02x", ipdu[0]);
 
+	count_pdu(ipdu[0]);
+
 	switch (ipdu[0]) {
 	case ATT_OP_READ_BY_GROUP_REQ:
 		length = dec_read_by_grp_req(ipdu, len, &start, &end, &uuid);
@@ -991,8 +1011,9 @@ static void channel_handler(const uint8_t *ipdu, uint16_t len,
 			goto done;
 		}
 
-		length = read_by_group(channel, start, end, &uuid, opdu,
-								channel->mtu);
+		length = att_db_read_by_group(channel->server->database,
+						start, end, &uuid, check_read,
+						channel, opdu, channel->mtu);
 		break;
 	case ATT_OP_READ_BY_TYPE_REQ:
 		length = dec_read_by_type_req(ipdu, len, &start, &end, &uuid);
@@ -1001,8 +1022,9 @@ static void channel_handler(const uint8_t *ipdu, uint16_t len,
 			goto done;
 		}
 
-		length = read_by_type(channel, start, end, &uuid, opdu,
-								channel->mtu);
+		length = att_db_read_by_type(channel->server->database,
+						start, end, &uuid, check_read,
+						channel, opdu, channel->mtu);
 		break;
 	case ATT_OP_READ_REQ:
 		length = dec_read_req(ipdu, len, &start);
@@ -1043,7 +1065,8 @@ static void channel_handler(const uint8_t *ipdu, uint16_t len,
 			goto done;
 		}
 
-		length = find_info(channel, start, end, opdu, channel->mtu);
+		length = att_db_find_info(channel->server->database, start,
+						end, opdu, channel->mtu);
 		break;
 	case ATT_OP_WRITE_REQ:
 		length = dec_write_req(ipdu, len, &start, value, &vlen);
@@ -1069,8 +1092,9 @@ static void channel_handler(const uint8_t *ipdu, uint16_t len,
 			goto done;
 		}
 
-		length = find_by_type(channel, start, end, &uuid, value, vlen,
-							opdu, channel->mtu);
+		length = att_db_find_by_type(channel->server->database, start,
+						end, &uuid, value, vlen, opdu,
+						channel->mtu);
 		break;
 	case ATT_OP_HANDLE_CNF:
 		return;
@@ -1103,6 +1127,7 @@ guint attrib_channel_attach(GAttrib *attrib)
 	struct gatt_server *server;
 	struct btd_device *device;
 	struct gatt_channel *channel;
+	struct gatt_client *client;
 	GIOChannel *io;
 	GError *gerr = NULL;
 	uint16_t cid;
@@ -1152,6 +1177,10 @@ guint attrib_channel_attach(GAttrib *attrib)
 			unlink(filename);
 			g_free(filename);
 		}
+
+		client = find_device_client(server, device);
+		if (client)
+			client_remove(client);
 	}
 
 	if (cid != ATT_CID) {
@@ -1173,6 +1202,10 @@ guint attrib_channel_attach(GAttrib *attrib)
 
 	server->clients = g_slist_append(server->clients, channel);
 
+	client = find_device_client(server, device);
+	if (client)
+		client_flush(client, channel->attrib);
+
 	return channel->id;
 }
 
@@ -1309,6 +1342,8 @@ int btd_adapter_gatt_server_start(struct btd_adapter *adapter)
 
 	server = g_new0(struct gatt_server, 1);
 	server->adapter = btd_adapter_ref(adapter);
+	server->ccc_index = g_hash_table_new_full(NULL, NULL, NULL,
+						(GDestroyNotify) g_slist_free);
 
 	addr = adapter_get_address(server->adapter);
 
@@ -37,5 +37,9 @@ int attrib_gap_set(struct btd_adapter *adapter, uint16_t uuid,
 uint32_t attrib_create_sdp(struct btd_adapter *adapter, uint16_t handle,
 							const char *name);
 void attrib_free_sdp(uint32_t sdp_handle);
+int attrib_server_notify(struct btd_adapter *adapter, uint16_t ccc_handle,
+				uint16_t handle, const uint8_t *value,
+				size_t len);
+void attrib_server_remove_device(struct btd_device *device);
 guint attrib_channel_attach(GAttrib *attrib);
 gboolean attrib_channel_detach(GAttrib *attrib, guint id);
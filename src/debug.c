@@ -0,0 +1,259 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2013  Intel Corporation
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdint.h>
+
+#include <glib.h>
+#include <dbus/dbus.h>
+#include <gdbus/gdbus.h>
+
+#include "log.h"
+#include "error.h"
+#include "dbus-common.h"
+#include "hcid.h"
+#include "src/shared/metrics.h"
+#include "debug.h"
+
+#define DEBUG_INTERFACE "org.bluez.Debug1"
+
+static struct metrics_counter *signals_total = NULL;
+
+static DBusMessage *set_debug(DBusMessage *msg, int enable)
+{
+	const char *pattern;
+	dbus_uint32_t count;
+
+	if (!dbus_message_get_args(msg, NULL, DBUS_TYPE_STRING, &pattern,
+							DBUS_TYPE_INVALID))
+		return btd_error_invalid_args(msg);
+
+	if (*pattern == '\0')
+		return btd_error_invalid_args(msg);
+
+	count = __btd_debug_set(pattern, enable);
+
+	DBG("%s %u debug points matching %s", enable ? "Enabled" : "Disabled",
+							count, pattern);
+
+	return g_dbus_create_reply(msg, DBUS_TYPE_UINT32, &count,
+							DBUS_TYPE_INVALID);
+}
+
+static DBusMessage *enable_debug(DBusConnection *conn, DBusMessage *msg,
+							void *user_data)
+{
+	return set_debug(msg, TRUE);
+}
+
+static DBusMessage *disable_debug(DBusConnection *conn, DBusMessage *msg,
+							void *user_data)
+{
+	return set_debug(msg, FALSE);
+}
+
+static DBusMessage *start_capture(DBusConnection *conn, DBusMessage *msg,
+							void *user_data)
+{
+	dbus_uint32_t size;
+
+	if (!dbus_message_get_args(msg, NULL, DBUS_TYPE_UINT32, &size,
+							DBUS_TYPE_INVALID))
+		return btd_error_invalid_args(msg);
+
+	if (__btd_debug_capture_start(size) < 0)
+		return btd_error_invalid_args(msg);
+
+	return dbus_message_new_method_return(msg);
+}
+
+static void append_message(uint64_t timestamp, const char *message,
+							void *user_data)
+{
+	DBusMessageIter *array = user_data;
+	DBusMessageIter entry;
+	dbus_uint64_t value = timestamp;
+
+	dbus_message_iter_open_container(array, DBUS_TYPE_STRUCT, NULL,
+								&entry);
+
+	dbus_message_iter_append_basic(&entry, DBUS_TYPE_UINT64, &value);
+	dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING, &message);
+
+	dbus_message_iter_close_container(array, &entry);
+}
+
+static DBusMessage *get_capture(DBusConnection *conn, DBusMessage *msg,
+							void *user_data)
+{
+	DBusMessage *reply;
+	DBusMessageIter iter, array;
+
+	reply = dbus_message_new_method_return(msg);
+	if (!reply)
+		return NULL;
+
+	dbus_message_iter_init_append(reply, &iter);
+
+	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
+					DBUS_STRUCT_BEGIN_CHAR_AS_STRING
+					DBUS_TYPE_UINT64_AS_STRING
+					DBUS_TYPE_STRING_AS_STRING
+					DBUS_STRUCT_END_CHAR_AS_STRING,
+					&array);
+
+	__btd_debug_capture_foreach(append_message, &array);
+
+	dbus_message_iter_close_container(&iter, &array);
+
+	return reply;
+}
+
+static DBusMessage *stop_capture(DBusConnection *conn, DBusMessage *msg,
+							void *user_data)
+{
+	__btd_debug_capture_stop();
+
+	return dbus_message_new_method_return(msg);
+}
+
+/* gdbus keeps its own count since it doesn't link the registry */
+static void update_signal_count(void)
+{
+	uint64_t count = g_dbus_get_signal_count();
+
+	metrics_counter_add(signals_total,
+				count - metrics_counter_get(signals_total));
+}
+
+static void append_sample(const char *name, uint64_t value, void *user_data)
+{
+	DBusMessageIter *dict = user_data;
+	dbus_uint64_t val = value;
+
+	dict_append_entry(dict, name, DBUS_TYPE_UINT64, &val);
+}
+
+static DBusMessage *get_metrics(DBusConnection *conn, DBusMessage *msg,
+							void *user_data)
+{
+	DBusMessage *reply;
+	DBusMessageIter iter, dict;
+
+	reply = dbus_message_new_method_return(msg);
+	if (!reply)
+		return NULL;
+
+	update_signal_count();
+
+	dbus_message_iter_init_append(reply, &iter);
+
+	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
+				DBUS_DICT_ENTRY_BEGIN_CHAR_AS_STRING
+				DBUS_TYPE_STRING_AS_STRING
+				DBUS_TYPE_VARIANT_AS_STRING
+				DBUS_DICT_ENTRY_END_CHAR_AS_STRING, &dict);
+
+	metrics_foreach_sample(append_sample, &dict);
+
+	dbus_message_iter_close_container(&iter, &dict);
+
+	return reply;
+}
+
+static DBusMessage *get_metrics_text(DBusConnection *conn, DBusMessage *msg,
+							void *user_data)
+{
+	DBusMessage *reply;
+	char *text;
+
+	update_signal_count();
+
+	text = metrics_to_text();
+
+	reply = g_dbus_create_reply(msg, DBUS_TYPE_STRING, &text,
+							DBUS_TYPE_INVALID);
+
+	g_free(text);
+
+	return reply;
+}
+
+static DBusMessage *get_startup_timeline(DBusConnection *conn,
+					DBusMessage *msg, void *user_data)
+{
+	DBusMessage *reply;
+	char *json;
+
+	json = btd_startup_timeline();
+	if (json == NULL)
+		return btd_error_failed(msg, "No startup timeline");
+
+	reply = g_dbus_create_reply(msg, DBUS_TYPE_STRING, &json,
+							DBUS_TYPE_INVALID);
+
+	g_free(json);
+
+	return reply;
+}
+
+static const GDBusMethodTable methods[] = {
+	{ GDBUS_EXPERIMENTAL_METHOD("EnableDebug",
+			GDBUS_ARGS({ "pattern", "s" }),
+			GDBUS_ARGS({ "count", "u" }), enable_debug) },
+	{ GDBUS_EXPERIMENTAL_METHOD("DisableDebug",
+			GDBUS_ARGS({ "pattern", "s" }),
+			GDBUS_ARGS({ "count", "u" }), disable_debug) },
+	{ GDBUS_EXPERIMENTAL_METHOD("StartCapture",
+			GDBUS_ARGS({ "size", "u" }), NULL, start_capture) },
+	{ GDBUS_EXPERIMENTAL_METHOD("GetCapture", NULL,
+			GDBUS_ARGS({ "messages", "a(ts)" }), get_capture) },
+	{ GDBUS_EXPERIMENTAL_METHOD("StopCapture", NULL, NULL,
+			stop_capture) },
+	{ GDBUS_EXPERIMENTAL_METHOD("GetMetrics", NULL,
+			GDBUS_ARGS({ "metrics", "a{sv}" }), get_metrics) },
+	{ GDBUS_EXPERIMENTAL_METHOD("GetMetricsText", NULL,
+			GDBUS_ARGS({ "text", "s" }), get_metrics_text) },
+	{ GDBUS_EXPERIMENTAL_METHOD("GetStartupTimeline", NULL,
+			GDBUS_ARGS({ "timeline", "s" }), get_startup_timeline) },
+	{ }
+};
+
+void btd_debug_init(void)
+{
+	signals_total = metrics_counter_new("bluez_dbus_signals_total",
+						"D-Bus signals emitted");
+
+	g_dbus_register_interface(btd_get_dbus_connection(),
+				"/org/bluez", DEBUG_INTERFACE,
+				methods, NULL, NULL, NULL, NULL);
+}
+
+void btd_debug_cleanup(void)
+{
+	g_dbus_unregister_interface(btd_get_dbus_connection(),
+				"/org/bluez", DEBUG_INTERFACE);
+}
@@ -66,7 +66,10 @@
 #include "agent.h"
 #include "sdp-xml.h"
 #include "storage.h"
+#include "record-cache.h"
 #include "attrib-server.h"
+#include "trace.h"
+#include "src/shared/metrics.h"
 
 #define IO_CAPABILITY_NOINPUTNOOUTPUT	0x03
 
@@ -76,6 +79,8 @@
 static DBusConnection *dbus_conn = NULL;
 unsigned service_state_cb_id;
 
+static struct metrics_counter *storage_writes_total = NULL;
+
 struct btd_disconnect_data {
 	guint id;
 	disconnect_watch watch;
@@ -178,6 +183,7 @@ struct btd_device {
 	GSList		*primaries;		/* List of primary services */
 	GSList		*services;		/* List of btd_service */
 	GSList		*pending;		/* Pending services */
+	bool		connect_scheduling;
 	GSList		*watches;		/* List of disconnect_data */
 	gboolean	temporary;
 	guint		disconn_timer;
@@ -211,6 +217,8 @@ struct btd_device {
 	GIOChannel	*att_io;
 	guint		cleanup_id;
 	guint		store_id;
+
+	struct trace_ring *trace;		/* Connection setup stages */
 };
 
 static const uint16_t uuid_list[] = {
@@ -364,6 +372,8 @@ static gboolean store_device_info_cb(gpointer user_data)
 	g_file_set_contents(filename, str, length, NULL);
 	g_free(str);
 
+	metrics_counter_add(storage_writes_total, 1);
+
 	g_key_file_free(key_file);
 	g_free(uuids);
 
@@ -533,6 +543,8 @@ static void device_free(gpointer user_data)
 	if (device->eir_uuids)
 		g_slist_free_full(device->eir_uuids, g_free);
 
+	trace_ring_free(device->trace);
+
 	g_free(device->path);
 	g_free(device->alias);
 	g_free(device->modalias);
@@ -1126,56 +1138,120 @@ static DBusMessage *dev_disconnect(DBusConnection *conn, DBusMessage *msg,
 	return NULL;
 }
 
-static int connect_next(struct btd_device *dev)
+static unsigned int count_connecting(struct btd_device *dev)
 {
-	struct btd_service *service;
-	int err = -ENOENT;
+	unsigned int count = 0;
+	GSList *l;
 
-	while (dev->pending) {
-		service = dev->pending->data;
+	for (l = dev->pending; l != NULL; l = g_slist_next(l)) {
+		if (btd_service_get_state(l->data) ==
+						BTD_SERVICE_STATE_CONNECTING)
+			count++;
+	}
 
-		if (btd_service_connect(service) == 0)
-			return 0;
+	return count;
+}
 
-		dev->pending = g_slist_delete_link(dev->pending, dev->pending);
+static bool service_is_blocked(struct btd_device *dev,
+						struct btd_service *service)
+{
+	struct btd_profile *p = btd_service_get_profile(service);
+	const char **uuid;
+	GSList *l;
+
+	if (p->after_services == NULL)
+		return false;
+
+	for (uuid = p->after_services; *uuid != NULL; uuid++) {
+		for (l = dev->pending; l != NULL; l = g_slist_next(l)) {
+			struct btd_profile *dep;
+
+			if (l->data == service)
+				continue;
+
+			dep = btd_service_get_profile(l->data);
+			if (dep->remote_uuid &&
+				bt_uuid_strcmp(dep->remote_uuid, *uuid) == 0)
+				return true;
+		}
 	}
 
-	return err;
+	return false;
 }
 
-static void device_profile_connected(struct btd_device *dev,
-					struct btd_profile *profile, int err)
+static struct btd_service *next_pending(struct btd_device *dev)
 {
-	struct btd_service *pending;
+	struct btd_service *first = NULL;
 	GSList *l;
 
-	DBG("%s %s (%d)", profile->name, strerror(-err), -err);
+	for (l = dev->pending; l != NULL; l = g_slist_next(l)) {
+		struct btd_service *service = l->data;
 
-	if (!err)
-		device_set_temporary(dev, FALSE);
+		if (btd_service_get_state(service) ==
+						BTD_SERVICE_STATE_CONNECTING)
+			continue;
 
-	if (dev->pending == NULL)
-		return;
+		if (!service_is_blocked(dev, service))
+			return service;
 
-	if (!dev->connected && err == -EHOSTDOWN)
-		goto done;
+		if (first == NULL)
+			first = service;
+	}
 
-	pending = dev->pending->data;
-	l = find_service_with_profile(dev->pending, profile);
-	if (l != NULL)
-		dev->pending = g_slist_delete_link(dev->pending, l);
+	/*
+	 * Everything left waits on something else that is pending: with
+	 * nothing in progress this can only be a dependency loop, so break
+	 * it by following the priority order.
+	 */
+	if (first && count_connecting(dev) == 0)
+		return first;
+
+	return NULL;
+}
+
+/*
+ * Start every pending service whose dependencies have been attempted,
+ * up to the configured number of concurrent connections. Returns 0 if
+ * at least one connection is in progress.
+ */
+static int connect_next(struct btd_device *dev)
+{
+	struct btd_service *service;
+	int err = -ENOENT;
 
-	/* Only continue connecting the next profile if it matches the first
-	 * pending, otherwise it will trigger another connect to the same
-	 * profile
+	/*
+	 * A failing btd_service_connect() reports back synchronously through
+	 * device_profile_connected(), which must not reschedule meanwhile.
 	 */
-	if (profile != btd_service_get_profile(pending))
-		return;
+	dev->connect_scheduling = true;
 
-	if (connect_next(dev) == 0)
-		return;
+	while (count_connecting(dev) < main_opts.connect_parallel) {
+		service = next_pending(dev);
+		if (service == NULL)
+			break;
+
+		device_trace(dev, "connect-profile",
+				btd_service_get_profile(service)->name);
+
+		err = btd_service_connect(service);
+		if (err == 0)
+			continue;
+
+		dev->pending = g_slist_remove(dev->pending, service);
+	}
+
+	dev->connect_scheduling = false;
+
+	if (count_connecting(dev) > 0)
+		return 0;
+
+	return err;
+}
+
+static void device_connect_reply(struct btd_device *dev, int err)
+{
+	GSList *l;
 
-done:
 	if (!dev->connect)
 		return;
 
@@ -1197,13 +1273,56 @@ done:
 		g_dbus_send_reply(dbus_conn, dev->connect, DBUS_TYPE_INVALID);
 	}
 
-	g_slist_free(dev->pending);
-	dev->pending = NULL;
-
 	dbus_message_unref(dev->connect);
 	dev->connect = NULL;
 }
 
+static void device_profile_connected(struct btd_device *dev,
+					struct btd_profile *profile, int err)
+{
+	GSList *l;
+
+	DBG("%s %s (%d)", profile->name, strerror(-err), -err);
+
+	if (!err)
+		device_set_temporary(dev, FALSE);
+
+	if (dev->pending == NULL)
+		return;
+
+	if (dev->connect_scheduling) {
+		l = find_service_with_profile(dev->pending, profile);
+		if (l != NULL)
+			dev->pending = g_slist_delete_link(dev->pending, l);
+		return;
+	}
+
+	if (!dev->connected && err == -EHOSTDOWN)
+		goto done;
+
+	/*
+	 * Ignore profiles not started by us, otherwise they would trigger
+	 * the same profile to be connected again
+	 */
+	l = find_service_with_profile(dev->pending, profile);
+	if (l == NULL)
+		return;
+
+	dev->pending = g_slist_delete_link(dev->pending, l);
+
+	if (!err && main_opts.connect_first)
+		device_connect_reply(dev, 0);
+
+	if (connect_next(dev) == 0)
+		return;
+
+done:
+	device_connect_reply(dev, err);
+
+	g_slist_free(dev->pending);
+	dev->pending = NULL;
+}
+
 void device_add_eir_uuids(struct btd_device *dev, GSList *uuids)
 {
 	GSList *l;
@@ -1443,6 +1562,8 @@ static void device_svc_resolved(struct btd_device *dev, int err)
 
 	DBG("%s err %d", dev->path, err);
 
+	device_trace(dev, "services-resolved", err < 0 ? strerror(-err) : NULL);
+
 	dev->svc_resolved = true;
 	dev->browse = NULL;
 
@@ -1781,6 +1902,99 @@ static const GDBusPropertyTable device_properties[] = {
 	{ }
 };
 
+static void append_trace_event(const struct trace_event *event,
+							void *user_data)
+{
+	DBusMessageIter *array = user_data;
+	DBusMessageIter entry;
+	dbus_uint64_t timestamp = event->timestamp;
+	const char *detail = event->detail;
+
+	dbus_message_iter_open_container(array, DBUS_TYPE_STRUCT, NULL,
+								&entry);
+
+	dbus_message_iter_append_basic(&entry, DBUS_TYPE_UINT64, &timestamp);
+	dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING,
+								&event->stage);
+	dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING, &detail);
+
+	dbus_message_iter_close_container(array, &entry);
+}
+
+static DBusMessage *trace_get_events(DBusConnection *conn, DBusMessage *msg,
+							void *user_data)
+{
+	struct btd_device *device = user_data;
+	DBusMessage *reply;
+	DBusMessageIter iter, array;
+
+	reply = dbus_message_new_method_return(msg);
+	if (!reply)
+		return NULL;
+
+	dbus_message_iter_init_append(reply, &iter);
+
+	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
+					DBUS_STRUCT_BEGIN_CHAR_AS_STRING
+					DBUS_TYPE_UINT64_AS_STRING
+					DBUS_TYPE_STRING_AS_STRING
+					DBUS_TYPE_STRING_AS_STRING
+					DBUS_STRUCT_END_CHAR_AS_STRING,
+					&array);
+
+	trace_ring_foreach(device->trace, append_trace_event, &array);
+
+	dbus_message_iter_close_container(&iter, &array);
+
+	return reply;
+}
+
+static DBusMessage *trace_get_timeline(DBusConnection *conn,
+					DBusMessage *msg, void *user_data)
+{
+	struct btd_device *device = user_data;
+	DBusMessage *reply;
+	char *json;
+
+	json = trace_ring_to_json(device->trace, device->path);
+
+	reply = g_dbus_create_reply(msg, DBUS_TYPE_STRING, &json,
+							DBUS_TYPE_INVALID);
+
+	g_free(json);
+
+	return reply;
+}
+
+static DBusMessage *trace_clear(DBusConnection *conn, DBusMessage *msg,
+							void *user_data)
+{
+	struct btd_device *device = user_data;
+
+	trace_ring_clear(device->trace);
+
+	return dbus_message_new_method_return(msg);
+}
+
+static const GDBusMethodTable trace_methods[] = {
+	{ GDBUS_EXPERIMENTAL_METHOD("GetEvents", NULL,
+			GDBUS_ARGS({ "events", "a(tss)" }),
+			trace_get_events) },
+	{ GDBUS_EXPERIMENTAL_METHOD("GetTimeline", NULL,
+			GDBUS_ARGS({ "timeline", "s" }),
+			trace_get_timeline) },
+	{ GDBUS_EXPERIMENTAL_METHOD("Clear", NULL, NULL, trace_clear) },
+	{ }
+};
+
+void device_trace(struct btd_device *device, const char *stage,
+							const char *detail)
+{
+	DBG("%s %s %s", device->path, stage, detail ? detail : "");
+
+	trace_ring_record(device->trace, stage, detail);
+}
+
 gboolean device_is_connected(struct btd_device *device)
 {
 	return device->connected;
@@ -1812,6 +2026,8 @@ void device_remove_connection(struct btd_device *device)
 
 	device->connected = FALSE;
 	device->general_connect = FALSE;
+
+	device_trace(device, "disconnected", NULL);
 	device->svc_refreshed = false;
 
 	if (device->disconn_timer > 0) {
@@ -2035,11 +2251,10 @@ next:
 		store_device_info(device);
 }
 
-static void load_att_info(struct btd_device *device, const char *local,
-				const char *peer)
+static GSList *read_legacy_primaries(const char *filename)
 {
-	char filename[PATH_MAX + 1];
 	GKeyFile *key_file;
+	GSList *primaries = NULL;
 	char *prim_uuid, *str;
 	char **groups, **handle, *service_uuid;
 	struct gatt_primary *prim;
@@ -2050,10 +2265,6 @@ static void load_att_info(struct btd_device *device, const char *local,
 	sdp_uuid16_create(&uuid, GATT_PRIM_SVC_UUID);
 	prim_uuid = bt_uuid2string(&uuid);
 
-	snprintf(filename, PATH_MAX, STORAGEDIR "/%s/%s/attributes", local,
-			peer);
-	filename[PATH_MAX] = '\0';
-
 	key_file = g_key_file_new();
 	g_key_file_load_from_file(key_file, filename, 0, NULL);
 	groups = g_key_file_get_groups(key_file, NULL);
@@ -2116,12 +2327,148 @@ static void load_att_info(struct btd_device *device, const char *local,
 		g_free(service_uuid);
 		g_free(str);
 
-		device->primaries = g_slist_append(device->primaries, prim);
+		primaries = g_slist_append(primaries, prim);
 	}
 
 	g_strfreev(groups);
 	g_key_file_free(key_file);
 	g_free(prim_uuid);
+
+	return primaries;
+}
+
+static sdp_list_t *read_legacy_records(GKeyFile *key_file)
+{
+	char **keys, **handle;
+	sdp_list_t *recs = NULL;
+
+	keys = g_key_file_get_keys(key_file, "ServiceRecords", NULL, NULL);
+
+	for (handle = keys; handle && *handle; handle++) {
+		sdp_record_t *rec;
+		char *str;
+
+		str = g_key_file_get_string(key_file, "ServiceRecords",
+							*handle, NULL);
+		if (!str)
+			continue;
+
+		rec = record_from_string(str);
+		if (rec)
+			recs = sdp_list_append(recs, rec);
+
+		g_free(str);
+	}
+
+	g_strfreev(keys);
+
+	return recs;
+}
+
+static char *record_cache_path(const char *local, const char *peer)
+{
+	return g_strdup_printf(STORAGEDIR "/%s/cache/%s.records", local, peer);
+}
+
+/*
+ * Moves the hex encoded records of the cache file and the primary services
+ * of the attributes file into the binary attribute cache.
+ */
+static void convert_record_cache(const char *local, const char *peer,
+							const char *filename)
+{
+	char sdp_file[PATH_MAX + 1];
+	char att_file[PATH_MAX + 1];
+	GKeyFile *key_file;
+	sdp_list_t *recs;
+	GSList *primaries;
+	char *data;
+	gsize length = 0;
+
+	snprintf(sdp_file, PATH_MAX, STORAGEDIR "/%s/cache/%s", local, peer);
+	sdp_file[PATH_MAX] = '\0';
+
+	snprintf(att_file, PATH_MAX, STORAGEDIR "/%s/%s/attributes", local,
+									peer);
+	att_file[PATH_MAX] = '\0';
+
+	key_file = g_key_file_new();
+	g_key_file_load_from_file(key_file, sdp_file, 0, NULL);
+
+	recs = read_legacy_records(key_file);
+	primaries = read_legacy_primaries(att_file);
+
+	if (!recs && !primaries)
+		goto done;
+
+	DBG("Converting %d records and %u services of %s", sdp_list_len(recs),
+					g_slist_length(primaries), peer);
+
+	if (record_cache_update(filename, recs, primaries, true) < 0)
+		goto done;
+
+	if (recs) {
+		g_key_file_remove_group(key_file, "ServiceRecords", NULL);
+
+		data = g_key_file_to_data(key_file, &length, NULL);
+		g_file_set_contents(sdp_file, data, length, NULL);
+		g_free(data);
+	}
+
+	if (primaries)
+		unlink(att_file);
+
+done:
+	sdp_list_free(recs, (sdp_free_func_t) sdp_record_free);
+	g_slist_free_full(primaries, g_free);
+	g_key_file_free(key_file);
+}
+
+static struct record_cache *open_record_cache(const char *local,
+							const char *peer)
+{
+	struct record_cache *cache;
+	char *filename;
+
+	filename = record_cache_path(local, peer);
+
+	cache = record_cache_open(filename);
+	if (!cache) {
+		convert_record_cache(local, peer, filename);
+		cache = record_cache_open(filename);
+	}
+
+	g_free(filename);
+
+	return cache;
+}
+
+/* Returns the attribute cache path once legacy entries got converted */
+static char *device_record_cache(struct btd_device *device)
+{
+	char local[18], peer[18];
+
+	ba2str(adapter_get_address(device->adapter), local);
+	ba2str(&device->bdaddr, peer);
+
+	record_cache_close(open_record_cache(local, peer));
+
+	return record_cache_path(local, peer);
+}
+
+static void load_att_info(struct btd_device *device, const char *local,
+				const char *peer)
+{
+	struct record_cache *cache;
+
+	cache = open_record_cache(local, peer);
+	if (!cache)
+		return;
+
+	device->primaries = g_slist_concat(device->primaries,
+					record_cache_get_primaries(cache));
+
+	record_cache_close(cache);
 }
 
 static struct btd_device *device_new(struct btd_adapter *adapter,
@@ -2142,6 +2489,8 @@ static struct btd_device *device_new(struct btd_adapter *adapter,
 	g_strdelimit(device->path, ":", '_');
 	g_free(address_up);
 
+	device->trace = trace_ring_new();
+
 	DBG("Creating device %s", device->path);
 
 	if (g_dbus_register_interface(dbus_conn,
@@ -2154,6 +2503,11 @@ static struct btd_device *device_new(struct btd_adapter *adapter,
 		return NULL;
 	}
 
+	/* Only available with experimental interfaces enabled */
+	g_dbus_register_interface(dbus_conn, device->path, TRACE_INTERFACE,
+					trace_methods, NULL, NULL, device,
+					NULL);
+
 	str2ba(address, &device->bdaddr);
 	device->adapter = adapter;
 
@@ -2375,12 +2729,19 @@ static void device_remove_stored(struct btd_device *device)
 
 	g_free(data);
 	g_key_file_free(key_file);
+
+	snprintf(filename, PATH_MAX, STORAGEDIR "/%s/cache/%s.records",
+						adapter_addr, device_addr);
+	filename[PATH_MAX] = '\0';
+	unlink(filename);
 }
 
 void device_remove(struct btd_device *device, gboolean remove_stored)
 {
 	DBG("Removing device %s", device->path);
 
+	attrib_server_remove_device(device);
+
 	if (device->bonding) {
 		uint8_t status;
 
@@ -2536,8 +2897,7 @@ void device_probe_profile(gpointer a, gpointer b)
 
 	device->pending = g_slist_append(device->pending, service);
 
-	if (g_slist_length(device->pending) == 1)
-		connect_next(device);
+	connect_next(device);
 }
 
 void device_remove_profile(gpointer a, gpointer b)
@@ -2571,6 +2931,8 @@ void device_probe_profiles(struct btd_device *device, GSList *uuids)
 
 	DBG("Probing profiles for device %s", d.addr);
 
+	device_trace(device, "probe-profiles", NULL);
+
 	btd_profile_foreach(dev_probe, &d);
 
 add_uuids:
@@ -2589,76 +2951,36 @@ add_uuids:
 						DEVICE_INTERFACE, "UUIDs");
 }
 
-static void store_sdp_record(GKeyFile *key_file, sdp_record_t *rec)
-{
-	char handle_str[11];
-	sdp_buf_t buf;
-	int size, i;
-	char *str;
-
-	sprintf(handle_str, "0x%8.8X", rec->handle);
-
-	if (sdp_gen_record_pdu(rec, &buf) < 0)
-		return;
-
-	size = buf.data_size;
-
-	str = g_malloc0(size*2+1);
-
-	for (i = 0; i < size; i++)
-		sprintf(str + (i * 2), "%02X", buf.data[i]);
-
-	g_key_file_set_string(key_file, "ServiceRecords", handle_str, str);
-
-	free(buf.data);
-	g_free(str);
-}
-
-static void store_primaries_from_sdp_record(GKeyFile *key_file,
-						sdp_record_t *rec)
+static struct gatt_primary *primary_from_sdp_record(sdp_record_t *rec)
 {
+	struct gatt_primary *prim = NULL;
 	uuid_t uuid;
-	char *att_uuid, *prim_uuid;
+	char *att_uuid, *str;
 	uint16_t start = 0, end = 0, psm = 0;
-	char handle[6], uuid_str[33];
-	int i;
 
 	sdp_uuid16_create(&uuid, ATT_UUID);
 	att_uuid = bt_uuid2string(&uuid);
 
-	sdp_uuid16_create(&uuid, GATT_PRIM_SVC_UUID);
-	prim_uuid = bt_uuid2string(&uuid);
-
 	if (!record_has_uuid(rec, att_uuid))
 		goto done;
 
 	if (!gatt_parse_record(rec, &uuid, &psm, &start, &end))
 		goto done;
 
-	sprintf(handle, "%hu", start);
-	switch (uuid.type) {
-	case SDP_UUID16:
-		sprintf(uuid_str, "%4.4X", uuid.value.uuid16);
-		break;
-	case SDP_UUID32:
-		sprintf(uuid_str, "%8.8X", uuid.value.uuid32);
-		break;
-	case SDP_UUID128:
-		for (i = 0; i < 16; i++)
-			sprintf(uuid_str + (i * 2), "%2.2X",
-					uuid.value.uuid128.data[i]);
-		break;
-	default:
-		uuid_str[0] = '\0';
-	}
+	str = bt_uuid2string(&uuid);
+	if (!str)
+		goto done;
 
-	g_key_file_set_string(key_file, handle, "UUID", prim_uuid);
-	g_key_file_set_string(key_file, handle, "Value", uuid_str);
-	g_key_file_set_integer(key_file, handle, "EndGroupHandle", end);
+	prim = g_new0(struct gatt_primary, 1);
+	prim->range.start = start;
+	prim->range.end = end;
+	g_strlcpy(prim->uuid, str, sizeof(prim->uuid));
+	g_free(str);
 
 done:
-	g_free(prim_uuid);
 	g_free(att_uuid);
+
+	return prim;
 }
 
 static int rec_cmp(const void *a, const void *b)
@@ -2698,33 +3020,9 @@ static int update_record(struct browse_req *req, const char *uuid,
 static void update_bredr_services(struct browse_req *req, sdp_list_t *recs)
 {
 	struct btd_device *device = req->device;
-	sdp_list_t *seq;
-	char srcaddr[18], dstaddr[18];
-	char sdp_file[PATH_MAX + 1];
-	char att_file[PATH_MAX + 1];
-	GKeyFile *sdp_key_file = NULL;
-	GKeyFile *att_key_file = NULL;
-	char *data;
-	gsize length = 0;
-
-	ba2str(adapter_get_address(device->adapter), srcaddr);
-	ba2str(&device->bdaddr, dstaddr);
-
-	if (!device->temporary) {
-		snprintf(sdp_file, PATH_MAX, STORAGEDIR "/%s/cache/%s",
-							srcaddr, dstaddr);
-		sdp_file[PATH_MAX] = '\0';
-
-		sdp_key_file = g_key_file_new();
-		g_key_file_load_from_file(sdp_key_file, sdp_file, 0, NULL);
-
-		snprintf(att_file, PATH_MAX, STORAGEDIR "/%s/%s/attributes",
-							srcaddr, dstaddr);
-		att_file[PATH_MAX] = '\0';
-
-		att_key_file = g_key_file_new();
-		g_key_file_load_from_file(att_key_file, att_file, 0, NULL);
-	}
+	sdp_list_t *seq, *stored = NULL;
+	GSList *primaries = NULL;
+	char *filename;
 
 	for (seq = recs; seq; seq = seq->next) {
 		sdp_record_t *rec = (sdp_record_t *) seq->data;
@@ -2774,38 +3072,29 @@ static void update_bredr_services(struct browse_req *req, sdp_list_t *recs)
 		if (update_record(req, profile_uuid, rec) < 0)
 			goto next;
 
-		if (sdp_key_file)
-			store_sdp_record(sdp_key_file, rec);
+		if (!device->temporary) {
+			struct gatt_primary *prim;
 
-		if (att_key_file)
-			store_primaries_from_sdp_record(att_key_file, rec);
+			stored = sdp_list_append(stored, rec);
+
+			prim = primary_from_sdp_record(rec);
+			if (prim)
+				primaries = g_slist_append(primaries, prim);
+		}
 
 next:
 		g_free(profile_uuid);
 		sdp_list_free(svcclass, free);
 	}
 
-	if (sdp_key_file) {
-		data = g_key_file_to_data(sdp_key_file, &length, NULL);
-		if (length > 0) {
-			create_file(sdp_file, S_IRUSR | S_IWUSR);
-			g_file_set_contents(sdp_file, data, length, NULL);
-		}
-
-		g_free(data);
-		g_key_file_free(sdp_key_file);
+	if (stored) {
+		filename = device_record_cache(device);
+		record_cache_update(filename, stored, primaries, false);
+		g_free(filename);
 	}
 
-	if (att_key_file) {
-		data = g_key_file_to_data(att_key_file, &length, NULL);
-		if (length > 0) {
-			create_file(att_file, S_IRUSR | S_IWUSR);
-			g_file_set_contents(att_file, data, length, NULL);
-		}
-
-		g_free(data);
-		g_key_file_free(att_key_file);
-	}
+	sdp_list_free(stored, NULL);
+	g_slist_free_full(primaries, g_free);
 }
 
 static int primary_cmp(gconstpointer a, gconstpointer b)
@@ -2963,15 +3252,7 @@ done:
 
 static void store_services(struct btd_device *device)
 {
-	struct btd_adapter *adapter = device->adapter;
-	char filename[PATH_MAX + 1];
-	char src_addr[18], dst_addr[18];
-	uuid_t uuid;
-	char *prim_uuid;
-	GKeyFile *key_file;
-	GSList *l;
-	char *data;
-	gsize length = 0;
+	char *filename;
 
 	if (device_address_is_private(device)) {
 		warn("Can't store services for private addressed device %s",
@@ -2979,61 +3260,9 @@ static void store_services(struct btd_device *device)
 		return;
 	}
 
-	sdp_uuid16_create(&uuid, GATT_PRIM_SVC_UUID);
-	prim_uuid = bt_uuid2string(&uuid);
-	if (prim_uuid == NULL)
-		return;
-
-	ba2str(adapter_get_address(adapter), src_addr);
-	ba2str(&device->bdaddr, dst_addr);
-
-	snprintf(filename, PATH_MAX, STORAGEDIR "/%s/%s/attributes", src_addr,
-								dst_addr);
-	filename[PATH_MAX] = '\0';
-
-	key_file = g_key_file_new();
-
-	for (l = device->primaries; l; l = l->next) {
-		struct gatt_primary *primary = l->data;
-		char handle[6], uuid_str[33];
-		int i;
-
-		sprintf(handle, "%hu", primary->range.start);
-
-		bt_string2uuid(&uuid, primary->uuid);
-		sdp_uuid128_to_uuid(&uuid);
-
-		switch (uuid.type) {
-		case SDP_UUID16:
-			sprintf(uuid_str, "%4.4X", uuid.value.uuid16);
-			break;
-		case SDP_UUID32:
-			sprintf(uuid_str, "%8.8X", uuid.value.uuid32);
-			break;
-		case SDP_UUID128:
-			for (i = 0; i < 16; i++)
-				sprintf(uuid_str + (i * 2), "%2.2X",
-						uuid.value.uuid128.data[i]);
-			break;
-		default:
-			uuid_str[0] = '\0';
-		}
-
-		g_key_file_set_string(key_file, handle, "UUID", prim_uuid);
-		g_key_file_set_string(key_file, handle, "Value", uuid_str);
-		g_key_file_set_integer(key_file, handle, "EndGroupHandle",
-					primary->range.end);
-	}
-
-	data = g_key_file_to_data(key_file, &length, NULL);
-	if (length > 0) {
-		create_file(filename, S_IRUSR | S_IWUSR);
-		g_file_set_contents(filename, data, length, NULL);
-	}
-
-	g_free(prim_uuid);
-	g_free(data);
-	g_key_file_free(key_file);
+	filename = device_record_cache(device);
+	record_cache_update(filename, NULL, device->primaries, true);
+	g_free(filename);
 }
 
 static bool device_get_auto_connect(struct btd_device *device)
@@ -3430,6 +3659,8 @@ static int device_browse_primary(struct btd_device *device, DBusMessage *msg)
 
 	device->browse = req;
 
+	device_trace(device, "browse-gatt", NULL);
+
 	if (device->attrib) {
 		gatt_discover_primary(device->attrib, NULL, primary_cb, req);
 		goto done;
@@ -3497,6 +3728,8 @@ static int device_browse_sdp(struct btd_device *device, DBusMessage *msg)
 
 	device->browse = req;
 
+	device_trace(device, "browse-sdp", NULL);
+
 	if (msg) {
 		const char *sender = dbus_message_get_sender(msg);
 
@@ -3525,6 +3758,11 @@ const bdaddr_t *device_get_address(struct btd_device *device)
 	return &device->bdaddr;
 }
 
+uint8_t btd_device_get_bdaddr_type(struct btd_device *device)
+{
+	return device->bdaddr_type;
+}
+
 const char *device_get_path(const struct btd_device *device)
 {
 	if (!device)
@@ -3631,6 +3869,11 @@ void device_set_rssi(struct btd_device *device, int8_t rssi)
 						DEVICE_INTERFACE, "RSSI");
 }
 
+int8_t device_get_rssi(struct btd_device *device)
+{
+	return device->rssi;
+}
+
 static void device_set_auto_connect(struct btd_device *device, gboolean enable)
 {
 	char addr[18];
@@ -4259,63 +4502,64 @@ void btd_device_add_uuid(struct btd_device *device, const char *uuid)
 						DEVICE_INTERFACE, "UUIDs");
 }
 
-static sdp_list_t *read_device_records(struct btd_device *device)
+static struct record_cache *device_open_cache(struct btd_device *device)
 {
 	char local[18], peer[18];
-	char filename[PATH_MAX + 1];
-	GKeyFile *key_file;
-	char **keys, **handle;
-	char *str;
-	sdp_list_t *recs = NULL;
-	sdp_record_t *rec;
 
 	ba2str(adapter_get_address(device->adapter), local);
 	ba2str(&device->bdaddr, peer);
 
-	snprintf(filename, PATH_MAX, STORAGEDIR "/%s/cache/%s", local, peer);
-	filename[PATH_MAX] = '\0';
-
-	key_file = g_key_file_new();
-	g_key_file_load_from_file(key_file, filename, 0, NULL);
-	keys = g_key_file_get_keys(key_file, "ServiceRecords", NULL, NULL);
-
-	for (handle = keys; handle && *handle; handle++) {
-		str = g_key_file_get_string(key_file, "ServiceRecords",
-						*handle, NULL);
-		if (!str)
-			continue;
-
-		rec = record_from_string(str);
-		recs = sdp_list_append(recs, rec);
-		g_free(str);
-	}
-
-	g_strfreev(keys);
-	g_key_file_free(key_file);
-
-	return recs;
+	return open_record_cache(local, peer);
 }
 
 const sdp_record_t *btd_device_get_record(struct btd_device *device,
 							const char *uuid)
 {
+	struct record_cache *cache;
+	sdp_record_t *rec;
+	uuid_t svc;
+
 	if (device->tmp_records) {
 		const sdp_record_t *record;
 
 		record = find_record_in_list(device->tmp_records, uuid);
 		if (record != NULL)
 			return record;
-
-		sdp_list_free(device->tmp_records,
-					(sdp_free_func_t) sdp_record_free);
-		device->tmp_records = NULL;
 	}
 
-	device->tmp_records = read_device_records(device);
-	if (!device->tmp_records)
+	if (bt_string2uuid(&svc, uuid) < 0)
+		return NULL;
+
+	cache = device_open_cache(device);
+	if (!cache)
+		return NULL;
+
+	/* Only the requested record gets extracted */
+	rec = record_cache_find(cache, &svc);
+	record_cache_close(cache);
+
+	if (!rec)
+		return NULL;
+
+	device->tmp_records = sdp_list_append(device->tmp_records, rec);
+
+	return rec;
+}
+
+sdp_record_t *btd_device_read_record(struct btd_device *device,
+							uint32_t handle)
+{
+	struct record_cache *cache;
+	sdp_record_t *rec;
+
+	cache = device_open_cache(device);
+	if (!cache)
 		return NULL;
 
-	return find_record_in_list(device->tmp_records, uuid);
+	rec = record_cache_get(cache, handle);
+	record_cache_close(cache);
+
+	return rec;
 }
 
 struct btd_device *btd_device_ref(struct btd_device *device)
@@ -4337,6 +4581,7 @@ void btd_device_unref(struct btd_device *device)
 
 	DBG("Freeing device %s", device->path);
 
+	g_dbus_unregister_interface(dbus_conn, device->path, TRACE_INTERFACE);
 	g_dbus_unregister_interface(dbus_conn, device->path, DEVICE_INTERFACE);
 }
 
@@ -4506,6 +4751,9 @@ void btd_device_init(void)
 	dbus_conn = btd_get_dbus_connection();
 	service_state_cb_id = btd_service_add_state_cb(
 						service_state_changed, NULL);
+
+	storage_writes_total = metrics_counter_new("bluez_storage_writes_total",
+					"Settings and device info files written");
 }
 
 void btd_device_cleanup(void)
@@ -23,6 +23,7 @@
  */
 
 #define DEVICE_INTERFACE	"org.bluez.Device1"
+#define TRACE_INTERFACE		"org.bluez.Trace1"
 
 struct btd_device;
 
@@ -50,6 +51,8 @@ GSList *device_get_uuids(struct btd_device *device);
 void device_probe_profiles(struct btd_device *device, GSList *profiles);
 const sdp_record_t *btd_device_get_record(struct btd_device *device,
 						const char *uuid);
+sdp_record_t *btd_device_read_record(struct btd_device *device,
+							uint32_t handle);
 struct gatt_primary *btd_device_get_primary(struct btd_device *device,
 							const char *uuid);
 GSList *btd_device_get_primaries(struct btd_device *device);
@@ -61,6 +64,7 @@ void device_probe_profile(gpointer a, gpointer b);
 void device_remove_profile(gpointer a, gpointer b);
 struct btd_adapter *device_get_adapter(struct btd_device *device);
 const bdaddr_t *device_get_address(struct btd_device *device);
+uint8_t btd_device_get_bdaddr_type(struct btd_device *device);
 const char *device_get_path(const struct btd_device *device);
 gboolean device_is_bredr(struct btd_device *device);
 gboolean device_is_le(struct btd_device *device);
@@ -74,6 +78,7 @@ void device_set_trusted(struct btd_device *device, gboolean trusted);
 void device_set_bonded(struct btd_device *device, gboolean bonded);
 void device_set_legacy(struct btd_device *device, bool legacy);
 void device_set_rssi(struct btd_device *device, int8_t rssi);
+int8_t device_get_rssi(struct btd_device *device);
 gboolean device_is_connected(struct btd_device *device);
 bool device_is_retrying(struct btd_device *device);
 void device_bonding_complete(struct btd_device *device, uint8_t status);
@@ -131,5 +136,8 @@ bool device_remove_svc_complete_callback(struct btd_device *dev,
 struct btd_service *btd_device_get_service(struct btd_device *dev,
 						const char *remote_uuid);
 
+void device_trace(struct btd_device *device, const char *stage,
+							const char *detail);
+
 void btd_device_init(void);
 void btd_device_cleanup(void);
@@ -32,6 +32,8 @@ struct main_opts {
 	gboolean	reverse_sdp;
 	gboolean	name_resolv;
 	gboolean	debug_keys;
+	uint16_t	connect_parallel;
+	gboolean	connect_first;
 
 	uint16_t	did_source;
 	uint16_t	did_vendor;
@@ -41,10 +43,14 @@ struct main_opts {
 
 extern struct main_opts main_opts;
 
-gboolean plugin_init(const char *enable, const char *disable);
+gboolean plugin_init(const char *enable, const char *disable,
+						void (*ready) (void));
 void plugin_cleanup(void);
 
 void rfkill_init(void);
 void rfkill_exit(void);
 
 void btd_exit(void);
+
+void btd_startup_mark(const char *stage, const char *detail);
+char *btd_startup_timeline(void);
@@ -26,7 +26,9 @@
 #endif
 
 #include <stdio.h>
+#include <errno.h>
 #include <stdarg.h>
+#include <string.h>
 #include <syslog.h>
 
 #include <glib.h>
@@ -66,13 +68,163 @@ void error(const char *format, ...)
 	va_end(ap);
 }
 
+/*
+ * Debug output can be captured into a ring buffer instead of syslog.
+ * Each record is a timestamp and a length followed by the message,
+ * and the oldest records are dropped when the buffer is full.
+ */
+#define CAPTURE_MIN_SIZE	1024
+#define CAPTURE_MAX_SIZE	(16 * 1024 * 1024)
+#define CAPTURE_MSG_SIZE	512
+
+struct capture_header {
+	uint64_t timestamp;
+	uint16_t len;
+} __attribute__((packed));
+
+static uint8_t *capture_buf = NULL;
+static unsigned int capture_size = 0;
+static unsigned int capture_head = 0;
+static unsigned int capture_used = 0;
+
+static void capture_write(unsigned int offset, const void *data,
+							unsigned int len)
+{
+	unsigned int part = MIN(len, capture_size - offset);
+
+	memcpy(capture_buf + offset, data, part);
+	memcpy(capture_buf, (const uint8_t *) data + part, len - part);
+}
+
+static void capture_read(unsigned int offset, void *data, unsigned int len)
+{
+	unsigned int part = MIN(len, capture_size - offset);
+
+	memcpy(data, capture_buf + offset, part);
+	memcpy((uint8_t *) data + part, capture_buf, len - part);
+}
+
+static void capture_drop_oldest(void)
+{
+	struct capture_header hdr;
+	unsigned int tail;
+
+	tail = (capture_head + capture_size - capture_used) % capture_size;
+
+	capture_read(tail, &hdr, sizeof(hdr));
+
+	capture_used -= sizeof(hdr) + hdr.len;
+}
+
+/*
+ * Messages are returned as D-Bus strings, so they have to be valid
+ * UTF-8. Device names can contain anything and truncation can split a
+ * character, so replace every byte that isn't part of a valid sequence.
+ */
+static void capture_sanitize(char *msg, unsigned int len)
+{
+	const gchar *end;
+
+	while (!g_utf8_validate(msg, len, &end)) {
+		unsigned int valid = end - msg;
+
+		msg[valid] = '?';
+
+		msg += valid + 1;
+		len -= valid + 1;
+	}
+}
+
+static void capture_add(const char *format, va_list ap)
+{
+	struct capture_header hdr;
+	char msg[CAPTURE_MSG_SIZE];
+	int len;
+
+	len = vsnprintf(msg, sizeof(msg), format, ap);
+	if (len < 0)
+		return;
+
+	hdr.timestamp = g_get_monotonic_time();
+	hdr.len = MIN((unsigned int) len, sizeof(msg) - 1);
+
+	capture_sanitize(msg, hdr.len);
+
+	while (capture_size - capture_used < sizeof(hdr) + hdr.len)
+		capture_drop_oldest();
+
+	capture_write(capture_head, &hdr, sizeof(hdr));
+	capture_head = (capture_head + sizeof(hdr)) % capture_size;
+
+	capture_write(capture_head, msg, hdr.len);
+	capture_head = (capture_head + hdr.len) % capture_size;
+
+	capture_used += sizeof(hdr) + hdr.len;
+}
+
+int __btd_debug_capture_start(unsigned int size)
+{
+	if (size < CAPTURE_MIN_SIZE || size > CAPTURE_MAX_SIZE)
+		return -EINVAL;
+
+	__btd_debug_capture_stop();
+
+	capture_buf = g_try_malloc(size);
+	if (!capture_buf)
+		return -ENOMEM;
+
+	capture_size = size;
+
+	return 0;
+}
+
+void __btd_debug_capture_stop(void)
+{
+	g_free(capture_buf);
+	capture_buf = NULL;
+
+	capture_size = 0;
+	capture_head = 0;
+	capture_used = 0;
+}
+
+void __btd_debug_capture_foreach(btd_debug_capture_func_t func,
+							void *user_data)
+{
+	char msg[CAPTURE_MSG_SIZE];
+	unsigned int offset, left;
+
+	if (!capture_buf)
+		return;
+
+	offset = (capture_head + capture_size - capture_used) % capture_size;
+
+	for (left = capture_used; left > 0;) {
+		struct capture_header hdr;
+
+		capture_read(offset, &hdr, sizeof(hdr));
+		offset = (offset + sizeof(hdr)) % capture_size;
+
+		capture_read(offset, msg, hdr.len);
+		offset = (offset + hdr.len) % capture_size;
+		msg[hdr.len] = '\0';
+
+		func(hdr.timestamp, msg, user_data);
+
+		left -= sizeof(hdr) + hdr.len;
+	}
+}
+
 void btd_debug(const char *format, ...)
 {
 	va_list ap;
 
 	va_start(ap, format);
 
-	vsyslog(LOG_DEBUG, format, ap);
+	if (capture_buf)
+		capture_add(format, ap);
+	else
+		vsyslog(LOG_DEBUG, format, ap);
 
 	va_end(ap);
 }
@@ -80,7 +232,13 @@ void btd_debug(const char *format, ...)
 extern struct btd_debug_desc __start___debug[];
 extern struct btd_debug_desc __stop___debug[];
 
+struct debug_section {
+	struct btd_debug_desc *start;
+	struct btd_debug_desc *stop;
+};
+
 static char **enabled = NULL;
+static GSList *sections = NULL;
 
 static gboolean is_enabled(struct btd_debug_desc *desc)
 {
@@ -100,23 +258,76 @@ static gboolean is_enabled(struct btd_debug_desc *desc)
 void __btd_enable_debug(struct btd_debug_desc *start,
 					struct btd_debug_desc *stop)
 {
+	struct debug_section *section;
 	struct btd_debug_desc *desc;
 
 	if (start == NULL || stop == NULL)
 		return;
 
+	section = g_new0(struct debug_section, 1);
+	section->start = start;
+	section->stop = stop;
+
+	sections = g_slist_append(sections, section);
+
 	for (desc = start; desc < stop; desc++) {
 		if (is_enabled(desc))
 			desc->flags |= BTD_DEBUG_FLAG_PRINT;
 	}
 }
 
+static gboolean match_desc(GPatternSpec *spec, struct btd_debug_desc *desc)
+{
+	if (desc->file && g_pattern_match_string(spec, desc->file))
+		return TRUE;
+
+	if (desc->func && g_pattern_match_string(spec, desc->func))
+		return TRUE;
+
+	return FALSE;
+}
+
+unsigned int __btd_debug_set(const char *pattern, int enable)
+{
+	GPatternSpec *spec;
+	GSList *l;
+	unsigned int count = 0;
+
+	spec = g_pattern_spec_new(pattern);
+
+	for (l = sections; l; l = l->next) {
+		struct debug_section *section = l->data;
+		struct btd_debug_desc *desc;
+
+		for (desc = section->start; desc < section->stop; desc++) {
+			if (!match_desc(spec, desc))
+				continue;
+
+			if (enable)
+				desc->flags |= BTD_DEBUG_FLAG_PRINT;
+			else
+				desc->flags &= ~BTD_DEBUG_FLAG_PRINT;
+
+			count++;
+		}
+	}
+
+	g_pattern_spec_free(spec);
+
+	return count;
+}
+
 void __btd_toggle_debug(void)
 {
-	struct btd_debug_desc *desc;
+	GSList *l;
 
-	for (desc = __start___debug; desc < __stop___debug; desc++)
-		desc->flags |= BTD_DEBUG_FLAG_PRINT;
+	for (l = sections; l; l = l->next) {
+		struct debug_section *section = l->data;
+		struct btd_debug_desc *desc;
+
+		for (desc = section->start; desc < section->stop; desc++)
+			desc->flags |= BTD_DEBUG_FLAG_PRINT;
+	}
 }
 
 void __btd_log_init(const char *debug, int detach)
@@ -138,7 +349,12 @@ void __btd_log_init(const char *debug, int detach)
 
 void __btd_log_cleanup(void)
 {
+	__btd_debug_capture_stop();
+
 	closelog();
 
+	g_slist_free_full(sections, g_free);
+	sections = NULL;
+
 	g_strfreev(enabled);
 }
@@ -21,6 +21,8 @@
  *
  */
 
+#include <stdint.h>
+
 void info(const char *format, ...) __attribute__((format(printf, 1, 2)));
 void warn(const char *format, ...) __attribute__((format(printf, 1, 2)));
 void error(const char *format, ...) __attribute__((format(printf, 1, 2)));
@@ -33,6 +35,7 @@ void __btd_toggle_debug(void);
 
 struct btd_debug_desc {
 	const char *file;
+	const char *func;
 #define BTD_DEBUG_FLAG_DEFAULT (0)
 #define BTD_DEBUG_FLAG_PRINT   (1 << 0)
 	unsigned int flags;
@@ -40,6 +43,15 @@ struct btd_debug_desc {
 
 void __btd_enable_debug(struct btd_debug_desc *start,
 					struct btd_debug_desc *stop);
+unsigned int __btd_debug_set(const char *pattern, int enable);
+
+typedef void (*btd_debug_capture_func_t) (uint64_t timestamp,
+					const char *message, void *user_data);
+
+int __btd_debug_capture_start(unsigned int size);
+void __btd_debug_capture_stop(void);
+void __btd_debug_capture_foreach(btd_debug_capture_func_t func,
+							void *user_data);
 
 /**
  * DBG:
@@ -47,13 +59,17 @@ void __btd_enable_debug(struct btd_debug_desc *start,
  * @arg...: list of arguments
  *
  * Simple macro around btd_debug() which also include the function
- * name it is called in.
+ * name it is called in. The arguments are only evaluated when the
+ * debug point is enabled, so anything expensive should be computed
+ * in the argument list rather than before the macro.
  */
 #define DBG(fmt, arg...) do { \
 	static struct btd_debug_desc __btd_debug_desc \
 	__attribute__((used, section("__debug"), aligned(8))) = { \
-		.file = __FILE__, .flags = BTD_DEBUG_FLAG_DEFAULT, \
+		.file = __FILE__, .func = __FUNCTION__, \
+		.flags = BTD_DEBUG_FLAG_DEFAULT, \
 	}; \
-	if (__btd_debug_desc.flags & BTD_DEBUG_FLAG_PRINT) \
+	if (__builtin_expect(__btd_debug_desc.flags & \
+					BTD_DEBUG_FLAG_PRINT, 0)) \
 		btd_debug("%s:%s() " fmt,  __FILE__, __FUNCTION__ , ## arg); \
 } while (0)
@@ -33,6 +33,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <signal.h>
+#include <time.h>
 #include <sys/signalfd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -55,12 +56,16 @@
 #include "dbus-common.h"
 #include "agent.h"
 #include "profile.h"
+#include "debug.h"
 #include "systemd.h"
+#include "trace.h"
+#include "src/shared/metrics.h"
 
 #define BLUEZ_NAME "org.bluez"
 
 #define DEFAULT_PAIRABLE_TIMEOUT       0 /* disabled */
 #define DEFAULT_DISCOVERABLE_TIMEOUT 180 /* 3 minutes */
+#define DEFAULT_CONNECT_PARALLELISM    1
 
 #define SHUTDOWN_GRACE_SECONDS 10
 
@@ -76,6 +81,8 @@ static const char * const supported_options[] = {
 	"ReverseServiceDiscovery",
 	"NameResolving",
 	"DebugKeys",
+	"ConnectParallelism",
+	"ConnectReply",
 };
 
 static GKeyFile *load_config(const char *file)
@@ -263,6 +270,38 @@ static void parse_config(GKeyFile *config)
 		g_clear_error(&err);
 	else
 		main_opts.debug_keys = boolean;
+
+	val = g_key_file_get_integer(config, "General",
+						"ConnectParallelism", &err);
+	if (err) {
+		DBG("%s", err->message);
+		g_clear_error(&err);
+	} else if (val < 1) {
+		warn("Invalid ConnectParallelism %d, using 1", val);
+		main_opts.connect_parallel = 1;
+	} else if (val > UINT16_MAX) {
+		warn("Invalid ConnectParallelism %d, using %u", val,
+								UINT16_MAX);
+		main_opts.connect_parallel = UINT16_MAX;
+	} else {
+		DBG("connect_parallel=%d", val);
+		main_opts.connect_parallel = val;
+	}
+
+	str = g_key_file_get_string(config, "General", "ConnectReply", &err);
+	if (err) {
+		DBG("%s", err->message);
+		g_clear_error(&err);
+	} else {
+		DBG("connect_reply=%s", str);
+		if (g_str_equal(str, "first"))
+			main_opts.connect_first = TRUE;
+		else if (g_str_equal(str, "all"))
+			main_opts.connect_first = FALSE;
+		else
+			warn("Invalid ConnectReply %s", str);
+		g_free(str);
+	}
 }
 
 static void init_defaults(void)
@@ -278,6 +317,8 @@ static void init_defaults(void)
 	main_opts.reverse_sdp = TRUE;
 	main_opts.name_resolv = TRUE;
 	main_opts.debug_keys = FALSE;
+	main_opts.connect_parallel = DEFAULT_CONNECT_PARALLELISM;
+	main_opts.connect_first = FALSE;
 
 	if (sscanf(VERSION, "%hhu.%hhu", &major, &minor) != 2)
 		return;
@@ -385,6 +426,46 @@ static gboolean option_compat = FALSE;
 static gboolean option_detach = TRUE;
 static gboolean option_version = FALSE;
 static gboolean option_experimental = FALSE;
+static gboolean option_timeline = FALSE;
+
+static struct trace_ring *startup_trace = NULL;
+static uint64_t startup_time = 0;
+
+static uint64_t get_monotonic_usec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+void btd_startup_mark(const char *stage, const char *detail)
+{
+	uint64_t now;
+
+	/* Keep the earliest events, later ones are not part of startup */
+	if (startup_trace == NULL ||
+			trace_ring_count(startup_trace) == TRACE_RING_SIZE)
+		return;
+
+	now = get_monotonic_usec();
+
+	trace_ring_add(startup_trace, now, stage, detail);
+
+	if (option_timeline)
+		info("Startup %s %s (%" G_GUINT64_FORMAT " ms)", stage,
+					detail ? detail : "",
+					(now - startup_time) / 1000);
+}
+
+char *btd_startup_timeline(void)
+{
+	if (startup_trace == NULL)
+		return NULL;
+
+	return trace_ring_to_json(startup_trace, "bluetoothd");
+}
 
 static void free_options(void)
 {
@@ -449,6 +530,16 @@ static gboolean watchdog_callback(gpointer user_data)
 	return TRUE;
 }
 
+static void plugins_ready(void)
+{
+	btd_startup_mark("plugins-ready", NULL);
+
+	adapter_plugins_ready();
+
+	sd_notify(0, "STATUS=Running");
+	sd_notify(0, "READY=1");
+}
+
 static gboolean parse_debug(const char *key, const char *value,
 				gpointer user_data, GError **error)
 {
@@ -472,6 +563,8 @@ static GOptionEntry options[] = {
 				"Provide deprecated command line interfaces" },
 	{ "experimental", 'E', 0, G_OPTION_ARG_NONE, &option_experimental,
 				"Enable experimental interfaces" },
+	{ "timeline", 'T', 0, G_OPTION_ARG_NONE, &option_timeline,
+				"Log the startup timeline" },
 	{ "nodetach", 'n', G_OPTION_FLAG_REVERSE,
 				G_OPTION_ARG_NONE, &option_detach,
 				"Run with logging in foreground" },
@@ -491,6 +584,10 @@ int main(int argc, char *argv[])
 	guint signal, watchdog;
 	const char *watchdog_usec;
 
+	startup_time = get_monotonic_usec();
+	startup_trace = trace_ring_new();
+	trace_ring_add(startup_trace, startup_time, "start", NULL);
+
 	init_defaults();
 
 	context = g_option_context_new(NULL);
@@ -526,11 +623,15 @@ int main(int argc, char *argv[])
 
 	parse_config(config);
 
+	btd_startup_mark("config", NULL);
+
 	if (connect_dbus() < 0) {
 		error("Unable to get on D-Bus");
 		exit(1);
 	}
 
+	btd_startup_mark("dbus", NULL);
+
 	if (adapter_init() < 0) {
 		error("Adapter handling initialization failed");
 		exit(1);
@@ -539,6 +640,7 @@ int main(int argc, char *argv[])
 	btd_device_init();
 	btd_agent_init();
 	btd_profile_init();
+	btd_debug_init();
 
 	if (option_experimental)
 		gdbus_flags = G_DBUS_FLAG_ENABLE_EXPERIMENTAL;
@@ -550,11 +652,14 @@ int main(int argc, char *argv[])
 
 	start_sdp_server(sdp_mtu, sdp_flags);
 
+	btd_startup_mark("sdp-server", NULL);
+
 	/* Loading plugins has to be done after D-Bus has been setup since
-	 * the plugins might wanna expose some paths on the bus. However the
-	 * best order of how to init various subsystems of the Bluetooth
-	 * daemon needs to be re-worked. */
-	plugin_init(option_plugin, option_noplugin);
+	 * the plugins might wanna expose some paths on the bus. Their init
+	 * functions run from the main loop, interleaved with the replies to
+	 * the mgmt commands sent by adapter_init(). The adapters are made
+	 * connectable and powered on from plugins_ready(). */
+	plugin_init(option_plugin, option_noplugin, plugins_ready);
 
 	/* no need to keep parsed option in memory */
 	free_options();
@@ -563,8 +668,7 @@ int main(int argc, char *argv[])
 
 	DBG("Entering main loop");
 
-	sd_notify(0, "STATUS=Running");
-	sd_notify(0, "READY=1");
+	btd_startup_mark("main-loop", NULL);
 
 	watchdog_usec = getenv("WATCHDOG_USEC");
 	if (watchdog_usec) {
@@ -588,6 +692,7 @@ int main(int argc, char *argv[])
 
 	plugin_cleanup();
 
+	btd_debug_cleanup();
 	btd_profile_cleanup();
 	btd_agent_cleanup();
 	btd_device_cleanup();
@@ -610,6 +715,11 @@ int main(int argc, char *argv[])
 	if (watchdog > 0)
 		g_source_remove(watchdog);
 
+	metrics_cleanup();
+
+	trace_ring_free(startup_trace);
+	startup_trace = NULL;
+
 	__btd_log_cleanup();
 
 	return 0;
@@ -25,53 +25,143 @@
 #include <config.h>
 #endif
 
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
 #include "oui.h"
 
+/*
+ * Vendor names are looked up once per OUI and kept in a table sorted by
+ * OUI for the lifetime of the process. With hwdb the table memoizes the
+ * answers (including misses), with oui.txt it holds the whole file.
+ */
+struct oui_entry {
+	uint32_t oui;
+	char *comp;
+};
+
+static struct oui_entry *oui_table = NULL;
+static size_t oui_count = 0;
+static size_t oui_size = 0;
+
+static int oui_cmp(const void *a, const void *b)
+{
+	const struct oui_entry *ea = a, *eb = b;
+
+	if (ea->oui < eb->oui)
+		return -1;
+
+	return ea->oui > eb->oui;
+}
+
+static struct oui_entry *oui_find(uint32_t oui)
+{
+	struct oui_entry key = { .oui = oui };
+
+	if (!oui_count)
+		return NULL;
+
+	return bsearch(&key, oui_table, oui_count, sizeof(key), oui_cmp);
+}
+
+static struct oui_entry *oui_append(uint32_t oui, char *comp)
+{
+	struct oui_entry *entry;
+
+	if (oui_count == oui_size) {
+		size_t size = oui_size ? oui_size * 2 : 64;
+
+		entry = realloc(oui_table, size * sizeof(*entry));
+		if (!entry)
+			return NULL;
+
+		oui_table = entry;
+		oui_size = size;
+	}
+
+	entry = &oui_table[oui_count++];
+	entry->oui = oui;
+	entry->comp = comp;
+
+	return entry;
+}
+
+static inline uint32_t batooui(const bdaddr_t *ba)
+{
+	return ba->b[5] << 16 | ba->b[4] << 8 | ba->b[3];
+}
+
 #ifdef HAVE_UDEV_HWDB_NEW
 #include <libudev.h>
 
-char *batocomp(const bdaddr_t *ba)
+static struct udev *udev = NULL;
+static struct udev_hwdb *hwdb = NULL;
+
+static char *hwdb_lookup(uint32_t oui)
 {
-	struct udev *udev;
-	struct udev_hwdb *hwdb;
 	struct udev_list_entry *head, *entry;
-	char modalias[11], *comp = NULL;
+	char modalias[11];
 
-	sprintf(modalias, "OUI:%2.2X%2.2X%2.2X", ba->b[5], ba->b[4], ba->b[3]);
+	if (!udev) {
+		udev = udev_new();
+		if (!udev)
+			return NULL;
 
-	udev = udev_new();
-	if (!udev)
-		return NULL;
+		hwdb = udev_hwdb_new(udev);
+	}
 
-	hwdb = udev_hwdb_new(udev);
 	if (!hwdb)
-		goto done;
+		return NULL;
+
+	sprintf(modalias, "OUI:%6.6X", oui);
 
 	head = udev_hwdb_get_properties_list_entry(hwdb, modalias, 0);
 
 	udev_list_entry_foreach(entry, head) {
 		const char *name = udev_list_entry_get_name(entry);
 
-		if (name && !strcmp(name, "ID_OUI_FROM_DATABASE")) {
-			comp = strdup(udev_list_entry_get_value(entry));
-			break;
-		}
+		if (name && !strcmp(name, "ID_OUI_FROM_DATABASE"))
+			return strdup(udev_list_entry_get_value(entry));
 	}
 
-	hwdb = udev_hwdb_unref(hwdb);
+	return NULL;
+}
 
-done:
-	udev = udev_unref(udev);
+static const char *oui_lookup(uint32_t oui)
+{
+	struct oui_entry *entry;
+	char *comp;
+
+	entry = oui_find(oui);
+	if (entry)
+		return entry->comp;
+
+	comp = hwdb_lookup(oui);
+
+	entry = oui_append(oui, comp);
+	if (!entry) {
+		free(comp);
+		return NULL;
+	}
 
-	return comp;
+	/* Keep the table sorted, new OUIs are rare after a warm up */
+	while (entry > oui_table && (entry - 1)->oui > oui) {
+		struct oui_entry tmp = *entry;
+
+		*entry = *(entry - 1);
+		*(entry - 1) = tmp;
+		entry--;
+	}
+
+	return entry->comp;
 }
 #else
-#include <stdio.h>
-#include <errno.h>
+#include <ctype.h>
 #include <fcntl.h>
+#include <stdbool.h>
 #include <unistd.h>
-#include <stdlib.h>
-#include <string.h>
 #include <sys/stat.h>
 #include <sys/mman.h>
 
@@ -81,59 +171,141 @@ done:
 #define OUIFILE "/usr/share/hwdata/oui.txt"
 #endif
 
-static char *ouitocomp(const char *oui)
+static bool oui_loaded = false;
+
+static bool parse_oui(const char *str, size_t len, uint32_t *oui)
+{
+	unsigned int i;
+
+	/* XX-XX-XX   (hex)		Company */
+	if (len < 8 || str[2] != '-' || str[5] != '-')
+		return false;
+
+	*oui = 0;
+
+	for (i = 0; i < 8; i++) {
+		if (i == 2 || i == 5)
+			continue;
+
+		if (!isxdigit((unsigned char) str[i]))
+			return false;
+
+		*oui = *oui << 4 | (isdigit((unsigned char) str[i]) ?
+					str[i] - '0' :
+					(toupper((unsigned char) str[i]) - 'A' + 10));
+	}
+
+	return true;
+}
+
+static void parse_line(const char *line, size_t len)
+{
+	const char *comp, *end = line + len;
+	char *name;
+	uint32_t oui;
+
+	/* The IEEE file indents the entries */
+	while (line < end && (*line == ' ' || *line == '\t'))
+		line++;
+
+	len = end - line;
+
+	if (!parse_oui(line, len, &oui))
+		return;
+
+	comp = memmem(line, len, "(hex)", 5);
+	if (!comp)
+		return;
+
+	for (comp += 5; comp < end && (*comp == ' ' || *comp == '\t'); comp++);
+
+	while (end > comp && (end[-1] == ' ' || end[-1] == '\r'))
+		end--;
+
+	if (end == comp)
+		return;
+
+	name = strndup(comp, end - comp);
+	if (!name)
+		return;
+
+	if (!oui_append(oui, name))
+		free(name);
+}
+
+static void load_ouifile(void)
 {
 	struct stat st;
-	char *str, *map, *off, *end;
+	char *map, *off, *end;
 	int fd;
 
+	oui_loaded = true;
+
 	fd = open(OUIFILE, O_RDONLY);
 	if (fd < 0)
-		return NULL;
+		return;
 
-	if (fstat(fd, &st) < 0) {
+	if (fstat(fd, &st) < 0 || st.st_size == 0) {
 		close(fd);
-		return NULL;
-	}
-
-	str = malloc(128);
-	if (!str) {
-		close(fd);
-		return NULL;
+		return;
 	}
 
-	memset(str, 0, 128);
-
 	map = mmap(0, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
 	if (!map || map == MAP_FAILED) {
-		free(str);
 		close(fd);
-		return NULL;
+		return;
 	}
 
-	off = strstr(map, oui);
-	if (off) {
-		off += 18;
-		end = strpbrk(off, "\r\n");
-		strncpy(str, off, end - off);
-	} else {
-		free(str);
-		str = NULL;
+	for (off = map; off < map + st.st_size; off = end + 1) {
+		end = memchr(off, '\n', map + st.st_size - off);
+		if (!end)
+			end = map + st.st_size;
+
+		parse_line(off, end - off);
 	}
 
 	munmap(map, st.st_size);
 
 	close(fd);
 
-	return str;
+	qsort(oui_table, oui_count, sizeof(*oui_table), oui_cmp);
 }
 
-char *batocomp(const bdaddr_t *ba)
+static const char *oui_lookup(uint32_t oui)
 {
-	char oui[9];
+	struct oui_entry *entry;
 
-	sprintf(oui, "%2.2X-%2.2X-%2.2X", ba->b[5], ba->b[4], ba->b[3]);
+	if (!oui_loaded)
+		load_ouifile();
 
-	return ouitocomp(oui);
+	entry = oui_find(oui);
+	if (!entry)
+		return NULL;
+
+	return entry->comp;
 }
 #endif
+
+char *batocomp(const bdaddr_t *ba)
+{
+	const char *comp;
+
+	comp = oui_lookup(batooui(ba));
+	if (!comp)
+		return NULL;
+
+	return strdup(comp);
+}
+
+int batocomp_list(const bdaddr_t *ba, int num, char **comp)
+{
+	int i, found = 0;
+
+	for (i = 0; i < num; i++) {
+		comp[i] = batocomp(&ba[i]);
+		if (comp[i])
+			found++;
+	}
+
+	return found;
+}
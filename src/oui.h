@@ -24,3 +24,4 @@
 #include <bluetooth/bluetooth.h>
 
 char *batocomp(const bdaddr_t *ba);
+int batocomp_list(const bdaddr_t *ba, int num, char **comp);
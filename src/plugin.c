@@ -40,6 +40,9 @@
 #include "hcid.h"
 
 static GSList *plugins = NULL;
+static GSList *pending = NULL;
+static guint init_id = 0;
+static void (*ready_cb) (void) = NULL;
 
 struct bluetooth_plugin {
 	void *handle;
@@ -112,9 +115,42 @@ static gboolean enable_plugin(const char *name, char **cli_enable,
 
 #include "builtin.h"
 
-gboolean plugin_init(const char *enable, const char *disable)
+/*
+ * Plugins are initialized one per main loop iteration at idle priority,
+ * so replies to the mgmt commands sent during startup and the adapter
+ * setup they trigger are not held back until every plugin is ready.
+ */
+static gboolean init_next_plugin(gpointer user_data)
+{
+	struct bluetooth_plugin *plugin;
+
+	if (pending == NULL) {
+		init_id = 0;
+
+		if (ready_cb)
+			ready_cb();
+
+		return FALSE;
+	}
+
+	plugin = pending->data;
+	pending = g_slist_delete_link(pending, pending);
+
+	if (plugin->desc->init() < 0) {
+		error("Failed to init %s plugin", plugin->desc->name);
+		return TRUE;
+	}
+
+	plugin->active = TRUE;
+
+	btd_startup_mark("plugin", plugin->desc->name);
+
+	return TRUE;
+}
+
+gboolean plugin_init(const char *enable, const char *disable,
+						void (*ready) (void))
 {
-	GSList *list;
 	GDir *dir;
 	const char *file;
 	char **cli_disabled, **cli_enabled;
@@ -193,16 +229,10 @@ gboolean plugin_init(const char *enable, const char *disable)
 	g_dir_close(dir);
 
 start:
-	for (list = plugins; list; list = list->next) {
-		struct bluetooth_plugin *plugin = list->data;
+	pending = g_slist_copy(plugins);
+	ready_cb = ready;
 
-		if (plugin->desc->init() < 0) {
-			error("Failed to init %s plugin", plugin->desc->name);
-			continue;
-		}
-
-		plugin->active = TRUE;
-	}
+	init_id = g_idle_add(init_next_plugin, NULL);
 
 	g_strfreev(cli_enabled);
 	g_strfreev(cli_disabled);
@@ -216,6 +246,14 @@ void plugin_cleanup(void)
 
 	DBG("Cleanup plugins");
 
+	if (init_id > 0) {
+		g_source_remove(init_id);
+		init_id = 0;
+	}
+
+	g_slist_free(pending);
+	pending = NULL;
+
 	for (list = plugins; list; list = list->next) {
 		struct bluetooth_plugin *plugin = list->data;
 
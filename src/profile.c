@@ -68,480 +68,6 @@
 #define BTD_PROFILE_PSM_AUTO	-1
 #define BTD_PROFILE_CHAN_AUTO	-1
 
-#define HFP_HF_RECORD							\
-	"<?xml version=\"1.0\" encoding=\"UTF-8\" ?>			\
-	<record>							\
-		<attribute id=\"0x0001\">				\
-			<sequence>					\
-				<uuid value=\"0x111e\" />		\
-				<uuid value=\"0x1203\" />		\
-			</sequence>					\
-		</attribute>						\
-		<attribute id=\"0x0004\">				\
-			<sequence>					\
-				<sequence>				\
-					<uuid value=\"0x0100\" />	\
-				</sequence>				\
-				<sequence>				\
-					<uuid value=\"0x0003\" />	\
-					<uint8 value=\"0x%02x\" />	\
-				</sequence>				\
-			</sequence>					\
-		</attribute>						\
-		<attribute id=\"0x0005\">				\
-			<sequence>					\
-				<uuid value=\"0x1002\" />		\
-			</sequence>					\
-		</attribute>						\
-		<attribute id=\"0x0009\">				\
-			<sequence>					\
-				<sequence>				\
-					<uuid value=\"0x111e\" />	\
-					<uint16 value=\"0x%04x\" />	\
-				</sequence>				\
-			</sequence>					\
-		</attribute>						\
-		<attribute id=\"0x0100\">				\
-			<text value=\"%s\" />				\
-		</attribute>						\
-		<attribute id=\"0x0311\">				\
-			<uint16 value=\"0x%04x\" />			\
-		</attribute>						\
-	</record>"
-
-#define HFP_AG_RECORD							\
-	"<?xml version=\"1.0\" encoding=\"UTF-8\" ?>			\
-	<record>							\
-		<attribute id=\"0x0001\">				\
-			<sequence>					\
-				<uuid value=\"0x111f\" />		\
-				<uuid value=\"0x1203\" />		\
-			</sequence>					\
-		</attribute>						\
-		<attribute id=\"0x0004\">				\
-			<sequence>					\
-				<sequence>				\
-					<uuid value=\"0x0100\" />	\
-				</sequence>				\
-				<sequence>				\
-					<uuid value=\"0x0003\" />	\
-					<uint8 value=\"0x%02x\" />	\
-				</sequence>				\
-			</sequence>					\
-		</attribute>						\
-		<attribute id=\"0x0005\">				\
-			<sequence>					\
-				<uuid value=\"0x1002\" />		\
-			</sequence>					\
-		</attribute>						\
-		<attribute id=\"0x0009\">				\
-			<sequence>					\
-				<sequence>				\
-					<uuid value=\"0x111e\" />	\
-					<uint16 value=\"0x%04x\" />	\
-				</sequence>				\
-			</sequence>					\
-		</attribute>						\
-		<attribute id=\"0x0100\">				\
-			<text value=\"%s\" />				\
-		</attribute>						\
-		<attribute id=\"0x0311\">				\
-			<uint16 value=\"0x%04x\" />			\
-		</attribute>						\
-		<attribute id=\"0x0301\" >				\
-			<uint8 value=\"0x01\" />			\
-		</attribute>						\
-	</record>"
-
-#define SPP_RECORD							\
-	"<?xml version=\"1.0\" encoding=\"UTF-8\" ?>			\
-	<record>							\
-		<attribute id=\"0x0001\">				\
-			<sequence>					\
-				<uuid value=\"0x1101\" />		\
-				%s					\
-			</sequence>					\
-		</attribute>						\
-		<attribute id=\"0x0004\">				\
-			<sequence>					\
-				<sequence>				\
-					<uuid value=\"0x0100\" />	\
-				</sequence>				\
-				<sequence>				\
-					<uuid value=\"0x0003\" />	\
-					<uint8 value=\"0x%02x\" />	\
-				</sequence>				\
-			</sequence>					\
-		</attribute>						\
-		<attribute id=\"0x0005\">				\
-			<sequence>					\
-				<uuid value=\"0x1002\" />		\
-			</sequence>					\
-		</attribute>						\
-		<attribute id=\"0x0009\">				\
-			<sequence>					\
-				<sequence>				\
-					<uuid value=\"0x1101\" />	\
-					<uint16 value=\"0x%04x\" />	\
-				</sequence>				\
-			</sequence>					\
-		</attribute>						\
-		<attribute id=\"0x0100\">				\
-			<text value=\"%s\" />				\
-		</attribute>						\
-	</record>"
-
-#define DUN_RECORD							\
-	"<?xml version=\"1.0\" encoding=\"UTF-8\" ?>			\
-	<record>							\
-		<attribute id=\"0x0001\">				\
-			<sequence>					\
-				<uuid value=\"0x1103\" />		\
-				<uuid value=\"0x1201\" />		\
-			</sequence>					\
-		</attribute>						\
-		<attribute id=\"0x0004\">				\
-			<sequence>					\
-				<sequence>				\
-					<uuid value=\"0x0100\" />	\
-				</sequence>				\
-				<sequence>				\
-					<uuid value=\"0x0003\" />	\
-					<uint8 value=\"0x%02x\" />	\
-				</sequence>				\
-			</sequence>					\
-		</attribute>						\
-		<attribute id=\"0x0005\">				\
-			<sequence>					\
-				<uuid value=\"0x1002\" />		\
-			</sequence>					\
-		</attribute>						\
-		<attribute id=\"0x0009\">				\
-			<sequence>					\
-				<sequence>				\
-					<uuid value=\"0x1103\" />	\
-					<uint16 value=\"0x%04x\" />	\
-				</sequence>				\
-			</sequence>					\
-		</attribute>						\
-		<attribute id=\"0x0100\">				\
-			<text value=\"%s\" />				\
-		</attribute>						\
-	</record>"
-
-#define OPP_RECORD							\
-	"<?xml version=\"1.0\" encoding=\"UTF-8\" ?>			\
-	<record>							\
-		<attribute id=\"0x0001\">				\
-			<sequence>					\
-				<uuid value=\"0x1105\" />		\
-			</sequence>					\
-		</attribute>						\
-		<attribute id=\"0x0004\">				\
-			<sequence>					\
-				<sequence>				\
-					<uuid value=\"0x0100\" />	\
-				</sequence>				\
-				<sequence>				\
-					<uuid value=\"0x0003\" />	\
-					<uint8 value=\"0x%02x\" />	\
-				</sequence>				\
-				<sequence>				\
-					<uuid value=\"0x0008\"/>	\
-				</sequence>				\
-			</sequence>					\
-		</attribute>						\
-		<attribute id=\"0x0005\">				\
-			<sequence>					\
-				<uuid value=\"0x1002\" />		\
-			</sequence>					\
-		</attribute>						\
-		<attribute id=\"0x0009\">				\
-			<sequence>					\
-				<sequence>				\
-					<uuid value=\"0x1105\" />	\
-					<uint16 value=\"0x%04x\" />	\
-				</sequence>				\
-			</sequence>					\
-		</attribute>						\
-		<attribute id=\"0x0303\">				\
-			<sequence>					\
-				<uint8 value=\"0x01\"/>			\
-				<uint8 value=\"0x02\"/>			\
-				<uint8 value=\"0x03\"/>			\
-				<uint8 value=\"0x04\"/>			\
-				<uint8 value=\"0x05\"/>			\
-				<uint8 value=\"0x06\"/>			\
-				<uint8 value=\"0xff\"/>			\
-			</sequence>					\
-		</attribute>						\
-		<attribute id=\"0x0200\">				\
-			<uint16 value=\"%u\" name=\"psm\"/>		\
-		</attribute>						\
-		<attribute id=\"0x0100\">				\
-			<text value=\"%s\" />				\
-		</attribute>						\
-	</record>"
-
-#define FTP_RECORD							\
-	"<?xml version=\"1.0\" encoding=\"UTF-8\" ?>			\
-	<record>							\
-		<attribute id=\"0x0001\">				\
-			<sequence>					\
-				<uuid value=\"0x1106\" />		\
-			</sequence>					\
-		</attribute>						\
-		<attribute id=\"0x0004\">				\
-			<sequence>					\
-				<sequence>				\
-					<uuid value=\"0x0100\" />	\
-				</sequence>				\
-				<sequence>				\
-					<uuid value=\"0x0003\" />	\
-					<uint8 value=\"0x%02x\" />	\
-				</sequence>				\
-				<sequence>				\
-					<uuid value=\"0x0008\"/>	\
-				</sequence>				\
-			</sequence>					\
-		</attribute>						\
-		<attribute id=\"0x0005\">				\
-			<sequence>					\
-				<uuid value=\"0x1002\" />		\
-			</sequence>					\
-		</attribute>						\
-		<attribute id=\"0x0009\">				\
-			<sequence>					\
-				<sequence>				\
-					<uuid value=\"0x1106\" />	\
-					<uint16 value=\"0x%04x\" />	\
-				</sequence>				\
-			</sequence>					\
-		</attribute>						\
-		<attribute id=\"0x0200\">				\
-			<uint16 value=\"%u\" name=\"psm\"/>		\
-		</attribute>						\
-		<attribute id=\"0x0100\">				\
-			<text value=\"%s\" />				\
-		</attribute>						\
-	</record>"
-
-#define PCE_RECORD							\
-	"<?xml version=\"1.0\" encoding=\"UTF-8\" ?>			\
-	<record>							\
-		<attribute id=\"0x0001\">				\
-			<sequence>					\
-				<uuid value=\"0x112e\" />		\
-			</sequence>					\
-		</attribute>						\
-		<attribute id=\"0x0005\">				\
-			<sequence>					\
-				<uuid value=\"0x1002\" />		\
-			</sequence>					\
-		</attribute>						\
-		<attribute id=\"0x0009\">				\
-			<sequence>					\
-				<sequence>				\
-					<uuid value=\"0x1130\" />	\
-					<uint16 value=\"0x%04x\" />	\
-				</sequence>				\
-			</sequence>					\
-		</attribute>						\
-		<attribute id=\"0x0100\">				\
-			<text value=\"%s\" />				\
-		</attribute>						\
-	</record>"
-
-#define PSE_RECORD							\
-	"<?xml version=\"1.0\" encoding=\"UTF-8\" ?>			\
-	<record>							\
-		<attribute id=\"0x0001\">				\
-			<sequence>					\
-				<uuid value=\"0x112f\" />		\
-			</sequence>					\
-		</attribute>						\
-		<attribute id=\"0x0004\">				\
-			<sequence>					\
-				<sequence>				\
-					<uuid value=\"0x0100\" />	\
-				</sequence>				\
-				<sequence>				\
-					<uuid value=\"0x0003\" />	\
-					<uint8 value=\"0x%02x\" />	\
-				</sequence>				\
-				<sequence>				\
-					<uuid value=\"0x0008\"/>	\
-				</sequence>				\
-			</sequence>					\
-		</attribute>						\
-		<attribute id=\"0x0005\">				\
-			<sequence>					\
-				<uuid value=\"0x1002\" />		\
-			</sequence>					\
-		</attribute>						\
-		<attribute id=\"0x0009\">				\
-			<sequence>					\
-				<sequence>				\
-					<uuid value=\"0x1130\" />	\
-					<uint16 value=\"0x%04x\" />	\
-				</sequence>				\
-			</sequence>					\
-		</attribute>						\
-		<attribute id=\"0x0100\">				\
-			<text value=\"%s\" />				\
-		</attribute>						\
-		<attribute id=\"0x0314\">				\
-			<uint8 value=\"0x01\"/>				\
-		</attribute>						\
-	</record>"
-
-#define MAS_RECORD							\
-	"<?xml version=\"1.0\" encoding=\"UTF-8\" ?>			\
-	<record>							\
-		<attribute id=\"0x0001\">				\
-			<sequence>					\
-				<uuid value=\"0x1132\"/>		\
-			</sequence>					\
-		</attribute>						\
-		<attribute id=\"0x0004\">				\
-			<sequence>					\
-				<sequence>				\
-					<uuid value=\"0x0100\"/>	\
-				</sequence>				\
-				<sequence>				\
-					<uuid value=\"0x0003\"/>	\
-					<uint8 value=\"0x%02x\"/>	\
-				</sequence>				\
-				<sequence>				\
-					<uuid value=\"0x0008\"/>	\
-				</sequence>				\
-			</sequence>					\
-		</attribute>						\
-		<attribute id=\"0x0009\">				\
-			<sequence>					\
-				<sequence>				\
-					<uuid value=\"0x1134\"/>	\
-					<uint16 value=\"0x%04x\" />	\
-				</sequence>				\
-			</sequence>					\
-		</attribute>						\
-		<attribute id=\"0x0100\">				\
-			<text value=\"%s\"/>				\
-		</attribute>						\
-		<attribute id=\"0x0315\">				\
-			<uint8 value=\"0x00\"/>				\
-		</attribute>						\
-		<attribute id=\"0x0316\">				\
-			<uint8 value=\"0x0F\"/>				\
-		</attribute>						\
-	</record>"
-
-#define MNS_RECORD							\
-	"<?xml version=\"1.0\" encoding=\"UTF-8\" ?>			\
-	<record>							\
-		<attribute id=\"0x0001\">				\
-			<sequence>					\
-				<uuid value=\"0x1133\"/>		\
-			</sequence>					\
-		</attribute>						\
-		<attribute id=\"0x0004\">				\
-			<sequence>					\
-				<sequence>				\
-					<uuid value=\"0x0100\"/>	\
-				</sequence>				\
-				<sequence>				\
-					<uuid value=\"0x0003\"/>	\
-					<uint8 value=\"0x%02x\"/>	\
-				</sequence>				\
-				<sequence>				\
-					<uuid value=\"0x0008\"/>	\
-				</sequence>				\
-			</sequence>					\
-		</attribute>						\
-		<attribute id=\"0x0009\">				\
-			<sequence>					\
-				<sequence>				\
-					<uuid value=\"0x1134\"/>	\
-					<uint16 value=\"0x%04x\"/>	\
-				</sequence>				\
-			</sequence>					\
-		</attribute>						\
-		<attribute id=\"0x0100\">				\
-			<text value=\"%s\"/>				\
-		</attribute>						\
-		<attribute id=\"0x0200\">				\
-			<uint16 value=\"%u\" name=\"psm\"/>		\
-		</attribute>						\
-	</record>"
-
-#define SYNC_RECORD							\
-	"<?xml version=\"1.0\" encoding=\"UTF-8\" ?>			\
-	<record>							\
-		<attribute id=\"0x0001\">				\
-			<sequence>					\
-				<uuid value=\"0x1104\"/>		\
-			</sequence>					\
-		</attribute>						\
-		<attribute id=\"0x0004\">				\
-			<sequence>					\
-				<sequence>				\
-					<uuid value=\"0x0100\"/>	\
-				</sequence>				\
-				<sequence>				\
-					<uuid value=\"0x0003\"/>	\
-					<uint8 value=\"0x%02x\"/>	\
-				</sequence>				\
-				<sequence>				\
-					<uuid value=\"0x0008\"/>	\
-				</sequence>				\
-			</sequence>					\
-		</attribute>						\
-		<attribute id=\"0x0009\">				\
-			<sequence>					\
-				<sequence>				\
-					<uuid value=\"0x1104\"/>	\
-					<uint16 value=\"0x%04x\" />	\
-				 </sequence>				\
-			</sequence>					\
-		</attribute>						\
-		<attribute id=\"0x0100\">				\
-			<text value=\"%s\"/>				\
-		</attribute>						\
-		<attribute id=\"0x0301\">				\
-			<sequence>					\
-				<uint8 value=\"0x01\"/>			\
-			</sequence>					\
-		</attribute>						\
-	</record>"
-
-#define GENERIC_RECORD							\
-	"<?xml version=\"1.0\" encoding=\"UTF-8\" ?>			\
-	<record>							\
-		<attribute id=\"0x0001\">				\
-			<sequence>					\
-				<uuid value=\"%s\" />			\
-			</sequence>					\
-		</attribute>						\
-		<attribute id=\"0x0004\">				\
-			<sequence>					\
-				<sequence>				\
-					<uuid value=\"0x0100\" />	\
-					%s				\
-				</sequence>				\
-				%s					\
-			</sequence>					\
-		</attribute>						\
-		<attribute id=\"0x0005\">				\
-			<sequence>					\
-				<uuid value=\"0x1002\" />		\
-			</sequence>					\
-		</attribute>						\
-		%s							\
-		<attribute id=\"0x0100\">				\
-			<text value=\"%s\" />				\
-		</attribute>						\
-	</record>"
-
 struct ext_io;
 
 struct ext_profile {
@@ -555,8 +81,10 @@ struct ext_profile {
 	char *role;
 
 	char *record;
-	char *(*get_record)(struct ext_profile *ext, struct ext_io *l2cap,
-							struct ext_io *rfcomm);
+	sdp_record_t *user_record;
+	sdp_record_t *(*get_record)(struct ext_profile *ext,
+						struct ext_io *l2cap,
+						struct ext_io *rfcomm);
 
 	char *remote_uuid;
 
@@ -652,6 +180,14 @@ void btd_profile_foreach(void (*func)(struct btd_profile *p, void *data),
 int btd_profile_register(struct btd_profile *profile)
 {
 	profiles = g_slist_append(profiles, profile);
+
+	/*
+	 * Plugins are initialized from the main loop, so the adapters and
+	 * their devices may already be loaded. They are probed here, and
+	 * the adapters are only made connectable once every plugin is done.
+	 */
+	adapter_foreach(adapter_add_profile, profile);
+
 	return 0;
 }
 
@@ -1194,27 +730,36 @@ static void ext_direct_connect(GIOChannel *io, GError *err, gpointer user_data)
 	ext_connect(io, err, conn);
 }
 
+static sdp_record_t *ext_get_user_record(struct ext_profile *ext)
+{
+	/*
+	 * User supplied records are parsed only once and then copied for
+	 * every adapter the profile gets registered on.
+	 */
+	if (!ext->user_record) {
+		ext->user_record = sdp_xml_parse_record(ext->record,
+							strlen(ext->record));
+		if (!ext->user_record)
+			return NULL;
+	}
+
+	return sdp_copy_record(ext->user_record);
+}
+
 static uint32_t ext_register_record(struct ext_profile *ext,
 							struct ext_io *l2cap,
 							struct ext_io *rfcomm,
 							const bdaddr_t *src)
 {
 	sdp_record_t *rec;
-	char *dyn_record = NULL;
-	const char *record = ext->record;
 
-	if (!record && ext->get_record) {
-		dyn_record = ext->get_record(ext, l2cap, rfcomm);
-		record = dyn_record;
-	}
-
-	if (!record)
+	if (ext->record)
+		rec = ext_get_user_record(ext);
+	else if (ext->get_record)
+		rec = ext->get_record(ext, l2cap, rfcomm);
+	else
 		return 0;
 
-	rec = sdp_xml_parse_record(record, strlen(record));
-
-	g_free(dyn_record);
-
 	if (!rec) {
 		error("Unable to parse record for %s", ext->name);
 		return 0;
@@ -1722,66 +1267,274 @@ static int ext_disconnect_dev(struct btd_service *service)
 	return 0;
 }
 
-static char *get_hfp_hf_record(struct ext_profile *ext, struct ext_io *l2cap,
+static sdp_record_t *record_new(const uuid_t *svc, const uuid_t *svc2,
+								bool browse)
+{
+	sdp_list_t *svclass, *root;
+	uuid_t root_uuid;
+	sdp_record_t *rec;
+
+	rec = sdp_record_alloc();
+	if (!rec)
+		return NULL;
+
+	svclass = sdp_list_append(NULL, (void *) svc);
+	if (svc2)
+		svclass = sdp_list_append(svclass, (void *) svc2);
+	sdp_set_service_classes(rec, svclass);
+	sdp_list_free(svclass, NULL);
+
+	if (browse) {
+		sdp_uuid16_create(&root_uuid, PUBLIC_BROWSE_GROUP);
+		root = sdp_list_append(NULL, &root_uuid);
+		sdp_set_browse_groups(rec, root);
+		sdp_list_free(root, NULL);
+	}
+
+	return rec;
+}
+
+static sdp_record_t *record_new16(uint16_t svc, uint16_t svc2, bool browse)
+{
+	uuid_t uuid, uuid2;
+
+	sdp_uuid16_create(&uuid, svc);
+	if (svc2)
+		sdp_uuid16_create(&uuid2, svc2);
+
+	return record_new(&uuid, svc2 ? &uuid2 : NULL, browse);
+}
+
+/* Adds L2CAP, optionally followed by RFCOMM and OBEX, as protocol stack */
+static void record_add_protos(sdp_record_t *rec, const uint16_t *psm,
+					const uint8_t *chan, bool obex)
+{
+	sdp_list_t *l2cap, *rfcomm = NULL, *goep = NULL, *apseq, *aproto;
+	uuid_t l2cap_uuid, rfcomm_uuid, obex_uuid;
+	sdp_data_t *psm_data = NULL, *chan_data = NULL;
+
+	sdp_uuid16_create(&l2cap_uuid, L2CAP_UUID);
+	l2cap = sdp_list_append(NULL, &l2cap_uuid);
+	if (psm) {
+		psm_data = sdp_data_alloc(SDP_UINT16, psm);
+		l2cap = sdp_list_append(l2cap, psm_data);
+	}
+	apseq = sdp_list_append(NULL, l2cap);
+
+	if (chan) {
+		sdp_uuid16_create(&rfcomm_uuid, RFCOMM_UUID);
+		rfcomm = sdp_list_append(NULL, &rfcomm_uuid);
+		chan_data = sdp_data_alloc(SDP_UINT8, chan);
+		rfcomm = sdp_list_append(rfcomm, chan_data);
+		apseq = sdp_list_append(apseq, rfcomm);
+	}
+
+	if (obex) {
+		sdp_uuid16_create(&obex_uuid, OBEX_UUID);
+		goep = sdp_list_append(NULL, &obex_uuid);
+		apseq = sdp_list_append(apseq, goep);
+	}
+
+	aproto = sdp_list_append(NULL, apseq);
+	sdp_set_access_protos(rec, aproto);
+
+	free(psm_data);
+	free(chan_data);
+	sdp_list_free(l2cap, NULL);
+	sdp_list_free(rfcomm, NULL);
+	sdp_list_free(goep, NULL);
+	sdp_list_free(apseq, NULL);
+	sdp_list_free(aproto, NULL);
+}
+
+static void record_add_profile(sdp_record_t *rec, const uuid_t *uuid,
+							uint16_t version)
+{
+	sdp_profile_desc_t profile;
+	sdp_list_t *pfseq;
+
+	profile.uuid = *uuid;
+	profile.version = version;
+
+	pfseq = sdp_list_append(NULL, &profile);
+	sdp_set_profile_descs(rec, pfseq);
+	sdp_list_free(pfseq, NULL);
+}
+
+static void record_add_profile16(sdp_record_t *rec, uint16_t profile,
+							uint16_t version)
+{
+	uuid_t uuid;
+
+	sdp_uuid16_create(&uuid, profile);
+	record_add_profile(rec, &uuid, version);
+}
+
+static void record_add_uint8_seq(sdp_record_t *rec, uint16_t attr,
+					const uint8_t *values, int len)
+{
+	uint8_t dtd = SDP_UINT8;
+	void **dtds, **vals;
+	int i;
+
+	dtds = g_new0(void *, len);
+	vals = g_new0(void *, len);
+
+	for (i = 0; i < len; i++) {
+		dtds[i] = &dtd;
+		vals[i] = (void *) &values[i];
+	}
+
+	sdp_attr_add(rec, attr, sdp_seq_alloc(dtds, vals, len));
+
+	g_free(dtds);
+	g_free(vals);
+}
+
+static sdp_record_t *get_hfp_record(struct ext_profile *ext,
+					struct ext_io *rfcomm, uint16_t svc)
+{
+	sdp_record_t *rec;
+
+	rec = record_new16(svc, GENERIC_AUDIO_SVCLASS_ID, true);
+	if (!rec)
+		return NULL;
+
+	record_add_protos(rec, NULL, &rfcomm->chan, false);
+	record_add_profile16(rec, HANDSFREE_SVCLASS_ID, ext->version);
+	sdp_set_info_attr(rec, ext->name, NULL, NULL);
+	sdp_attr_add_new(rec, SDP_ATTR_SUPPORTED_FEATURES, SDP_UINT16,
+							&ext->features);
+
+	return rec;
+}
+
+static sdp_record_t *get_hfp_hf_record(struct ext_profile *ext,
+							struct ext_io *l2cap,
 							struct ext_io *rfcomm)
 {
-	return g_strdup_printf(HFP_HF_RECORD, rfcomm->chan, ext->version,
-						ext->name, ext->features);
+	return get_hfp_record(ext, rfcomm, HANDSFREE_SVCLASS_ID);
 }
 
-static char *get_hfp_ag_record(struct ext_profile *ext, struct ext_io *l2cap,
+static sdp_record_t *get_hfp_ag_record(struct ext_profile *ext,
+							struct ext_io *l2cap,
 							struct ext_io *rfcomm)
 {
-	return g_strdup_printf(HFP_AG_RECORD, rfcomm->chan, ext->version,
-						ext->name, ext->features);
+	sdp_record_t *rec;
+	uint8_t network = 0x01;
+
+	rec = get_hfp_record(ext, rfcomm, HANDSFREE_AGW_SVCLASS_ID);
+	if (!rec)
+		return NULL;
+
+	sdp_attr_add_new(rec, SDP_ATTR_EXTERNAL_NETWORK, SDP_UINT8, &network);
+
+	return rec;
 }
 
-static char *get_spp_record(struct ext_profile *ext, struct ext_io *l2cap,
+static sdp_record_t *get_spp_record(struct ext_profile *ext,
+							struct ext_io *l2cap,
 							struct ext_io *rfcomm)
 {
-	char *svc, *rec;
+	uuid_t uuid, svc;
+	sdp_record_t *rec;
+
+	sdp_uuid16_create(&uuid, SERIAL_PORT_SVCLASS_ID);
 
 	if (ext->service)
-		svc = g_strdup_printf("<uuid value=\"%s\" />", ext->service);
-	else
-		svc = g_strdup("");
+		bt_string2uuid(&svc, ext->service);
+
+	rec = record_new(&uuid, ext->service ? &svc : NULL, true);
+	if (!rec)
+		return NULL;
+
+	record_add_protos(rec, NULL, &rfcomm->chan, false);
+	record_add_profile(rec, &uuid, ext->version);
+	sdp_set_info_attr(rec, ext->name, NULL, NULL);
 
-	rec = g_strdup_printf(SPP_RECORD, svc, rfcomm->chan, ext->version,
-								ext->name);
-	g_free(svc);
 	return rec;
 }
 
-static char *get_dun_record(struct ext_profile *ext, struct ext_io *l2cap,
+static sdp_record_t *get_dun_record(struct ext_profile *ext,
+							struct ext_io *l2cap,
 							struct ext_io *rfcomm)
 {
-	return g_strdup_printf(DUN_RECORD, rfcomm->chan, ext->version,
-								ext->name);
+	sdp_record_t *rec;
+
+	rec = record_new16(DIALUP_NET_SVCLASS_ID,
+					GENERIC_NETWORKING_SVCLASS_ID, true);
+	if (!rec)
+		return NULL;
+
+	record_add_protos(rec, NULL, &rfcomm->chan, false);
+	record_add_profile16(rec, DIALUP_NET_SVCLASS_ID, ext->version);
+	sdp_set_info_attr(rec, ext->name, NULL, NULL);
+
+	return rec;
 }
 
-static char *get_pce_record(struct ext_profile *ext, struct ext_io *l2cap,
+static sdp_record_t *get_pce_record(struct ext_profile *ext,
+							struct ext_io *l2cap,
 							struct ext_io *rfcomm)
 {
-	return g_strdup_printf(PCE_RECORD, ext->version, ext->name);
+	sdp_record_t *rec;
+
+	rec = record_new16(PBAP_PCE_SVCLASS_ID, 0, true);
+	if (!rec)
+		return NULL;
+
+	record_add_profile16(rec, PBAP_SVCLASS_ID, ext->version);
+	sdp_set_info_attr(rec, ext->name, NULL, NULL);
+
+	return rec;
 }
 
-static char *get_pse_record(struct ext_profile *ext, struct ext_io *l2cap,
+static sdp_record_t *get_pse_record(struct ext_profile *ext,
+							struct ext_io *l2cap,
 							struct ext_io *rfcomm)
 {
-	return g_strdup_printf(PSE_RECORD, rfcomm->chan, ext->version,
-								ext->name);
+	sdp_record_t *rec;
+	uint8_t repositories = 0x01;
+
+	rec = record_new16(PBAP_PSE_SVCLASS_ID, 0, true);
+	if (!rec)
+		return NULL;
+
+	record_add_protos(rec, NULL, &rfcomm->chan, true);
+	record_add_profile16(rec, PBAP_SVCLASS_ID, ext->version);
+	sdp_set_info_attr(rec, ext->name, NULL, NULL);
+	sdp_attr_add_new(rec, SDP_ATTR_SUPPORTED_REPOSITORIES, SDP_UINT8,
+								&repositories);
+
+	return rec;
 }
 
-static char *get_mas_record(struct ext_profile *ext, struct ext_io *l2cap,
+static sdp_record_t *get_mas_record(struct ext_profile *ext,
+							struct ext_io *l2cap,
 							struct ext_io *rfcomm)
 {
-	return g_strdup_printf(MAS_RECORD, rfcomm->chan, ext->version,
-								ext->name);
+	sdp_record_t *rec;
+	uint8_t instance = 0x00, types = 0x0f;
+
+	rec = record_new16(MAP_MSE_SVCLASS_ID, 0, false);
+	if (!rec)
+		return NULL;
+
+	record_add_protos(rec, NULL, &rfcomm->chan, true);
+	record_add_profile16(rec, MAP_SVCLASS_ID, ext->version);
+	sdp_set_info_attr(rec, ext->name, NULL, NULL);
+	sdp_attr_add_new(rec, SDP_ATTR_MAS_INSTANCE_ID, SDP_UINT8, &instance);
+	sdp_attr_add_new(rec, SDP_ATTR_SUPPORTED_MESSAGE_TYPES, SDP_UINT8,
+									&types);
+
+	return rec;
 }
 
-static char *get_mns_record(struct ext_profile *ext, struct ext_io *l2cap,
+static sdp_record_t *get_mns_record(struct ext_profile *ext,
+							struct ext_io *l2cap,
 							struct ext_io *rfcomm)
 {
+	sdp_record_t *rec;
 	uint16_t psm = 0;
 	uint8_t chan = 0;
 
@@ -1790,19 +1543,43 @@ static char *get_mns_record(struct ext_profile *ext, struct ext_io *l2cap,
 	if (rfcomm)
 		chan = rfcomm->chan;
 
-	return g_strdup_printf(MNS_RECORD, chan, ext->version, ext->name, psm);
+	rec = record_new16(MAP_MCE_SVCLASS_ID, 0, false);
+	if (!rec)
+		return NULL;
+
+	record_add_protos(rec, NULL, &chan, true);
+	record_add_profile16(rec, MAP_SVCLASS_ID, ext->version);
+	sdp_set_info_attr(rec, ext->name, NULL, NULL);
+	sdp_attr_add_new(rec, SDP_ATTR_GOEP_L2CAP_PSM, SDP_UINT16, &psm);
+
+	return rec;
 }
 
-static char *get_sync_record(struct ext_profile *ext, struct ext_io *l2cap,
+static sdp_record_t *get_sync_record(struct ext_profile *ext,
+							struct ext_io *l2cap,
 							struct ext_io *rfcomm)
 {
-	return g_strdup_printf(SYNC_RECORD, rfcomm->chan, ext->version,
-								ext->name);
+	static const uint8_t stores[] = { 0x01 };
+	sdp_record_t *rec;
+
+	rec = record_new16(IRMC_SYNC_SVCLASS_ID, 0, false);
+	if (!rec)
+		return NULL;
+
+	record_add_protos(rec, NULL, &rfcomm->chan, true);
+	record_add_profile16(rec, IRMC_SYNC_SVCLASS_ID, ext->version);
+	sdp_set_info_attr(rec, ext->name, NULL, NULL);
+	record_add_uint8_seq(rec, SDP_ATTR_SUPPORTED_DATA_STORES_LIST,
+					stores, G_N_ELEMENTS(stores));
+
+	return rec;
 }
 
-static char *get_opp_record(struct ext_profile *ext, struct ext_io *l2cap,
-							struct ext_io *rfcomm)
+static sdp_record_t *get_obex_record(struct ext_profile *ext,
+					struct ext_io *l2cap,
+					struct ext_io *rfcomm, uint16_t svc)
 {
+	sdp_record_t *rec;
 	uint16_t psm = 0;
 	uint8_t chan = 0;
 
@@ -1811,77 +1588,68 @@ static char *get_opp_record(struct ext_profile *ext, struct ext_io *l2cap,
 	if (rfcomm)
 		chan = rfcomm->chan;
 
-	return g_strdup_printf(OPP_RECORD, chan, ext->version, psm, ext->name);
+	rec = record_new16(svc, 0, true);
+	if (!rec)
+		return NULL;
+
+	record_add_protos(rec, NULL, &chan, true);
+	record_add_profile16(rec, svc, ext->version);
+	sdp_set_info_attr(rec, ext->name, NULL, NULL);
+	sdp_attr_add_new(rec, SDP_ATTR_GOEP_L2CAP_PSM, SDP_UINT16, &psm);
+
+	return rec;
 }
 
-static char *get_ftp_record(struct ext_profile *ext, struct ext_io *l2cap,
+static sdp_record_t *get_opp_record(struct ext_profile *ext,
+							struct ext_io *l2cap,
 							struct ext_io *rfcomm)
 {
-	uint16_t psm = 0;
-	uint8_t chan = 0;
+	static const uint8_t formats[] = { 0x01, 0x02, 0x03, 0x04, 0x05,
+								0x06, 0xff };
+	sdp_record_t *rec;
 
-	if (l2cap)
-		psm = l2cap->psm;
-	if (rfcomm)
-		chan = rfcomm->chan;
+	rec = get_obex_record(ext, l2cap, rfcomm, OBEX_OBJPUSH_SVCLASS_ID);
+	if (!rec)
+		return NULL;
 
-	return g_strdup_printf(FTP_RECORD, chan, ext->version, psm, ext->name);
-}
+	record_add_uint8_seq(rec, SDP_ATTR_SUPPORTED_FORMATS_LIST, formats,
+						G_N_ELEMENTS(formats));
 
-#define RFCOMM_SEQ	"<sequence>				\
-				<uuid value=\"0x0003\" />	\
-				<uint8 value=\"0x%02x\" />	\
-			</sequence>"
+	return rec;
+}
 
-#define VERSION_ATTR							\
-		"<attribute id=\"0x0009\">				\
-			<sequence>					\
-				<sequence>				\
-					<uuid value=\"%s\" />		\
-					<uint16 value=\"0x%04x\" />	\
-				</sequence>				\
-			</sequence>					\
-		</attribute>"
+static sdp_record_t *get_ftp_record(struct ext_profile *ext,
+							struct ext_io *l2cap,
+							struct ext_io *rfcomm)
+{
+	return get_obex_record(ext, l2cap, rfcomm, OBEX_FILETRANS_SVCLASS_ID);
+}
 
-static char *get_generic_record(struct ext_profile *ext, struct ext_io *l2cap,
+static sdp_record_t *get_generic_record(struct ext_profile *ext,
+							struct ext_io *l2cap,
 							struct ext_io *rfcomm)
 {
-	char uuid_str[MAX_LEN_UUID_STR], svc_str[MAX_LEN_UUID_STR], psm[30];
-	char *rf_seq, *ver_attr, *rec;
-	uuid_t uuid;
+	sdp_record_t *rec;
+	uuid_t uuid, svc;
 
 	bt_string2uuid(&uuid, ext->uuid);
-	sdp_uuid2strn(&uuid, uuid_str, sizeof(uuid_str));
-
-	if (ext->service) {
-		bt_string2uuid(&uuid, ext->service);
-		sdp_uuid2strn(&uuid, svc_str, sizeof(svc_str));
-	} else {
-		strncpy(svc_str, uuid_str, sizeof(svc_str));
-	}
 
-	if (l2cap)
-		snprintf(psm, sizeof(psm), "<uint16 value=\"0x%04x\" />",
-								l2cap->psm);
+	if (ext->service)
+		bt_string2uuid(&svc, ext->service);
 	else
-		psm[0] = '\0';
+		svc = uuid;
 
-	if (rfcomm)
-		rf_seq = g_strdup_printf(RFCOMM_SEQ, rfcomm->chan);
-	else
-		rf_seq = g_strdup("");
+	rec = record_new(&svc, NULL, true);
+	if (!rec)
+		return NULL;
 
-	if (ext->version)
-		ver_attr = g_strdup_printf(VERSION_ATTR, uuid_str,
-								ext->version);
-	else
-		ver_attr = g_strdup("");
+	record_add_protos(rec, l2cap ? &l2cap->psm : NULL,
+					rfcomm ? &rfcomm->chan : NULL, false);
 
-	rec = g_strdup_printf(GENERIC_RECORD, svc_str, psm, rf_seq, ver_attr,
-								ext->name);
+	if (ext->version)
+		record_add_profile(rec, &uuid, ext->version);
 
-	g_free(rf_seq);
-	g_free(ver_attr);
+	sdp_set_info_attr(rec, ext->name, NULL, NULL);
 
 	return rec;
 }
@@ -1897,7 +1665,7 @@ static struct default_settings {
 	BtIOSecLevel	sec_level;
 	bool		authorize;
 	bool		auto_connect;
-	char *		(*get_record)(struct ext_profile *ext,
+	sdp_record_t *	(*get_record)(struct ext_profile *ext,
 					struct ext_io *l2cap,
 					struct ext_io *rfcomm);
 	uint16_t	version;
@@ -2284,6 +2052,9 @@ static void remove_ext(struct ext_profile *ext)
 	g_free(ext->path);
 	g_free(ext->record);
 
+	if (ext->user_record)
+		sdp_record_free(ext->user_record);
+
 	g_free(ext);
 }
 
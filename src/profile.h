@@ -25,6 +25,8 @@
 #define BTD_PROFILE_PRIORITY_MEDIUM	1
 #define BTD_PROFILE_PRIORITY_HIGH	2
 
+#define BTD_PROFILE_UUID(args...) ((const char *[]) { args, NULL })
+
 struct btd_service;
 
 struct btd_profile {
@@ -36,6 +38,9 @@ struct btd_profile {
 
 	bool auto_connect;
 
+	/* Remote UUIDs whose connection must be attempted first */
+	const char **after_services;
+
 	int (*device_probe) (struct btd_service *service);
 	void (*device_remove) (struct btd_service *service);
 
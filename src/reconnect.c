@@ -0,0 +1,397 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2013  Intel Corporation
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <glib.h>
+
+#include "reconnect.h"
+
+/*
+ * Each outcome moves the learned score a quarter of the way towards 100
+ * (success) or 0 (failure), so a few recent results outweigh old ones.
+ */
+#define SCORE_INITIAL		50
+#define SCORE_WEIGHT		4
+
+struct reconnect_entry {
+	void *key;
+	const void *group;
+	int8_t rssi;
+	unsigned int attempts;
+	uint64_t due;
+	bool active;
+	int priority;
+};
+
+struct reconnect_queue {
+	unsigned int max_active;
+	unsigned int base_delay;
+	unsigned int max_delay;
+	unsigned int max_attempts;
+	reconnect_func_t func;
+	void *user_data;
+	GRand *rand;
+	GList *entries;			/* Sorted by priority, highest first */
+	GHashTable *history;		/* key -> learned score */
+	bool running;
+};
+
+struct reconnect_queue *reconnect_queue_new(unsigned int max_active,
+						reconnect_func_t func,
+						void *user_data)
+{
+	struct reconnect_queue *queue;
+
+	queue = g_new0(struct reconnect_queue, 1);
+	queue->max_active = max_active ? max_active : 1;
+	queue->base_delay = RECONNECT_BASE_DELAY;
+	queue->max_delay = RECONNECT_MAX_DELAY;
+	queue->max_attempts = RECONNECT_MAX_ATTEMPTS;
+	queue->func = func;
+	queue->user_data = user_data;
+	queue->rand = g_rand_new();
+	queue->history = g_hash_table_new_full(NULL, NULL, NULL, g_free);
+
+	return queue;
+}
+
+void reconnect_queue_free(struct reconnect_queue *queue)
+{
+	if (queue == NULL)
+		return;
+
+	g_list_free_full(queue->entries, g_free);
+	g_hash_table_destroy(queue->history);
+	g_rand_free(queue->rand);
+	g_free(queue);
+}
+
+void reconnect_queue_set_backoff(struct reconnect_queue *queue,
+					unsigned int base_delay,
+					unsigned int max_delay,
+					unsigned int max_attempts)
+{
+	queue->base_delay = base_delay;
+	queue->max_delay = MAX(base_delay, max_delay);
+	queue->max_attempts = max_attempts;
+}
+
+void reconnect_queue_set_seed(struct reconnect_queue *queue, uint32_t seed)
+{
+	g_rand_set_seed(queue->rand, seed);
+}
+
+static int history_score(struct reconnect_queue *queue, void *key)
+{
+	int *score = g_hash_table_lookup(queue->history, key);
+
+	return score ? *score : SCORE_INITIAL;
+}
+
+static void history_update(struct reconnect_queue *queue, void *key,
+								bool success)
+{
+	int *score = g_hash_table_lookup(queue->history, key);
+
+	if (score == NULL) {
+		score = g_new(int, 1);
+		*score = SCORE_INITIAL;
+		g_hash_table_insert(queue->history, key, score);
+	}
+
+	*score += ((success ? 100 : 0) - *score) / SCORE_WEIGHT;
+}
+
+/*
+ * Devices that reconnected recently come first, stronger signal second:
+ * the learned score ranges 0-100 and RSSI adds up to 50 more.
+ */
+static int entry_priority(struct reconnect_queue *queue,
+					struct reconnect_entry *entry)
+{
+	int priority = history_score(queue, entry->key);
+
+	if (entry->rssi != 0)
+		priority += CLAMP(entry->rssi + 100, 0, 100) / 2;
+
+	return priority;
+}
+
+static int entry_cmp(gconstpointer a, gconstpointer b)
+{
+	const struct reconnect_entry *e1 = a;
+	const struct reconnect_entry *e2 = b;
+
+	if (e1->priority != e2->priority)
+		return e2->priority - e1->priority;
+
+	if (e1->due < e2->due)
+		return -1;
+
+	return e1->due > e2->due;
+}
+
+static void entry_insert(struct reconnect_queue *queue,
+					struct reconnect_entry *entry)
+{
+	entry->priority = entry_priority(queue, entry);
+	queue->entries = g_list_insert_sorted(queue->entries, entry,
+								entry_cmp);
+}
+
+static struct reconnect_entry *find_entry(struct reconnect_queue *queue,
+								void *key)
+{
+	GList *l;
+
+	for (l = queue->entries; l != NULL; l = g_list_next(l)) {
+		struct reconnect_entry *entry = l->data;
+
+		if (entry->key == key)
+			return entry;
+	}
+
+	return NULL;
+}
+
+static void entry_remove(struct reconnect_queue *queue,
+					struct reconnect_entry *entry)
+{
+	queue->entries = g_list_remove(queue->entries, entry);
+	g_free(entry);
+}
+
+/* Exponential backoff with "equal jitter": half fixed, half random */
+static unsigned int backoff_delay(struct reconnect_queue *queue,
+						unsigned int attempts)
+{
+	unsigned int delay = queue->base_delay;
+	unsigned int half;
+
+	while (attempts-- > 0 && delay < queue->max_delay)
+		delay *= 2;
+
+	delay = MIN(delay, queue->max_delay);
+	half = delay / 2;
+
+	return half + g_rand_int_range(queue->rand, 0, delay - half + 1);
+}
+
+unsigned int reconnect_queue_active(struct reconnect_queue *queue,
+							const void *group)
+{
+	unsigned int count = 0;
+	GList *l;
+
+	for (l = queue->entries; l != NULL; l = g_list_next(l)) {
+		struct reconnect_entry *entry = l->data;
+
+		if (entry->active && entry->group == group)
+			count++;
+	}
+
+	return count;
+}
+
+bool reconnect_queue_add(struct reconnect_queue *queue, void *key,
+				const void *group, int8_t rssi, uint64_t now)
+{
+	struct reconnect_entry *entry;
+
+	entry = find_entry(queue, key);
+	if (entry != NULL) {
+		entry->rssi = rssi;
+		return false;
+	}
+
+	entry = g_new0(struct reconnect_entry, 1);
+	entry->key = key;
+	entry->group = group;
+	entry->rssi = rssi;
+	entry->due = now + backoff_delay(queue, 0);
+
+	entry_insert(queue, entry);
+
+	return true;
+}
+
+static bool entry_complete(struct reconnect_queue *queue,
+					struct reconnect_entry *entry,
+					int err, uint64_t now)
+{
+	history_update(queue, entry->key, err == 0);
+
+	if (err == 0) {
+		entry_remove(queue, entry);
+		return false;
+	}
+
+	/* Failure of an attempt the queue did not start */
+	if (!entry->active)
+		return true;
+
+	entry->active = false;
+
+	if (entry->attempts >= queue->max_attempts) {
+		entry_remove(queue, entry);
+		return false;
+	}
+
+	entry->due = now + backoff_delay(queue, entry->attempts);
+
+	queue->entries = g_list_remove(queue->entries, entry);
+	entry_insert(queue, entry);
+
+	return true;
+}
+
+bool reconnect_queue_complete(struct reconnect_queue *queue, void *key,
+						int err, uint64_t now)
+{
+	struct reconnect_entry *entry;
+
+	entry = find_entry(queue, key);
+	if (entry == NULL)
+		return false;
+
+	return entry_complete(queue, entry, err, now);
+}
+
+void reconnect_queue_remove(struct reconnect_queue *queue, void *key)
+{
+	struct reconnect_entry *entry;
+
+	entry = find_entry(queue, key);
+	if (entry != NULL)
+		entry_remove(queue, entry);
+
+	g_hash_table_remove(queue->history, key);
+}
+
+bool reconnect_queue_contains(struct reconnect_queue *queue, void *key)
+{
+	return find_entry(queue, key) != NULL;
+}
+
+static struct reconnect_entry *next_due(struct reconnect_queue *queue,
+								uint64_t now)
+{
+	GList *l;
+
+	for (l = queue->entries; l != NULL; l = g_list_next(l)) {
+		struct reconnect_entry *entry = l->data;
+
+		if (entry->active || entry->due > now)
+			continue;
+
+		if (reconnect_queue_active(queue, entry->group) >=
+							queue->max_active)
+			continue;
+
+		return entry;
+	}
+
+	return NULL;
+}
+
+static int next_delay(struct reconnect_queue *queue, uint64_t now)
+{
+	uint64_t due = UINT64_MAX;
+	GList *l;
+
+	for (l = queue->entries; l != NULL; l = g_list_next(l)) {
+		struct reconnect_entry *entry = l->data;
+
+		if (entry->active)
+			continue;
+
+		/* Completion of the active attempts reschedules these */
+		if (reconnect_queue_active(queue, entry->group) >=
+							queue->max_active)
+			continue;
+
+		due = MIN(due, entry->due);
+	}
+
+	if (due == UINT64_MAX)
+		return -1;
+
+	if (due <= now)
+		return 0;
+
+	return MIN(due - now, (uint64_t) INT_MAX);
+}
+
+/*
+ * Start every candidate that is due, in priority order, without
+ * exceeding the limit of concurrent attempts per group. Returns the
+ * delay in milliseconds until the next candidate becomes due or -1 if
+ * nothing is waiting.
+ */
+int reconnect_queue_run(struct reconnect_queue *queue, uint64_t now)
+{
+	struct reconnect_entry *entry;
+
+	/* Called back from within func, the outer run takes care of it */
+	if (queue->running)
+		return -1;
+
+	queue->running = true;
+
+	while ((entry = next_due(queue, now)) != NULL) {
+		void *key = entry->key;
+		int err;
+
+		entry->active = true;
+		entry->attempts++;
+
+		err = queue->func(key, queue->user_data);
+		if (err == 0)
+			continue;
+
+		/* A synchronous failure may already have been reported */
+		entry = find_entry(queue, key);
+		if (entry != NULL && entry->active)
+			entry_complete(queue, entry, err, now);
+	}
+
+	queue->running = false;
+
+	return next_delay(queue, now);
+}
+
+unsigned int reconnect_queue_length(struct reconnect_queue *queue)
+{
+	return g_list_length(queue->entries);
+}
+
+int reconnect_queue_score(struct reconnect_queue *queue, void *key)
+{
+	return history_score(queue, key);
+}
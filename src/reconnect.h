@@ -0,0 +1,54 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2013  Intel Corporation
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#define RECONNECT_MAX_ACTIVE		1
+#define RECONNECT_BASE_DELAY		2000	/* ms */
+#define RECONNECT_MAX_DELAY		60000	/* ms */
+#define RECONNECT_MAX_ATTEMPTS		5
+
+struct reconnect_queue;
+
+typedef int (*reconnect_func_t) (void *key, void *user_data);
+
+struct reconnect_queue *reconnect_queue_new(unsigned int max_active,
+						reconnect_func_t func,
+						void *user_data);
+void reconnect_queue_free(struct reconnect_queue *queue);
+void reconnect_queue_set_backoff(struct reconnect_queue *queue,
+					unsigned int base_delay,
+					unsigned int max_delay,
+					unsigned int max_attempts);
+void reconnect_queue_set_seed(struct reconnect_queue *queue, uint32_t seed);
+
+bool reconnect_queue_add(struct reconnect_queue *queue, void *key,
+				const void *group, int8_t rssi, uint64_t now);
+bool reconnect_queue_complete(struct reconnect_queue *queue, void *key,
+						int err, uint64_t now);
+void reconnect_queue_remove(struct reconnect_queue *queue, void *key);
+bool reconnect_queue_contains(struct reconnect_queue *queue, void *key);
+int reconnect_queue_run(struct reconnect_queue *queue, uint64_t now);
+
+unsigned int reconnect_queue_length(struct reconnect_queue *queue);
+unsigned int reconnect_queue_active(struct reconnect_queue *queue,
+							const void *group);
+int reconnect_queue_score(struct reconnect_queue *queue, void *key);
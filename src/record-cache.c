@@ -0,0 +1,492 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2013  Intel Corporation
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <glib.h>
+
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/sdp.h>
+#include <bluetooth/sdp_lib.h>
+
+#include "lib/uuid.h"
+#include "attrib/att.h"
+#include "attrib/gattrib.h"
+#include "attrib/gatt.h"
+#include "log.h"
+#include "glib-helper.h"
+#include "textfile.h"
+#include "record-cache.h"
+
+/*
+ * All values are little endian. The file starts with a header followed
+ * by the entries, each one padded to a multiple of four octets so the
+ * file can be used directly from its memory mapping.
+ *
+ * SDP record entries carry the record handle, the first service class
+ * UUID for lookups and the record PDU as payload. Primary service
+ * entries carry the start and end group handles and the service UUID
+ * and no payload. The CRC covers the entry up to the CRC field plus the
+ * payload, it is only checked when an entry is actually used.
+ */
+
+#define CACHE_MAGIC		"BZAC"
+#define CACHE_VERSION		1
+
+#define CACHE_SDP_RECORD	0x01
+#define CACHE_PRIMARY		0x02
+
+#define PADDED(len)		(((len) + 3) & ~3)
+
+struct cache_header {
+	uint8_t magic[4];
+	uint8_t version;
+	uint8_t reserved[3];
+	uint32_t count;
+} __attribute__ ((packed));
+
+struct cache_entry {
+	uint8_t type;
+	uint8_t reserved;
+	uint16_t end;
+	uint32_t handle;
+	uint8_t uuid[16];
+	uint32_t length;
+	uint32_t crc;
+} __attribute__ ((packed));
+
+struct record_cache {
+	uint8_t *map;
+	size_t size;
+	const struct cache_entry **entries;
+	unsigned int count;
+};
+
+static uint32_t crc32_update(uint32_t crc, const uint8_t *data, size_t len)
+{
+	size_t i;
+	int bit;
+
+	crc = ~crc;
+
+	for (i = 0; i < len; i++) {
+		crc ^= data[i];
+
+		for (bit = 0; bit < 8; bit++)
+			crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+	}
+
+	return ~crc;
+}
+
+static uint32_t entry_crc(const struct cache_entry *e, const uint8_t *payload,
+								size_t len)
+{
+	uint32_t crc;
+
+	crc = crc32_update(0, (const uint8_t *) e,
+					offsetof(struct cache_entry, crc));
+
+	return crc32_update(crc, payload, len);
+}
+
+static const uint8_t *entry_payload(const struct cache_entry *e)
+{
+	return (const uint8_t *) e + sizeof(*e);
+}
+
+static bool entry_valid(const struct cache_entry *e)
+{
+	size_t len = bt_get_le32(&e->length);
+
+	if (entry_crc(e, entry_payload(e), len) == bt_get_le32(&e->crc))
+		return true;
+
+	error("Corrupted attribute cache entry for handle 0x%08x",
+						bt_get_le32(&e->handle));
+
+	return false;
+}
+
+static void uuid_to_bytes(const uuid_t *uuid, uint8_t *dst)
+{
+	uuid_t uuid128;
+
+	switch (uuid->type) {
+	case SDP_UUID16:
+		sdp_uuid16_to_uuid128(&uuid128, uuid);
+		break;
+	case SDP_UUID32:
+		sdp_uuid32_to_uuid128(&uuid128, uuid);
+		break;
+	case SDP_UUID128:
+		uuid128 = *uuid;
+		break;
+	default:
+		memset(dst, 0, 16);
+		return;
+	}
+
+	memcpy(dst, &uuid128.value.uuid128, 16);
+}
+
+struct record_cache *record_cache_open(const char *filename)
+{
+	struct record_cache *cache;
+	const struct cache_header *hdr;
+	struct stat st;
+	unsigned int i, count, max;
+	size_t off;
+	void *map;
+	int fd;
+
+	fd = open(filename, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+
+	if (fstat(fd, &st) < 0 || (size_t) st.st_size < sizeof(*hdr)) {
+		close(fd);
+		return NULL;
+	}
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+
+	close(fd);
+
+	if (map == MAP_FAILED)
+		return NULL;
+
+	hdr = map;
+
+	if (memcmp(hdr->magic, CACHE_MAGIC, sizeof(hdr->magic)) != 0 ||
+					hdr->version != CACHE_VERSION) {
+		error("Unsupported attribute cache %s", filename);
+		munmap(map, st.st_size);
+		return NULL;
+	}
+
+	cache = g_new0(struct record_cache, 1);
+	cache->map = map;
+	cache->size = st.st_size;
+
+	count = bt_get_le32(&hdr->count);
+	max = (cache->size - sizeof(*hdr)) / sizeof(struct cache_entry);
+	cache->entries = g_new0(const struct cache_entry *, MIN(count, max));
+
+	/* Only the layout is checked here, the checksums on first use */
+	for (i = 0, off = sizeof(*hdr); i < count; i++) {
+		const struct cache_entry *e;
+		size_t len;
+
+		if (off + sizeof(*e) > cache->size)
+			break;
+
+		e = (const struct cache_entry *) (cache->map + off);
+		len = bt_get_le32(&e->length);
+
+		if (len > cache->size - off - sizeof(*e))
+			break;
+
+		cache->entries[cache->count++] = e;
+		off += sizeof(*e) + PADDED(len);
+	}
+
+	if (i < count)
+		error("Truncated attribute cache %s", filename);
+
+	return cache;
+}
+
+void record_cache_close(struct record_cache *cache)
+{
+	if (cache == NULL)
+		return;
+
+	munmap(cache->map, cache->size);
+	g_free(cache->entries);
+	g_free(cache);
+}
+
+static sdp_record_t *extract_record(const struct cache_entry *e)
+{
+	int scanned;
+
+	if (!entry_valid(e))
+		return NULL;
+
+	return sdp_extract_pdu(entry_payload(e), bt_get_le32(&e->length),
+								&scanned);
+}
+
+sdp_record_t *record_cache_find(struct record_cache *cache,
+							const uuid_t *uuid)
+{
+	uint8_t value[16];
+	unsigned int i;
+
+	uuid_to_bytes(uuid, value);
+
+	for (i = 0; i < cache->count; i++) {
+		const struct cache_entry *e = cache->entries[i];
+		sdp_record_t *rec;
+
+		if (e->type != CACHE_SDP_RECORD)
+			continue;
+
+		if (memcmp(e->uuid, value, sizeof(value)) != 0)
+			continue;
+
+		rec = extract_record(e);
+		if (rec)
+			return rec;
+	}
+
+	return NULL;
+}
+
+sdp_record_t *record_cache_get(struct record_cache *cache, uint32_t handle)
+{
+	unsigned int i;
+
+	for (i = 0; i < cache->count; i++) {
+		const struct cache_entry *e = cache->entries[i];
+
+		if (e->type != CACHE_SDP_RECORD)
+			continue;
+
+		if (bt_get_le32(&e->handle) == handle)
+			return extract_record(e);
+	}
+
+	return NULL;
+}
+
+GSList *record_cache_get_primaries(struct record_cache *cache)
+{
+	GSList *primaries = NULL;
+	unsigned int i;
+
+	for (i = 0; i < cache->count; i++) {
+		const struct cache_entry *e = cache->entries[i];
+		struct gatt_primary *prim;
+		uint128_t value;
+		uuid_t uuid;
+		char *str;
+
+		if (e->type != CACHE_PRIMARY || !entry_valid(e))
+			continue;
+
+		memcpy(&value, e->uuid, sizeof(value));
+		sdp_uuid128_create(&uuid, &value);
+
+		str = bt_uuid2string(&uuid);
+		if (str == NULL)
+			continue;
+
+		prim = g_new0(struct gatt_primary, 1);
+		prim->range.start = bt_get_le32(&e->handle);
+		prim->range.end = bt_get_le16(&e->end);
+		g_strlcpy(prim->uuid, str, sizeof(prim->uuid));
+		g_free(str);
+
+		primaries = g_slist_append(primaries, prim);
+	}
+
+	return primaries;
+}
+
+static void append_raw(GByteArray *buf, const void *data, size_t len)
+{
+	static const uint8_t padding[3];
+
+	g_byte_array_append(buf, data, len);
+	g_byte_array_append(buf, padding, PADDED(len) - len);
+}
+
+static void append_entry(GByteArray *buf, uint8_t type, uint32_t handle,
+				uint16_t end, const uint8_t *uuid,
+				const uint8_t *payload, size_t len)
+{
+	struct cache_entry e;
+
+	memset(&e, 0, sizeof(e));
+	e.type = type;
+	bt_put_le16(end, &e.end);
+	bt_put_le32(handle, &e.handle);
+	memcpy(e.uuid, uuid, sizeof(e.uuid));
+	bt_put_le32(len, &e.length);
+	bt_put_le32(entry_crc(&e, payload, len), &e.crc);
+
+	append_raw(buf, &e, sizeof(e));
+	append_raw(buf, payload, len);
+}
+
+static bool append_record(GByteArray *buf, const sdp_record_t *rec)
+{
+	uint8_t uuid[16];
+	sdp_list_t *svcclass = NULL;
+	sdp_buf_t pdu;
+
+	if (sdp_gen_record_pdu(rec, &pdu) < 0)
+		return false;
+
+	memset(uuid, 0, sizeof(uuid));
+
+	if (sdp_get_service_classes(rec, &svcclass) == 0 && svcclass) {
+		uuid_to_bytes(svcclass->data, uuid);
+		sdp_list_free(svcclass, free);
+	}
+
+	append_entry(buf, CACHE_SDP_RECORD, rec->handle, 0, uuid, pdu.data,
+								pdu.data_size);
+
+	free(pdu.data);
+
+	return true;
+}
+
+static bool append_primary(GByteArray *buf, const struct gatt_primary *prim)
+{
+	uint8_t value[16];
+	uuid_t uuid;
+
+	if (bt_string2uuid(&uuid, prim->uuid) < 0)
+		return false;
+
+	uuid_to_bytes(&uuid, value);
+
+	append_entry(buf, CACHE_PRIMARY, prim->range.start, prim->range.end,
+							value, NULL, 0);
+
+	return true;
+}
+
+static bool has_record(sdp_list_t *records, uint32_t handle)
+{
+	for (; records; records = records->next) {
+		const sdp_record_t *rec = records->data;
+
+		if (rec->handle == handle)
+			return true;
+	}
+
+	return false;
+}
+
+static bool has_primary(GSList *primaries, uint32_t start)
+{
+	for (; primaries; primaries = primaries->next) {
+		const struct gatt_primary *prim = primaries->data;
+
+		if (prim->range.start == start)
+			return true;
+	}
+
+	return false;
+}
+
+/*
+ * Stores the given records and primary services, replacing entries with
+ * the same record or start handle. Other entries of an existing cache are
+ * copied over without being parsed. The file is written atomically.
+ */
+int record_cache_update(const char *filename, sdp_list_t *records,
+				GSList *primaries, bool replace_primaries)
+{
+	struct record_cache *cache;
+	struct cache_header hdr;
+	GByteArray *buf;
+	GError *gerr = NULL;
+	uint32_t count = 0;
+	unsigned int i;
+	sdp_list_t *l;
+	GSList *p;
+	int err = 0;
+
+	buf = g_byte_array_new();
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, CACHE_MAGIC, sizeof(hdr.magic));
+	hdr.version = CACHE_VERSION;
+	g_byte_array_append(buf, (const guint8 *) &hdr, sizeof(hdr));
+
+	cache = record_cache_open(filename);
+
+	for (i = 0; cache && i < cache->count; i++) {
+		const struct cache_entry *e = cache->entries[i];
+		uint32_t handle = bt_get_le32(&e->handle);
+		size_t len = bt_get_le32(&e->length);
+
+		if (e->type == CACHE_SDP_RECORD && has_record(records, handle))
+			continue;
+
+		if (e->type == CACHE_PRIMARY && (replace_primaries ||
+					has_primary(primaries, handle)))
+			continue;
+
+		if (!entry_valid(e))
+			continue;
+
+		append_raw(buf, e, sizeof(*e) + len);
+		count++;
+	}
+
+	record_cache_close(cache);
+
+	for (l = records; l; l = l->next) {
+		if (append_record(buf, l->data))
+			count++;
+	}
+
+	for (p = primaries; p; p = p->next) {
+		if (append_primary(buf, p->data))
+			count++;
+	}
+
+	bt_put_le32(count, buf->data + offsetof(struct cache_header, count));
+
+	create_file(filename, S_IRUSR | S_IWUSR);
+
+	if (!g_file_set_contents(filename, (const char *) buf->data, buf->len,
+								&gerr)) {
+		error("Unable to write attribute cache: %s", gerr->message);
+		g_error_free(gerr);
+		err = -EIO;
+	}
+
+	g_byte_array_free(buf, TRUE);
+
+	return err;
+}
@@ -0,0 +1,35 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2013  Intel Corporation
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+struct record_cache;
+
+struct record_cache *record_cache_open(const char *filename);
+void record_cache_close(struct record_cache *cache);
+
+sdp_record_t *record_cache_find(struct record_cache *cache,
+							const uuid_t *uuid);
+sdp_record_t *record_cache_get(struct record_cache *cache, uint32_t handle);
+GSList *record_cache_get_primaries(struct record_cache *cache);
+
+int record_cache_update(const char *filename, sdp_list_t *records,
+				GSList *primaries, bool replace_primaries);
@@ -31,12 +31,14 @@
 #include <errno.h>
 #include <stdlib.h>
 #include <limits.h>
+#include <time.h>
 
 #include <bluetooth/bluetooth.h>
 #include <bluetooth/l2cap.h>
 #include <bluetooth/sdp.h>
 #include <bluetooth/sdp_lib.h>
 
+#include "src/shared/metrics.h"
 #include "sdpd.h"
 #include "log.h"
 
@@ -957,6 +959,19 @@ done:
 	return status;
 }
 
+static struct metrics_counter *requests_total = NULL;
+static struct metrics_counter *errors_total = NULL;
+static struct metrics_histogram *request_latency = NULL;
+
+static uint64_t get_usec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
 /*
  * Top level request processor. Calls the appropriate processing
  * function based on request type. Handles service registration
@@ -969,6 +984,19 @@ static void process_request(sdp_req_t *req)
 	sdp_buf_t rsp;
 	uint8_t *buf = malloc(USHRT_MAX);
 	int status = SDP_INVALID_SYNTAX;
+	uint64_t start;
+
+	if (!requests_total) {
+		requests_total = metrics_counter_new("bluez_sdp_requests_total",
+						"SDP requests served");
+		errors_total = metrics_counter_new("bluez_sdp_errors_total",
+						"SDP requests answered with an error");
+		request_latency = metrics_histogram_new(
+						"bluez_sdp_request_latency_us",
+						"SDP request processing time");
+	}
+
+	start = get_usec();
 
 	memset(buf, 0, USHRT_MAX);
 	rsp.data = buf + sizeof(sdp_pdu_hdr_t);
@@ -1029,6 +1057,7 @@ send_rsp:
 		rsphdr->pdu_id = SDP_ERROR_RSP;
 		bt_put_be16(status, rsp.data);
 		rsp.data_size = sizeof(uint16_t);
+		metrics_counter_add(errors_total, 1);
 	}
 
 	SDPDBG("Sending rsp. status %d", status);
@@ -1046,6 +1075,9 @@ send_rsp:
 
 	SDPDBG("Bytes Sent : %d", rsp.data_size);
 
+	metrics_counter_add(requests_total, 1);
+	metrics_histogram_observe(request_latency, get_usec() - start);
+
 	free(rsp.data);
 	free(req->buf);
 }
@@ -66,6 +66,38 @@ static void destroy_command_hook(gpointer data, gpointer user_data)
 	g_free(hook);
 }
 
+struct hciemu_timeout {
+	btdev_timeout_func func;
+	void *user_data;
+};
+
+static gboolean timeout_callback(gpointer user_data)
+{
+	struct hciemu_timeout *timeout = user_data;
+
+	timeout->func(timeout->user_data);
+
+	return FALSE;
+}
+
+static int add_timeout(unsigned int msec, btdev_timeout_func func,
+					void *func_data, void *user_data)
+{
+	struct hciemu_timeout *timeout;
+
+	timeout = g_new0(struct hciemu_timeout, 1);
+	timeout->func = func;
+	timeout->user_data = func_data;
+
+	return g_timeout_add_full(G_PRIORITY_DEFAULT, msec, timeout_callback,
+							timeout, g_free);
+}
+
+static void remove_timeout(int id, void *user_data)
+{
+	g_source_remove(id);
+}
+
 static void master_command_callback(uint16_t opcode,
 				const void *data, uint8_t len,
 				btdev_callback callback, void *user_data)
@@ -202,6 +234,7 @@ static bool create_vhci(struct hciemu *hciemu)
 		return false;
 
 	btdev_set_command_handler(btdev, master_command_callback, hciemu);
+	btdev_set_timeout_handler(btdev, add_timeout, remove_timeout, NULL);
 
 	fd = open("/dev/vhci", O_RDWR | O_NONBLOCK | O_CLOEXEC);
 	if (fd < 0) {
@@ -241,6 +274,7 @@ static bool create_stack(struct hciemu *hciemu)
 	}
 
 	btdev_set_command_handler(btdev, client_command_callback, hciemu);
+	btdev_set_timeout_handler(btdev, add_timeout, remove_timeout, NULL);
 
 	if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC,
 								0, sv) < 0) {
@@ -369,6 +403,29 @@ const uint8_t *hciemu_get_client_bdaddr(struct hciemu *hciemu)
 	return btdev_get_bdaddr(hciemu->client_dev);
 }
 
+void hciemu_set_acl_buffer(struct hciemu *hciemu, uint16_t mtu,
+							uint16_t max_pkt)
+{
+	if (!hciemu)
+		return;
+
+	btdev_set_acl_buffer(hciemu->master_dev, mtu, max_pkt);
+	btdev_set_acl_buffer(hciemu->client_dev, mtu, max_pkt);
+}
+
+void hciemu_set_link_params(struct hciemu *hciemu, uint32_t bandwidth,
+					uint32_t latency, uint16_t batch)
+{
+	if (!hciemu)
+		return;
+
+	btdev_set_link_params(hciemu->master_dev, bandwidth, latency);
+	btdev_set_link_params(hciemu->client_dev, bandwidth, latency);
+
+	btdev_set_completion_batch(hciemu->master_dev, batch);
+	btdev_set_completion_batch(hciemu->client_dev, batch);
+}
+
 bool hciemu_add_master_post_command_hook(struct hciemu *hciemu,
 			hciemu_command_func_t function, void *user_data)
 {
@@ -44,6 +44,11 @@ const char *hciemu_get_address(struct hciemu *hciemu);
 const uint8_t *hciemu_get_master_bdaddr(struct hciemu *hciemu);
 const uint8_t *hciemu_get_client_bdaddr(struct hciemu *hciemu);
 
+void hciemu_set_acl_buffer(struct hciemu *hciemu, uint16_t mtu,
+							uint16_t max_pkt);
+void hciemu_set_link_params(struct hciemu *hciemu, uint32_t bandwidth,
+					uint32_t latency, uint16_t batch);
+
 typedef void (*hciemu_command_func_t)(uint16_t opcode, const void *data,
 						uint8_t len, void *user_data);
 
@@ -0,0 +1,463 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2013  Intel Corporation. All rights reserved.
+ *
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "src/shared/metrics.h"
+
+/*
+ * Histogram buckets are log-linear: every power of two range is split
+ * into HISTOGRAM_SUB linear buckets, which keeps the relative error
+ * below 25% over the whole 64-bit range with a fixed number of buckets.
+ */
+#define HISTOGRAM_SUB_BITS	2
+#define HISTOGRAM_SUB		(1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_BUCKETS	(HISTOGRAM_SUB + \
+				(64 - HISTOGRAM_SUB_BITS) * HISTOGRAM_SUB)
+
+enum metric_type {
+	METRIC_COUNTER,
+	METRIC_GAUGE,
+	METRIC_HISTOGRAM,
+};
+
+struct metric {
+	enum metric_type type;
+	char *name;
+	char *family;
+	char *labels;
+	char *help;
+};
+
+struct metrics_counter {
+	struct metric metric;
+	uint64_t value;
+};
+
+struct metrics_gauge {
+	struct metric metric;
+	uint64_t value;
+};
+
+struct metrics_histogram {
+	struct metric metric;
+	uint64_t count;
+	uint64_t sum;
+	uint64_t buckets[HISTOGRAM_BUCKETS];
+};
+
+static GSList *metrics = NULL;
+
+static inline uint64_t atomic_get(uint64_t *value)
+{
+	return __sync_fetch_and_add(value, 0);
+}
+
+static int metric_cmp(gconstpointer a, gconstpointer b)
+{
+	const struct metric *ma = a, *mb = b;
+	int cmp;
+
+	/* Samples of one family have to be adjacent in the text format */
+	cmp = strcmp(ma->family, mb->family);
+	if (cmp)
+		return cmp;
+
+	return strcmp(ma->name, mb->name);
+}
+
+static struct metric *metric_lookup(const char *name)
+{
+	GSList *l;
+
+	for (l = metrics; l; l = l->next) {
+		struct metric *metric = l->data;
+
+		if (!strcmp(metric->name, name))
+			return metric;
+	}
+
+	return NULL;
+}
+
+static void metric_init(struct metric *metric, enum metric_type type,
+					const char *name, const char *help)
+{
+	const char *labels = strchr(name, '{');
+
+	metric->type = type;
+	metric->name = g_strdup(name);
+	metric->help = g_strdup(help);
+
+	if (labels) {
+		metric->family = g_strndup(name, labels - name);
+		metric->labels = g_strndup(labels + 1,
+						strcspn(labels + 1, "}"));
+	} else {
+		metric->family = g_strdup(name);
+		metric->labels = NULL;
+	}
+
+	metrics = g_slist_insert_sorted(metrics, metric, metric_cmp);
+}
+
+static void metric_free(gpointer data)
+{
+	struct metric *metric = data;
+
+	g_free(metric->name);
+	g_free(metric->family);
+	g_free(metric->labels);
+	g_free(metric->help);
+	g_free(metric);
+}
+
+struct metrics_counter *metrics_counter_new(const char *name,
+							const char *help)
+{
+	struct metrics_counter *counter;
+	struct metric *metric;
+
+	metric = metric_lookup(name);
+	if (metric) {
+		/* The same name can't be registered with another type */
+		if (metric->type != METRIC_COUNTER)
+			return NULL;
+
+		return (struct metrics_counter *) metric;
+	}
+
+	counter = g_new0(struct metrics_counter, 1);
+	metric_init(&counter->metric, METRIC_COUNTER, name, help);
+
+	return counter;
+}
+
+void metrics_counter_add(struct metrics_counter *counter, uint64_t value)
+{
+	if (!counter)
+		return;
+
+	__sync_fetch_and_add(&counter->value, value);
+}
+
+uint64_t metrics_counter_get(struct metrics_counter *counter)
+{
+	if (!counter)
+		return 0;
+
+	return atomic_get(&counter->value);
+}
+
+struct metrics_gauge *metrics_gauge_new(const char *name, const char *help)
+{
+	struct metrics_gauge *gauge;
+	struct metric *metric;
+
+	metric = metric_lookup(name);
+	if (metric) {
+		if (metric->type != METRIC_GAUGE)
+			return NULL;
+
+		return (struct metrics_gauge *) metric;
+	}
+
+	gauge = g_new0(struct metrics_gauge, 1);
+	metric_init(&gauge->metric, METRIC_GAUGE, name, help);
+
+	return gauge;
+}
+
+void metrics_gauge_set(struct metrics_gauge *gauge, uint64_t value)
+{
+	if (!gauge)
+		return;
+
+	__sync_lock_test_and_set(&gauge->value, value);
+}
+
+void metrics_gauge_inc(struct metrics_gauge *gauge)
+{
+	if (!gauge)
+		return;
+
+	__sync_fetch_and_add(&gauge->value, 1);
+}
+
+void metrics_gauge_dec(struct metrics_gauge *gauge)
+{
+	if (!gauge)
+		return;
+
+	__sync_fetch_and_sub(&gauge->value, 1);
+}
+
+uint64_t metrics_gauge_get(struct metrics_gauge *gauge)
+{
+	if (!gauge)
+		return 0;
+
+	return atomic_get(&gauge->value);
+}
+
+static unsigned int bucket_index(uint64_t value)
+{
+	unsigned int exp;
+
+	if (value < HISTOGRAM_SUB)
+		return value;
+
+	exp = 63 - __builtin_clzll(value);
+
+	return HISTOGRAM_SUB + (exp - HISTOGRAM_SUB_BITS) * HISTOGRAM_SUB +
+			((value >> (exp - HISTOGRAM_SUB_BITS)) &
+							(HISTOGRAM_SUB - 1));
+}
+
+static uint64_t bucket_upper(unsigned int index)
+{
+	unsigned int shift, sub;
+
+	if (index < HISTOGRAM_SUB)
+		return index;
+
+	shift = (index - HISTOGRAM_SUB) / HISTOGRAM_SUB;
+	sub = (index - HISTOGRAM_SUB) % HISTOGRAM_SUB;
+
+	/* Wraps around to UINT64_MAX for the very last bucket */
+	return ((uint64_t) (HISTOGRAM_SUB + sub + 1) << shift) - 1;
+}
+
+struct metrics_histogram *metrics_histogram_new(const char *name,
+							const char *help)
+{
+	struct metrics_histogram *histogram;
+	struct metric *metric;
+
+	metric = metric_lookup(name);
+	if (metric) {
+		if (metric->type != METRIC_HISTOGRAM)
+			return NULL;
+
+		return (struct metrics_histogram *) metric;
+	}
+
+	histogram = g_new0(struct metrics_histogram, 1);
+	metric_init(&histogram->metric, METRIC_HISTOGRAM, name, help);
+
+	return histogram;
+}
+
+void metrics_histogram_observe(struct metrics_histogram *histogram,
+							uint64_t value)
+{
+	if (!histogram)
+		return;
+
+	__sync_fetch_and_add(&histogram->buckets[bucket_index(value)], 1);
+	__sync_fetch_and_add(&histogram->sum, value);
+	__sync_fetch_and_add(&histogram->count, 1);
+}
+
+uint64_t metrics_histogram_count(struct metrics_histogram *histogram)
+{
+	if (!histogram)
+		return 0;
+
+	return atomic_get(&histogram->count);
+}
+
+uint64_t metrics_histogram_sum(struct metrics_histogram *histogram)
+{
+	if (!histogram)
+		return 0;
+
+	return atomic_get(&histogram->sum);
+}
+
+uint64_t metrics_histogram_percentile(struct metrics_histogram *histogram,
+							unsigned int percent)
+{
+	uint64_t count, rank, seen = 0;
+	unsigned int i;
+
+	count = metrics_histogram_count(histogram);
+	if (!count)
+		return 0;
+
+	rank = (count * MIN(percent, 100) + 99) / 100;
+	if (!rank)
+		rank = 1;
+
+	for (i = 0; i < HISTOGRAM_BUCKETS; i++) {
+		seen += atomic_get(&histogram->buckets[i]);
+		if (seen >= rank)
+			return bucket_upper(i);
+	}
+
+	return bucket_upper(HISTOGRAM_BUCKETS - 1);
+}
+
+static void sample(const struct metric *metric, const char *suffix,
+				const char *extra, uint64_t value,
+				metrics_sample_func_t func, void *user_data)
+{
+	char *name;
+
+	if (metric->labels && extra)
+		name = g_strdup_printf("%s%s{%s,%s}", metric->family, suffix,
+							metric->labels, extra);
+	else if (metric->labels || extra)
+		name = g_strdup_printf("%s%s{%s}", metric->family, suffix,
+						metric->labels ? : extra);
+	else
+		name = g_strdup_printf("%s%s", metric->family, suffix);
+
+	func(name, value, user_data);
+
+	g_free(name);
+}
+
+static void histogram_samples(struct metrics_histogram *histogram,
+				metrics_sample_func_t func, void *user_data)
+{
+	const struct metric *metric = &histogram->metric;
+	uint64_t count, cumulative = 0;
+	unsigned int i;
+
+	count = atomic_get(&histogram->count);
+
+	/* Only buckets with observations are listed, they are cumulative */
+	for (i = 0; i < HISTOGRAM_BUCKETS; i++) {
+		uint64_t value = atomic_get(&histogram->buckets[i]);
+		char le[32];
+
+		if (!value)
+			continue;
+
+		cumulative += value;
+
+		snprintf(le, sizeof(le), "le=\"%llu\"",
+				(unsigned long long) bucket_upper(i));
+		sample(metric, "_bucket", le, cumulative, func, user_data);
+	}
+
+	sample(metric, "_bucket", "le=\"+Inf\"", MAX(count, cumulative),
+							func, user_data);
+	sample(metric, "_sum", NULL, atomic_get(&histogram->sum), func,
+								user_data);
+	sample(metric, "_count", NULL, MAX(count, cumulative), func,
+								user_data);
+}
+
+static void metric_samples(struct metric *metric, metrics_sample_func_t func,
+							void *user_data)
+{
+	switch (metric->type) {
+	case METRIC_COUNTER:
+		sample(metric, "", NULL, metrics_counter_get(
+					(struct metrics_counter *) metric),
+					func, user_data);
+		break;
+	case METRIC_GAUGE:
+		sample(metric, "", NULL, metrics_gauge_get(
+					(struct metrics_gauge *) metric),
+					func, user_data);
+		break;
+	case METRIC_HISTOGRAM:
+		histogram_samples((struct metrics_histogram *) metric, func,
+								user_data);
+		break;
+	}
+}
+
+void metrics_foreach_sample(metrics_sample_func_t func, void *user_data)
+{
+	GSList *l;
+
+	for (l = metrics; l; l = l->next)
+		metric_samples(l->data, func, user_data);
+}
+
+static void append_sample(const char *name, uint64_t value, void *user_data)
+{
+	GString *str = user_data;
+
+	g_string_append_printf(str, "%s %llu\n", name,
+						(unsigned long long) value);
+}
+
+static const char *type_to_str(enum metric_type type)
+{
+	switch (type) {
+	case METRIC_COUNTER:
+		return "counter";
+	case METRIC_GAUGE:
+		return "gauge";
+	case METRIC_HISTOGRAM:
+		return "histogram";
+	}
+
+	return "untyped";
+}
+
+char *metrics_to_text(void)
+{
+	const char *family = NULL;
+	GString *str;
+	GSList *l;
+
+	str = g_string_new(NULL);
+
+	for (l = metrics; l; l = l->next) {
+		struct metric *metric = l->data;
+
+		if (!family || strcmp(family, metric->family)) {
+			family = metric->family;
+
+			if (metric->help)
+				g_string_append_printf(str, "# HELP %s %s\n",
+							family, metric->help);
+
+			g_string_append_printf(str, "# TYPE %s %s\n", family,
+						type_to_str(metric->type));
+		}
+
+		metric_samples(metric, append_sample, str);
+	}
+
+	return g_string_free(str, FALSE);
+}
+
+void metrics_cleanup(void)
+{
+	g_slist_free_full(metrics, metric_free);
+	metrics = NULL;
+}
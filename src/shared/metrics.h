@@ -0,0 +1,63 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2013  Intel Corporation. All rights reserved.
+ *
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <stdint.h>
+
+/*
+ * Process wide registry of counters, gauges and latency histograms.
+ * Metrics are looked up by name, so creating one that already exists
+ * returns the registered instance. Updates are atomic and never
+ * allocate, so they are cheap enough for hot paths.
+ */
+
+struct metrics_counter;
+struct metrics_gauge;
+struct metrics_histogram;
+
+struct metrics_counter *metrics_counter_new(const char *name,
+							const char *help);
+void metrics_counter_add(struct metrics_counter *counter, uint64_t value);
+uint64_t metrics_counter_get(struct metrics_counter *counter);
+
+struct metrics_gauge *metrics_gauge_new(const char *name, const char *help);
+void metrics_gauge_set(struct metrics_gauge *gauge, uint64_t value);
+void metrics_gauge_inc(struct metrics_gauge *gauge);
+void metrics_gauge_dec(struct metrics_gauge *gauge);
+uint64_t metrics_gauge_get(struct metrics_gauge *gauge);
+
+struct metrics_histogram *metrics_histogram_new(const char *name,
+							const char *help);
+void metrics_histogram_observe(struct metrics_histogram *histogram,
+							uint64_t value);
+uint64_t metrics_histogram_count(struct metrics_histogram *histogram);
+uint64_t metrics_histogram_sum(struct metrics_histogram *histogram);
+uint64_t metrics_histogram_percentile(struct metrics_histogram *histogram,
+							unsigned int percent);
+
+typedef void (*metrics_sample_func_t)(const char *name, uint64_t value,
+							void *user_data);
+
+void metrics_foreach_sample(metrics_sample_func_t func, void *user_data);
+char *metrics_to_text(void);
+
+void metrics_cleanup(void);
@@ -60,6 +60,9 @@ struct mgmt {
 	mgmt_debug_func_t debug_callback;
 	mgmt_destroy_func_t debug_destroy;
 	void *debug_data;
+	mgmt_stats_func_t stats_callback;
+	mgmt_destroy_func_t stats_destroy;
+	void *stats_data;
 };
 
 struct mgmt_request {
@@ -71,6 +74,7 @@ struct mgmt_request {
 	mgmt_request_func_t callback;
 	mgmt_destroy_func_t destroy;
 	void *user_data;
+	gint64 sent;
 };
 
 struct mgmt_notify {
@@ -83,9 +87,19 @@ struct mgmt_notify {
 	void *user_data;
 };
 
+static void stats_update(struct mgmt *mgmt, enum mgmt_stats_type type,
+							uint32_t latency)
+{
+	if (mgmt->stats_callback)
+		mgmt->stats_callback(type, latency, mgmt->stats_data);
+}
+
 static void destroy_request(gpointer data, gpointer user_data)
 {
 	struct mgmt_request *request = data;
+	struct mgmt *mgmt = user_data;
+
+	stats_update(mgmt, MGMT_STATS_REQUEST_FREED, 0);
 
 	if (request->destroy)
 		request->destroy(request->user_data);
@@ -155,7 +169,7 @@ static gboolean can_write_data(GIOChannel *channel, GIOCondition cond,
 		if (request->callback)
 			request->callback(MGMT_STATUS_FAILED, 0, NULL,
 							request->user_data);
-		destroy_request(request, NULL);
+		destroy_request(request, mgmt);
 		return TRUE;
 	}
 
@@ -166,6 +180,9 @@ static gboolean can_write_data(GIOChannel *channel, GIOCondition cond,
 	util_hexdump('<', request->buf, bytes_written,
 				mgmt->debug_callback, mgmt->debug_data);
 
+	request->sent = g_get_monotonic_time();
+	stats_update(mgmt, MGMT_STATS_REQUEST_SENT, 0);
+
 	mgmt->pending_list = g_list_append(mgmt->pending_list, request);
 
 	return FALSE;
@@ -217,10 +234,13 @@ static void request_complete(struct mgmt *mgmt, uint8_t status,
 
 	mgmt->pending_list = g_list_delete_link(mgmt->pending_list, list);
 
+	stats_update(mgmt, MGMT_STATS_REQUEST_COMPLETE,
+				g_get_monotonic_time() - request->sent);
+
 	if (request->callback)
 		request->callback(status, length, param, request->user_data);
 
-	destroy_request(request, NULL);
+	destroy_request(request, mgmt);
 
 	if (mgmt->destroyed)
 		return;
@@ -333,6 +353,8 @@ static gboolean received_data(GIOChannel *channel, GIOCondition cond,
 		util_debug(mgmt->debug_callback, mgmt->debug_data,
 				"[0x%04x] event 0x%04x", index, event);
 
+		stats_update(mgmt, MGMT_STATS_EVENT, 0);
+
 		process_notify(mgmt, event, index, length,
 						mgmt->buf + MGMT_HDR_SIZE);
 		break;
@@ -451,6 +473,11 @@ void mgmt_unref(struct mgmt *mgmt)
 	if (mgmt->debug_destroy)
 		mgmt->debug_destroy(mgmt->debug_data);
 
+	if (mgmt->stats_destroy)
+		mgmt->stats_destroy(mgmt->stats_data);
+
+	mgmt->stats_callback = NULL;
+
 	g_free(mgmt->buf);
 	mgmt->buf = NULL;
 
@@ -478,6 +505,22 @@ bool mgmt_set_debug(struct mgmt *mgmt, mgmt_debug_func_t callback,
 	return true;
 }
 
+bool mgmt_set_stats(struct mgmt *mgmt, mgmt_stats_func_t callback,
+				void *user_data, mgmt_destroy_func_t destroy)
+{
+	if (!mgmt)
+		return false;
+
+	if (mgmt->stats_destroy)
+		mgmt->stats_destroy(mgmt->stats_data);
+
+	mgmt->stats_callback = callback;
+	mgmt->stats_destroy = destroy;
+	mgmt->stats_data = user_data;
+
+	return true;
+}
+
 bool mgmt_set_close_on_unref(struct mgmt *mgmt, bool do_close)
 {
 	if (!mgmt)
@@ -551,6 +594,8 @@ unsigned int mgmt_send(struct mgmt *mgmt, uint16_t opcode, uint16_t index,
 
 	request->id = mgmt->next_request_id++;
 
+	stats_update(mgmt, MGMT_STATS_REQUEST_QUEUED, 0);
+
 	g_queue_push_tail(mgmt->request_queue, request);
 
 	wakeup_writer(mgmt);
@@ -578,6 +623,8 @@ unsigned int mgmt_reply(struct mgmt *mgmt, uint16_t opcode, uint16_t index,
 
 	request->id = mgmt->next_request_id++;
 
+	stats_update(mgmt, MGMT_STATS_REQUEST_QUEUED, 0);
+
 	g_queue_push_tail(mgmt->reply_queue, request);
 
 	wakeup_writer(mgmt);
@@ -619,7 +666,7 @@ bool mgmt_cancel(struct mgmt *mgmt, unsigned int id)
 	mgmt->pending_list = g_list_delete_link(mgmt->pending_list, list);
 
 done:
-	destroy_request(request, NULL);
+	destroy_request(request, mgmt);
 
 	wakeup_writer(mgmt);
 
@@ -644,7 +691,7 @@ bool mgmt_cancel_index(struct mgmt *mgmt, uint16_t index)
 
 		g_queue_delete_link(mgmt->request_queue, list);
 
-		destroy_request(request, NULL);
+		destroy_request(request, mgmt);
 	}
 
 	for (list = g_queue_peek_head_link(mgmt->reply_queue); list;
@@ -658,7 +705,7 @@ bool mgmt_cancel_index(struct mgmt *mgmt, uint16_t index)
 
 		g_queue_delete_link(mgmt->reply_queue, list);
 
-		destroy_request(request, NULL);
+		destroy_request(request, mgmt);
 	}
 
 	for (list = g_list_first(mgmt->pending_list); list; list = next) {
@@ -672,7 +719,7 @@ bool mgmt_cancel_index(struct mgmt *mgmt, uint16_t index)
 		mgmt->pending_list = g_list_delete_link(mgmt->pending_list,
 									list);
 
-		destroy_request(request, NULL);
+		destroy_request(request, mgmt);
 	}
 
 	return true;
@@ -683,14 +730,14 @@ bool mgmt_cancel_all(struct mgmt *mgmt)
 	if (!mgmt)
 		return false;
 
-	g_list_foreach(mgmt->pending_list, destroy_request, NULL);
+	g_list_foreach(mgmt->pending_list, destroy_request, mgmt);
 	g_list_free(mgmt->pending_list);
 	mgmt->pending_list = NULL;
 
-	g_queue_foreach(mgmt->reply_queue, destroy_request, NULL);
+	g_queue_foreach(mgmt->reply_queue, destroy_request, mgmt);
 	g_queue_clear(mgmt->reply_queue);
 
-	g_queue_foreach(mgmt->request_queue, destroy_request, NULL);
+	g_queue_foreach(mgmt->request_queue, destroy_request, mgmt);
 	g_queue_clear(mgmt->request_queue);
 
 	return true;
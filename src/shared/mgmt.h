@@ -39,6 +39,21 @@ typedef void (*mgmt_debug_func_t)(const char *str, void *user_data);
 bool mgmt_set_debug(struct mgmt *mgmt, mgmt_debug_func_t callback,
 				void *user_data, mgmt_destroy_func_t destroy);
 
+enum mgmt_stats_type {
+	MGMT_STATS_REQUEST_QUEUED,
+	MGMT_STATS_REQUEST_SENT,
+	MGMT_STATS_REQUEST_COMPLETE,
+	MGMT_STATS_REQUEST_FREED,
+	MGMT_STATS_EVENT,
+};
+
+/* The latency in microseconds is only set for completed requests */
+typedef void (*mgmt_stats_func_t)(enum mgmt_stats_type type,
+					uint32_t latency, void *user_data);
+
+bool mgmt_set_stats(struct mgmt *mgmt, mgmt_stats_func_t callback,
+				void *user_data, mgmt_destroy_func_t destroy);
+
 bool mgmt_set_close_on_unref(struct mgmt *mgmt, bool do_close);
 
 typedef void (*mgmt_request_func_t)(uint8_t status, uint16_t length,
@@ -29,6 +29,7 @@
 #include <errno.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <string.h>
 #include <signal.h>
 #include <sys/signalfd.h>
 
@@ -58,6 +59,9 @@
 		printf(COLOR_HIGHLIGHT "%s" COLOR_OFF " - " \
 				color fmt COLOR_OFF "\n", name, ## args)
 
+#define print_metric(label, fmt, args...) \
+		printf("  %-43s " COLOR_CYAN fmt COLOR_OFF "\n", label, ## args)
+
 enum test_result {
 	TEST_RESULT_NOT_RUN,
 	TEST_RESULT_PASSED,
@@ -74,6 +78,22 @@ enum test_stage {
 	TEST_STAGE_POST_TEARDOWN,
 };
 
+struct test_metric {
+	char *name;
+	char *unit;
+	GArray *samples;
+};
+
+struct metric_summary {
+	unsigned int count;
+	double min;
+	double max;
+	double mean;
+	double p50;
+	double p90;
+	double p99;
+};
+
 struct test_case {
 	char *name;
 	enum test_result result;
@@ -90,6 +110,7 @@ struct test_case {
 	unsigned int timeout_id;
 	tester_destroy_func_t destroy;
 	void *user_data;
+	GList *metrics;
 };
 
 static GMainLoop *main_loop;
@@ -103,6 +124,17 @@ static gboolean option_quiet = FALSE;
 static gboolean option_debug = FALSE;
 static gboolean option_list = FALSE;
 static const char *option_prefix = NULL;
+static const char *option_results = NULL;
+
+static void metric_free(gpointer data)
+{
+	struct test_metric *metric = data;
+
+	g_array_free(metric->samples, TRUE);
+	g_free(metric->name);
+	g_free(metric->unit);
+	g_free(metric);
+}
 
 static void test_destroy(gpointer data)
 {
@@ -114,6 +146,8 @@ static void test_destroy(gpointer data)
 	if (test->destroy)
 		test->destroy(test->user_data);
 
+	g_list_free_full(test->metrics, metric_free);
+
 	g_free(test->name);
 	g_free(test);
 }
@@ -249,6 +283,200 @@ void *tester_get_data(void)
 	return test->user_data;
 }
 
+void tester_add_sample(const char *name, const char *unit, double value)
+{
+	struct test_case *test;
+	struct test_metric *metric = NULL;
+	GList *list;
+
+	if (!test_current || !name)
+		return;
+
+	test = test_current->data;
+
+	for (list = test->metrics; list; list = g_list_next(list)) {
+		struct test_metric *entry = list->data;
+
+		if (!strcmp(entry->name, name)) {
+			metric = entry;
+			break;
+		}
+	}
+
+	if (!metric) {
+		metric = g_new0(struct test_metric, 1);
+		metric->name = g_strdup(name);
+		metric->unit = g_strdup(unit ? unit : "");
+		metric->samples = g_array_new(FALSE, FALSE, sizeof(double));
+
+		test->metrics = g_list_append(test->metrics, metric);
+	}
+
+	g_array_append_val(metric->samples, value);
+}
+
+static int compare_sample(const void *a, const void *b)
+{
+	double val1 = *(const double *) a;
+	double val2 = *(const double *) b;
+
+	if (val1 < val2)
+		return -1;
+
+	if (val1 > val2)
+		return 1;
+
+	return 0;
+}
+
+static double percentile(const double *samples, unsigned int count,
+							unsigned int rank)
+{
+	unsigned int index;
+
+	/* Nearest-rank method on an already sorted set of samples */
+	index = (rank * count + 99) / 100;
+	if (index > 0)
+		index--;
+
+	return samples[index];
+}
+
+static void metric_summarize(struct test_metric *metric,
+					struct metric_summary *summary)
+{
+	double *samples, total = 0;
+	unsigned int i;
+
+	memset(summary, 0, sizeof(*summary));
+
+	summary->count = metric->samples->len;
+	if (!summary->count)
+		return;
+
+	samples = g_memdup(metric->samples->data,
+					summary->count * sizeof(double));
+
+	qsort(samples, summary->count, sizeof(double), compare_sample);
+
+	for (i = 0; i < summary->count; i++)
+		total += samples[i];
+
+	summary->min = samples[0];
+	summary->max = samples[summary->count - 1];
+	summary->mean = total / summary->count;
+	summary->p50 = percentile(samples, summary->count, 50);
+	summary->p90 = percentile(samples, summary->count, 90);
+	summary->p99 = percentile(samples, summary->count, 99);
+
+	g_free(samples);
+}
+
+static void print_metrics(struct test_case *test)
+{
+	GList *list;
+
+	for (list = test->metrics; list; list = g_list_next(list)) {
+		struct test_metric *metric = list->data;
+		struct metric_summary summary;
+
+		metric_summarize(metric, &summary);
+
+		print_metric(metric->name, "p50 %.3f p90 %.3f p99 %.3f "
+						"max %.3f %s (%u samples)",
+					summary.p50, summary.p90, summary.p99,
+					summary.max, metric->unit,
+					summary.count);
+	}
+}
+
+static const char *result_to_str(enum test_result result)
+{
+	switch (result) {
+	case TEST_RESULT_NOT_RUN:
+		return "not-run";
+	case TEST_RESULT_PASSED:
+		return "passed";
+	case TEST_RESULT_FAILED:
+		return "failed";
+	case TEST_RESULT_TIMED_OUT:
+		return "timed-out";
+	}
+
+	return "unknown";
+}
+
+static void print_json_string(FILE *fp, const char *str)
+{
+	fputc('"', fp);
+
+	for (; *str; str++) {
+		if (*str == '"' || *str == '\\')
+			fprintf(fp, "\\%c", *str);
+		else if ((unsigned char) *str < 0x20)
+			fprintf(fp, "\\u%04x", *str);
+		else
+			fputc(*str, fp);
+	}
+
+	fputc('"', fp);
+}
+
+static void tester_write_results(const char *filename)
+{
+	GList *list;
+	FILE *fp;
+
+	fp = fopen(filename, "w");
+	if (!fp) {
+		fprintf(stderr, "Failed to open %s: %s\n", filename,
+							strerror(errno));
+		return;
+	}
+
+	fprintf(fp, "{\n  \"tests\": [");
+
+	for (list = g_list_first(test_list); list; list = g_list_next(list)) {
+		struct test_case *test = list->data;
+		GList *item;
+
+		fprintf(fp, "%s\n    { \"name\": ",
+					list == g_list_first(test_list) ?
+								"" : ",");
+		print_json_string(fp, test->name);
+		fprintf(fp, ", \"result\": \"%s\", \"time\": %.6f,",
+					result_to_str(test->result),
+					test->end_time - test->start_time);
+		fprintf(fp, "\n      \"metrics\": [");
+
+		for (item = test->metrics; item; item = g_list_next(item)) {
+			struct test_metric *metric = item->data;
+			struct metric_summary summary;
+
+			metric_summarize(metric, &summary);
+
+			fprintf(fp, "%s\n        { \"name\": ",
+					item == test->metrics ? "" : ",");
+			print_json_string(fp, metric->name);
+			fprintf(fp, ", \"unit\": ");
+			print_json_string(fp, metric->unit);
+			fprintf(fp, ", \"count\": %u, \"min\": %.6f, "
+					"\"mean\": %.6f, \"p50\": %.6f, "
+					"\"p90\": %.6f, \"p99\": %.6f, "
+					"\"max\": %.6f }",
+					summary.count, summary.min,
+					summary.mean, summary.p50,
+					summary.p90, summary.p99, summary.max);
+		}
+
+		fprintf(fp, "%s] }", test->metrics ? "\n      " : "");
+	}
+
+	fprintf(fp, "\n  ]\n}\n");
+
+	fclose(fp);
+}
+
 static void tester_summarize(void)
 {
 	unsigned int not_run = 0, passed = 0, failed = 0;
@@ -274,6 +502,7 @@ static void tester_summarize(void)
 		case TEST_RESULT_PASSED:
 			print_summary(test->name, COLOR_GREEN, "Passed",
 						"%8.3f seconds", exec_time);
+			print_metrics(test);
 			passed++;
 			break;
 		case TEST_RESULT_FAILED:
@@ -733,6 +962,8 @@ static GOptionEntry options[] = {
 				"Only list the tests to be run" },
 	{ "prefix", 'p', 0, G_OPTION_ARG_STRING, &option_prefix,
 				"Run tests matching provided prefix" },
+	{ "results", 'r', 0, G_OPTION_ARG_STRING, &option_results,
+				"Write results in JSON format to file" },
 	{ NULL },
 };
 
@@ -789,6 +1020,9 @@ int tester_run(void)
 
 	tester_summarize();
 
+	if (option_results)
+		tester_write_results(option_results);
+
 	g_list_free_full(test_list, test_destroy);
 
 	return EXIT_SUCCESS;
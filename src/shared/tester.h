@@ -34,6 +34,8 @@ void tester_print(const char *format, ...)
 void tester_warn(const char *format, ...)
 				__attribute__((format(printf, 1, 2)));
 
+void tester_add_sample(const char *name, const char *unit, double value);
+
 typedef void (*tester_destroy_func_t)(void *user_data);
 typedef void (*tester_data_func_t)(const void *test_data);
 
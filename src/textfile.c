@@ -27,14 +27,12 @@
 
 #include <stdio.h>
 #include <errno.h>
-#include <ctype.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/file.h>
 #include <sys/stat.h>
-#include <sys/mman.h>
 #include <sys/param.h>
 
 #include "textfile.h"
@@ -93,199 +91,609 @@ int create_name(char *buf, size_t size, const char *path, const char *address, c
 	return snprintf(buf, size, "%s/%s/%s", path, address, name);
 }
 
-static inline char *find_key(char *map, size_t size, const char *key, size_t len, int icase)
+
+/*
+ * The contents of the last file accessed are kept in memory together
+ * with an index of its keys sorted for binary search. The index is
+ * reused for as long as the file is not changed behind our back, which
+ * is detected from its inode, size and modification times.
+ */
+struct textfile_entry {
+	const char *key;
+	size_t key_len;
+	const char *value;
+	size_t value_len;
+	size_t start;			/* Offset of the line */
+	size_t end;			/* Offset after the line terminators */
+};
+
+struct textfile_index {
+	unsigned int refs;
+	char *pathname;
+	dev_t dev;
+	ino_t ino;
+	struct timespec mtime;
+	struct timespec ctime;
+	char *data;
+	size_t size;
+	struct textfile_entry *entries;	/* In file order */
+	struct textfile_entry **sorted;	/* By key, then file order */
+	unsigned int count;
+};
+
+static struct textfile_index *cached_index = NULL;
+
+static void index_unref(struct textfile_index *index)
 {
-	char *ptr = map;
-	size_t ptrlen = size;
-
-	while (ptrlen > len + 1) {
-		int cmp = (icase) ? strncasecmp(ptr, key, len) : strncmp(ptr, key, len);
-		if (cmp == 0) {
-			if (ptr == map && *(ptr + len) == ' ')
-				return ptr;
-
-			if ((*(ptr - 1) == '\r' || *(ptr - 1) == '\n') &&
-							*(ptr + len) == ' ')
-				return ptr;
-		}
+	if (!index || --index->refs > 0)
+		return;
+
+	free(index->pathname);
+	free(index->data);
+	free(index->entries);
+	free(index->sorted);
+	free(index);
+}
 
-		if (icase) {
-			char *p1 = memchr(ptr + 1, tolower(*key), ptrlen - 1);
-			char *p2 = memchr(ptr + 1, toupper(*key), ptrlen - 1);
+static int key_cmp(const char *key1, size_t len1, const char *key2,
+								size_t len2)
+{
+	int cmp;
 
-			if (!p1)
-				ptr = p2;
-			else if (!p2)
-				ptr = p1;
-			else
-				ptr = (p1 < p2) ? p1 : p2;
-		} else
-			ptr = memchr(ptr + 1, *key, ptrlen - 1);
+	cmp = memcmp(key1, key2, len1 < len2 ? len1 : len2);
+	if (cmp != 0)
+		return cmp;
 
-		if (!ptr)
-			return NULL;
+	if (len1 != len2)
+		return len1 < len2 ? -1 : 1;
+
+	return 0;
+}
+
+static int entry_cmp(const void *a, const void *b)
+{
+	const struct textfile_entry *entry1 = *(struct textfile_entry **) a;
+	const struct textfile_entry *entry2 = *(struct textfile_entry **) b;
+	int cmp;
+
+	cmp = key_cmp(entry1->key, entry1->key_len,
+					entry2->key, entry2->key_len);
+	if (cmp != 0)
+		return cmp;
+
+	/* Duplicated keys resolve to the first one in the file */
+	return entry1 < entry2 ? -1 : 1;
+}
+
+static size_t find_eol(const char *data, size_t size, size_t pos)
+{
+	while (pos < size && data[pos] != '\r' && data[pos] != '\n')
+		pos++;
+
+	return pos;
+}
+
+/* Takes ownership of data, the index still needs to be sorted */
+static struct textfile_index *index_new(const char *pathname,
+				const struct stat *st, char *data, size_t size)
+{
+	struct textfile_index *index;
+	size_t pos, eol, max;
+
+	index = calloc(1, sizeof(*index));
+	if (!index) {
+		free(data);
+		return NULL;
+	}
+
+	index->refs = 1;
+	index->data = data;
+	index->size = size;
+
+	index->pathname = strdup(pathname);
+	if (!index->pathname)
+		goto failed;
+
+	/* A line holds at least a key, a space and a line terminator */
+	max = size / 3 + 1;
+
+	index->entries = malloc(max * sizeof(*index->entries));
+	if (!index->entries)
+		goto failed;
+
+	for (pos = 0; pos < size; ) {
+		struct textfile_entry *entry = &index->entries[index->count];
+		const char *space;
 
-		ptrlen = size - (ptr - map);
+		eol = find_eol(data, size, pos);
+
+		/* Lines without a terminator are not complete entries */
+		if (eol == size)
+			break;
+
+		space = memchr(data + pos, ' ', eol - pos);
+
+		entry->start = pos;
+
+		pos = eol;
+		while (pos < size && (data[pos] == '\r' || data[pos] == '\n'))
+			pos++;
+
+		if (!space || space == data + entry->start)
+			continue;
+
+		entry->key = data + entry->start;
+		entry->key_len = space - entry->key;
+		entry->value = space + 1;
+		entry->value_len = data + eol - entry->value;
+		entry->end = pos;
+
+		index->count++;
 	}
 
+	index->sorted = malloc((index->count + 1) * sizeof(*index->sorted));
+	if (!index->sorted)
+		goto failed;
+
+	index->dev = st->st_dev;
+	index->ino = st->st_ino;
+	index->mtime = st->st_mtim;
+	index->ctime = st->st_ctim;
+
+	return index;
+
+failed:
+	index_unref(index);
 	return NULL;
 }
 
-static inline int write_key_value(int fd, const char *key, const char *value)
+static void index_sort(struct textfile_index *index)
 {
-	char *str;
-	size_t size;
-	int err = 0;
+	unsigned int i;
 
-	size = strlen(key) + strlen(value) + 2;
+	for (i = 0; i < index->count; i++)
+		index->sorted[i] = &index->entries[i];
 
-	str = malloc(size + 1);
-	if (!str)
-		return ENOMEM;
+	qsort(index->sorted, index->count, sizeof(*index->sorted), entry_cmp);
+}
 
-	sprintf(str, "%s %s\n", key, value);
+/*
+ * Derive the order of an index after a rewrite from the index it was
+ * written from. Kept entries appear in the same relative order in both,
+ * so only the appended ones need to be sorted before merging. Returns 0
+ * if the new file does not have the expected layout.
+ */
+static int index_resort(struct textfile_index *index,
+				struct textfile_index *old, const char *removed,
+				unsigned int num_appended)
+{
+	struct textfile_entry **appended;
+	unsigned int *map;
+	unsigned int i, j, k, count;
 
-	if (write(fd, str, size) < 0)
-		err = -errno;
+	/* An unterminated last line would swallow the first appended one */
+	if (old->size > 0 && old->data[old->size - 1] != '\n' &&
+					old->data[old->size - 1] != '\r')
+		return 0;
 
-	free(str);
+	map = malloc((old->count + 1) * sizeof(*map));
+	appended = malloc((num_appended + 1) * sizeof(*appended));
+	if (!map || !appended)
+		goto failed;
 
-	return err;
+	for (i = 0, count = 0; i < old->count; i++)
+		map[i] = removed[i] ? old->count : count++;
+
+	if (count + num_appended != index->count)
+		goto failed;
+
+	for (k = 0; k < num_appended; k++)
+		appended[k] = &index->entries[count + k];
+
+	qsort(appended, num_appended, sizeof(*appended), entry_cmp);
+
+	for (i = 0, j = 0, k = 0; j < index->count; j++) {
+		struct textfile_entry *entry = NULL;
+
+		while (i < old->count &&
+				map[old->sorted[i] - old->entries] == old->count)
+			i++;
+
+		if (i < old->count)
+			entry = &index->entries[map[old->sorted[i] -
+							old->entries]];
+
+		if (entry && (k == num_appended ||
+				entry_cmp(&entry, &appended[k]) < 0)) {
+			index->sorted[j] = entry;
+			i++;
+		} else
+			index->sorted[j] = appended[k++];
+	}
+
+	free(appended);
+	free(map);
+
+	return 1;
+
+failed:
+	free(appended);
+	free(map);
+
+	return 0;
 }
 
-static char *strnpbrk(const char *s, ssize_t len, const char *accept)
+static int index_is_valid(struct textfile_index *index, const char *pathname,
+							const struct stat *st)
 {
-	const char *p = s;
-	const char *end;
+	if (!index || strcmp(index->pathname, pathname) != 0)
+		return 0;
 
-	end = s + len - 1;
+	return index->dev == st->st_dev && index->ino == st->st_ino &&
+		index->size == (size_t) st->st_size &&
+		index->mtime.tv_sec == st->st_mtim.tv_sec &&
+		index->mtime.tv_nsec == st->st_mtim.tv_nsec &&
+		index->ctime.tv_sec == st->st_ctim.tv_sec &&
+		index->ctime.tv_nsec == st->st_ctim.tv_nsec;
+}
 
-	while (p <= end && *p) {
-		const char *a = accept;
+static void index_cache(struct textfile_index *index)
+{
+	index_unref(cached_index);
+
+	index->refs++;
+	cached_index = index;
+}
 
-		while (*a) {
-			if (*p == *a)
-				return (char *) p;
-			a++;
+static void index_cache_drop(void)
+{
+	index_unref(cached_index);
+	cached_index = NULL;
+}
+
+/* Returns a new reference to the index of the locked file */
+static struct textfile_index *index_get(int fd, const char *pathname, int *err)
+{
+	struct textfile_index *index;
+	struct stat st;
+	char *data;
+	size_t size = 0;
+
+	if (fstat(fd, &st) < 0) {
+		*err = -errno;
+		return NULL;
+	}
+
+	if (index_is_valid(cached_index, pathname, &st)) {
+		cached_index->refs++;
+		return cached_index;
+	}
+
+	data = malloc(st.st_size + 1);
+	if (!data) {
+		*err = -ENOMEM;
+		return NULL;
+	}
+
+	while (size < (size_t) st.st_size) {
+		ssize_t len;
+
+		len = pread(fd, data + size, st.st_size - size, size);
+		if (len < 0 && errno == EINTR)
+			continue;
+
+		if (len < 0) {
+			*err = -errno;
+			free(data);
+			return NULL;
 		}
 
-		p++;
+		if (len == 0)
+			break;
+
+		size += len;
 	}
 
-	return NULL;
+	data[size] = '\0';
+
+	index = index_new(pathname, &st, data, size);
+	if (!index) {
+		*err = -ENOMEM;
+		return NULL;
+	}
+
+	index_sort(index);
+	index_cache(index);
+
+	return index;
 }
 
-static int write_key(const char *pathname, const char *key, const char *value, int icase)
+static struct textfile_entry *index_find(struct textfile_index *index,
+							const char *key)
 {
-	struct stat st;
-	char *map, *off, *end, *str;
-	off_t size;
-	size_t base;
-	int fd, len, err = 0;
+	size_t len = strlen(key);
+	unsigned int low = 0, high = index->count;
+
+	/* Find the first entry not sorting before the key */
+	while (low < high) {
+		unsigned int mid = low + (high - low) / 2;
+		struct textfile_entry *entry = index->sorted[mid];
+
+		if (key_cmp(entry->key, entry->key_len, key, len) < 0)
+			low = mid + 1;
+		else
+			high = mid;
+	}
 
-	fd = open(pathname, O_RDWR);
-	if (fd < 0)
+	if (low == index->count)
+		return NULL;
+
+	if (key_cmp(index->sorted[low]->key, index->sorted[low]->key_len,
+							key, len) != 0)
+		return NULL;
+
+	return index->sorted[low];
+}
+
+static char *entry_value(const struct textfile_entry *entry)
+{
+	char *str;
+
+	str = malloc(entry->value_len + 1);
+	if (!str)
+		return NULL;
+
+	memcpy(str, entry->value, entry->value_len);
+	str[entry->value_len] = '\0';
+
+	return str;
+}
+
+struct textfile_change {
+	const char *key;
+	const char *value;
+	unsigned int order;
+	struct textfile_entry *entry;	/* Existing entry, if any */
+	int winner;			/* Last change of its key */
+};
+
+static int change_cmp(const void *a, const void *b)
+{
+	const struct textfile_change *change1 = a;
+	const struct textfile_change *change2 = b;
+	int cmp;
+
+	cmp = strcmp(change1->key, change2->key);
+	if (cmp != 0)
+		return cmp;
+
+	return change1->order < change2->order ? -1 : 1;
+}
+
+static int change_order_cmp(const void *a, const void *b)
+{
+	const struct textfile_change *change1 = a;
+	const struct textfile_change *change2 = b;
+
+	return change1->order < change2->order ? -1 : 1;
+}
+
+static int entry_pos_cmp(const void *a, const void *b)
+{
+	const struct textfile_change *change1 = *(struct textfile_change **) a;
+	const struct textfile_change *change2 = *(struct textfile_change **) b;
+
+	return change1->entry->start < change2->entry->start ? -1 : 1;
+}
+
+static int write_data(int fd, size_t offset, const char *data, size_t size)
+{
+	if (ftruncate(fd, offset) < 0)
 		return -errno;
 
-	if (flock(fd, LOCK_EX) < 0) {
-		err = -errno;
-		goto close;
-	}
+	lseek(fd, offset, SEEK_SET);
 
-	if (fstat(fd, &st) < 0) {
-		err = -errno;
-		goto unlock;
+	while (size > 0) {
+		ssize_t len;
+
+		len = write(fd, data, size);
+		if (len < 0 && errno == EINTR)
+			continue;
+
+		if (len < 0)
+			return -errno;
+
+		data += len;
+		size -= len;
 	}
 
-	size = st.st_size;
+	return 0;
+}
+
+static size_t append_line(char *buf, const char *key, const char *value)
+{
+	return sprintf(buf, "%s %s\n", key, value);
+}
+
+static int apply_changes(int fd, const char *pathname,
+				struct textfile_index *index,
+				struct textfile_change *changes, unsigned int count)
+{
+	struct textfile_change **updates;
+	struct textfile_index *new_index;
+	unsigned int i, num_updates = 0, num_appended = 0;
+	size_t size, copied, first, len;
+	struct stat st;
+	char *buf, *removed;
+	int err;
 
-	if (!size) {
-		if (value) {
-			lseek(fd, size, SEEK_SET);
-			err = write_key_value(fd, key, value);
+	/* Keep only the last change of each key */
+	qsort(changes, count, sizeof(*changes), change_cmp);
+
+	size = index->size;
+
+	for (i = 0; i < count; i++) {
+		struct textfile_change *change = &changes[i];
+
+		change->winner = (i + 1 == count ||
+				strcmp(change->key, changes[i + 1].key) != 0);
+		if (!change->winner)
+			continue;
+
+		change->entry = index_find(index, change->key);
+
+		if (change->entry && change->value &&
+			strlen(change->value) == change->entry->value_len &&
+			!memcmp(change->value, change->entry->value,
+						change->entry->value_len)) {
+			change->winner = 0;
+			continue;
 		}
-		goto unlock;
+
+		if (!change->entry && !change->value) {
+			change->winner = 0;
+			continue;
+		}
+
+		if (change->value)
+			size += strlen(change->key) + strlen(change->value) + 2;
+
+		num_updates++;
 	}
 
-	map = mmap(NULL, size, PROT_READ | PROT_WRITE,
-					MAP_PRIVATE | MAP_LOCKED, fd, 0);
-	if (!map || map == MAP_FAILED) {
-		err = -errno;
-		goto unlock;
+	if (num_updates == 0)
+		return 0;
+
+	updates = malloc(num_updates * sizeof(*updates));
+	removed = calloc(index->count + 1, sizeof(*removed));
+	buf = malloc(size + 1);
+	if (!updates || !removed || !buf) {
+		free(updates);
+		free(removed);
+		free(buf);
+		return -ENOMEM;
 	}
 
-	len = strlen(key);
-	off = find_key(map, size, key, len, icase);
-	if (!off) {
-		munmap(map, size);
-		if (value) {
-			lseek(fd, size, SEEK_SET);
-			err = write_key_value(fd, key, value);
+	num_updates = 0;
+
+	for (i = 0; i < count; i++) {
+		struct textfile_change *change = &changes[i];
+
+		if (!change->winner)
+			continue;
+
+		if (!change->entry) {
+			num_appended++;
+			continue;
 		}
-		goto unlock;
+
+		if (!change->value)
+			removed[change->entry - index->entries] = 1;
+
+		updates[num_updates++] = change;
 	}
 
-	base = off - map;
+	qsort(updates, num_updates, sizeof(*updates), entry_pos_cmp);
 
-	end = strnpbrk(off, size, "\r\n");
-	if (!end) {
-		err = -EILSEQ;
-		goto unmap;
+	/* Existing lines are replaced in place, new ones are appended */
+	first = num_updates > 0 ? updates[0]->entry->start : index->size;
+
+	memcpy(buf, index->data, first);
+	copied = first;
+	len = first;
+
+	for (i = 0; i < num_updates; i++) {
+		struct textfile_entry *entry = updates[i]->entry;
+
+		memcpy(buf + len, index->data + copied, entry->start - copied);
+		len += entry->start - copied;
+
+		if (updates[i]->value)
+			len += append_line(buf + len, updates[i]->key,
+							updates[i]->value);
+
+		copied = entry->end;
 	}
 
-	if (value && ((ssize_t) strlen(value) == end - off - len - 1) &&
-			!strncmp(off + len + 1, value, end - off - len - 1))
-		goto unmap;
+	memcpy(buf + len, index->data + copied, index->size - copied);
+	len += index->size - copied;
 
-	len = strspn(end, "\r\n");
-	end += len;
+	free(updates);
 
-	len = size - (end - map);
-	if (!len) {
-		munmap(map, size);
-		if (ftruncate(fd, base) < 0) {
-			err = -errno;
-			goto unlock;
-		}
-		lseek(fd, base, SEEK_SET);
-		if (value)
-			err = write_key_value(fd, key, value);
+	/* Appended keys keep the order they were given in */
+	qsort(changes, count, sizeof(*changes), change_order_cmp);
 
-		goto unlock;
+	for (i = 0; i < count; i++) {
+		if (changes[i].winner && !changes[i].entry)
+			len += append_line(buf + len, changes[i].key,
+							changes[i].value);
 	}
 
-	if (len < 0 || len > size) {
-		err = -EILSEQ;
-		goto unmap;
+	err = write_data(fd, first, buf + first, len - first);
+	if (err < 0 || fstat(fd, &st) < 0) {
+		free(buf);
+		free(removed);
+		index_cache_drop();
+		return err;
 	}
 
-	str = malloc(len);
-	if (!str) {
-		err = -errno;
-		goto unmap;
+	new_index = index_new(pathname, &st, buf, len);
+	if (!new_index) {
+		free(removed);
+		index_cache_drop();
+		return 0;
 	}
 
-	memcpy(str, end, len);
+	if (!index_resort(new_index, index, removed, num_appended))
+		index_sort(new_index);
 
-	munmap(map, size);
-	if (ftruncate(fd, base) < 0) {
+	free(removed);
+
+	index_cache(new_index);
+	index_unref(new_index);
+
+	return 0;
+}
+
+static int update_keys(const char *pathname, const char **keys,
+				const char **values, unsigned int count)
+{
+	struct textfile_index *index;
+	struct textfile_change *changes;
+	unsigned int i;
+	int fd, err = 0;
+
+	fd = open(pathname, O_RDWR);
+	if (fd < 0)
+		return -errno;
+
+	if (flock(fd, LOCK_EX) < 0) {
 		err = -errno;
-		free(str);
+		goto close;
+	}
+
+	index = index_get(fd, pathname, &err);
+	if (!index)
 		goto unlock;
+
+	changes = calloc(count, sizeof(*changes));
+	if (!changes) {
+		err = -ENOMEM;
+		goto unref;
 	}
-	lseek(fd, base, SEEK_SET);
-	if (value)
-		err = write_key_value(fd, key, value);
 
-	if (write(fd, str, len) < 0)
-		err = -errno;
+	for (i = 0; i < count; i++) {
+		changes[i].key = keys[i];
+		changes[i].value = values ? values[i] : NULL;
+		changes[i].order = i;
+	}
 
-	free(str);
+	err = apply_changes(fd, pathname, index, changes, count);
 
-	goto unlock;
+	free(changes);
 
-unmap:
-	munmap(map, size);
+unref:
+	index_unref(index);
 
 unlock:
 	flock(fd, LOCK_UN);
@@ -299,11 +707,11 @@ close:
 	return err;
 }
 
-static char *read_key(const char *pathname, const char *key, int icase)
+static char *read_key(const char *pathname, const char *key)
 {
-	struct stat st;
-	char *map, *off, *end, *str = NULL;
-	off_t size; size_t len;
+	struct textfile_index *index;
+	struct textfile_entry *entry;
+	char *str = NULL;
 	int fd, err = 0;
 
 	fd = open(pathname, O_RDONLY);
@@ -315,43 +723,22 @@ static char *read_key(const char *pathname, const char *key, int icase)
 		goto close;
 	}
 
-	if (fstat(fd, &st) < 0) {
-		err = -errno;
-		goto unlock;
-	}
-
-	size = st.st_size;
-
-	map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
-	if (!map || map == MAP_FAILED) {
-		err = -errno;
+	index = index_get(fd, pathname, &err);
+	if (!index)
 		goto unlock;
-	}
-
-	len = strlen(key);
-	off = find_key(map, size, key, len, icase);
-	if (!off) {
-		err = -EILSEQ;
-		goto unmap;
-	}
-
-	end = strnpbrk(off, size - (off - map), "\r\n");
-	if (!end) {
-		err = -EILSEQ;
-		goto unmap;
-	}
 
-	str = malloc(end - off - len);
-	if (!str) {
+	entry = index_find(index, key);
+	if (!entry) {
 		err = -EILSEQ;
-		goto unmap;
+		goto unref;
 	}
 
-	memset(str, 0, end - off - len);
-	strncpy(str, off + len + 1, end - off - len - 1);
+	str = entry_value(entry);
+	if (!str)
+		err = -ENOMEM;
 
-unmap:
-	munmap(map, size);
+unref:
+	index_unref(index);
 
 unlock:
 	flock(fd, LOCK_UN);
@@ -365,24 +752,33 @@ close:
 
 int textfile_put(const char *pathname, const char *key, const char *value)
 {
-	return write_key(pathname, key, value, 0);
+	return update_keys(pathname, &key, &value, 1);
 }
 
 int textfile_del(const char *pathname, const char *key)
 {
-	return write_key(pathname, key, NULL, 0);
+	return update_keys(pathname, &key, NULL, 1);
+}
+
+/*
+ * Store or, for NULL values, delete several keys with a single rewrite
+ * of the file. When a key is given more than once the last value wins.
+ */
+int textfile_update(const char *pathname, const char **keys,
+				const char **values, unsigned int count)
+{
+	return update_keys(pathname, keys, values, count);
 }
 
 char *textfile_get(const char *pathname, const char *key)
 {
-	return read_key(pathname, key, 0);
+	return read_key(pathname, key);
 }
 
 int textfile_foreach(const char *pathname, textfile_cb func, void *data)
 {
-	struct stat st;
-	char *map, *off, *end, *key, *value;
-	off_t size; size_t len;
+	struct textfile_index *index;
+	unsigned int i;
 	int fd, err = 0;
 
 	fd = open(pathname, O_RDONLY);
@@ -394,78 +790,42 @@ int textfile_foreach(const char *pathname, textfile_cb func, void *data)
 		goto close;
 	}
 
-	if (fstat(fd, &st) < 0) {
-		err = -errno;
-		goto unlock;
-	}
-
-	size = st.st_size;
-
-	map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
-	if (!map || map == MAP_FAILED) {
-		err = -errno;
-		goto unlock;
-	}
+	index = index_get(fd, pathname, &err);
 
-	off = map;
+	flock(fd, LOCK_UN);
 
-	while (size - (off - map) > 0) {
-		end = strnpbrk(off, size - (off - map), " ");
-		if (!end) {
-			err = -EILSEQ;
-			break;
-		}
+	if (!index)
+		goto close;
 
-		len = end - off;
+	/* The reference keeps the entries valid if the callback changes
+	 * the file */
+	for (i = 0; i < index->count; i++) {
+		struct textfile_entry *entry = &index->entries[i];
+		char *key, *value;
 
-		key = malloc(len + 1);
+		key = malloc(entry->key_len + 1);
 		if (!key) {
 			err = -errno;
 			break;
 		}
 
-		memset(key, 0, len + 1);
-		memcpy(key, off, len);
-
-		off = end + 1;
-
-		if (size - (off - map) < 0) {
-			err = -EILSEQ;
-			free(key);
-			break;
-		}
-
-		end = strnpbrk(off, size - (off - map), "\r\n");
-		if (!end) {
-			err = -EILSEQ;
-			free(key);
-			break;
-		}
-
-		len = end - off;
+		memcpy(key, entry->key, entry->key_len);
+		key[entry->key_len] = '\0';
 
-		value = malloc(len + 1);
+		value = entry_value(entry);
 		if (!value) {
 			err = -errno;
 			free(key);
 			break;
 		}
 
-		memset(value, 0, len + 1);
-		memcpy(value, off, len);
-
 		func(key, value, data);
 
 		free(key);
 		free(value);
-
-		off = end + 1;
 	}
 
-	munmap(map, size);
-
-unlock:
-	flock(fd, LOCK_UN);
+	index_unref(index);
 
 close:
 	close(fd);
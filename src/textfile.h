@@ -32,6 +32,9 @@ int textfile_put(const char *pathname, const char *key, const char *value);
 int textfile_del(const char *pathname, const char *key);
 char *textfile_get(const char *pathname, const char *key);
 
+int textfile_update(const char *pathname, const char **keys,
+				const char **values, unsigned int count);
+
 typedef void (*textfile_cb) (char *key, char *value, void *data);
 
 int textfile_foreach(const char *pathname, textfile_cb func, void *data);
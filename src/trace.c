@@ -0,0 +1,192 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2013  Intel Corporation
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <glib.h>
+
+#include "trace.h"
+
+struct trace_ring {
+	struct trace_event events[TRACE_RING_SIZE];
+	unsigned int head;		/* Next slot to write */
+	unsigned int count;
+};
+
+struct trace_ring *trace_ring_new(void)
+{
+	return g_new0(struct trace_ring, 1);
+}
+
+void trace_ring_free(struct trace_ring *ring)
+{
+	g_free(ring);
+}
+
+void trace_ring_clear(struct trace_ring *ring)
+{
+	ring->head = 0;
+	ring->count = 0;
+}
+
+void trace_ring_add(struct trace_ring *ring, uint64_t timestamp,
+				const char *stage, const char *detail)
+{
+	struct trace_event *event = &ring->events[ring->head];
+
+	event->timestamp = timestamp;
+	event->stage = stage;
+
+	if (detail != NULL)
+		g_strlcpy(event->detail, detail, sizeof(event->detail));
+	else
+		event->detail[0] = '\0';
+
+	ring->head = (ring->head + 1) % TRACE_RING_SIZE;
+
+	/* Once full the oldest event is overwritten */
+	if (ring->count < TRACE_RING_SIZE)
+		ring->count++;
+}
+
+void trace_ring_record(struct trace_ring *ring, const char *stage,
+							const char *detail)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	trace_ring_add(ring, ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000,
+								stage, detail);
+}
+
+unsigned int trace_ring_count(struct trace_ring *ring)
+{
+	return ring->count;
+}
+
+void trace_ring_foreach(struct trace_ring *ring, trace_func_t func,
+							void *user_data)
+{
+	unsigned int i, first;
+
+	first = (ring->head + TRACE_RING_SIZE - ring->count) % TRACE_RING_SIZE;
+
+	for (i = 0; i < ring->count; i++)
+		func(&ring->events[(first + i) % TRACE_RING_SIZE], user_data);
+}
+
+struct json_data {
+	GString *str;
+	const char *name;
+	const struct trace_event *prev;
+};
+
+static void append_json_string(GString *str, const char *value)
+{
+	const char *c;
+
+	g_string_append_c(str, '"');
+
+	for (c = value; *c != '\0'; c++) {
+		if (*c == '"' || *c == '\\')
+			g_string_append_printf(str, "\\%c", *c);
+		else if ((unsigned char) *c < 0x20)
+			g_string_append_printf(str, "\\u%04x", *c);
+		else
+			g_string_append_c(str, *c);
+	}
+
+	g_string_append_c(str, '"');
+}
+
+static void append_json_event(GString *str, const char *name,
+					const struct trace_event *event,
+					const struct trace_event *next)
+{
+	if (str->str[str->len - 1] == '}')
+		g_string_append_c(str, ',');
+
+	g_string_append(str, "\n{\"name\":");
+	append_json_string(str, event->stage);
+	g_string_append(str, ",\"cat\":");
+	append_json_string(str, name);
+
+	/* A stage lasts until the next one starts, the last one is an
+	 * instant event */
+	if (next != NULL)
+		g_string_append_printf(str, ",\"ph\":\"X\",\"ts\":%" G_GUINT64_FORMAT
+					",\"dur\":%" G_GUINT64_FORMAT,
+					event->timestamp,
+					next->timestamp - event->timestamp);
+	else
+		g_string_append_printf(str, ",\"ph\":\"i\",\"s\":\"t\",\"ts\":%"
+					G_GUINT64_FORMAT, event->timestamp);
+
+	g_string_append(str, ",\"pid\":1,\"tid\":1");
+
+	if (event->detail[0] != '\0') {
+		g_string_append(str, ",\"args\":{\"detail\":");
+		append_json_string(str, event->detail);
+		g_string_append_c(str, '}');
+	}
+
+	g_string_append_c(str, '}');
+}
+
+static void json_event(const struct trace_event *event, void *user_data)
+{
+	struct json_data *data = user_data;
+
+	if (data->prev != NULL)
+		append_json_event(data->str, data->name, data->prev, event);
+
+	data->prev = event;
+}
+
+/*
+ * Format the ring as Chrome trace event JSON, which can be loaded by
+ * chrome://tracing and similar timeline viewers.
+ */
+char *trace_ring_to_json(struct trace_ring *ring, const char *name)
+{
+	struct json_data data;
+
+	data.str = g_string_new("{\"traceEvents\":[");
+	data.name = name;
+	data.prev = NULL;
+
+	trace_ring_foreach(ring, json_event, &data);
+
+	if (data.prev != NULL)
+		append_json_event(data.str, name, data.prev, NULL);
+
+	g_string_append(data.str, "\n],\"displayTimeUnit\":\"ms\"}\n");
+
+	return g_string_free(data.str, FALSE);
+}
@@ -0,0 +1,50 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2013  Intel Corporation
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#define TRACE_RING_SIZE		64
+#define TRACE_DETAIL_LENGTH	32
+
+struct trace_event {
+	uint64_t timestamp;		/* Monotonic time in microseconds */
+	const char *stage;		/* Static stage name */
+	char detail[TRACE_DETAIL_LENGTH];
+};
+
+struct trace_ring;
+
+typedef void (*trace_func_t) (const struct trace_event *event,
+							void *user_data);
+
+struct trace_ring *trace_ring_new(void);
+void trace_ring_free(struct trace_ring *ring);
+void trace_ring_clear(struct trace_ring *ring);
+
+void trace_ring_add(struct trace_ring *ring, uint64_t timestamp,
+				const char *stage, const char *detail);
+void trace_ring_record(struct trace_ring *ring, const char *stage,
+							const char *detail);
+unsigned int trace_ring_count(struct trace_ring *ring);
+void trace_ring_foreach(struct trace_ring *ring, trace_func_t func,
+							void *user_data);
+
+char *trace_ring_to_json(struct trace_ring *ring, const char *name);
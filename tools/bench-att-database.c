@@ -0,0 +1,116 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2013  Intel Corporation
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include <bluetooth/bluetooth.h>
+
+#include <glib.h>
+
+#include "lib/uuid.h"
+#include "attrib/att.h"
+#include "attrib/att-database.h"
+
+#include "unit/att-database-ref.h"
+
+#define NUM_ROUNDS 200
+
+static const size_t mtus[] = { ATT_DEFAULT_LE_MTU, 185, 512 };
+
+/* Walks the whole database and returns the number of requests issued */
+static unsigned int discover(GList *database, request_func_t func,
+					const bt_uuid_t *uuid, size_t mtu)
+{
+	uint8_t pdu[512];
+	uint16_t start = 0x0001, len;
+	unsigned int count = 0;
+
+	while (start != 0x0000) {
+		len = func(database, start, 0xffff, uuid, pdu, mtu);
+		count++;
+
+		if (len == 0 || pdu[0] == ATT_OP_ERROR)
+			break;
+
+		start = next_handle(pdu, len);
+	}
+
+	return count;
+}
+
+static double run_discovery(GList *database, request_func_t read_by_group,
+					request_func_t read_by_type,
+					request_func_t find_info, size_t mtu)
+{
+	GTimer *timer;
+	unsigned int i, count = 0;
+	double elapsed;
+
+	timer = g_timer_new();
+
+	for (i = 0; i < NUM_ROUNDS; i++) {
+		count += discover(database, read_by_group, &prim_uuid, mtu);
+		count += discover(database, read_by_type, &chr_uuid, mtu);
+		count += discover(database, find_info, NULL, mtu);
+	}
+
+	elapsed = g_timer_elapsed(timer, NULL);
+	g_timer_destroy(timer);
+
+	return elapsed > 0 ? count / elapsed : 0;
+}
+
+int main(int argc, char *argv[])
+{
+	GList *database;
+	unsigned int i;
+
+	database = create_database(NUM_SERVICES);
+
+	printf("Discovering %u services (%u attributes), %u rounds\n",
+					NUM_SERVICES,
+					NUM_SERVICES * SERVICE_SIZE, NUM_ROUNDS);
+
+	for (i = 0; i < G_N_ELEMENTS(mtus); i++) {
+		double before, after;
+
+		before = run_discovery(database, list_read_by_group,
+					list_read_by_type, list_find_info,
+					mtus[i]);
+		after = run_discovery(database, db_read_by_group,
+					db_read_by_type, db_find_info,
+					mtus[i]);
+
+		printf("MTU %zu: %.0f requests/s (%.0f requests/s before)\n",
+						mtus[i], after, before);
+	}
+
+	free_database(database);
+
+	return 0;
+}
@@ -0,0 +1,162 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2013  Intel Corporation
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <glib.h>
+#include <gdbus.h>
+
+#define SERVICE_NAME "org.bluez.bench-gdbus-watch"
+#define SERVICE_PATH "/org/bluez/bench_gdbus_watch"
+#define SERVICE_IFACE "org.bluez.bench.Watch"
+
+#define NUM_PATHS 256
+#define NUM_ROUNDS 16
+
+static GMainLoop *main_loop;
+static unsigned int received;
+
+static gboolean path_signal(DBusConnection *conn, DBusMessage *msg,
+							void *user_data)
+{
+	received++;
+
+	return TRUE;
+}
+
+static gboolean done_signal(DBusConnection *conn, DBusMessage *msg,
+							void *user_data)
+{
+	g_main_loop_quit(main_loop);
+
+	return TRUE;
+}
+
+static void send_signal(DBusConnection *conn, const char *path,
+							const char *member)
+{
+	DBusMessage *signal;
+
+	signal = dbus_message_new_signal(path, SERVICE_IFACE, member);
+	if (signal == NULL)
+		return;
+
+	g_dbus_send_message(conn, signal);
+}
+
+static void add_watches(DBusConnection *conn)
+{
+	unsigned int i;
+
+	for (i = 0; i < NUM_PATHS; i++) {
+		char *path = g_strdup_printf("%s/obj%u", SERVICE_PATH, i);
+
+		g_dbus_add_signal_watch(conn, NULL, path, SERVICE_IFACE,
+					"Changed", path_signal, NULL, NULL);
+
+		g_free(path);
+	}
+
+	/* Matches every Changed signal regardless of the path */
+	g_dbus_add_signal_watch(conn, NULL, NULL, SERVICE_IFACE, "Changed",
+						path_signal, NULL, NULL);
+
+	/* Never matches, same path but a different member */
+	g_dbus_add_signal_watch(conn, NULL, SERVICE_PATH "/obj0",
+					SERVICE_IFACE, "Other", path_signal,
+					NULL, NULL);
+
+	g_dbus_add_signal_watch(conn, NULL, SERVICE_PATH, SERVICE_IFACE,
+					"Done", done_signal, NULL, NULL);
+}
+
+static void send_storm(DBusConnection *conn)
+{
+	unsigned int i, round;
+
+	for (round = 0; round < NUM_ROUNDS; round++) {
+		for (i = 0; i < NUM_PATHS; i++) {
+			char *path = g_strdup_printf("%s/obj%u",
+							SERVICE_PATH, i);
+
+			send_signal(conn, path, "Changed");
+			g_free(path);
+		}
+	}
+
+	/* Signals from the same sender are delivered in order */
+	send_signal(conn, SERVICE_PATH, "Done");
+}
+
+int main(int argc, char *argv[])
+{
+	DBusConnection *conn;
+	DBusError err;
+	GTimer *timer;
+	double elapsed;
+
+	dbus_error_init(&err);
+
+	conn = g_dbus_setup_private(DBUS_BUS_SESSION, SERVICE_NAME, &err);
+	if (conn == NULL) {
+		if (dbus_error_is_set(&err)) {
+			fprintf(stderr, "D-Bus setup failed: %s\n",
+								err.message);
+			dbus_error_free(&err);
+		}
+
+		return EXIT_FAILURE;
+	}
+
+	main_loop = g_main_loop_new(NULL, FALSE);
+
+	add_watches(conn);
+
+	timer = g_timer_new();
+
+	send_storm(conn);
+
+	g_main_loop_run(main_loop);
+
+	elapsed = g_timer_elapsed(timer, NULL);
+	g_timer_destroy(timer);
+
+	printf("%u signals, %u watches, %u dispatched: %.3f s\n",
+					NUM_PATHS * NUM_ROUNDS, NUM_PATHS + 3,
+					received, elapsed);
+
+	g_dbus_remove_all_watches(conn);
+
+	dbus_connection_flush(conn);
+	dbus_connection_close(conn);
+	dbus_connection_unref(conn);
+
+	g_main_loop_unref(main_loop);
+
+	return EXIT_SUCCESS;
+}
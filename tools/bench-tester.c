@@ -0,0 +1,1114 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2013  Intel Corporation. All rights reserved.
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdbool.h>
+
+#include <glib.h>
+
+#include "lib/bluetooth.h"
+#include "lib/l2cap.h"
+#include "lib/sdp.h"
+#include "lib/mgmt.h"
+
+#include "monitor/bt.h"
+#include "emulator/bthost.h"
+
+#include "src/shared/tester.h"
+#include "src/shared/mgmt.h"
+#include "src/shared/hciemu.h"
+
+#define SAMPLE_INTERVAL		100
+
+#define ATT_PSM			0x001f
+#define ATT_OP_READ_REQ		0x0a
+#define ATT_OP_READ_RSP		0x0b
+
+struct test_data {
+	const void *test_data;
+	struct mgmt *mgmt;
+	uint16_t mgmt_index;
+	struct hciemu *hciemu;
+	enum hciemu_type hciemu_type;
+	unsigned int io_id;
+	unsigned int sample_id;
+	int sk;
+	uint16_t handle;
+	unsigned int iteration;
+	gint64 bench_time;
+	gint64 start_time;
+	unsigned int sdus_sent;
+	unsigned int sdus_recv;
+	unsigned int sdus_sampled;
+	uint8_t expected_seq;
+	uint8_t unacked;
+};
+
+struct bench_data {
+	uint16_t psm;
+	uint8_t mode;
+	uint16_t sdu_len;
+	unsigned int count;
+	uint32_t link_bandwidth;
+	uint32_t link_latency;
+};
+
+static void mgmt_debug(const char *str, void *user_data)
+{
+	const char *prefix = user_data;
+
+	tester_print("%s%s", prefix, str);
+}
+
+static void read_info_callback(uint8_t status, uint16_t length,
+					const void *param, void *user_data)
+{
+	struct test_data *data = tester_get_data();
+	const struct mgmt_rp_read_info *rp = param;
+	char addr[18];
+
+	tester_print("Read Info callback");
+	tester_print("  Status: 0x%02x", status);
+
+	if (status || !param) {
+		tester_pre_setup_failed();
+		return;
+	}
+
+	ba2str(&rp->bdaddr, addr);
+
+	tester_print("  Address: %s", addr);
+
+	if (strcmp(hciemu_get_address(data->hciemu), addr)) {
+		tester_pre_setup_failed();
+		return;
+	}
+
+	tester_pre_setup_complete();
+}
+
+static void index_added_callback(uint16_t index, uint16_t length,
+					const void *param, void *user_data)
+{
+	struct test_data *data = tester_get_data();
+
+	tester_print("Index Added callback");
+	tester_print("  Index: 0x%04x", index);
+
+	data->mgmt_index = index;
+
+	mgmt_send(data->mgmt, MGMT_OP_READ_INFO, data->mgmt_index, 0, NULL,
+					read_info_callback, NULL, NULL);
+}
+
+static void index_removed_callback(uint16_t index, uint16_t length,
+					const void *param, void *user_data)
+{
+	struct test_data *data = tester_get_data();
+
+	tester_print("Index Removed callback");
+	tester_print("  Index: 0x%04x", index);
+
+	if (index != data->mgmt_index)
+		return;
+
+	mgmt_unregister_index(data->mgmt, data->mgmt_index);
+
+	mgmt_unref(data->mgmt);
+	data->mgmt = NULL;
+
+	tester_post_teardown_complete();
+}
+
+static void read_index_list_callback(uint8_t status, uint16_t length,
+					const void *param, void *user_data)
+{
+	struct test_data *data = tester_get_data();
+
+	tester_print("Read Index List callback");
+	tester_print("  Status: 0x%02x", status);
+
+	if (status || !param) {
+		tester_pre_setup_failed();
+		return;
+	}
+
+	mgmt_register(data->mgmt, MGMT_EV_INDEX_ADDED, MGMT_INDEX_NONE,
+					index_added_callback, NULL, NULL);
+
+	mgmt_register(data->mgmt, MGMT_EV_INDEX_REMOVED, MGMT_INDEX_NONE,
+					index_removed_callback, NULL, NULL);
+
+	data->hciemu = hciemu_new(data->hciemu_type);
+	if (!data->hciemu) {
+		tester_warn("Failed to setup HCI emulation");
+		tester_pre_setup_failed();
+	}
+
+	tester_print("New hciemu instance created");
+}
+
+static void test_pre_setup(const void *test_data)
+{
+	struct test_data *data = tester_get_data();
+
+	data->mgmt = mgmt_new_default();
+	if (!data->mgmt) {
+		tester_warn("Failed to setup management interface");
+		tester_pre_setup_failed();
+		return;
+	}
+
+	if (tester_use_debug())
+		mgmt_set_debug(data->mgmt, mgmt_debug, "mgmt: ", NULL);
+
+	mgmt_send(data->mgmt, MGMT_OP_READ_INDEX_LIST, MGMT_INDEX_NONE, 0, NULL,
+					read_index_list_callback, NULL, NULL);
+}
+
+static void test_teardown(const void *test_data)
+{
+	struct test_data *data = tester_get_data();
+
+	if (data->io_id > 0) {
+		g_source_remove(data->io_id);
+		data->io_id = 0;
+	}
+
+	if (data->sample_id > 0) {
+		g_source_remove(data->sample_id);
+		data->sample_id = 0;
+	}
+
+	if (data->sk >= 0) {
+		close(data->sk);
+		data->sk = -1;
+	}
+
+	tester_teardown_complete();
+}
+
+static void test_post_teardown(const void *test_data)
+{
+	struct test_data *data = tester_get_data();
+
+	hciemu_unref(data->hciemu);
+	data->hciemu = NULL;
+}
+
+static void test_data_free(void *test_data)
+{
+	struct test_data *data = test_data;
+
+	if (data->io_id > 0)
+		g_source_remove(data->io_id);
+
+	if (data->sample_id > 0)
+		g_source_remove(data->sample_id);
+
+	if (data->sk >= 0)
+		close(data->sk);
+
+	free(data);
+}
+
+#define test_bench(name, data, setup, func, timeout) \
+	do { \
+		struct test_data *user; \
+		user = malloc(sizeof(struct test_data)); \
+		if (!user) \
+			break; \
+		memset(user, 0, sizeof(struct test_data)); \
+		user->hciemu_type = HCIEMU_TYPE_BREDRLE; \
+		user->sk = -1; \
+		user->test_data = data; \
+		tester_add_full(name, data, \
+				test_pre_setup, setup, func, test_teardown, \
+				test_post_teardown, timeout, user, \
+				test_data_free); \
+	} while (0)
+
+static const struct bench_data mgmt_read_info_bench = {
+	.count = 500,
+};
+
+static const struct bench_data l2cap_connect_bench = {
+	.psm = 0x1001,
+	.count = 50,
+};
+
+static const struct bench_data l2cap_basic_bench = {
+	.psm = 0x1001,
+	.mode = L2CAP_MODE_BASIC,
+	.sdu_len = 672,
+	.count = 2000,
+};
+
+static const struct bench_data l2cap_ertm_bench = {
+	.psm = 0x1001,
+	.mode = L2CAP_MODE_ERTM,
+	.sdu_len = 672,
+	.count = 2000,
+};
+
+static const struct bench_data l2cap_streaming_bench = {
+	.psm = 0x1001,
+	.mode = L2CAP_MODE_STREAMING,
+	.sdu_len = 672,
+	.count = 2000,
+};
+
+static const struct bench_data l2cap_basic_slow_link_bench = {
+	.psm = 0x1001,
+	.mode = L2CAP_MODE_BASIC,
+	.sdu_len = 672,
+	.count = 200,
+	.link_bandwidth = 128000,
+	.link_latency = 5,
+};
+
+static const struct bench_data att_read_bench = {
+	.psm = ATT_PSM,
+	.count = 1000,
+};
+
+static const struct bench_data sdp_browse_bench = {
+	.psm = SDP_PSM,
+	.count = 50,
+};
+
+static double elapsed_usec(gint64 start)
+{
+	return g_get_monotonic_time() - start;
+}
+
+static void client_connectable_complete(uint16_t opcode, uint8_t status,
+					const void *param, uint8_t len,
+					void *user_data)
+{
+	if (opcode != BT_HCI_CMD_WRITE_SCAN_ENABLE)
+		return;
+
+	tester_print("Client set connectable status 0x%02x", status);
+
+	if (status)
+		tester_setup_failed();
+	else
+		tester_setup_complete();
+}
+
+static void setup_powered_callback(uint8_t status, uint16_t length,
+					const void *param, void *user_data)
+{
+	struct test_data *data = tester_get_data();
+	const struct bench_data *bench = data->test_data;
+	struct bthost *bthost;
+
+	if (status != MGMT_STATUS_SUCCESS) {
+		tester_setup_failed();
+		return;
+	}
+
+	tester_print("Controller powered on");
+
+	if (bench->link_bandwidth || bench->link_latency)
+		hciemu_set_link_params(data->hciemu, bench->link_bandwidth,
+						bench->link_latency, 4);
+
+	bthost = hciemu_client_get_host(data->hciemu);
+	bthost_set_cmd_complete_cb(bthost, client_connectable_complete, data);
+	bthost_write_scan_enable(bthost, 0x03);
+}
+
+static void setup_powered(const void *test_data)
+{
+	struct test_data *data = tester_get_data();
+	unsigned char param[] = { 0x01 };
+
+	tester_print("Powering on controller");
+
+	mgmt_send(data->mgmt, MGMT_OP_SET_CONNECTABLE, data->mgmt_index,
+					sizeof(param), param,
+					NULL, NULL, NULL);
+
+	mgmt_send(data->mgmt, MGMT_OP_SET_SSP, data->mgmt_index,
+				sizeof(param), param, NULL, NULL, NULL);
+
+	mgmt_send(data->mgmt, MGMT_OP_SET_POWERED, data->mgmt_index,
+					sizeof(param), param,
+					setup_powered_callback, NULL, NULL);
+}
+
+static void mgmt_read_info_next(struct test_data *data);
+
+static void bench_read_info_callback(uint8_t status, uint16_t length,
+					const void *param, void *user_data)
+{
+	struct test_data *data = tester_get_data();
+	const struct bench_data *bench = data->test_data;
+
+	if (status) {
+		tester_warn("Read Info failed with status 0x%02x", status);
+		tester_test_failed();
+		return;
+	}
+
+	tester_add_sample("Read Info round-trip", "usec",
+					elapsed_usec(data->start_time));
+
+	if (++data->iteration < bench->count) {
+		mgmt_read_info_next(data);
+		return;
+	}
+
+	tester_test_passed();
+}
+
+static void mgmt_read_info_next(struct test_data *data)
+{
+	data->start_time = g_get_monotonic_time();
+
+	mgmt_send(data->mgmt, MGMT_OP_READ_INFO, data->mgmt_index, 0, NULL,
+					bench_read_info_callback, NULL, NULL);
+}
+
+static void test_mgmt_read_info(const void *test_data)
+{
+	struct test_data *data = tester_get_data();
+
+	mgmt_read_info_next(data);
+}
+
+static int create_l2cap_sock(struct test_data *data, uint8_t mode)
+{
+	const uint8_t *master_bdaddr;
+	struct sockaddr_l2 addr;
+	int sk, err;
+
+	sk = socket(PF_BLUETOOTH, SOCK_SEQPACKET | SOCK_NONBLOCK,
+							BTPROTO_L2CAP);
+	if (sk < 0) {
+		err = -errno;
+		tester_warn("Can't create socket: %s (%d)", strerror(errno),
+									errno);
+		return err;
+	}
+
+	master_bdaddr = hciemu_get_master_bdaddr(data->hciemu);
+	if (!master_bdaddr) {
+		tester_warn("No master bdaddr");
+		close(sk);
+		return -ENODEV;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.l2_family = AF_BLUETOOTH;
+	bacpy(&addr.l2_bdaddr, (void *) master_bdaddr);
+
+	if (bind(sk, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+		err = -errno;
+		tester_warn("Can't bind socket: %s (%d)", strerror(errno),
+									errno);
+		close(sk);
+		return err;
+	}
+
+	if (mode != L2CAP_MODE_BASIC) {
+		struct l2cap_options opts;
+		socklen_t len = sizeof(opts);
+
+		memset(&opts, 0, sizeof(opts));
+
+		if (getsockopt(sk, SOL_L2CAP, L2CAP_OPTIONS, &opts,
+								&len) < 0) {
+			err = -errno;
+			tester_warn("Can't get L2CAP options: %s (%d)",
+						strerror(errno), errno);
+			close(sk);
+			return err;
+		}
+
+		opts.mode = mode;
+
+		if (setsockopt(sk, SOL_L2CAP, L2CAP_OPTIONS, &opts,
+							sizeof(opts)) < 0) {
+			err = -errno;
+			tester_warn("Can't set L2CAP mode: %s (%d)",
+						strerror(errno), errno);
+			close(sk);
+			return err;
+		}
+	}
+
+	return sk;
+}
+
+static int connect_l2cap_sock(struct test_data *data, int sk, uint16_t psm)
+{
+	const uint8_t *client_bdaddr;
+	struct sockaddr_l2 addr;
+	int err;
+
+	client_bdaddr = hciemu_get_client_bdaddr(data->hciemu);
+	if (!client_bdaddr) {
+		tester_warn("No client bdaddr");
+		return -ENODEV;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.l2_family = AF_BLUETOOTH;
+	bacpy(&addr.l2_bdaddr, (void *) client_bdaddr);
+	addr.l2_psm = htobs(psm);
+
+	err = connect(sk, (struct sockaddr *) &addr, sizeof(addr));
+	if (err < 0 && !(errno == EAGAIN || errno == EINPROGRESS)) {
+		err = -errno;
+		tester_warn("Can't connect socket: %s (%d)", strerror(errno),
+									errno);
+		return err;
+	}
+
+	return 0;
+}
+
+static int sock_error(int sk)
+{
+	int sk_err;
+	socklen_t len = sizeof(sk_err);
+
+	if (getsockopt(sk, SOL_SOCKET, SO_ERROR, &sk_err, &len) < 0)
+		return -errno;
+
+	return -sk_err;
+}
+
+static bool start_l2cap_connect(struct test_data *data, uint8_t mode,
+							GIOFunc func)
+{
+	const struct bench_data *bench = data->test_data;
+	GIOChannel *io;
+	int sk;
+
+	sk = create_l2cap_sock(data, mode);
+	if (sk < 0)
+		return false;
+
+	data->start_time = g_get_monotonic_time();
+
+	if (connect_l2cap_sock(data, sk, bench->psm) < 0) {
+		close(sk);
+		return false;
+	}
+
+	data->sk = sk;
+
+	io = g_io_channel_unix_new(sk);
+	data->io_id = g_io_add_watch(io, G_IO_OUT | G_IO_ERR | G_IO_HUP,
+								func, NULL);
+	g_io_channel_unref(io);
+
+	return true;
+}
+
+static void close_l2cap_sock(struct test_data *data)
+{
+	if (data->sk < 0)
+		return;
+
+	close(data->sk);
+	data->sk = -1;
+}
+
+static gboolean l2cap_setup_cb(GIOChannel *io, GIOCondition cond,
+							gpointer user_data)
+{
+	struct test_data *data = tester_get_data();
+	const struct bench_data *bench = data->test_data;
+	int err;
+
+	data->io_id = 0;
+
+	err = sock_error(data->sk);
+	if (err < 0) {
+		tester_warn("Connect failed: %s (%d)", strerror(-err), -err);
+		tester_test_failed();
+		return FALSE;
+	}
+
+	/* The first connection also includes the ACL link setup */
+	tester_add_sample(data->iteration ? "L2CAP connect" :
+						"ACL and L2CAP connect",
+				"usec", elapsed_usec(data->start_time));
+
+	close_l2cap_sock(data);
+
+	if (++data->iteration >= bench->count) {
+		tester_test_passed();
+		return FALSE;
+	}
+
+	if (!start_l2cap_connect(data, L2CAP_MODE_BASIC, l2cap_setup_cb))
+		tester_test_failed();
+
+	return FALSE;
+}
+
+static void test_l2cap_connect(const void *test_data)
+{
+	struct test_data *data = tester_get_data();
+	const struct bench_data *bench = data->test_data;
+	struct bthost *bthost;
+
+	bthost = hciemu_client_get_host(data->hciemu);
+	bthost_set_server_psm(bthost, bench->psm);
+
+	if (!start_l2cap_connect(data, L2CAP_MODE_BASIC, l2cap_setup_cb))
+		tester_test_failed();
+}
+
+/* CRC-16 as used for the L2CAP Frame Check Sequence (x^16 + x^15 + x^2 + 1) */
+static uint16_t l2cap_fcs(uint16_t crc, const uint8_t *data, size_t len)
+{
+	unsigned int i;
+
+	while (len--) {
+		crc ^= *data++;
+
+		for (i = 0; i < 8; i++)
+			crc = (crc & 1) ? (crc >> 1) ^ 0xa001 : crc >> 1;
+	}
+
+	return crc;
+}
+
+static void send_ertm_rr(struct test_data *data, uint16_t cid, bool final)
+{
+	struct bthost *bthost = hciemu_client_get_host(data->hciemu);
+	uint8_t pdu[8];
+	uint16_t control;
+
+	/* Receiver Ready S-frame, enhanced control field */
+	control = 0x0001 | ((data->expected_seq & 0x3f) << 8);
+	if (final)
+		control |= 0x0080;
+
+	/* The FCS covers the basic L2CAP header as well */
+	bt_put_le16(4, pdu);
+	bt_put_le16(cid, pdu + 2);
+	bt_put_le16(control, pdu + 4);
+	bt_put_le16(l2cap_fcs(0, pdu, 6), pdu + 6);
+
+	bthost_send_cid(bthost, data->handle, cid, pdu + 4, 4);
+
+	data->unacked = 0;
+}
+
+static void sample_throughput(struct test_data *data, double interval)
+{
+	const struct bench_data *bench = data->test_data;
+	unsigned int sdus;
+
+	sdus = data->sdus_recv - data->sdus_sampled;
+	data->sdus_sampled = data->sdus_recv;
+
+	if (interval <= 0)
+		return;
+
+	tester_add_sample("Throughput", "KiB/s",
+				sdus * bench->sdu_len / 1024.0 /
+						(interval / 1000000.0));
+}
+
+static gboolean throughput_sample_cb(gpointer user_data)
+{
+	struct test_data *data = tester_get_data();
+
+	sample_throughput(data, SAMPLE_INTERVAL * 1000);
+
+	return TRUE;
+}
+
+static void throughput_complete(struct test_data *data)
+{
+	const struct bench_data *bench = data->test_data;
+	double elapsed = elapsed_usec(data->start_time);
+
+	if (data->sample_id > 0) {
+		g_source_remove(data->sample_id);
+		data->sample_id = 0;
+	}
+
+	tester_add_sample("Total throughput", "KiB/s",
+				bench->count * bench->sdu_len / 1024.0 /
+						(elapsed / 1000000.0));
+
+	tester_test_passed();
+}
+
+static void throughput_received(const void *buf, uint16_t len,
+							void *user_data)
+{
+	struct test_data *data = tester_get_data();
+	const struct bench_data *bench = data->test_data;
+	uint16_t cid = GPOINTER_TO_UINT(user_data);
+	const uint8_t *pdu = buf;
+
+	if (bench->mode == L2CAP_MODE_ERTM ||
+				bench->mode == L2CAP_MODE_STREAMING) {
+		uint16_t control;
+
+		if (len < 2)
+			return;
+
+		control = bt_get_le16(pdu);
+
+		if (control & 0x0001) {
+			/* S-frame, answer polls so the link stays up */
+			if (bench->mode == L2CAP_MODE_ERTM &&
+							(control & 0x0010))
+				send_ertm_rr(data, cid, true);
+			return;
+		}
+
+		data->expected_seq = ((control >> 1) + 1) & 0x3f;
+
+		if (bench->mode == L2CAP_MODE_ERTM && ++data->unacked >= 16)
+			send_ertm_rr(data, cid, false);
+	}
+
+	if (++data->sdus_recv < bench->count)
+		return;
+
+	if (bench->mode == L2CAP_MODE_ERTM)
+		send_ertm_rr(data, cid, false);
+
+	throughput_complete(data);
+}
+
+static gboolean throughput_write_cb(GIOChannel *io, GIOCondition cond,
+							gpointer user_data)
+{
+	struct test_data *data = tester_get_data();
+	const struct bench_data *bench = data->test_data;
+	uint8_t buf[bench->sdu_len];
+
+	if (cond & (G_IO_ERR | G_IO_HUP)) {
+		tester_warn("Connection lost after %u SDUs", data->sdus_sent);
+		data->io_id = 0;
+		tester_test_failed();
+		return FALSE;
+	}
+
+	memset(buf, 0x5a, sizeof(buf));
+
+	while (data->sdus_sent < bench->count) {
+		if (write(data->sk, buf, sizeof(buf)) < 0) {
+			if (errno == EAGAIN)
+				return TRUE;
+
+			tester_warn("Write failed: %s (%d)", strerror(errno),
+									errno);
+			data->io_id = 0;
+			tester_test_failed();
+			return FALSE;
+		}
+
+		data->sdus_sent++;
+	}
+
+	data->io_id = 0;
+
+	return FALSE;
+}
+
+static gboolean throughput_connect_cb(GIOChannel *io, GIOCondition cond,
+							gpointer user_data)
+{
+	struct test_data *data = tester_get_data();
+	int err;
+
+	data->io_id = 0;
+
+	err = sock_error(data->sk);
+	if (err < 0) {
+		tester_warn("Connect failed: %s (%d)", strerror(-err), -err);
+		tester_test_failed();
+		return FALSE;
+	}
+
+	tester_print("Connected, starting transfer");
+
+	data->start_time = g_get_monotonic_time();
+	data->sample_id = g_timeout_add(SAMPLE_INTERVAL, throughput_sample_cb,
+									NULL);
+
+	data->io_id = g_io_add_watch(io, G_IO_OUT | G_IO_ERR | G_IO_HUP,
+						throughput_write_cb, NULL);
+
+	return FALSE;
+}
+
+static void throughput_l2cap_connect(uint16_t handle, uint16_t cid,
+							void *user_data)
+{
+	struct test_data *data = user_data;
+	struct bthost *bthost = hciemu_client_get_host(data->hciemu);
+
+	tester_print("L2CAP channel 0x%04x on handle 0x%04x", cid, handle);
+
+	data->handle = handle;
+
+	bthost_add_cid_hook(bthost, handle, cid, throughput_received,
+							GUINT_TO_POINTER(cid));
+}
+
+static void test_l2cap_throughput(const void *test_data)
+{
+	struct test_data *data = tester_get_data();
+	const struct bench_data *bench = data->test_data;
+	struct bthost *bthost;
+
+	bthost = hciemu_client_get_host(data->hciemu);
+	bthost_set_server_psm(bthost, bench->psm);
+	bthost_set_server_mode(bthost, bench->mode);
+	bthost_set_l2cap_connect_cb(bthost, throughput_l2cap_connect, data);
+
+	if (!start_l2cap_connect(data, bench->mode, throughput_connect_cb))
+		tester_test_failed();
+}
+
+static void att_received(const void *buf, uint16_t len, void *user_data)
+{
+	struct test_data *data = tester_get_data();
+	struct bthost *bthost = hciemu_client_get_host(data->hciemu);
+	uint16_t cid = GPOINTER_TO_UINT(user_data);
+	const uint8_t *pdu = buf;
+	uint8_t rsp[23];
+
+	if (len < 3 || pdu[0] != ATT_OP_READ_REQ)
+		return;
+
+	/* Fill the response with the requested handle as value */
+	memset(rsp, 0, sizeof(rsp));
+	rsp[0] = ATT_OP_READ_RSP;
+	memcpy(rsp + 1, pdu + 1, 2);
+
+	bthost_send_cid(bthost, data->handle, cid, rsp, sizeof(rsp));
+}
+
+static void att_l2cap_connect(uint16_t handle, uint16_t cid, void *user_data)
+{
+	struct test_data *data = user_data;
+	struct bthost *bthost = hciemu_client_get_host(data->hciemu);
+
+	data->handle = handle;
+
+	bthost_add_cid_hook(bthost, handle, cid, att_received,
+							GUINT_TO_POINTER(cid));
+}
+
+static bool att_send_read(struct test_data *data)
+{
+	uint8_t req[3];
+
+	req[0] = ATT_OP_READ_REQ;
+	bt_put_le16(0x0001 + data->iteration % 0x100, req + 1);
+
+	data->start_time = g_get_monotonic_time();
+
+	if (write(data->sk, req, sizeof(req)) < 0) {
+		tester_warn("Write failed: %s (%d)", strerror(errno), errno);
+		return false;
+	}
+
+	return true;
+}
+
+static gboolean att_read_cb(GIOChannel *io, GIOCondition cond,
+							gpointer user_data)
+{
+	struct test_data *data = tester_get_data();
+	const struct bench_data *bench = data->test_data;
+	uint8_t rsp[23];
+	ssize_t len;
+
+	if (cond & (G_IO_ERR | G_IO_HUP))
+		goto failed;
+
+	len = read(data->sk, rsp, sizeof(rsp));
+	if (len < 0) {
+		if (errno == EAGAIN)
+			return TRUE;
+
+		tester_warn("Read failed: %s (%d)", strerror(errno), errno);
+		goto failed;
+	}
+
+	if (len < 1 || rsp[0] != ATT_OP_READ_RSP) {
+		tester_warn("Unexpected ATT response");
+		goto failed;
+	}
+
+	tester_add_sample("Read request round-trip", "usec",
+					elapsed_usec(data->start_time));
+
+	if (++data->iteration >= bench->count) {
+		tester_add_sample("Request rate", "req/s", bench->count /
+				(elapsed_usec(data->bench_time) / 1000000.0));
+		data->io_id = 0;
+		tester_test_passed();
+		return FALSE;
+	}
+
+	if (!att_send_read(data))
+		goto failed;
+
+	return TRUE;
+
+failed:
+	data->io_id = 0;
+	tester_test_failed();
+	return FALSE;
+}
+
+static gboolean att_connect_cb(GIOChannel *io, GIOCondition cond,
+							gpointer user_data)
+{
+	struct test_data *data = tester_get_data();
+	int err;
+
+	data->io_id = 0;
+
+	err = sock_error(data->sk);
+	if (err < 0) {
+		tester_warn("Connect failed: %s (%d)", strerror(-err), -err);
+		tester_test_failed();
+		return FALSE;
+	}
+
+	data->io_id = g_io_add_watch(io, G_IO_IN | G_IO_ERR | G_IO_HUP,
+							att_read_cb, NULL);
+
+	data->bench_time = g_get_monotonic_time();
+
+	if (!att_send_read(data))
+		tester_test_failed();
+
+	return FALSE;
+}
+
+static void test_att_read(const void *test_data)
+{
+	struct test_data *data = tester_get_data();
+	const struct bench_data *bench = data->test_data;
+	struct bthost *bthost;
+
+	bthost = hciemu_client_get_host(data->hciemu);
+	bthost_set_server_psm(bthost, bench->psm);
+	bthost_set_l2cap_connect_cb(bthost, att_l2cap_connect, data);
+
+	if (!start_l2cap_connect(data, L2CAP_MODE_BASIC, att_connect_cb))
+		tester_test_failed();
+}
+
+/* ServiceSearchAttributeRequest for the public browse group */
+static const uint8_t sdp_browse_req[] = {
+	SDP_SVC_SEARCH_ATTR_REQ, 0x00, 0x01, 0x00, 0x0f,
+	0x35, 0x03, 0x19, 0x10, 0x02,			/* PublicBrowseGroup */
+	0xff, 0xff,					/* Max byte count */
+	0x35, 0x05, 0x0a, 0x00, 0x00, 0xff, 0xff,	/* All attributes */
+	0x00,						/* Continuation */
+};
+
+/* Single OBEX Object Push record with handle and class ID list */
+static const uint8_t sdp_browse_rsp[] = {
+	SDP_SVC_SEARCH_ATTR_RSP, 0x00, 0x01, 0x00, 0x17,
+	0x00, 0x14,
+	0x35, 0x12, 0x35, 0x10,
+	0x09, 0x00, 0x00, 0x0a, 0x00, 0x01, 0x00, 0x00,
+	0x09, 0x00, 0x01, 0x35, 0x03, 0x19, 0x11, 0x05,
+	0x00,
+};
+
+static void sdp_received(const void *buf, uint16_t len, void *user_data)
+{
+	struct test_data *data = tester_get_data();
+	struct bthost *bthost = hciemu_client_get_host(data->hciemu);
+	uint16_t cid = GPOINTER_TO_UINT(user_data);
+	const uint8_t *pdu = buf;
+	uint8_t rsp[sizeof(sdp_browse_rsp)];
+
+	if (len < 5 || pdu[0] != SDP_SVC_SEARCH_ATTR_REQ)
+		return;
+
+	/* Echo the transaction identifier of the request */
+	memcpy(rsp, sdp_browse_rsp, sizeof(rsp));
+	memcpy(rsp + 1, pdu + 1, 2);
+
+	bthost_send_cid(bthost, data->handle, cid, rsp, sizeof(rsp));
+}
+
+static void sdp_l2cap_connect(uint16_t handle, uint16_t cid, void *user_data)
+{
+	struct test_data *data = user_data;
+	struct bthost *bthost = hciemu_client_get_host(data->hciemu);
+
+	data->handle = handle;
+
+	bthost_add_cid_hook(bthost, handle, cid, sdp_received,
+							GUINT_TO_POINTER(cid));
+}
+
+static gboolean sdp_connect_cb(GIOChannel *io, GIOCondition cond,
+							gpointer user_data);
+
+static gboolean sdp_read_cb(GIOChannel *io, GIOCondition cond,
+							gpointer user_data)
+{
+	struct test_data *data = tester_get_data();
+	const struct bench_data *bench = data->test_data;
+	uint8_t rsp[64];
+	ssize_t len;
+
+	data->io_id = 0;
+
+	if (cond & (G_IO_ERR | G_IO_HUP))
+		goto failed;
+
+	len = read(data->sk, rsp, sizeof(rsp));
+	if (len < 0) {
+		if (errno == EAGAIN) {
+			data->io_id = g_io_add_watch(io,
+					G_IO_IN | G_IO_ERR | G_IO_HUP,
+					sdp_read_cb, NULL);
+			return FALSE;
+		}
+
+		tester_warn("Read failed: %s (%d)", strerror(errno), errno);
+		goto failed;
+	}
+
+	if (len < 5 || rsp[0] != SDP_SVC_SEARCH_ATTR_RSP) {
+		tester_warn("Unexpected SDP response");
+		goto failed;
+	}
+
+	/* Connection setup, request and response of a single browse */
+	tester_add_sample("Browse latency", "usec",
+					elapsed_usec(data->start_time));
+
+	close_l2cap_sock(data);
+
+	if (++data->iteration >= bench->count) {
+		tester_test_passed();
+		return FALSE;
+	}
+
+	if (!start_l2cap_connect(data, L2CAP_MODE_BASIC, sdp_connect_cb))
+		goto failed;
+
+	return FALSE;
+
+failed:
+	tester_test_failed();
+	return FALSE;
+}
+
+static gboolean sdp_connect_cb(GIOChannel *io, GIOCondition cond,
+							gpointer user_data)
+{
+	struct test_data *data = tester_get_data();
+	int err;
+
+	data->io_id = 0;
+
+	err = sock_error(data->sk);
+	if (err < 0) {
+		tester_warn("Connect failed: %s (%d)", strerror(-err), -err);
+		tester_test_failed();
+		return FALSE;
+	}
+
+	if (write(data->sk, sdp_browse_req, sizeof(sdp_browse_req)) < 0) {
+		tester_warn("Write failed: %s (%d)", strerror(errno), errno);
+		tester_test_failed();
+		return FALSE;
+	}
+
+	data->io_id = g_io_add_watch(io, G_IO_IN | G_IO_ERR | G_IO_HUP,
+							sdp_read_cb, NULL);
+
+	return FALSE;
+}
+
+static void test_sdp_browse(const void *test_data)
+{
+	struct test_data *data = tester_get_data();
+	const struct bench_data *bench = data->test_data;
+	struct bthost *bthost;
+
+	bthost = hciemu_client_get_host(data->hciemu);
+	bthost_set_server_psm(bthost, bench->psm);
+	bthost_set_l2cap_connect_cb(bthost, sdp_l2cap_connect, data);
+
+	if (!start_l2cap_connect(data, L2CAP_MODE_BASIC, sdp_connect_cb))
+		tester_test_failed();
+}
+
+int main(int argc, char *argv[])
+{
+	tester_init(&argc, &argv);
+
+	test_bench("Bench mgmt - Read Info", &mgmt_read_info_bench,
+				setup_powered, test_mgmt_read_info, 10);
+
+	test_bench("Bench L2CAP BR/EDR - Connect", &l2cap_connect_bench,
+				setup_powered, test_l2cap_connect, 30);
+
+	test_bench("Bench L2CAP BR/EDR - Basic Throughput",
+				&l2cap_basic_bench, setup_powered,
+				test_l2cap_throughput, 30);
+	test_bench("Bench L2CAP BR/EDR - ERTM Throughput",
+				&l2cap_ertm_bench, setup_powered,
+				test_l2cap_throughput, 30);
+	test_bench("Bench L2CAP BR/EDR - Streaming Throughput",
+				&l2cap_streaming_bench, setup_powered,
+				test_l2cap_throughput, 30);
+	test_bench("Bench L2CAP BR/EDR - Basic Throughput (Slow Link)",
+				&l2cap_basic_slow_link_bench, setup_powered,
+				test_l2cap_throughput, 30);
+
+	test_bench("Bench ATT BR/EDR - Read Requests", &att_read_bench,
+				setup_powered, test_att_read, 30);
+
+	test_bench("Bench SDP BR/EDR - Browse", &sdp_browse_bench,
+				setup_powered, test_sdp_browse, 30);
+
+	return tester_run();
+}
@@ -82,33 +82,6 @@ static const uint8_t btsnoop_id[] = { 0x62, 0x74, 0x73, 0x6e,
 
 static const uint32_t btsnoop_version = 1;
 
-static int btsnoop_create(const char *path)
-{
-	struct btsnoop_hdr hdr;
-	ssize_t written;
-	int fd;
-
-	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
-				S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
-	if (fd < 0) {
-		perror("failed to output file");
-		return -1;
-	}
-
-	memcpy(hdr.id, btsnoop_id, sizeof(btsnoop_id));
-	hdr.version = htonl(btsnoop_version);
-	hdr.type = htonl(2001);
-
-	written = write(fd, &hdr, BTSNOOP_HDR_SIZE);
-	if (written < 0) {
-		perror("failed to write output header");
-		close(fd);
-		return -1;
-	}
-
-	return fd;
-}
-
 static int btsnoop_open(const char *path, uint32_t *type)
 {
 	struct btsnoop_hdr hdr;
@@ -146,39 +119,389 @@ static int btsnoop_open(const char *path, uint32_t *type)
 	return fd;
 }
 
-#define MAX_MERGE 8
+#define IO_BUFFER_SIZE		(1024 * 1024)
+/* Anything larger than this is treated as a corrupt packet header */
+#define MAX_PACKET_SIZE		(1024 * 1024)
+
+struct btsnoop_reader {
+	FILE *fp;
+	char *buf;
+	uint32_t type;
+	uint16_t default_index;
+	struct btsnoop_pkt pkt;
+	unsigned char *data;
+	uint32_t data_size;
+	uint32_t len;
+	uint64_t ts;
+	uint64_t num;
+	uint16_t index;
+	uint16_t opcode;
+};
+
+struct btsnoop_writer {
+	FILE *fp;
+	char *buf;
+	uint32_t type;
+};
 
-static void command_merge(const char *output, int argc, char *argv[])
+static bool btsnoop_type_supported(uint32_t type)
 {
-	struct btsnoop_pkt input_pkt[MAX_MERGE];
-	unsigned char buf[2048];
-	int output_fd, input_fd[MAX_MERGE], num_input = 0;
-	int i, select_input;
-	ssize_t len, written;
-	uint32_t toread, flags;
-	uint16_t index, opcode;
-
-	if (argc > MAX_MERGE) {
-		fprintf(stderr, "only up to %d files allowed\n", MAX_MERGE);
-		return;
+	switch (type) {
+	case 1001:
+	case 1002:
+	case 2001:
+		return true;
 	}
 
-	for (i = 0; i < argc; i++) {
-		uint32_t type;
-		int fd;
+	return false;
+}
+
+static int reader_open(struct btsnoop_reader *reader, const char *path,
+							uint16_t index)
+{
+	uint32_t type;
+	int fd;
+
+	memset(reader, 0, sizeof(*reader));
+
+	fd = btsnoop_open(path, &type);
+	if (fd < 0)
+		return -1;
+
+	if (!btsnoop_type_supported(type)) {
+		fprintf(stderr, "unsupported link data type %u\n", type);
+		close(fd);
+		return -1;
+	}
+
+	reader->fp = fdopen(fd, "r");
+	if (!reader->fp) {
+		perror("failed to open input stream");
+		close(fd);
+		return -1;
+	}
+
+	reader->buf = malloc(IO_BUFFER_SIZE);
+	if (reader->buf)
+		setvbuf(reader->fp, reader->buf, _IOFBF, IO_BUFFER_SIZE);
+
+	reader->type = type;
+	reader->default_index = index;
+
+	return 0;
+}
+
+static void reader_close(struct btsnoop_reader *reader)
+{
+	if (reader->fp) {
+		fclose(reader->fp);
+		reader->fp = NULL;
+	}
+
+	free(reader->buf);
+	reader->buf = NULL;
+
+	free(reader->data);
+	reader->data = NULL;
+	reader->data_size = 0;
+}
+
+static int reader_reserve(struct btsnoop_reader *reader, uint32_t len)
+{
+	unsigned char *data;
+
+	if (len <= reader->data_size)
+		return 0;
+
+	data = realloc(reader->data, len);
+	if (!data) {
+		fprintf(stderr, "failed to allocate packet buffer\n");
+		return -1;
+	}
+
+	reader->data = data;
+	reader->data_size = len;
+
+	return 0;
+}
+
+/*
+ * Read the next packet and classify it as monitor opcode and index. The
+ * raw header and data are kept so packets can be copied unmodified.
+ *
+ * Returns 1 when a packet was read, 0 at the end of the file and -1 when
+ * the file is truncated or corrupt.
+ */
+static int reader_next(struct btsnoop_reader *reader)
+{
+	uint32_t flags;
+	size_t n;
 
-		fd = btsnoop_open(argv[i], &type);
-		if (fd < 0)
+	if (!reader->fp)
+		return 0;
+
+	n = fread(&reader->pkt, 1, BTSNOOP_PKT_SIZE, reader->fp);
+	if (n == 0 && feof(reader->fp))
+		return 0;
+
+	if (n != BTSNOOP_PKT_SIZE) {
+		fprintf(stderr, "failed to read header of packet %llu\n",
+				(unsigned long long) reader->num + 1);
+		return -1;
+	}
+
+	reader->len = ntohl(reader->pkt.len);
+	if (reader->len > MAX_PACKET_SIZE) {
+		fprintf(stderr, "packet %llu too large (%u bytes)\n",
+				(unsigned long long) reader->num + 1,
+				reader->len);
+		return -1;
+	}
+
+	if (reader_reserve(reader, reader->len) < 0)
+		return -1;
+
+	if (reader->len > 0 &&
+			fread(reader->data, reader->len, 1, reader->fp) != 1) {
+		fprintf(stderr, "failed to read data of packet %llu\n",
+				(unsigned long long) reader->num + 1);
+		return -1;
+	}
+
+	reader->num++;
+	reader->ts = ntoh64(reader->pkt.ts);
+
+	flags = ntohl(reader->pkt.flags);
+
+	reader->index = reader->default_index;
+	reader->opcode = 0xffff;
+
+	switch (reader->type) {
+	case 1001:
+		if (flags & 0x02) {
+			if (flags & 0x01)
+				reader->opcode = MONITOR_EVENT_PKT;
+			else
+				reader->opcode = MONITOR_COMMAND_PKT;
+		} else {
+			if (flags & 0x01)
+				reader->opcode = MONITOR_ACL_RX_PKT;
+			else
+				reader->opcode = MONITOR_ACL_TX_PKT;
+		}
+		break;
+
+	case 1002:
+		if (reader->len < 1)
 			break;
 
-		if (type != 1002) {
-			fprintf(stderr, "unsupported link data type %u\n",
-									type);
-			close(fd);
+		switch (reader->data[0]) {
+		case 0x01:
+			reader->opcode = MONITOR_COMMAND_PKT;
+			break;
+		case 0x02:
+			if (flags & 0x01)
+				reader->opcode = MONITOR_ACL_RX_PKT;
+			else
+				reader->opcode = MONITOR_ACL_TX_PKT;
+			break;
+		case 0x03:
+			if (flags & 0x01)
+				reader->opcode = MONITOR_SCO_RX_PKT;
+			else
+				reader->opcode = MONITOR_SCO_TX_PKT;
+			break;
+		case 0x04:
+			reader->opcode = MONITOR_EVENT_PKT;
 			break;
 		}
+		break;
+
+	case 2001:
+		reader->index = flags >> 16;
+		reader->opcode = flags & 0xffff;
+		break;
+	}
+
+	return 1;
+}
+
+static int writer_create(struct btsnoop_writer *writer, const char *path,
+								uint32_t type)
+{
+	struct btsnoop_hdr hdr;
+	int fd;
+
+	memset(writer, 0, sizeof(*writer));
+
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+				S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+	if (fd < 0) {
+		perror("failed to output file");
+		return -1;
+	}
+
+	writer->fp = fdopen(fd, "w");
+	if (!writer->fp) {
+		perror("failed to open output stream");
+		close(fd);
+		return -1;
+	}
+
+	writer->buf = malloc(IO_BUFFER_SIZE);
+	if (writer->buf)
+		setvbuf(writer->fp, writer->buf, _IOFBF, IO_BUFFER_SIZE);
+
+	writer->type = type;
+
+	memcpy(hdr.id, btsnoop_id, sizeof(btsnoop_id));
+	hdr.version = htonl(btsnoop_version);
+	hdr.type = htonl(type);
+
+	if (fwrite(&hdr, BTSNOOP_HDR_SIZE, 1, writer->fp) != 1) {
+		perror("failed to write output header");
+		fclose(writer->fp);
+		free(writer->buf);
+		writer->fp = NULL;
+		return -1;
+	}
+
+	return 0;
+}
+
+static int writer_close(struct btsnoop_writer *writer)
+{
+	int err = 0;
+
+	if (writer->fp && fclose(writer->fp) != 0) {
+		perror("failed to write output file");
+		err = -1;
+	}
+
+	writer->fp = NULL;
+
+	free(writer->buf);
+	writer->buf = NULL;
+
+	return err;
+}
+
+static bool writer_copy(struct btsnoop_writer *writer,
+					const struct btsnoop_reader *reader)
+{
+	if (fwrite(&reader->pkt, BTSNOOP_PKT_SIZE, 1, writer->fp) != 1) {
+		fprintf(stderr, "write of packet header failed\n");
+		return false;
+	}
+
+	if (reader->len > 0 &&
+		fwrite(reader->data, reader->len, 1, writer->fp) != 1) {
+		fprintf(stderr, "write of packet data failed\n");
+		return false;
+	}
+
+	return true;
+}
+
+static bool writer_monitor(struct btsnoop_writer *writer,
+					const struct btsnoop_reader *reader)
+{
+	struct btsnoop_pkt pkt;
+	const unsigned char *data = reader->data;
+	uint32_t len = reader->len, size = ntohl(reader->pkt.size);
+
+	if (reader->opcode == 0xffff)
+		return true;
+
+	/* The H:4 packet indicator is implied by the monitor opcode */
+	if (reader->type == 1002 && len > 0) {
+		data++;
+		len--;
+		size--;
+	}
+
+	pkt.size = htonl(size);
+	pkt.len = htonl(len);
+	pkt.flags = htonl((reader->index << 16) | reader->opcode);
+	pkt.drops = reader->pkt.drops;
+	pkt.ts = reader->pkt.ts;
+
+	if (fwrite(&pkt, BTSNOOP_PKT_SIZE, 1, writer->fp) != 1) {
+		fprintf(stderr, "write of packet header failed\n");
+		return false;
+	}
+
+	if (len > 0 && fwrite(data, len, 1, writer->fp) != 1) {
+		fprintf(stderr, "write of packet data failed\n");
+		return false;
+	}
+
+	return true;
+}
+
+struct merge_heap {
+	struct btsnoop_reader **entries;
+	unsigned int count;
+};
+
+static bool heap_less(const struct btsnoop_reader *a,
+					const struct btsnoop_reader *b)
+{
+	if (a->ts != b->ts)
+		return a->ts < b->ts;
+
+	/* Keep the input order for packets with equal timestamps */
+	return a->default_index < b->default_index;
+}
+
+static void heap_sift_down(struct merge_heap *heap, unsigned int pos)
+{
+	struct btsnoop_reader **entries = heap->entries;
+
+	for (;;) {
+		unsigned int left = 2 * pos + 1, right = left + 1;
+		unsigned int min = pos;
+		struct btsnoop_reader *tmp;
+
+		if (left < heap->count && heap_less(entries[left], entries[min]))
+			min = left;
+
+		if (right < heap->count &&
+				heap_less(entries[right], entries[min]))
+			min = right;
+
+		if (min == pos)
+			break;
+
+		tmp = entries[pos];
+		entries[pos] = entries[min];
+		entries[min] = tmp;
+
+		pos = min;
+	}
+}
+
+static int command_merge(const char *output, int argc, char *argv[])
+{
+	struct btsnoop_reader *readers;
+	struct btsnoop_writer writer;
+	struct merge_heap heap;
+	int i, num_input = 0, err = -1;
+
+	readers = calloc(argc, sizeof(*readers));
+	heap.entries = calloc(argc, sizeof(*heap.entries));
+	heap.count = 0;
+
+	if (!readers || !heap.entries) {
+		fprintf(stderr, "failed to allocate merge state\n");
+		goto free_state;
+	}
+
+	for (i = 0; i < argc; i++) {
+		if (reader_open(&readers[i], argv[i], i) < 0)
+			break;
 
-		input_fd[num_input++] = fd;
+		num_input++;
 	}
 
 	if (num_input != argc) {
@@ -186,108 +509,206 @@ static void command_merge(const char *output, int argc, char *argv[])
 		goto close_input;
 	}
 
-	output_fd = btsnoop_create(output);
-	if (output_fd < 0)
+	if (writer_create(&writer, output, 2001) < 0)
 		goto close_input;
 
 	for (i = 0; i < num_input; i++) {
-		len = read(input_fd[i], &input_pkt[i], BTSNOOP_PKT_SIZE);
-		if (len < 0 || len != BTSNOOP_PKT_SIZE) {
-			close(input_fd[i]);
-			input_fd[i] = -1;
-		}
+		int res = reader_next(&readers[i]);
+
+		if (res < 0)
+			goto close_output;
+
+		if (res > 0)
+			heap.entries[heap.count++] = &readers[i];
 	}
 
-next_packet:
-	select_input = -1;
+	for (i = heap.count / 2; i > 0; i--)
+		heap_sift_down(&heap, i - 1);
 
-	for (i = 0; i < num_input; i++) {
-		uint64_t ts;
+	while (heap.count > 0) {
+		struct btsnoop_reader *reader = heap.entries[0];
+		int res;
 
-		if (input_fd[i] < 0)
-			continue;
+		if (!writer_monitor(&writer, reader))
+			goto close_output;
 
-		if (select_input < 0) {
-			select_input = i;
-			continue;
-		}
+		res = reader_next(reader);
+		if (res < 0)
+			goto close_output;
 
-		ts = ntoh64(input_pkt[i].ts);
+		if (res == 0)
+			heap.entries[0] = heap.entries[--heap.count];
 
-		if (ts < ntoh64(input_pkt[select_input].ts))
-			select_input = i;
+		heap_sift_down(&heap, 0);
 	}
 
-	if (select_input < 0)
-		goto close_output;
+	err = 0;
 
-	toread = ntohl(input_pkt[select_input].size);
-	flags = ntohl(input_pkt[select_input].flags);
+close_output:
+	if (writer_close(&writer) < 0)
+		err = -1;
 
-	len = read(input_fd[select_input], buf, toread);
-	if (len < 0 || len != (ssize_t) toread) {
-		close(input_fd[select_input]);
-		input_fd[select_input] = -1;
-		goto next_packet;
+close_input:
+	for (i = 0; i < num_input; i++)
+		reader_close(&readers[i]);
+
+free_state:
+	free(heap.entries);
+	free(readers);
+
+	return err;
+}
+
+struct slice_range {
+	uint64_t first;
+	uint64_t last;
+	double from;
+	double to;
+};
+
+static int command_slice(const char *output, const char *input,
+					const struct slice_range *range)
+{
+	struct btsnoop_reader reader;
+	struct btsnoop_writer writer;
+	uint64_t start_ts = 0;
+	unsigned long count = 0;
+	int res, err = 0;
+
+	if (reader_open(&reader, input, 0) < 0)
+		return -1;
+
+	if (writer_create(&writer, output, reader.type) < 0) {
+		reader_close(&reader);
+		return -1;
 	}
 
-	written = input_pkt[select_input].size = htonl(toread - 1);
-	written = input_pkt[select_input].len = htonl(toread - 1);
+	while ((res = reader_next(&reader)) > 0) {
+		double offset;
 
-	switch (buf[0]) {
-	case 0x01:
-		opcode = MONITOR_COMMAND_PKT;
-		break;
-	case 0x02:
-		if (flags & 0x01)
-			opcode = MONITOR_ACL_RX_PKT;
-		else
-			opcode = MONITOR_ACL_TX_PKT;
-		break;
-	case 0x03:
-		if (flags & 0x01)
-			opcode = MONITOR_SCO_RX_PKT;
-		else
-			opcode = MONITOR_ACL_TX_PKT;
-		break;
-	case 0x04:
-		opcode = MONITOR_EVENT_PKT;
-		break;
-	default:
-		goto skip_write;
+		if (reader.num == 1)
+			start_ts = reader.ts;
+
+		if (reader.num < range->first)
+			continue;
+
+		if (range->last && reader.num > range->last)
+			break;
+
+		/* Time range is relative to the first packet in seconds */
+		offset = (reader.ts - start_ts) / 1000000.0;
+
+		if (offset < range->from)
+			continue;
+
+		if (range->to >= 0 && offset > range->to)
+			break;
+
+		if (!writer_copy(&writer, &reader)) {
+			err = -1;
+			break;
+		}
+
+		count++;
 	}
 
-	index = select_input;
-	input_pkt[select_input].flags = htonl((index << 16) | opcode);
+	if (res < 0)
+		err = -1;
 
-	written = write(output_fd, &input_pkt[select_input], BTSNOOP_PKT_SIZE);
-	if (written != BTSNOOP_PKT_SIZE) {
-		fprintf(stderr, "write of packet header failed\n");
-		goto close_output;
+	if (writer_close(&writer) < 0)
+		err = -1;
+
+	reader_close(&reader);
+
+	printf("%lu packets written\n", count);
+
+	return err;
+}
+
+#define FILTER_COMMAND	(1 << MONITOR_COMMAND_PKT)
+#define FILTER_EVENT	(1 << MONITOR_EVENT_PKT)
+#define FILTER_ACL	((1 << MONITOR_ACL_TX_PKT) | (1 << MONITOR_ACL_RX_PKT))
+#define FILTER_SCO	((1 << MONITOR_SCO_TX_PKT) | (1 << MONITOR_SCO_RX_PKT))
+#define FILTER_INDEX	((1 << MONITOR_NEW_INDEX) | (1 << MONITOR_DEL_INDEX))
+
+static int parse_packet_types(const char *str, uint32_t *mask)
+{
+	char *list, *type, *saveptr = NULL;
+	int err = 0;
+
+	list = strdup(str);
+	if (!list)
+		return -1;
+
+	*mask = 0;
+
+	for (type = strtok_r(list, ",", &saveptr); type;
+				type = strtok_r(NULL, ",", &saveptr)) {
+		if (!strcasecmp(type, "cmd"))
+			*mask |= FILTER_COMMAND;
+		else if (!strcasecmp(type, "evt"))
+			*mask |= FILTER_EVENT;
+		else if (!strcasecmp(type, "acl"))
+			*mask |= FILTER_ACL;
+		else if (!strcasecmp(type, "sco"))
+			*mask |= FILTER_SCO;
+		else if (!strcasecmp(type, "index"))
+			*mask |= FILTER_INDEX;
+		else {
+			fprintf(stderr, "unknown packet type %s\n", type);
+			err = -1;
+			break;
+		}
 	}
 
-	written = write(output_fd, buf + 1, toread - 1);
-	if (written != (ssize_t) toread - 1) {
-		fprintf(stderr, "write of packet data failed\n");
-		goto close_output;
+	free(list);
+
+	return err;
+}
+
+static int command_filter(const char *output, const char *input,
+					int index, uint32_t packet_mask)
+{
+	struct btsnoop_reader reader;
+	struct btsnoop_writer writer;
+	unsigned long count = 0;
+	int res, err = 0;
+
+	if (reader_open(&reader, input, 0) < 0)
+		return -1;
+
+	if (writer_create(&writer, output, reader.type) < 0) {
+		reader_close(&reader);
+		return -1;
 	}
 
-skip_write:
-	len = read(input_fd[select_input],
-				&input_pkt[select_input], BTSNOOP_PKT_SIZE);
-	if (len < 0 || len != BTSNOOP_PKT_SIZE) {
-		close(input_fd[select_input]);
-		input_fd[select_input] = -1;
+	while ((res = reader_next(&reader)) > 0) {
+		if (index >= 0 && reader.index != index)
+			continue;
+
+		if (packet_mask && (reader.opcode > 31 ||
+				!(packet_mask & (1 << reader.opcode))))
+			continue;
+
+		if (!writer_copy(&writer, &reader)) {
+			err = -1;
+			break;
+		}
+
+		count++;
 	}
 
-	goto next_packet;
+	if (res < 0)
+		err = -1;
 
-close_output:
-	close(output_fd);
+	if (writer_close(&writer) < 0)
+		err = -1;
 
-close_input:
-	for (i = 0; i < num_input; i++)
-		close(input_fd[i]);
+	reader_close(&reader);
+
+	printf("%lu packets written\n", count);
+
+	return err;
 }
 
 static void command_extract_eir(const char *input)
@@ -535,20 +956,47 @@ static void usage(void)
 	printf("\tbtsnoop <command> [files]\n");
 	printf("commands:\n"
 		"\t-m, --merge <output>   Merge multiple btsnoop files\n"
+		"\t-s, --slice <output>   Extract a packet or time range\n"
+		"\t-f, --filter <output>  Extract packets by index or type\n"
 		"\t-e, --extract <input>  Extract data from btsnoop file\n"
 		"\t-h, --help             Show help options\n");
+	printf("slice options:\n"
+		"\t--first <num>          First packet number to include\n"
+		"\t--last <num>           Last packet number to include\n"
+		"\t--from <seconds>       Start time relative to first packet\n"
+		"\t--to <seconds>         End time relative to first packet\n");
+	printf("filter options:\n"
+		"\t--index <num>          Controller index to include\n"
+		"\t--packets <list>       Packet types (cmd,evt,acl,sco,index)\n");
 }
 
+enum {
+	OPT_FIRST = 256,
+	OPT_LAST,
+	OPT_FROM,
+	OPT_TO,
+	OPT_INDEX,
+	OPT_PACKETS,
+};
+
 static const struct option main_options[] = {
 	{ "merge",   required_argument, NULL, 'm' },
+	{ "slice",   required_argument, NULL, 's' },
+	{ "filter",  required_argument, NULL, 'f' },
 	{ "extract", required_argument, NULL, 'e' },
 	{ "type",    required_argument, NULL, 't' },
+	{ "first",   required_argument, NULL, OPT_FIRST },
+	{ "last",    required_argument, NULL, OPT_LAST },
+	{ "from",    required_argument, NULL, OPT_FROM },
+	{ "to",      required_argument, NULL, OPT_TO },
+	{ "index",   required_argument, NULL, OPT_INDEX },
+	{ "packets", required_argument, NULL, OPT_PACKETS },
 	{ "version", no_argument,       NULL, 'v' },
 	{ "help",    no_argument,       NULL, 'h' },
 	{ }
 };
 
-enum { INVALID, MERGE, EXTRACT };
+enum { INVALID, MERGE, SLICE, FILTER, EXTRACT };
 
 int main(int argc, char *argv[])
 {
@@ -556,11 +1004,16 @@ int main(int argc, char *argv[])
 	const char *input_path = NULL;
 	const char *type = NULL;
 	unsigned short command = INVALID;
+	struct slice_range range = { .first = 0, .last = 0,
+						.from = 0, .to = -1 };
+	uint32_t packet_mask = 0;
+	int index = -1;
 
 	for (;;) {
 		int opt;
 
-		opt = getopt_long(argc, argv, "m:e:t:vh", main_options, NULL);
+		opt = getopt_long(argc, argv, "m:s:f:e:t:vh", main_options,
+									NULL);
 		if (opt < 0)
 			break;
 
@@ -569,6 +1022,33 @@ int main(int argc, char *argv[])
 			command = MERGE;
 			output_path = optarg;
 			break;
+		case 's':
+			command = SLICE;
+			output_path = optarg;
+			break;
+		case 'f':
+			command = FILTER;
+			output_path = optarg;
+			break;
+		case OPT_FIRST:
+			range.first = strtoull(optarg, NULL, 0);
+			break;
+		case OPT_LAST:
+			range.last = strtoull(optarg, NULL, 0);
+			break;
+		case OPT_FROM:
+			range.from = strtod(optarg, NULL);
+			break;
+		case OPT_TO:
+			range.to = strtod(optarg, NULL);
+			break;
+		case OPT_INDEX:
+			index = atoi(optarg);
+			break;
+		case OPT_PACKETS:
+			if (parse_packet_types(optarg, &packet_mask) < 0)
+				return EXIT_FAILURE;
+			break;
 		case 'e':
 			command = EXTRACT;
 			input_path = optarg;
@@ -594,7 +1074,35 @@ int main(int argc, char *argv[])
 			return EXIT_FAILURE;
 		}
 
-		command_merge(output_path, argc - optind, argv + optind);
+		if (command_merge(output_path, argc - optind,
+						argv + optind) < 0)
+			return EXIT_FAILURE;
+		break;
+
+	case SLICE:
+		if (argc - optind != 1) {
+			fprintf(stderr, "one input file required\n");
+			return EXIT_FAILURE;
+		}
+
+		if (command_slice(output_path, argv[optind], &range) < 0)
+			return EXIT_FAILURE;
+		break;
+
+	case FILTER:
+		if (argc - optind != 1) {
+			fprintf(stderr, "one input file required\n");
+			return EXIT_FAILURE;
+		}
+
+		if (index < 0 && !packet_mask) {
+			fprintf(stderr, "no index or packet types specified\n");
+			return EXIT_FAILURE;
+		}
+
+		if (command_filter(output_path, argv[optind], index,
+							packet_mask) < 0)
+			return EXIT_FAILURE;
 		break;
 
 	case EXTRACT:
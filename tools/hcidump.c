@@ -34,6 +34,7 @@
 #include <string.h>
 #include <getopt.h>
 #include <sys/poll.h>
+#include <sys/uio.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/ioctl.h>
@@ -47,6 +48,10 @@
 
 #define SNAP_LEN	HCI_MAX_FRAME_SIZE
 
+#define CTRL_LEN	100
+#define BATCH_DEFAULT	64
+#define BATCH_MAX	256
+
 /* Modes */
 enum {
 	PARSE,
@@ -60,6 +65,7 @@ enum {
 static int  snap_len = SNAP_LEN;
 static int  mode = PARSE;
 static int  permcheck = 1;
+static int  batch = 0;
 static char *dump_file = NULL;
 static char *pppdump_file = NULL;
 static char *audio_file = NULL;
@@ -136,13 +142,125 @@ static inline int write_n(int fd, char *buf, int len)
 	return t;
 }
 
-static int process_frames(int dev, int sock, int fd, unsigned long flags)
+static inline int writev_n(int fd, struct iovec *iov, int iovcnt)
+{
+	int t = 0, w;
+
+	while (iovcnt > 0) {
+		if ((w = writev(fd, iov, iovcnt)) < 0) {
+			if (errno == EINTR || errno == EAGAIN)
+				continue;
+			return -1;
+		}
+		if (!w)
+			return 0;
+		t += w;
+
+		/* Skip over the vectors that have been fully written */
+		while (iovcnt > 0 && (size_t) w >= iov->iov_len) {
+			w -= iov->iov_len;
+			iov++; iovcnt--;
+		}
+
+		if (iovcnt > 0) {
+			iov->iov_base = (char *) iov->iov_base + w;
+			iov->iov_len -= w;
+		}
+	}
+	return t;
+}
+
+static void process_cmsg(struct msghdr *msg, struct frame *frm,
+							uint32_t *drops)
 {
 	struct cmsghdr *cmsg;
+
+	cmsg = CMSG_FIRSTHDR(msg);
+	while (cmsg) {
+		int dir;
+
+		if (cmsg->cmsg_level == SOL_SOCKET) {
+#ifdef SO_RXQ_OVFL
+			if (cmsg->cmsg_type == SO_RXQ_OVFL && drops)
+				memcpy(drops, CMSG_DATA(cmsg),
+							sizeof(uint32_t));
+#endif
+			cmsg = CMSG_NXTHDR(msg, cmsg);
+			continue;
+		}
+
+		switch (cmsg->cmsg_type) {
+		case HCI_CMSG_DIR:
+			memcpy(&dir, CMSG_DATA(cmsg), sizeof(int));
+			frm->in = (uint8_t) dir;
+			break;
+		case HCI_CMSG_TSTAMP:
+			memcpy(&frm->ts, CMSG_DATA(cmsg),
+					sizeof(struct timeval));
+			break;
+		}
+		cmsg = CMSG_NXTHDR(msg, cmsg);
+	}
+}
+
+static void dump_header(void *buf, struct frame *frm, unsigned long flags,
+							uint32_t drops)
+{
+	struct hcidump_hdr *dh = buf;
+	struct btsnoop_pkt *dp = buf;
+
+	if (flags & DUMP_BTSNOOP) {
+		uint64_t ts;
+		uint8_t pkt_type = ((uint8_t *) frm->data)[0];
+		dp->size = htonl(frm->data_len);
+		dp->len  = dp->size;
+		dp->flags = ntohl(frm->in & 0x01);
+		dp->drops = htonl(drops);
+		ts = (frm->ts.tv_sec - 946684800ll) * 1000000ll + frm->ts.tv_usec;
+		dp->ts = hton64(ts + 0x00E03AB44A676000ll);
+		if (pkt_type == HCI_COMMAND_PKT ||
+				pkt_type == HCI_EVENT_PKT)
+			dp->flags |= ntohl(0x02);
+	} else {
+		dh->len = htobs(frm->data_len);
+		dh->in  = frm->in;
+		dh->ts_sec  = htobl(frm->ts.tv_sec);
+		dh->ts_usec = htobl(frm->ts.tv_usec);
+	}
+}
+
+static void init_frame(struct frame *frm, int dev, int len)
+{
+	frm->data_len = len;
+	frm->dev_id = dev;
+	frm->in = 0;
+	frm->pppdump_fd = parser.pppdump_fd;
+	frm->audio_fd   = parser.audio_fd;
+}
+
+static int poll_socket(struct pollfd *fds, int nfds, int sock)
+{
+	int i, n = poll(fds, nfds, -1);
+	if (n <= 0)
+		return 0;
+
+	for (i = 0; i < nfds; i++) {
+		if (fds[i].revents & (POLLHUP | POLLERR | POLLNVAL)) {
+			if (fds[i].fd == sock)
+				printf("device: disconnected\n");
+			else
+				printf("client: disconnect\n");
+			return -1;
+		}
+	}
+
+	return n;
+}
+
+static int process_frames(int dev, int sock, int fd, unsigned long flags)
+{
 	struct msghdr msg;
 	struct iovec  iv;
-	struct hcidump_hdr *dh;
-	struct btsnoop_pkt *dp;
 	struct frame frm;
 	struct pollfd fds[2];
 	int nfds = 0;
@@ -164,11 +282,9 @@ static int process_frames(int dev, int sock, int fd, unsigned long flags)
 		return -1;
 	}
 
-	dh = (void *) buf;
-	dp = (void *) buf;
 	frm.data = buf + hdr_size;
 
-	ctrl = malloc(100);
+	ctrl = malloc(CTRL_LEN);
 	if (!ctrl) {
 		free(buf);
 		perror("Can't allocate control buffer");
@@ -190,27 +306,19 @@ static int process_frames(int dev, int sock, int fd, unsigned long flags)
 	nfds++;
 
 	while (1) {
-		int i, n = poll(fds, nfds, -1);
-		if (n <= 0)
+		int n = poll_socket(fds, nfds, sock);
+		if (n < 0)
+			return 0;
+		if (n == 0)
 			continue;
 
-		for (i = 0; i < nfds; i++) {
-			if (fds[i].revents & (POLLHUP | POLLERR | POLLNVAL)) {
-				if (fds[i].fd == sock)
-					printf("device: disconnected\n");
-				else
-					printf("client: disconnect\n");
-				return 0;
-			}
-		}
-
 		iv.iov_base = frm.data;
 		iv.iov_len  = snap_len;
 
 		msg.msg_iov = &iv;
 		msg.msg_iovlen = 1;
 		msg.msg_control = ctrl;
-		msg.msg_controllen = 100;
+		msg.msg_controllen = CTRL_LEN;
 
 		len = recvmsg(sock, &msg, MSG_DONTWAIT);
 		if (len < 0) {
@@ -221,27 +329,8 @@ static int process_frames(int dev, int sock, int fd, unsigned long flags)
 		}
 
 		/* Process control message */
-		frm.data_len = len;
-		frm.dev_id = dev;
-		frm.in = 0;
-		frm.pppdump_fd = parser.pppdump_fd;
-		frm.audio_fd   = parser.audio_fd;
-
-		cmsg = CMSG_FIRSTHDR(&msg);
-		while (cmsg) {
-			int dir;
-			switch (cmsg->cmsg_type) {
-			case HCI_CMSG_DIR:
-				memcpy(&dir, CMSG_DATA(cmsg), sizeof(int));
-				frm.in = (uint8_t) dir;
-				break;
-			case HCI_CMSG_TSTAMP:
-				memcpy(&frm.ts, CMSG_DATA(cmsg),
-						sizeof(struct timeval));
-				break;
-			}
-			cmsg = CMSG_NXTHDR(&msg, cmsg);
-		}
+		init_frame(&frm, dev, len);
+		process_cmsg(&msg, &frm, NULL);
 
 		frm.ptr = frm.data;
 		frm.len = frm.data_len;
@@ -249,24 +338,7 @@ static int process_frames(int dev, int sock, int fd, unsigned long flags)
 		switch (mode) {
 		case WRITE:
 			/* Save or send dump */
-			if (flags & DUMP_BTSNOOP) {
-				uint64_t ts;
-				uint8_t pkt_type = ((uint8_t *) frm.data)[0];
-				dp->size = htonl(frm.data_len);
-				dp->len  = dp->size;
-				dp->flags = ntohl(frm.in & 0x01);
-				dp->drops = 0;
-				ts = (frm.ts.tv_sec - 946684800ll) * 1000000ll + frm.ts.tv_usec;
-				dp->ts = hton64(ts + 0x00E03AB44A676000ll);
-				if (pkt_type == HCI_COMMAND_PKT ||
-						pkt_type == HCI_EVENT_PKT)
-					dp->flags |= ntohl(0x02);
-			} else {
-				dh->len = htobs(frm.data_len);
-				dh->in  = frm.in;
-				dh->ts_sec  = htobl(frm.ts.tv_sec);
-				dh->ts_usec = htobl(frm.ts.tv_usec);
-			}
+			dump_header(buf, &frm, flags, 0);
 
 			if (write_n(fd, buf, frm.data_len + hdr_size) < 0) {
 				perror("Write error");
@@ -284,6 +356,143 @@ static int process_frames(int dev, int sock, int fd, unsigned long flags)
 	return 0;
 }
 
+/*
+ * Batched variant of process_frames(). Every wakeup pulls up to batch
+ * frames with a single recvmmsg() into preallocated slots that already
+ * have room for the dump header, so a whole batch is written with one
+ * writev() call.
+ */
+static int process_frames_batch(int dev, int sock, int fd,
+							unsigned long flags)
+{
+	struct mmsghdr *msgs;
+	struct iovec *iovs, *out;
+	struct frame frm;
+	struct pollfd fds[2];
+	int nfds = 0, i, err = -1;
+	char *bufs, *ctrls;
+	int hdr_size = HCIDUMP_HDR_SIZE, slot_size;
+	uint32_t drops = 0, reported = 0;
+	unsigned long frames = 0, calls = 0;
+
+	if (sock < 0)
+		return -1;
+
+	if (snap_len < SNAP_LEN)
+		snap_len = SNAP_LEN;
+
+	if (flags & DUMP_BTSNOOP)
+		hdr_size = BTSNOOP_PKT_SIZE;
+
+	slot_size = hdr_size + snap_len;
+
+	bufs = malloc(batch * slot_size);
+	ctrls = malloc(batch * CTRL_LEN);
+	msgs = calloc(batch, sizeof(*msgs));
+	iovs = calloc(batch, sizeof(*iovs));
+	out = calloc(batch, sizeof(*out));
+
+	if (!bufs || !ctrls || !msgs || !iovs || !out) {
+		perror("Can't allocate batch buffers");
+		goto done;
+	}
+
+#ifdef SO_RXQ_OVFL
+	i = 1;
+	if (setsockopt(sock, SOL_SOCKET, SO_RXQ_OVFL, &i, sizeof(i)) < 0)
+		perror("Can't enable drop counter");
+#endif
+
+	if (dev == HCI_DEV_NONE)
+		printf("system: ");
+	else
+		printf("device: hci%d ", dev);
+
+	printf("snap_len: %d filter: 0x%lx batch: %d\n", snap_len,
+						parser.filter, batch);
+
+	fds[nfds].fd = sock;
+	fds[nfds].events = POLLIN;
+	fds[nfds].revents = 0;
+	nfds++;
+
+	while (1) {
+		int n = poll_socket(fds, nfds, sock);
+		if (n < 0) {
+			err = 0;
+			break;
+		}
+		if (n == 0)
+			continue;
+
+		for (i = 0; i < batch; i++) {
+			struct msghdr *msg = &msgs[i].msg_hdr;
+
+			iovs[i].iov_base = bufs + i * slot_size + hdr_size;
+			iovs[i].iov_len  = snap_len;
+
+			memset(msg, 0, sizeof(*msg));
+			msg->msg_iov = &iovs[i];
+			msg->msg_iovlen = 1;
+			msg->msg_control = ctrls + i * CTRL_LEN;
+			msg->msg_controllen = CTRL_LEN;
+		}
+
+		n = recvmmsg(sock, msgs, batch, MSG_DONTWAIT, NULL);
+		if (n < 0) {
+			if (errno == EAGAIN || errno == EINTR)
+				continue;
+			perror("Receive failed");
+			break;
+		}
+
+		calls++;
+		frames += n;
+
+		for (i = 0; i < n; i++) {
+			char *buf = bufs + i * slot_size;
+
+			frm.data = buf + hdr_size;
+			init_frame(&frm, dev, msgs[i].msg_len);
+			process_cmsg(&msgs[i].msg_hdr, &frm, &drops);
+
+			frm.ptr = frm.data;
+			frm.len = frm.data_len;
+
+			if (mode == WRITE) {
+				dump_header(buf, &frm, flags, drops);
+
+				out[i].iov_base = buf;
+				out[i].iov_len  = frm.data_len + hdr_size;
+			} else
+				parse(&frm);
+		}
+
+		if (mode == WRITE && writev_n(fd, out, n) < 0) {
+			perror("Write error");
+			break;
+		}
+
+		if (drops != reported) {
+			fprintf(stderr, "dropped: %u frames (%lu received "
+					"in %lu calls)\n", drops - reported,
+					frames, calls);
+			reported = drops;
+		}
+	}
+
+	printf("frames: %lu calls: %lu dropped: %u\n", frames, calls, drops);
+
+done:
+	free(out);
+	free(iovs);
+	free(msgs);
+	free(ctrls);
+	free(bufs);
+
+	return err;
+}
+
 static void read_dump(int fd)
 {
 	struct hcidump_hdr dh;
@@ -657,6 +866,7 @@ static void usage(void)
 	"  -D, --pppdump=file         Extract PPP traffic\n"
 	"  -A, --audio=file           Extract SCO audio data\n"
 	"  -Y, --novendor             No vendor commands or events\n"
+	"  -B, --batch[=count]        Receive and write frames in batches\n"
 	"  -h, --help                 Give this help list\n"
 	"  -v, --version              Give version information\n"
 	"      --usage                Give a short usage message\n"
@@ -683,6 +893,7 @@ static struct option main_options[] = {
 	{ "pppdump",		1, 0, 'D' },
 	{ "audio",		1, 0, 'A' },
 	{ "novendor",		0, 0, 'Y' },
+	{ "batch",		2, 0, 'B' },
 	{ "nopermcheck",	0, 0, 'Z' },
 	{ "help",		0, 0, 'h' },
 	{ "version",		0, 0, 'v' },
@@ -700,7 +911,7 @@ int main(int argc, char *argv[])
 	uint16_t obex_port;
 
 	while ((opt = getopt_long(argc, argv,
-				"i:l:p:m:w:r:taxXRC:H:O:P:S:D:A:YZhv",
+				"i:l:p:m:w:r:taxXRC:H:O:P:S:D:A:B::YZhv",
 				main_options, NULL)) != -1) {
 		switch(opt) {
 		case 'i':
@@ -788,6 +999,14 @@ int main(int argc, char *argv[])
 			flags |= DUMP_NOVENDOR;
 			break;
 
+		case 'B':
+			batch = optarg ? atoi(optarg) : BATCH_DEFAULT;
+			if (batch < 1)
+				batch = 1;
+			else if (batch > BATCH_MAX)
+				batch = BATCH_MAX;
+			break;
+
 		case 'Z':
 			permcheck = 0;
 			break;
@@ -827,7 +1046,12 @@ int main(int argc, char *argv[])
 		flags |= DUMP_VERBOSE;
 		init_parser(flags, filter, defpsm, defcompid,
 							pppdump_fd, audio_fd);
-		process_frames(device, open_socket(device, flags), -1, flags);
+		if (batch)
+			process_frames_batch(device, open_socket(device, flags),
+								-1, flags);
+		else
+			process_frames(device, open_socket(device, flags),
+								-1, flags);
 		break;
 
 	case READ:
@@ -839,7 +1063,11 @@ int main(int argc, char *argv[])
 
 	case WRITE:
 		flags |= DUMP_BTSNOOP;
-		process_frames(device, open_socket(device, flags),
+		if (batch)
+			process_frames_batch(device, open_socket(device, flags),
+				open_file(dump_file, mode, flags), flags);
+		else
+			process_frames(device, open_socket(device, flags),
 				open_file(dump_file, mode, flags), flags);
 		break;
 	}
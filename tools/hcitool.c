@@ -581,7 +581,7 @@ static void cmd_scan(int dev_id, int argc, char **argv)
 	uint8_t lap[3] = { 0x33, 0x8b, 0x9e };
 	int num_rsp, length, flags;
 	uint8_t cls[3], features[8];
-	char addr[18], name[249], *comp, *tmp;
+	char addr[18], name[249], **comps = NULL, *tmp;
 	struct hci_version version;
 	struct hci_dev_info di;
 	struct hci_conn_info_req *cr;
@@ -677,6 +677,21 @@ static void cmd_scan(int dev_id, int argc, char **argv)
 		exit(1);
 	}
 
+	if (extoui && num_rsp > 0) {
+		bdaddr_t *ba = malloc(num_rsp * sizeof(*ba));
+
+		comps = calloc(num_rsp, sizeof(*comps));
+
+		if (ba && comps) {
+			for (i = 0; i < num_rsp; i++)
+				bacpy(&ba[i], &(info+i)->bdaddr);
+
+			batocomp_list(ba, num_rsp, comps);
+		}
+
+		free(ba);
+	}
+
 	if (extcls || extinf || extoui)
 		printf("\n");
 
@@ -725,14 +740,10 @@ static void cmd_scan(int dev_id, int argc, char **argv)
 		printf("BD Address:\t%s [mode %d, clkoffset 0x%4.4x]\n", addr,
 			(info+i)->pscan_rep_mode, btohs((info+i)->clock_offset));
 
-		if (extoui) {
-			comp = batocomp(&(info+i)->bdaddr);
-			if (comp) {
-				char oui[9];
-				ba2oui(&(info+i)->bdaddr, oui);
-				printf("OUI company:\t%s (%s)\n", comp, oui);
-				free(comp);
-			}
+		if (comps && comps[i]) {
+			char oui[9];
+			ba2oui(&(info+i)->bdaddr, oui);
+			printf("OUI company:\t%s (%s)\n", comps[i], oui);
 		}
 
 		cc = 0;
@@ -830,6 +841,13 @@ static void cmd_scan(int dev_id, int argc, char **argv)
 		printf("\n");
 	}
 
+	if (comps) {
+		for (i = 0; i < num_rsp; i++)
+			free(comps[i]);
+
+		free(comps);
+	}
+
 	bt_free(info);
 
 	hci_close_dev(dd);
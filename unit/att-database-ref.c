@@ -0,0 +1,496 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2013  Intel Corporation
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdint.h>
+#include <string.h>
+
+#include <bluetooth/bluetooth.h>
+
+#include <glib.h>
+
+#include "lib/uuid.h"
+#include "attrib/gattrib.h"
+#include "attrib/att.h"
+#include "attrib/gatt.h"
+#include "attrib/att-database.h"
+
+#include "unit/att-database-ref.h"
+
+bt_uuid_t prim_uuid = {
+			.type = BT_UUID16,
+			.value.u16 = GATT_PRIM_SVC_UUID
+};
+bt_uuid_t snd_uuid = {
+			.type = BT_UUID16,
+			.value.u16 = GATT_SND_SVC_UUID
+};
+bt_uuid_t chr_uuid = {
+			.type = BT_UUID16,
+			.value.u16 = GATT_CHARAC_UUID
+};
+
+static const uint8_t base_uuid[] = {
+			0x00, 0x00, 0x00, 0x00, 0xde, 0xca, 0xfb, 0xad,
+			0xde, 0xca, 0xfb, 0xad, 0xde, 0xca, 0xfb, 0xad
+};
+
+static uint16_t handle;
+
+static void add_attribute(GList **database, const bt_uuid_t *uuid,
+					const uint8_t *value, size_t len)
+{
+	struct attribute *a;
+
+	a = g_new0(struct attribute, 1);
+	a->handle = ++handle;
+	a->uuid = *uuid;
+	a->len = len;
+	a->data = g_memdup(value, len);
+
+	*database = g_list_append(*database, a);
+}
+
+static void make_uuid128(bt_uuid_t *uuid, uint16_t id)
+{
+	uint128_t value;
+
+	memcpy(&value, base_uuid, sizeof(value));
+	value.data[2] = id >> 8;
+	value.data[3] = id & 0xff;
+
+	bt_uuid128_create(uuid, value);
+}
+
+static void add_service(GList **database, unsigned int index)
+{
+	uint8_t value[19];
+	bt_uuid_t uuid;
+	unsigned int i;
+
+	/* Every eighth service uses a 128-bit UUID */
+	if (index % 8 == 7) {
+		make_uuid128(&uuid, index);
+		att_put_uuid(uuid, value);
+		add_attribute(database, index % 16 == 7 ? &snd_uuid :
+						&prim_uuid, value, 16);
+	} else {
+		att_put_u16(0x1800 + index, value);
+		add_attribute(database, &prim_uuid, value, 2);
+	}
+
+	for (i = 0; i < NUM_CHARS; i++) {
+		uint8_t data[20];
+		size_t len;
+
+		if (index % 8 == 7)
+			make_uuid128(&uuid, 0x1000 + index * NUM_CHARS + i);
+		else
+			bt_uuid16_create(&uuid, 0x2a00 + i);
+
+		value[0] = ATT_CHAR_PROPER_READ | ATT_CHAR_PROPER_NOTIFY;
+		att_put_u16(handle + 2, &value[1]);
+		att_put_uuid(uuid, &value[3]);
+		len = uuid.type == BT_UUID16 ? 5 : 19;
+		add_attribute(database, &chr_uuid, value, len);
+
+		len = 1 + (index + i) % sizeof(data);
+		memset(data, index, len);
+		add_attribute(database, &uuid, data, len);
+
+		if (i % 2 == 0) {
+			bt_uuid16_create(&uuid, GATT_CLIENT_CHARAC_CFG_UUID);
+			memset(data, 0, 2);
+			add_attribute(database, &uuid, data, 2);
+		}
+	}
+}
+
+GList *create_database(unsigned int num_services)
+{
+	GList *database = NULL;
+	unsigned int i;
+
+	handle = 0;
+
+	for (i = 0; i < num_services; i++)
+		add_service(&database, i);
+
+	return database;
+}
+
+static void free_attribute(gpointer data)
+{
+	struct attribute *a = data;
+
+	g_free(a->data);
+	g_free(a);
+}
+
+void free_database(GList *database)
+{
+	g_list_free_full(database, free_attribute);
+}
+
+/*
+ * Reference implementations collecting every match into a list before
+ * encoding it, as the attribute server used to do.
+ */
+
+struct group_elem {
+	uint16_t handle;
+	uint16_t end;
+	uint8_t *data;
+	uint16_t len;
+};
+
+uint16_t list_read_by_group(GList *database, uint16_t start,
+					uint16_t end, const bt_uuid_t *uuid,
+					uint8_t *pdu, size_t len)
+{
+	struct att_data_list *adl;
+	struct attribute *a;
+	struct group_elem *cur, *old = NULL;
+	GSList *l, *groups;
+	GList *dl;
+	uint16_t length, last_handle, last_size = 0;
+	int i;
+
+	if (start > end || start == 0x0000)
+		return enc_error_resp(ATT_OP_READ_BY_GROUP_REQ, start,
+					ATT_ECODE_INVALID_HANDLE, pdu, len);
+
+	/*
+	 * Only <<Primary Service>> and <<Secondary Service>> grouping
+	 * types may be used in the Read By Group Type Request.
+	 */
+
+	if (bt_uuid_cmp(uuid, &prim_uuid) != 0 &&
+		bt_uuid_cmp(uuid, &snd_uuid) != 0)
+		return enc_error_resp(ATT_OP_READ_BY_GROUP_REQ, 0x0000,
+					ATT_ECODE_UNSUPP_GRP_TYPE, pdu, len);
+
+	last_handle = end;
+	for (dl = database, groups = NULL, cur = NULL; dl; dl = dl->next) {
+
+		a = dl->data;
+
+		if (a->handle < start)
+			continue;
+
+		if (a->handle >= end)
+			break;
+
+		/* The old group ends when a new one starts */
+		if (old && (bt_uuid_cmp(&a->uuid, &prim_uuid) == 0 ||
+				bt_uuid_cmp(&a->uuid, &snd_uuid) == 0)) {
+			old->end = last_handle;
+			old = NULL;
+		}
+
+		if (bt_uuid_cmp(&a->uuid, uuid) != 0) {
+			/* Still inside a service, update its last handle */
+			if (old)
+				last_handle = a->handle;
+			continue;
+		}
+
+		if (last_size && (last_size != a->len))
+			break;
+
+		cur = g_new0(struct group_elem, 1);
+		cur->handle = a->handle;
+		cur->data = a->data;
+		cur->len = a->len;
+
+		/* Attribute Grouping Type found */
+		groups = g_slist_append(groups, cur);
+
+		last_size = a->len;
+		old = cur;
+		last_handle = cur->handle;
+	}
+
+	if (groups == NULL)
+		return enc_error_resp(ATT_OP_READ_BY_GROUP_REQ, start,
+					ATT_ECODE_ATTR_NOT_FOUND, pdu, len);
+
+	if (dl == NULL)
+		cur->end = a->handle;
+	else
+		cur->end = last_handle;
+
+	length = g_slist_length(groups);
+
+	adl = att_data_list_alloc(length, last_size + 4);
+	if (adl == NULL) {
+		g_slist_free_full(groups, g_free);
+		return enc_error_resp(ATT_OP_READ_BY_GROUP_REQ, start,
+					ATT_ECODE_UNLIKELY, pdu, len);
+	}
+
+	for (i = 0, l = groups; l; l = l->next, i++) {
+		uint8_t *value;
+
+		cur = l->data;
+
+		value = (void *) adl->data[i];
+
+		att_put_u16(cur->handle, value);
+		att_put_u16(cur->end, &value[2]);
+		/* Attribute Value */
+		memcpy(&value[4], cur->data, cur->len);
+	}
+
+	length = enc_read_by_grp_resp(adl, pdu, len);
+
+	att_data_list_free(adl);
+	g_slist_free_full(groups, g_free);
+
+	return length;
+}
+
+uint16_t list_read_by_type(GList *database, uint16_t start,
+					uint16_t end, const bt_uuid_t *uuid,
+					uint8_t *pdu, size_t len)
+{
+	struct att_data_list *adl;
+	struct attribute *a;
+	GSList *l, *types = NULL;
+	GList *dl;
+	uint16_t length = 0;
+	int i;
+
+	for (dl = database; dl; dl = dl->next) {
+		a = dl->data;
+
+		if (a->handle < start)
+			continue;
+
+		if (a->handle > end)
+			break;
+
+		if (bt_uuid_cmp(&a->uuid, uuid) != 0)
+			continue;
+
+		if (length == 0)
+			length = a->len;
+		else if (a->len != length)
+			break;
+
+		types = g_slist_append(types, a);
+	}
+
+	if (types == NULL)
+		return enc_error_resp(ATT_OP_READ_BY_TYPE_REQ, start,
+					ATT_ECODE_ATTR_NOT_FOUND, pdu, len);
+
+	adl = att_data_list_alloc(g_slist_length(types), length + 2);
+
+	for (i = 0, l = types; l; i++, l = l->next) {
+		uint8_t *value = adl->data[i];
+
+		a = l->data;
+
+		att_put_u16(a->handle, value);
+		memcpy(&value[2], a->data, a->len);
+	}
+
+	length = enc_read_by_type_resp(adl, pdu, len);
+
+	att_data_list_free(adl);
+	g_slist_free(types);
+
+	return length;
+}
+
+uint16_t list_find_info(GList *database, uint16_t start,
+					uint16_t end, const bt_uuid_t *uuid,
+					uint8_t *pdu, size_t len)
+{
+	struct att_data_list *adl;
+	struct attribute *a;
+	GSList *l, *info = NULL;
+	GList *dl;
+	uint8_t format, last_type = BT_UUID_UNSPEC;
+	uint16_t length;
+	int i;
+
+	for (dl = database; dl; dl = dl->next) {
+		a = dl->data;
+
+		if (a->handle < start)
+			continue;
+
+		if (a->handle > end)
+			break;
+
+		if (last_type == BT_UUID_UNSPEC)
+			last_type = a->uuid.type;
+
+		if (a->uuid.type != last_type)
+			break;
+
+		info = g_slist_append(info, a);
+	}
+
+	if (info == NULL)
+		return enc_error_resp(ATT_OP_FIND_INFO_REQ, start,
+					ATT_ECODE_ATTR_NOT_FOUND, pdu, len);
+
+	if (last_type == BT_UUID16) {
+		length = 2;
+		format = 0x01;
+	} else {
+		length = 16;
+		format = 0x02;
+	}
+
+	adl = att_data_list_alloc(g_slist_length(info), length + 2);
+
+	for (i = 0, l = info; l; i++, l = l->next) {
+		uint8_t *value = adl->data[i];
+
+		a = l->data;
+
+		att_put_u16(a->handle, value);
+		att_put_uuid(a->uuid, &value[2]);
+	}
+
+	length = enc_find_info_resp(format, adl, pdu, len);
+
+	att_data_list_free(adl);
+	g_slist_free(info);
+
+	return length;
+}
+
+uint16_t list_find_by_type(GList *database, uint16_t start,
+					uint16_t end, const bt_uuid_t *uuid,
+					uint8_t *pdu, size_t len)
+{
+	struct attribute *a;
+	struct att_range *range = NULL;
+	GSList *matches = NULL;
+	GList *dl;
+	uint16_t length;
+	uint8_t value[2];
+
+	att_put_u16(uuid->value.u16, value);
+
+	for (dl = database; dl; dl = dl->next) {
+		a = dl->data;
+
+		if (a->handle < start)
+			continue;
+
+		if (a->handle > end)
+			break;
+
+		if (bt_uuid_cmp(&a->uuid, &prim_uuid) == 0 &&
+					a->len == sizeof(value) &&
+					memcmp(a->data, value, a->len) == 0) {
+			range = g_new0(struct att_range, 1);
+			range->start = a->handle;
+			range->end = a->handle;
+
+			matches = g_slist_append(matches, range);
+		} else if (range) {
+			if (bt_uuid_cmp(&a->uuid, &prim_uuid) == 0 ||
+					bt_uuid_cmp(&a->uuid, &snd_uuid) == 0)
+				range = NULL;
+			else
+				range->end = a->handle;
+		}
+	}
+
+	if (matches == NULL)
+		return enc_error_resp(ATT_OP_FIND_BY_TYPE_REQ, start,
+				ATT_ECODE_ATTR_NOT_FOUND, pdu, len);
+
+	length = enc_find_by_type_resp(matches, pdu, len);
+
+	g_slist_free_full(matches, g_free);
+
+	return length;
+}
+
+uint16_t db_read_by_group(GList *database, uint16_t start,
+					uint16_t end, const bt_uuid_t *uuid,
+					uint8_t *pdu, size_t len)
+{
+	return att_db_read_by_group(database, start, end, (bt_uuid_t *) uuid,
+							NULL, NULL, pdu, len);
+}
+
+uint16_t db_read_by_type(GList *database, uint16_t start,
+					uint16_t end, const bt_uuid_t *uuid,
+					uint8_t *pdu, size_t len)
+{
+	return att_db_read_by_type(database, start, end, (bt_uuid_t *) uuid,
+							NULL, NULL, pdu, len);
+}
+
+uint16_t db_find_info(GList *database, uint16_t start,
+					uint16_t end, const bt_uuid_t *uuid,
+					uint8_t *pdu, size_t len)
+{
+	return att_db_find_info(database, start, end, pdu, len);
+}
+
+uint16_t db_find_by_type(GList *database, uint16_t start,
+					uint16_t end, const bt_uuid_t *uuid,
+					uint8_t *pdu, size_t len)
+{
+	uint8_t value[2];
+
+	att_put_u16(uuid->value.u16, value);
+
+	return att_db_find_by_type(database, start, end, &prim_uuid, value,
+						sizeof(value), pdu, len);
+}
+
+/* Returns the handle following the last one covered by a response */
+uint16_t next_handle(const uint8_t *pdu, uint16_t len)
+{
+	size_t elen;
+
+	switch (pdu[0]) {
+	case ATT_OP_READ_BY_GROUP_RESP:
+		elen = pdu[1];
+		return att_get_u16(&pdu[len - elen + 2]) + 1;
+	case ATT_OP_READ_BY_TYPE_RESP:
+		elen = pdu[1];
+		return att_get_u16(&pdu[len - elen]) + 1;
+	case ATT_OP_FIND_INFO_RESP:
+		elen = pdu[1] == 0x01 ? 4 : 18;
+		return att_get_u16(&pdu[len - elen]) + 1;
+	case ATT_OP_FIND_BY_TYPE_RESP:
+		return att_get_u16(&pdu[len - 2]) + 1;
+	}
+
+	return 0;
+}
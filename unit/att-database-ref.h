@@ -0,0 +1,63 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2013  Intel Corporation
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/*
+ * Test attribute database and list based reference implementations of
+ * the discovery requests, shared by unit/test-att-database and
+ * tools/bench-att-database.
+ */
+
+#define NUM_SERVICES 64
+#define NUM_CHARS 4
+#define SERVICE_SIZE (1 + NUM_CHARS * 2 + NUM_CHARS / 2)
+
+extern bt_uuid_t prim_uuid;
+extern bt_uuid_t snd_uuid;
+extern bt_uuid_t chr_uuid;
+
+typedef uint16_t (*request_func_t) (GList *database, uint16_t start,
+					uint16_t end, const bt_uuid_t *uuid,
+					uint8_t *pdu, size_t len);
+
+GList *create_database(unsigned int num_services);
+void free_database(GList *database);
+
+uint16_t list_read_by_group(GList *database, uint16_t start, uint16_t end,
+				const bt_uuid_t *uuid, uint8_t *pdu, size_t len);
+uint16_t list_read_by_type(GList *database, uint16_t start, uint16_t end,
+				const bt_uuid_t *uuid, uint8_t *pdu, size_t len);
+uint16_t list_find_info(GList *database, uint16_t start, uint16_t end,
+				const bt_uuid_t *uuid, uint8_t *pdu, size_t len);
+uint16_t list_find_by_type(GList *database, uint16_t start, uint16_t end,
+				const bt_uuid_t *uuid, uint8_t *pdu, size_t len);
+
+uint16_t db_read_by_group(GList *database, uint16_t start, uint16_t end,
+				const bt_uuid_t *uuid, uint8_t *pdu, size_t len);
+uint16_t db_read_by_type(GList *database, uint16_t start, uint16_t end,
+				const bt_uuid_t *uuid, uint8_t *pdu, size_t len);
+uint16_t db_find_info(GList *database, uint16_t start, uint16_t end,
+				const bt_uuid_t *uuid, uint8_t *pdu, size_t len);
+uint16_t db_find_by_type(GList *database, uint16_t start, uint16_t end,
+				const bt_uuid_t *uuid, uint8_t *pdu, size_t len);
+
+uint16_t next_handle(const uint8_t *pdu, uint16_t len);
@@ -0,0 +1,215 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2013  Intel Corporation
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdint.h>
+#include <string.h>
+
+#include <bluetooth/bluetooth.h>
+
+#include <glib.h>
+
+#include "lib/uuid.h"
+#include "attrib/gattrib.h"
+#include "attrib/att.h"
+#include "attrib/gatt.h"
+#include "attrib/att-database.h"
+
+#include "unit/att-database-ref.h"
+
+static const size_t mtus[] = { ATT_DEFAULT_LE_MTU, 185, 512 };
+
+/*
+ * Walks the whole database the way a client discovers it, issuing the
+ * request again from the handle following the last one returned until
+ * an error response is received, and checks every response against the
+ * reference implementation.
+ */
+static void discover(GList *database, request_func_t func,
+				request_func_t ref, const bt_uuid_t *uuid,
+				size_t mtu)
+{
+	uint8_t pdu[512], ref_pdu[512];
+	uint16_t start = 0x0001, len, ref_len;
+
+	while (start != 0x0000) {
+		len = func(database, start, 0xffff, uuid, pdu, mtu);
+
+		g_assert(len > 0);
+		g_assert(len <= mtu);
+
+		ref_len = ref(database, start, 0xffff, uuid, ref_pdu, mtu);
+		g_assert_cmpuint(len, ==, ref_len);
+		g_assert(memcmp(pdu, ref_pdu, len) == 0);
+
+		if (pdu[0] == ATT_OP_ERROR)
+			break;
+
+		start = next_handle(pdu, len);
+	}
+}
+
+static void compare_services(request_func_t func, request_func_t ref,
+				const bt_uuid_t *uuid, unsigned int num_services)
+{
+	GList *database = create_database(num_services);
+	unsigned int i;
+
+	for (i = 0; i < G_N_ELEMENTS(mtus); i++)
+		discover(database, func, ref, uuid, mtus[i]);
+
+	free_database(database);
+}
+
+static void compare(request_func_t func, request_func_t ref,
+						const bt_uuid_t *uuid)
+{
+	compare_services(func, ref, uuid, NUM_SERVICES);
+}
+
+static void test_read_by_group(void)
+{
+	compare(db_read_by_group, list_read_by_group, &prim_uuid);
+
+	/*
+	 * The reference extends the last group to the end of the database
+	 * even when a service of the other type follows it, so compare the
+	 * secondary services on a database ending with one (service 55).
+	 * test_group_end covers the difference.
+	 */
+	compare_services(db_read_by_group, list_read_by_group, &snd_uuid, 56);
+}
+
+static void test_group_end(void)
+{
+	GList *database = create_database(NUM_SERVICES);
+	uint8_t pdu[512];
+	uint16_t len, start = 55 * SERVICE_SIZE + 1;
+
+	/* Secondary service 55 is followed by primary service 56 */
+	len = db_read_by_group(database, start, 0xffff, &snd_uuid,
+							pdu, sizeof(pdu));
+	g_assert(pdu[0] == ATT_OP_READ_BY_GROUP_RESP);
+	g_assert_cmpuint(len, ==, 2 + pdu[1]);
+	g_assert_cmpuint(att_get_u16(&pdu[2]), ==, start);
+	g_assert_cmpuint(att_get_u16(&pdu[4]), ==,
+						start + SERVICE_SIZE - 1);
+
+	len = list_read_by_group(database, start, 0xffff, &snd_uuid,
+							pdu, sizeof(pdu));
+	g_assert_cmpuint(att_get_u16(&pdu[4]), ==,
+						NUM_SERVICES * SERVICE_SIZE);
+
+	free_database(database);
+}
+
+static void test_read_by_type(void)
+{
+	bt_uuid_t uuid;
+
+	compare(db_read_by_type, list_read_by_type, &chr_uuid);
+
+	bt_uuid16_create(&uuid, GATT_CLIENT_CHARAC_CFG_UUID);
+	compare(db_read_by_type, list_read_by_type, &uuid);
+
+	bt_uuid16_create(&uuid, 0x2a01);
+	compare(db_read_by_type, list_read_by_type, &uuid);
+}
+
+static void test_find_info(void)
+{
+	compare(db_find_info, list_find_info, NULL);
+}
+
+static void test_find_by_type(void)
+{
+	bt_uuid_t uuid;
+
+	bt_uuid16_create(&uuid, 0x1800);
+	compare(db_find_by_type, list_find_by_type, &uuid);
+
+	bt_uuid16_create(&uuid, 0x1801);
+	compare(db_find_by_type, list_find_by_type, &uuid);
+
+	bt_uuid16_create(&uuid, 0x2000);
+	compare(db_find_by_type, list_find_by_type, &uuid);
+}
+
+static uint8_t read_denied(struct attribute *a, uint8_t opcode,
+							void *user_data)
+{
+	uint16_t *denied = user_data;
+
+	return a->handle == *denied ? ATT_ECODE_AUTHENTICATION : 0;
+}
+
+static void test_read_status(void)
+{
+	GList *database = create_database(NUM_SERVICES);
+	uint8_t pdu[ATT_DEFAULT_LE_MTU];
+	uint16_t len, denied;
+
+	/* Values past the end of the response are not read */
+	denied = 0x0060;
+	len = att_db_read_by_type(database, 0x0001, 0xffff, &chr_uuid,
+						read_denied, &denied,
+						pdu, sizeof(pdu));
+	g_assert(pdu[0] == ATT_OP_READ_BY_TYPE_RESP);
+
+	denied = 0x0002;
+	len = att_db_read_by_type(database, 0x0001, 0xffff, &chr_uuid,
+						read_denied, &denied,
+						pdu, sizeof(pdu));
+	g_assert_cmpuint(len, ==, 5);
+	g_assert(pdu[0] == ATT_OP_ERROR);
+	g_assert(pdu[1] == ATT_OP_READ_BY_TYPE_REQ);
+	g_assert_cmpuint(att_get_u16(&pdu[2]), ==, denied);
+	g_assert(pdu[4] == ATT_ECODE_AUTHENTICATION);
+
+	denied = 0x0001;
+	len = att_db_read_by_group(database, 0x0001, 0xffff, &prim_uuid,
+						read_denied, &denied,
+						pdu, sizeof(pdu));
+	g_assert_cmpuint(len, ==, 5);
+	g_assert(pdu[0] == ATT_OP_ERROR);
+	g_assert(pdu[4] == ATT_ECODE_AUTHENTICATION);
+
+	free_database(database);
+}
+
+int main(int argc, char *argv[])
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/att-database/read_by_group", test_read_by_group);
+	g_test_add_func("/att-database/group_end", test_group_end);
+	g_test_add_func("/att-database/read_by_type", test_read_by_type);
+	g_test_add_func("/att-database/find_info", test_find_info);
+	g_test_add_func("/att-database/find_by_type", test_find_by_type);
+	g_test_add_func("/att-database/read_status", test_read_status);
+
+	return g_test_run();
+}
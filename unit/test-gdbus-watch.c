@@ -0,0 +1,326 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2013  Intel Corporation
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include <glib.h>
+#include <gdbus.h>
+
+#define SERVICE_NAME "org.bluez.unit.test-gdbus-watch"
+#define SERVICE_PATH "/org/bluez/unit/test_gdbus_watch"
+#define SERVICE_IFACE "org.bluez.unit.Watch"
+
+#define NUM_PATHS 256
+#define NUM_ROUNDS 16
+
+struct context {
+	GMainLoop *main_loop;
+	DBusConnection *dbus_conn;
+	guint watches[NUM_PATHS];
+	unsigned int received[NUM_PATHS];
+	unsigned int wildcard;
+	unsigned int other;
+	guint wildcard_watch;
+	guint other_watch;
+	guint done_watch;
+};
+
+static struct context *create_context(void)
+{
+	struct context *context = g_new0(struct context, 1);
+	DBusError err;
+
+	context->main_loop = g_main_loop_new(NULL, FALSE);
+	if (context->main_loop == NULL) {
+		g_free(context);
+		return NULL;
+	}
+
+	dbus_error_init(&err);
+
+	context->dbus_conn = g_dbus_setup_private(DBUS_BUS_SESSION,
+							SERVICE_NAME, &err);
+	if (context->dbus_conn == NULL) {
+		if (dbus_error_is_set(&err)) {
+			if (g_test_verbose())
+				g_printerr("D-Bus setup failed: %s\n",
+								err.message);
+			dbus_error_free(&err);
+		}
+
+		g_main_loop_unref(context->main_loop);
+		g_free(context);
+		return NULL;
+	}
+
+	/* Avoid D-Bus library calling _exit() before next test finishes. */
+	dbus_connection_set_exit_on_disconnect(context->dbus_conn, FALSE);
+
+	return context;
+}
+
+static void destroy_context(struct context *context)
+{
+	if (context == NULL)
+		return;
+
+	g_dbus_remove_all_watches(context->dbus_conn);
+
+	dbus_connection_flush(context->dbus_conn);
+	dbus_connection_close(context->dbus_conn);
+
+	g_main_loop_unref(context->main_loop);
+
+	g_free(context);
+}
+
+static char *object_path(unsigned int index)
+{
+	return g_strdup_printf("%s/obj%u", SERVICE_PATH, index);
+}
+
+static gboolean path_signal(DBusConnection *conn, DBusMessage *msg,
+							void *user_data)
+{
+	unsigned int *count = user_data;
+
+	(*count)++;
+
+	return TRUE;
+}
+
+static gboolean done_signal(DBusConnection *conn, DBusMessage *msg,
+							void *user_data)
+{
+	struct context *context = user_data;
+
+	g_main_loop_quit(context->main_loop);
+
+	return TRUE;
+}
+
+static void send_signal(struct context *context, const char *path,
+							const char *member)
+{
+	DBusMessage *signal;
+
+	signal = dbus_message_new_signal(path, SERVICE_IFACE, member);
+	g_assert(signal != NULL);
+
+	g_dbus_send_message(context->dbus_conn, signal);
+}
+
+static void add_watches(struct context *context)
+{
+	unsigned int i;
+
+	for (i = 0; i < NUM_PATHS; i++) {
+		char *path = object_path(i);
+
+		context->watches[i] = g_dbus_add_signal_watch(
+						context->dbus_conn, NULL, path,
+						SERVICE_IFACE, "Changed",
+						path_signal,
+						&context->received[i], NULL);
+		g_assert(context->watches[i] != 0);
+
+		g_free(path);
+	}
+
+	/* Matches every Changed signal regardless of the path */
+	context->wildcard_watch = g_dbus_add_signal_watch(context->dbus_conn,
+						NULL, NULL, SERVICE_IFACE,
+						"Changed", path_signal,
+						&context->wildcard, NULL);
+	g_assert(context->wildcard_watch != 0);
+
+	/* Never matches, same path but a different member */
+	context->other_watch = g_dbus_add_signal_watch(context->dbus_conn,
+						NULL, SERVICE_PATH "/obj0",
+						SERVICE_IFACE, "Other",
+						path_signal, &context->other,
+						NULL);
+	g_assert(context->other_watch != 0);
+
+	context->done_watch = g_dbus_add_signal_watch(context->dbus_conn,
+						NULL, SERVICE_PATH,
+						SERVICE_IFACE, "Done",
+						done_signal, context, NULL);
+	g_assert(context->done_watch != 0);
+}
+
+static void send_storm(struct context *context, unsigned int rounds)
+{
+	unsigned int i, round;
+
+	for (round = 0; round < rounds; round++) {
+		for (i = 0; i < NUM_PATHS; i++) {
+			char *path = object_path(i);
+
+			send_signal(context, path, "Changed");
+			g_free(path);
+		}
+	}
+
+	/* Signals from the same sender are delivered in order */
+	send_signal(context, SERVICE_PATH, "Done");
+}
+
+static void signal_watch_dispatch(void)
+{
+	struct context *context = create_context();
+	unsigned int i;
+
+	if (context == NULL)
+		return;
+
+	add_watches(context);
+
+	send_storm(context, 1);
+
+	g_main_loop_run(context->main_loop);
+
+	for (i = 0; i < NUM_PATHS; i++)
+		g_assert_cmpuint(context->received[i], ==, 1);
+
+	g_assert_cmpuint(context->wildcard, ==, NUM_PATHS);
+	g_assert_cmpuint(context->other, ==, 0);
+
+	/* Removed watches must no longer be dispatched */
+	for (i = 0; i < NUM_PATHS; i += 2)
+		g_assert(g_dbus_remove_watch(context->dbus_conn,
+						context->watches[i]));
+
+	send_storm(context, 1);
+
+	g_main_loop_run(context->main_loop);
+
+	for (i = 0; i < NUM_PATHS; i++)
+		g_assert_cmpuint(context->received[i], ==, i % 2 ? 2 : 1);
+
+	g_assert_cmpuint(context->wildcard, ==, NUM_PATHS * 2);
+	g_assert_cmpuint(context->other, ==, 0);
+
+	destroy_context(context);
+}
+
+struct remove_data {
+	guint other;
+	unsigned int count;
+};
+
+static gboolean remove_signal(DBusConnection *conn, DBusMessage *msg,
+							void *user_data)
+{
+	struct remove_data *data = user_data;
+
+	data->count++;
+
+	/* Freed while the same signal is still being dispatched */
+	if (data->other > 0) {
+		g_assert(g_dbus_remove_watch(conn, data->other));
+		data->other = 0;
+	}
+
+	return TRUE;
+}
+
+static void signal_watch_remove(void)
+{
+	struct context *context = create_context();
+	struct remove_data first, second;
+	guint done;
+
+	if (context == NULL)
+		return;
+
+	memset(&first, 0, sizeof(first));
+	memset(&second, 0, sizeof(second));
+
+	g_assert(g_dbus_add_signal_watch(context->dbus_conn, NULL,
+					SERVICE_PATH "/obj0", SERVICE_IFACE,
+					"Changed", remove_signal, &first,
+					NULL) != 0);
+
+	first.other = g_dbus_add_signal_watch(context->dbus_conn, NULL,
+					SERVICE_PATH "/obj0", SERVICE_IFACE,
+					"Changed", remove_signal, &second,
+					NULL);
+	g_assert(first.other != 0);
+
+	done = g_dbus_add_signal_watch(context->dbus_conn, NULL, SERVICE_PATH,
+					SERVICE_IFACE, "Done", done_signal,
+					context, NULL);
+	g_assert(done != 0);
+
+	send_signal(context, SERVICE_PATH "/obj0", "Changed");
+	send_signal(context, SERVICE_PATH, "Done");
+
+	g_main_loop_run(context->main_loop);
+
+	g_assert_cmpuint(first.count, ==, 1);
+	g_assert_cmpuint(second.count, ==, 0);
+
+	destroy_context(context);
+}
+
+static void signal_watch_storm(void)
+{
+	struct context *context = create_context();
+	unsigned int i;
+
+	if (context == NULL)
+		return;
+
+	add_watches(context);
+
+	send_storm(context, NUM_ROUNDS);
+
+	g_main_loop_run(context->main_loop);
+
+	for (i = 0; i < NUM_PATHS; i++)
+		g_assert_cmpuint(context->received[i], ==, NUM_ROUNDS);
+
+	g_assert_cmpuint(context->wildcard, ==, NUM_PATHS * NUM_ROUNDS);
+	g_assert_cmpuint(context->other, ==, 0);
+
+	destroy_context(context);
+}
+
+int main(int argc, char *argv[])
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/gdbus/signal_watch_dispatch",
+						signal_watch_dispatch);
+
+	g_test_add_func("/gdbus/signal_watch_remove", signal_watch_remove);
+
+	g_test_add_func("/gdbus/signal_watch_storm", signal_watch_storm);
+
+	return g_test_run();
+}
@@ -0,0 +1,181 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2013  Intel Corporation
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdint.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "src/shared/metrics.h"
+
+static void test_counter(void)
+{
+	struct metrics_counter *counter;
+
+	counter = metrics_counter_new("test_events_total", "Events");
+	g_assert(counter != NULL);
+
+	metrics_counter_add(counter, 1);
+	metrics_counter_add(counter, 41);
+	g_assert_cmpuint(metrics_counter_get(counter), ==, 42);
+
+	/* Same name returns the registered counter */
+	g_assert(metrics_counter_new("test_events_total", NULL) == counter);
+
+	/* Same name with a different type is refused */
+	g_assert(metrics_gauge_new("test_events_total", NULL) == NULL);
+
+	metrics_cleanup();
+}
+
+static void test_gauge(void)
+{
+	struct metrics_gauge *gauge;
+
+	gauge = metrics_gauge_new("test_pending", "Pending");
+
+	metrics_gauge_inc(gauge);
+	metrics_gauge_inc(gauge);
+	metrics_gauge_dec(gauge);
+	g_assert_cmpuint(metrics_gauge_get(gauge), ==, 1);
+
+	metrics_gauge_set(gauge, 10);
+	g_assert_cmpuint(metrics_gauge_get(gauge), ==, 10);
+
+	metrics_cleanup();
+}
+
+static void test_histogram(void)
+{
+	struct metrics_histogram *histogram;
+	uint64_t value;
+
+	histogram = metrics_histogram_new("test_latency_us", "Latency");
+
+	for (value = 1; value <= 1000; value++)
+		metrics_histogram_observe(histogram, value);
+
+	g_assert_cmpuint(metrics_histogram_count(histogram), ==, 1000);
+	g_assert_cmpuint(metrics_histogram_sum(histogram), ==, 500500);
+
+	/* Bucket bounds stay within 25% of the exact percentile */
+	value = metrics_histogram_percentile(histogram, 50);
+	g_assert_cmpuint(value, >=, 500);
+	g_assert_cmpuint(value, <=, 625);
+
+	value = metrics_histogram_percentile(histogram, 99);
+	g_assert_cmpuint(value, >=, 990);
+	g_assert_cmpuint(value, <=, 1238);
+
+	g_assert_cmpuint(metrics_histogram_percentile(histogram, 0), ==, 1);
+
+	metrics_histogram_observe(histogram, UINT64_MAX);
+	g_assert_cmpuint(metrics_histogram_percentile(histogram, 100), ==,
+								UINT64_MAX);
+
+	metrics_cleanup();
+}
+
+static void test_text(void)
+{
+	struct metrics_histogram *histogram;
+	char *text;
+
+	metrics_counter_add(metrics_counter_new(
+				"test_pdus_total{opcode=\"0x0a\"}",
+				"PDUs by opcode"), 3);
+	metrics_counter_add(metrics_counter_new(
+				"test_pdus_total{opcode=\"0x08\"}",
+				"PDUs by opcode"), 5);
+	metrics_counter_new("test_pdus_total_other", "Other PDUs");
+
+	histogram = metrics_histogram_new("test_latency_us", "Latency");
+	metrics_histogram_observe(histogram, 2);
+	metrics_histogram_observe(histogram, 5);
+	metrics_histogram_observe(histogram, 5);
+
+	text = metrics_to_text();
+
+	g_assert_cmpstr(text, ==,
+		"# HELP test_latency_us Latency\n"
+		"# TYPE test_latency_us histogram\n"
+		"test_latency_us_bucket{le=\"2\"} 1\n"
+		"test_latency_us_bucket{le=\"5\"} 3\n"
+		"test_latency_us_bucket{le=\"+Inf\"} 3\n"
+		"test_latency_us_sum 12\n"
+		"test_latency_us_count 3\n"
+		"# HELP test_pdus_total PDUs by opcode\n"
+		"# TYPE test_pdus_total counter\n"
+		"test_pdus_total{opcode=\"0x08\"} 5\n"
+		"test_pdus_total{opcode=\"0x0a\"} 3\n"
+		"# HELP test_pdus_total_other Other PDUs\n"
+		"# TYPE test_pdus_total_other counter\n"
+		"test_pdus_total_other 0\n");
+
+	g_free(text);
+
+	metrics_cleanup();
+}
+
+static void test_rate(void)
+{
+	struct metrics_counter *counter;
+	struct metrics_histogram *histogram;
+	unsigned int i;
+	double elapsed;
+
+	counter = metrics_counter_new("test_rate_total", NULL);
+	histogram = metrics_histogram_new("test_rate_us", NULL);
+
+	g_test_timer_start();
+
+	for (i = 0; i < 1000000; i++) {
+		metrics_counter_add(counter, 1);
+		metrics_histogram_observe(histogram, i);
+	}
+
+	elapsed = g_test_timer_elapsed();
+
+	g_assert_cmpuint(metrics_counter_get(counter), ==, 1000000);
+
+	g_test_minimized_result(elapsed, "1000000 updates: %.3f s", elapsed);
+
+	metrics_cleanup();
+}
+
+int main(int argc, char *argv[])
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/metrics/counter", test_counter);
+	g_test_add_func("/metrics/gauge", test_gauge);
+	g_test_add_func("/metrics/histogram", test_histogram);
+	g_test_add_func("/metrics/text", test_text);
+	g_test_add_func("/metrics/rate", test_rate);
+
+	return g_test_run();
+}
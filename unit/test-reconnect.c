@@ -0,0 +1,307 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2013  Intel Corporation
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <glib.h>
+
+#include "src/reconnect.h"
+
+#define MAX_STARTS		64
+
+#define NUM_DEVICES		200
+#define NUM_ADAPTERS		2
+#define PAGE_TIME		1280	/* ms */
+
+struct start_data {
+	void *keys[MAX_STARTS];
+	unsigned int count;
+};
+
+static int record_start(void *key, void *user_data)
+{
+	struct start_data *data = user_data;
+
+	g_assert(data->count < MAX_STARTS);
+
+	data->keys[data->count++] = key;
+
+	return 0;
+}
+
+static void test_backoff(void)
+{
+	struct start_data data = { .count = 0 };
+	struct reconnect_queue *queue;
+	uint64_t now = 0, last = 0;
+	unsigned int attempt;
+	int key, delay;
+
+	queue = reconnect_queue_new(1, record_start, &data);
+	reconnect_queue_set_backoff(queue, 1000, 8000, 5);
+	reconnect_queue_set_seed(queue, 1);
+
+	g_assert(reconnect_queue_add(queue, &key, NULL, 0, now));
+	g_assert(!reconnect_queue_add(queue, &key, NULL, 0, now));
+
+	for (attempt = 0; attempt < 5; attempt++) {
+		unsigned int max = MIN(1000u << attempt, 8000u);
+
+		delay = reconnect_queue_run(queue, now);
+		g_assert_cmpint(delay, >=, (int) max / 2);
+		g_assert_cmpint(delay, <=, (int) max);
+
+		/* Nothing is started before the candidate is due */
+		g_assert_cmpuint(data.count, ==, attempt);
+
+		now += delay;
+		g_assert_cmpint(reconnect_queue_run(queue, now), ==, -1);
+		g_assert_cmpuint(data.count, ==, attempt + 1);
+		g_assert(data.keys[attempt] == &key);
+
+		last = now;
+
+		if (attempt < 4)
+			g_assert(reconnect_queue_complete(queue, &key, -EAGAIN,
+									now));
+		else
+			g_assert(!reconnect_queue_complete(queue, &key,
+							-EAGAIN, now));
+	}
+
+	/* Dropped after the last attempt failed */
+	g_assert_cmpuint(reconnect_queue_length(queue), ==, 0);
+	g_assert_cmpint(reconnect_queue_run(queue, last), ==, -1);
+
+	reconnect_queue_free(queue);
+}
+
+static void test_limit(void)
+{
+	struct start_data data = { .count = 0 };
+	struct reconnect_queue *queue;
+	int keys[10], group1, group2;
+	unsigned int i;
+
+	queue = reconnect_queue_new(2, record_start, &data);
+	reconnect_queue_set_backoff(queue, 0, 0, 1);
+
+	for (i = 0; i < 10; i++)
+		reconnect_queue_add(queue, &keys[i],
+					i % 2 ? &group1 : &group2, 0, 0);
+
+	reconnect_queue_run(queue, 0);
+
+	g_assert_cmpuint(data.count, ==, 4);
+	g_assert_cmpuint(reconnect_queue_active(queue, &group1), ==, 2);
+	g_assert_cmpuint(reconnect_queue_active(queue, &group2), ==, 2);
+
+	/* Completion frees a slot in the same group only */
+	reconnect_queue_complete(queue, data.keys[0], 0, 0);
+	reconnect_queue_run(queue, 0);
+
+	g_assert_cmpuint(data.count, ==, 5);
+	g_assert_cmpuint(reconnect_queue_active(queue, &group1), ==, 2);
+	g_assert_cmpuint(reconnect_queue_active(queue, &group2), ==, 2);
+	g_assert_cmpuint(reconnect_queue_length(queue), ==, 9);
+
+	reconnect_queue_free(queue);
+}
+
+static void test_priority(void)
+{
+	struct start_data data = { .count = 0 };
+	struct reconnect_queue *queue;
+	int far, near, known;
+
+	queue = reconnect_queue_new(1, record_start, &data);
+	reconnect_queue_set_backoff(queue, 0, 0, 2);
+
+	/* A previous successful reconnect is remembered */
+	reconnect_queue_add(queue, &known, NULL, -90, 0);
+	reconnect_queue_run(queue, 0);
+	reconnect_queue_complete(queue, &known, 0, 0);
+	g_assert_cmpint(reconnect_queue_score(queue, &known), >, 50);
+
+	data.count = 0;
+
+	reconnect_queue_add(queue, &far, NULL, -90, 0);
+	reconnect_queue_add(queue, &near, NULL, -40, 0);
+	reconnect_queue_add(queue, &known, NULL, -90, 0);
+
+	reconnect_queue_run(queue, 0);
+	g_assert(data.keys[0] == &near);
+
+	reconnect_queue_complete(queue, &near, 0, 0);
+	reconnect_queue_run(queue, 0);
+	g_assert(data.keys[1] == &known);
+
+	reconnect_queue_complete(queue, &known, 0, 0);
+	reconnect_queue_run(queue, 0);
+	g_assert(data.keys[2] == &far);
+
+	/* Failures lower the score again */
+	reconnect_queue_complete(queue, &far, -EHOSTDOWN, 0);
+	g_assert_cmpint(reconnect_queue_score(queue, &far), <, 50);
+
+	reconnect_queue_remove(queue, &far);
+	g_assert_cmpint(reconnect_queue_score(queue, &far), ==, 50);
+
+	reconnect_queue_free(queue);
+}
+
+struct sim_device {
+	const void *adapter;
+	int8_t rssi;
+	bool paging;
+	uint64_t done;
+	bool connected;
+};
+
+struct sim_data {
+	GRand *rand;
+	uint64_t now;
+	struct sim_device devices[NUM_DEVICES];
+	unsigned int adapters[NUM_ADAPTERS];
+	unsigned int paging[NUM_ADAPTERS];
+	unsigned int max_paging;
+	unsigned int connected;
+};
+
+static int sim_connect(void *key, void *user_data)
+{
+	struct sim_data *sim = user_data;
+	struct sim_device *dev = key;
+	unsigned int index = (const unsigned int *) dev->adapter -
+								sim->adapters;
+
+	dev->paging = true;
+	dev->done = sim->now + PAGE_TIME;
+
+	sim->paging[index]++;
+	sim->max_paging = MAX(sim->max_paging, sim->paging[index]);
+
+	return 0;
+}
+
+/* Weak devices are out of range half of the time */
+static bool sim_page(struct sim_data *sim, struct sim_device *dev)
+{
+	double success = dev->rssi > -80 ? 0.95 : 0.5;
+
+	return g_rand_double(sim->rand) < success;
+}
+
+static void test_simulation(void)
+{
+	struct reconnect_queue *queue;
+	struct sim_data *sim;
+	unsigned int i;
+	uint64_t next;
+	int delay;
+
+	sim = g_new0(struct sim_data, 1);
+	sim->rand = g_rand_new_with_seed(42);
+
+	queue = reconnect_queue_new(RECONNECT_MAX_ACTIVE, sim_connect, sim);
+	reconnect_queue_set_backoff(queue, RECONNECT_BASE_DELAY,
+					RECONNECT_MAX_DELAY, 1000);
+	reconnect_queue_set_seed(queue, 42);
+
+	/* The whole fleet returns at once and collides */
+	for (i = 0; i < NUM_DEVICES; i++) {
+		struct sim_device *dev = &sim->devices[i];
+
+		dev->adapter = &sim->adapters[i % NUM_ADAPTERS];
+		dev->rssi = -30 - g_rand_int_range(sim->rand, 0, 70);
+
+		reconnect_queue_add(queue, dev, dev->adapter, dev->rssi, 0);
+	}
+
+	while (sim->connected < NUM_DEVICES) {
+		delay = reconnect_queue_run(queue, sim->now);
+
+		next = UINT64_MAX;
+		if (delay >= 0)
+			next = sim->now + delay;
+
+		for (i = 0; i < NUM_DEVICES; i++) {
+			if (sim->devices[i].paging)
+				next = MIN(next, sim->devices[i].done);
+		}
+
+		g_assert(next != UINT64_MAX);
+		sim->now = MAX(next, sim->now);
+
+		for (i = 0; i < NUM_DEVICES; i++) {
+			struct sim_device *dev = &sim->devices[i];
+			unsigned int index;
+			bool success;
+
+			if (!dev->paging || dev->done > sim->now)
+				continue;
+
+			index = (const unsigned int *) dev->adapter -
+								sim->adapters;
+			dev->paging = false;
+			sim->paging[index]--;
+
+			success = sim_page(sim, dev);
+			if (success) {
+				dev->connected = true;
+				sim->connected++;
+			}
+
+			reconnect_queue_complete(queue, dev,
+					success ? 0 : -EHOSTDOWN, sim->now);
+		}
+	}
+
+	g_assert_cmpuint(sim->max_paging, <=, RECONNECT_MAX_ACTIVE);
+	g_assert_cmpuint(reconnect_queue_length(queue), ==, 0);
+
+	g_test_minimized_result(sim->now / 1000.0,
+				"%u devices, %u adapters reconnected in %.1f s",
+				NUM_DEVICES, NUM_ADAPTERS, sim->now / 1000.0);
+
+	reconnect_queue_free(queue);
+	g_rand_free(sim->rand);
+	g_free(sim);
+}
+
+int main(int argc, char *argv[])
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/reconnect/backoff", test_backoff);
+	g_test_add_func("/reconnect/limit", test_limit);
+	g_test_add_func("/reconnect/priority", test_priority);
+	g_test_add_func("/reconnect/simulation", test_simulation);
+
+	return g_test_run();
+}
@@ -0,0 +1,317 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2013  Intel Corporation
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <glib.h>
+
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/sdp.h>
+#include <bluetooth/sdp_lib.h>
+
+#include "lib/uuid.h"
+#include "attrib/att.h"
+#include "attrib/gattrib.h"
+#include "attrib/gatt.h"
+#include "src/glib-helper.h"
+#include "src/record-cache.h"
+
+#define NUM_RECORDS 32
+
+void error(const char *format, ...);
+
+void error(const char *format, ...)
+{
+}
+
+static char *create_filename(void)
+{
+	char *filename;
+	int fd;
+
+	filename = g_build_filename(g_get_tmp_dir(), "record-cache-XXXXXX",
+									NULL);
+	fd = g_mkstemp(filename);
+	g_assert(fd >= 0);
+	close(fd);
+
+	/* The cache gets created by the first update */
+	unlink(filename);
+
+	return filename;
+}
+
+static sdp_record_t *create_record(uint32_t handle, uint16_t svc)
+{
+	sdp_record_t *rec;
+	sdp_list_t *svclass;
+	uuid_t uuid;
+	char name[32];
+
+	rec = sdp_record_alloc();
+	rec->handle = handle;
+	sdp_attr_add_new(rec, SDP_ATTR_RECORD_HANDLE, SDP_UINT32, &handle);
+
+	sdp_uuid16_create(&uuid, svc);
+	svclass = sdp_list_append(NULL, &uuid);
+	sdp_set_service_classes(rec, svclass);
+	sdp_list_free(svclass, NULL);
+
+	snprintf(name, sizeof(name), "Service 0x%08x", handle);
+	sdp_set_info_attr(rec, name, NULL, NULL);
+
+	return rec;
+}
+
+static sdp_list_t *create_records(unsigned int count, uint32_t handle)
+{
+	sdp_list_t *recs = NULL;
+	unsigned int i;
+
+	for (i = 0; i < count; i++)
+		recs = sdp_list_append(recs, create_record(handle + i,
+								0x1100 + i));
+
+	return recs;
+}
+
+static struct gatt_primary *create_primary(uint16_t start, uint16_t end,
+							uint16_t svc)
+{
+	struct gatt_primary *prim;
+	uuid_t uuid;
+	char *str;
+
+	sdp_uuid16_create(&uuid, svc);
+	str = bt_uuid2string(&uuid);
+
+	prim = g_new0(struct gatt_primary, 1);
+	prim->range.start = start;
+	prim->range.end = end;
+	g_strlcpy(prim->uuid, str, sizeof(prim->uuid));
+	g_free(str);
+
+	return prim;
+}
+
+static const char *record_name(const sdp_record_t *rec)
+{
+	sdp_data_t *d = sdp_data_get(rec, SDP_ATTR_SVCNAME_PRIMARY);
+
+	g_assert(d != NULL);
+
+	return d->val.str;
+}
+
+static void test_records(void)
+{
+	char *filename = create_filename();
+	struct record_cache *cache;
+	sdp_list_t *recs;
+	sdp_record_t *rec;
+	uuid_t uuid, uuid128;
+	unsigned int i;
+
+	g_assert(record_cache_open(filename) == NULL);
+
+	recs = create_records(NUM_RECORDS, 0x10000);
+	g_assert(record_cache_update(filename, recs, NULL, false) == 0);
+	sdp_list_free(recs, (sdp_free_func_t) sdp_record_free);
+
+	cache = record_cache_open(filename);
+	g_assert(cache != NULL);
+
+	for (i = 0; i < NUM_RECORDS; i++) {
+		sdp_uuid16_create(&uuid, 0x1100 + i);
+
+		rec = record_cache_find(cache, &uuid);
+		g_assert(rec != NULL);
+		g_assert_cmpuint(rec->handle, ==, 0x10000 + i);
+		sdp_record_free(rec);
+
+		rec = record_cache_get(cache, 0x10000 + i);
+		g_assert(rec != NULL);
+		g_assert(sdp_uuid_cmp(&rec->svclass, &uuid) == 0);
+		sdp_record_free(rec);
+	}
+
+	/* 128-bit form of a 16-bit service class */
+	sdp_uuid16_create(&uuid, 0x1100);
+	sdp_uuid16_to_uuid128(&uuid128, &uuid);
+	rec = record_cache_find(cache, &uuid128);
+	g_assert(rec != NULL);
+	sdp_record_free(rec);
+
+	sdp_uuid16_create(&uuid, 0x1100 + NUM_RECORDS);
+	g_assert(record_cache_find(cache, &uuid) == NULL);
+	g_assert(record_cache_get(cache, 0x10000 + NUM_RECORDS) == NULL);
+
+	record_cache_close(cache);
+
+	unlink(filename);
+	g_free(filename);
+}
+
+static void test_update(void)
+{
+	char *filename = create_filename();
+	struct record_cache *cache;
+	sdp_list_t *recs;
+	GSList *primaries, *l;
+	sdp_record_t *rec;
+
+	recs = create_records(4, 0x10000);
+	primaries = g_slist_append(NULL, create_primary(0x0001, 0x0005,
+								0x1800));
+	primaries = g_slist_append(primaries, create_primary(0x0006, 0x0009,
+								0x1801));
+	g_assert(record_cache_update(filename, recs, primaries, false) == 0);
+	sdp_list_free(recs, (sdp_free_func_t) sdp_record_free);
+	g_slist_free_full(primaries, g_free);
+
+	/* Same handle replaces the stored record, others are kept */
+	rec = create_record(0x10001, 0x1200);
+	recs = sdp_list_append(NULL, rec);
+	primaries = g_slist_append(NULL, create_primary(0x0006, 0x000f,
+								0x180f));
+	g_assert(record_cache_update(filename, recs, primaries, false) == 0);
+	sdp_list_free(recs, (sdp_free_func_t) sdp_record_free);
+	g_slist_free_full(primaries, g_free);
+
+	cache = record_cache_open(filename);
+	g_assert(cache != NULL);
+
+	rec = record_cache_get(cache, 0x10001);
+	g_assert(rec != NULL);
+	g_assert_cmpuint(rec->svclass.value.uuid16, ==, 0x1200);
+	sdp_record_free(rec);
+
+	rec = record_cache_get(cache, 0x10003);
+	g_assert(rec != NULL);
+	g_assert_cmpstr(record_name(rec), ==, "Service 0x00010003");
+	sdp_record_free(rec);
+
+	primaries = record_cache_get_primaries(cache);
+	g_assert_cmpuint(g_slist_length(primaries), ==, 2);
+
+	for (l = primaries; l; l = l->next) {
+		struct gatt_primary *prim = l->data;
+
+		if (prim->range.start == 0x0001) {
+			g_assert_cmpuint(prim->range.end, ==, 0x0005);
+			g_assert_cmpstr(prim->uuid, ==,
+					"00001800-0000-1000-8000-00805f9b34fb");
+		} else {
+			g_assert_cmpuint(prim->range.start, ==, 0x0006);
+			g_assert_cmpuint(prim->range.end, ==, 0x000f);
+			g_assert_cmpstr(prim->uuid, ==,
+					"0000180f-0000-1000-8000-00805f9b34fb");
+		}
+	}
+
+	g_slist_free_full(primaries, g_free);
+	record_cache_close(cache);
+
+	/* Replacing the primary services keeps the records */
+	g_assert(record_cache_update(filename, NULL, NULL, true) == 0);
+
+	cache = record_cache_open(filename);
+	g_assert(cache != NULL);
+	g_assert(record_cache_get_primaries(cache) == NULL);
+
+	rec = record_cache_get(cache, 0x10000);
+	g_assert(rec != NULL);
+	sdp_record_free(rec);
+
+	record_cache_close(cache);
+
+	unlink(filename);
+	g_free(filename);
+}
+
+static void test_corrupted(void)
+{
+	char *filename = create_filename();
+	struct record_cache *cache;
+	sdp_list_t *recs;
+	sdp_record_t *rec;
+	char *data, *name;
+	gsize len;
+
+	recs = create_records(2, 0x10000);
+	g_assert(record_cache_update(filename, recs, NULL, false) == 0);
+	sdp_list_free(recs, (sdp_free_func_t) sdp_record_free);
+
+	g_assert(g_file_get_contents(filename, &data, &len, NULL));
+
+	/* Flip a bit in the name of the first record */
+	name = g_strstr_len(data, len, "Service 0x00010000");
+	g_assert(name != NULL);
+	name[0] ^= 0x01;
+
+	g_assert(g_file_set_contents(filename, data, len, NULL));
+
+	cache = record_cache_open(filename);
+	g_assert(cache != NULL);
+	g_assert(record_cache_get(cache, 0x10000) == NULL);
+
+	rec = record_cache_get(cache, 0x10001);
+	g_assert(rec != NULL);
+	sdp_record_free(rec);
+
+	record_cache_close(cache);
+
+	/* Truncated files only expose the complete entries */
+	g_assert(g_file_set_contents(filename, data, len - 8, NULL));
+
+	cache = record_cache_open(filename);
+	g_assert(cache != NULL);
+	g_assert(record_cache_get(cache, 0x10001) == NULL);
+	record_cache_close(cache);
+
+	/* Anything else is not an attribute cache at all */
+	g_assert(g_file_set_contents(filename, "[General]\n", -1, NULL));
+	g_assert(record_cache_open(filename) == NULL);
+
+	g_free(data);
+	unlink(filename);
+	g_free(filename);
+}
+
+int main(int argc, char *argv[])
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/record-cache/records", test_records);
+	g_test_add_func("/record-cache/update", test_update);
+	g_test_add_func("/record-cache/corrupted", test_corrupted);
+
+	return g_test_run();
+}
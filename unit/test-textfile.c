@@ -264,6 +264,168 @@ static void test_multiple(void)
 	textfile_foreach(test_pathname, check_entry, GUINT_TO_POINTER(max));
 }
 
+#define LARGE_ENTRIES 10000
+
+static void large_key(char *key, unsigned int i)
+{
+	sprintf(key, "%02X:%02X:%02X:00:00:00", i & 0xff, (i >> 8) & 0xff,
+							(i >> 16) & 0xff);
+}
+
+static void large_value(char *value, unsigned int i, char c)
+{
+	unsigned int len = i % 64 + 1;
+
+	memset(value, c, len);
+	value[len] = '\0';
+}
+
+struct large_data {
+	unsigned int count;
+	unsigned int deleted;
+};
+
+static void check_large_entry(char *key, char *value, void *data)
+{
+	struct large_data *large = data;
+	char expected_key[18], expected_value[65];
+	unsigned int i = large->count++;
+
+	/* Entries are reported in file order */
+	if (large->deleted)
+		i = i * 2 + 1;
+
+	large_key(expected_key, i);
+	large_value(expected_value, i, i % 64 ? 'x' : 'y');
+
+	g_assert(strcmp(key, expected_key) == 0);
+	g_assert(strcmp(value, expected_value) == 0);
+}
+
+static void test_large(void)
+{
+	char **keys, **values, *str;
+	struct large_data large;
+	unsigned int i;
+
+	util_create_empty();
+
+	keys = g_new0(char *, LARGE_ENTRIES);
+	values = g_new0(char *, LARGE_ENTRIES);
+
+	for (i = 0; i < LARGE_ENTRIES; i++) {
+		keys[i] = g_malloc(18);
+		large_key(keys[i], i);
+
+		values[i] = g_malloc(65);
+		large_value(values[i], i, 'x');
+	}
+
+	g_assert(textfile_update(test_pathname, (const char **) keys,
+				(const char **) values, LARGE_ENTRIES) == 0);
+
+	for (i = 0; i < LARGE_ENTRIES; i++) {
+		str = textfile_get(test_pathname, keys[i]);
+		g_assert(str != NULL);
+		g_assert(strcmp(str, values[i]) == 0);
+		free(str);
+	}
+
+	/* Replace some entries, a rewrite per put */
+	for (i = 0; i < LARGE_ENTRIES; i += 64) {
+		large_value(values[i], i, 'y');
+		g_assert(textfile_put(test_pathname, keys[i], values[i]) == 0);
+	}
+
+	memset(&large, 0, sizeof(large));
+	textfile_foreach(test_pathname, check_large_entry, &large);
+	g_assert(large.count == LARGE_ENTRIES);
+
+	/* Delete every even entry with a single rewrite */
+	for (i = 0; i < LARGE_ENTRIES; i += 2) {
+		g_free(values[i]);
+		values[i] = NULL;
+	}
+
+	g_assert(textfile_update(test_pathname, (const char **) keys,
+				(const char **) values, LARGE_ENTRIES) == 0);
+
+	for (i = 0; i < LARGE_ENTRIES; i++) {
+		str = textfile_get(test_pathname, keys[i]);
+
+		if (i % 2 == 0) {
+			g_assert(str == NULL);
+			continue;
+		}
+
+		g_assert(str != NULL);
+		g_assert(strcmp(str, values[i]) == 0);
+		free(str);
+	}
+
+	memset(&large, 0, sizeof(large));
+	large.deleted = 1;
+	textfile_foreach(test_pathname, check_large_entry, &large);
+	g_assert(large.count == LARGE_ENTRIES / 2);
+
+	for (i = 0; i < LARGE_ENTRIES; i++) {
+		g_free(keys[i]);
+		g_free(values[i]);
+	}
+
+	g_free(keys);
+	g_free(values);
+}
+
+static void test_duplicate(void)
+{
+	const char *keys[] = { "00:00:00:00:00:01", "00:00:00:00:00:02",
+						"00:00:00:00:00:01" };
+	const char *values[] = { "first", "second", "third" };
+	char *str;
+
+	util_create_empty();
+
+	/* The last change of a key wins */
+	g_assert(textfile_update(test_pathname, keys, values, 3) == 0);
+
+	str = textfile_get(test_pathname, keys[0]);
+	g_assert(str != NULL);
+	g_assert(strcmp(str, "third") == 0);
+	free(str);
+
+	str = textfile_get(test_pathname, keys[1]);
+	g_assert(str != NULL);
+	g_assert(strcmp(str, "second") == 0);
+	free(str);
+}
+
+static void test_external(void)
+{
+	char key[18], *str;
+	FILE *fp;
+
+	util_create_empty();
+
+	sprintf(key, "00:00:00:00:00:00");
+	g_assert(textfile_put(test_pathname, key, "Test") == 0);
+
+	str = textfile_get(test_pathname, key);
+	g_assert(str != NULL);
+	free(str);
+
+	/* Changes made behind our back must not be hidden */
+	fp = fopen(test_pathname, "w");
+	g_assert(fp != NULL);
+	fprintf(fp, "%s Changed\n", key);
+	fclose(fp);
+
+	str = textfile_get(test_pathname, key);
+	g_assert(str != NULL);
+	g_assert(strcmp(str, "Changed") == 0);
+	free(str);
+}
+
 int main(int argc, char *argv[])
 {
 	g_test_init(&argc, &argv, NULL);
@@ -272,6 +434,9 @@ int main(int argc, char *argv[])
 	g_test_add_func("/textfile/delete", test_delete);
 	g_test_add_func("/textfile/overwrite", test_overwrite);
 	g_test_add_func("/textfile/multiple", test_multiple);
+	g_test_add_func("/textfile/large", test_large);
+	g_test_add_func("/textfile/duplicate", test_duplicate);
+	g_test_add_func("/textfile/external", test_external);
 
 	return g_test_run();
 }
@@ -0,0 +1,141 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2013  Intel Corporation
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdint.h>
+#include <string.h>
+#include <glib.h>
+
+#include "src/trace.h"
+
+struct collect_data {
+	uint64_t timestamps[TRACE_RING_SIZE];
+	unsigned int count;
+};
+
+static void collect_event(const struct trace_event *event, void *user_data)
+{
+	struct collect_data *data = user_data;
+
+	data->timestamps[data->count++] = event->timestamp;
+}
+
+static void test_order(void)
+{
+	struct trace_ring *ring = trace_ring_new();
+	struct collect_data data;
+	unsigned int i;
+
+	trace_ring_add(ring, 10, "connected", NULL);
+	trace_ring_add(ring, 20, "browse-sdp", NULL);
+	trace_ring_add(ring, 30, "services-resolved", NULL);
+
+	memset(&data, 0, sizeof(data));
+	trace_ring_foreach(ring, collect_event, &data);
+
+	g_assert_cmpuint(data.count, ==, 3);
+
+	for (i = 0; i < data.count; i++)
+		g_assert_cmpuint(data.timestamps[i], ==, (i + 1) * 10);
+
+	trace_ring_clear(ring);
+	g_assert_cmpuint(trace_ring_count(ring), ==, 0);
+
+	trace_ring_free(ring);
+}
+
+static void test_wraparound(void)
+{
+	struct trace_ring *ring = trace_ring_new();
+	struct collect_data data;
+	unsigned int i;
+
+	for (i = 0; i < TRACE_RING_SIZE + 10; i++)
+		trace_ring_add(ring, i, "stage", NULL);
+
+	g_assert_cmpuint(trace_ring_count(ring), ==, TRACE_RING_SIZE);
+
+	memset(&data, 0, sizeof(data));
+	trace_ring_foreach(ring, collect_event, &data);
+
+	/* The oldest events are overwritten */
+	g_assert_cmpuint(data.count, ==, TRACE_RING_SIZE);
+
+	for (i = 0; i < data.count; i++)
+		g_assert_cmpuint(data.timestamps[i], ==, i + 10);
+
+	trace_ring_free(ring);
+}
+
+static void test_detail(void)
+{
+	struct trace_ring *ring = trace_ring_new();
+	char detail[TRACE_DETAIL_LENGTH * 2];
+	char *json;
+
+	memset(detail, 'a', sizeof(detail) - 1);
+	detail[sizeof(detail) - 1] = '\0';
+
+	trace_ring_add(ring, 100, "connect-profile", detail);
+	trace_ring_add(ring, 150, "connected", "a \"quoted\" name");
+
+	json = trace_ring_to_json(ring, "test");
+
+	/* Details are truncated to fit the event */
+	g_assert(strstr(json, detail) == NULL);
+	g_assert(strstr(json, "\"ph\":\"X\",\"ts\":100,\"dur\":50") != NULL);
+	g_assert(strstr(json, "\"ph\":\"i\",\"s\":\"t\",\"ts\":150") != NULL);
+	g_assert(strstr(json, "a \\\"quoted\\\" name") != NULL);
+
+	g_free(json);
+	trace_ring_free(ring);
+}
+
+static void test_json_empty(void)
+{
+	struct trace_ring *ring = trace_ring_new();
+	char *json;
+
+	json = trace_ring_to_json(ring, "test");
+
+	g_assert_cmpstr(json, ==,
+			"{\"traceEvents\":[\n],\"displayTimeUnit\":\"ms\"}\n");
+
+	g_free(json);
+	trace_ring_free(ring);
+}
+
+int main(int argc, char *argv[])
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/trace/order", test_order);
+	g_test_add_func("/trace/wraparound", test_wraparound);
+	g_test_add_func("/trace/detail", test_detail);
+	g_test_add_func("/trace/json_empty", test_json_empty);
+
+	return g_test_run();
+}